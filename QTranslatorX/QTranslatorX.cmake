@@ -0,0 +1,135 @@
+#
+# qtranslatorx_embed_translations(<VAR> <name> files... [OPTIONS <qm_compiler options>...])
+#
+# Compiles the qm-files (and ts-files, which are compiled by the qm_compiler
+# utility first) into the executable as read-only arrays. The generated header
+# <name>.h declares the null-terminated array of QmEmbeddedCatalogX entries
+# called <name> (one entry per file, named by the base name of the file) and
+# the <name>_count constant. The generated sources are appended to <VAR>,
+# the header is placed into the CMAKE_CURRENT_BINARY_DIR.
+#
+# Load the catalog with the QmTranslatorX::loadEmbedded() which uses the data
+# in place without the copying it to the heap.
+#
+# The path to the qm_compiler utility is taken from the QTRANSLATORX_QM_COMPILER
+# variable, otherwise the qm_compiler target of the current project is used.
+#
+# The QTRANSLATORX_SOURCES variable lists the sources of the QmTranslatorX
+# to add to the executable, which also needs the threads library
+# (find_package(Threads) and ${CMAKE_THREAD_LIBS_INIT}).
+#
+
+if(NOT QTX_EMBED_OUTPUT)
+
+set(QTRANSLATORX_EMBED_SCRIPT ${CMAKE_CURRENT_LIST_FILE})
+get_filename_component(QTRANSLATORX_DIR ${CMAKE_CURRENT_LIST_FILE} PATH)
+set(QTRANSLATORX_SOURCES
+    ${QTRANSLATORX_DIR}/qm_translator.cpp
+    ${QTRANSLATORX_DIR}/qm_profile.cpp)
+include(CMakeParseArguments)
+
+function(qtranslatorx_embed_translations _sources _name)
+    cmake_parse_arguments(_QTX "" "" "OPTIONS" ${ARGN})
+
+    if(QTRANSLATORX_QM_COMPILER)
+        set(_compiler ${QTRANSLATORX_QM_COMPILER})
+    elseif(TARGET qm_compiler)
+        set(_compiler $<TARGET_FILE:qm_compiler>)
+    else()
+        find_program(QTRANSLATORX_QM_COMPILER_PROGRAM qm_compiler)
+        set(_compiler ${QTRANSLATORX_QM_COMPILER_PROGRAM})
+    endif()
+
+    set(_outDir ${CMAKE_CURRENT_BINARY_DIR}/${_name}_qm)
+    file(MAKE_DIRECTORY ${_outDir})
+
+    set(_qmFiles)
+    foreach(_file ${_QTX_UNPARSED_ARGUMENTS})
+        get_filename_component(_abs ${_file} ABSOLUTE)
+        get_filename_component(_ext ${_file} EXT)
+        if(_ext STREQUAL ".ts")
+            get_filename_component(_base ${_file} NAME_WE)
+            set(_qm ${_outDir}/${_base}.qm)
+            add_custom_command(OUTPUT ${_qm}
+                COMMAND ${_compiler} ${_QTX_OPTIONS} ${_abs} -qm ${_qm}
+                DEPENDS ${_abs}
+                COMMENT "Compiling ${_file}"
+                VERBATIM)
+            list(APPEND _qmFiles ${_qm})
+        else()
+            list(APPEND _qmFiles ${_abs})
+        endif()
+    endforeach()
+
+    get_filename_component(_header ${QTRANSLATORX_EMBED_SCRIPT} PATH)
+    set(_output ${CMAKE_CURRENT_BINARY_DIR}/${_name})
+    file(WRITE ${_output}.files "${_qmFiles}")
+
+    add_custom_command(OUTPUT ${_output}.h ${_output}.cpp
+        COMMAND ${CMAKE_COMMAND}
+            -DQTX_EMBED_OUTPUT=${_output}
+            -DQTX_EMBED_NAME=${_name}
+            -DQTX_EMBED_FILES=${_output}.files
+            -DQTX_EMBED_HEADER=${_header}/qm_translator.h
+            -P ${QTRANSLATORX_EMBED_SCRIPT}
+        DEPENDS ${_qmFiles} ${QTRANSLATORX_EMBED_SCRIPT}
+        COMMENT "Embedding translations ${_name}"
+        VERBATIM)
+
+    set(${_sources} ${${_sources}} ${_output}.h ${_output}.cpp PARENT_SCOPE)
+endfunction()
+
+else()
+
+# Script mode: generate the sources from the list of qm-files
+file(READ ${QTX_EMBED_FILES} _files)
+
+set(_arrays "")
+set(_entries "")
+set(_count 0)
+
+foreach(_file ${_files})
+    get_filename_component(_base ${_file} NAME_WE)
+    string(MAKE_C_IDENTIFIER "${QTX_EMBED_NAME}_${_base}" _array)
+
+    file(READ ${_file} _hex HEX)
+    string(LENGTH "${_hex}" _hexLen)
+    math(EXPR _size "${_hexLen} / 2")
+    string(REGEX REPLACE "([0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f])" "\\1\n    " _hex "${_hex}")
+    string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1," _hex "${_hex}")
+
+    set(_arrays "${_arrays}alignas(16) static const uint8_t g_${_array}[${_size}] =\n{\n    ${_hex}\n};\n\n")
+    set(_entries "${_entries}    { \"${_base}\", g_${_array}, sizeof(g_${_array}) },\n")
+    math(EXPR _count "${_count} + 1")
+endforeach()
+
+string(TOUPPER "QTX_EMBED_${QTX_EMBED_NAME}_H" _guard)
+string(MAKE_C_IDENTIFIER "${_guard}" _guard)
+
+file(WRITE ${QTX_EMBED_OUTPUT}.h
+"// Generated by qtranslatorx_embed_translations(), don't edit!
+#ifndef ${_guard}
+#define ${_guard}
+
+#include \"${QTX_EMBED_HEADER}\"
+
+//! Null-terminated list of the embedded catalogs
+extern const QmEmbeddedCatalogX ${QTX_EMBED_NAME}[];
+extern const size_t ${QTX_EMBED_NAME}_count;
+
+#endif // ${_guard}
+")
+
+file(WRITE ${QTX_EMBED_OUTPUT}.cpp
+"// Generated by qtranslatorx_embed_translations(), don't edit!
+#include \"${QTX_EMBED_NAME}.h\"
+
+${_arrays}const QmEmbeddedCatalogX ${QTX_EMBED_NAME}[] =
+{
+${_entries}    { nullptr, nullptr, 0 }
+};
+
+const size_t ${QTX_EMBED_NAME}_count = ${_count};
+")
+
+endif()
@@ -0,0 +1,348 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** Copyright (C) 2016-2020 Vitaly Novichkov <admin@wohlnet.ru>
+**
+** This file use a part of the QtCore module of the Qt Toolkit,
+** ported into pure STL to allow support of qm translations in the non-Qt projects.
+**
+** To use this code statically linked with the non-GPL projects
+** you must have commercial license from the Qt rightholder
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial Qt License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl-3.0.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or (at your option) the GNU General
+** Public license version 3 or any later version approved by the KDE Free
+** Qt Foundation. The licenses are as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL2 and LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-2.0.html and
+** https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <cstdint>
+#include <cstring>
+
+#include "qm_diff.h"
+#include "qm_format_p.h"
+
+/*
+   The "Hashes" block of one catalog: entries of the key hash and the record offset
+ */
+struct QmDiffSideX
+{
+    const QmTranslatorX *translator;
+    const uint8_t *entries;
+    size_t         count;
+    const uint8_t *messages;
+    uint32_t       messagesLength;
+
+    uint32_t hashAt(size_t i) const
+    {
+        return read32be(entries + (i << 3));
+    }
+
+    bool recordAt(size_t i, QmRecordX &record) const
+    {
+        uint32_t ro = read32be(entries + (i << 3) + 4);
+        return ro < messagesLength &&
+               readRecord(messages + ro, messages + messagesLength, record);
+    }
+
+    // First entry of the hash not less than the given one
+    size_t lowerBound(uint32_t hash) const
+    {
+        size_t first = 0, len = count;
+        while(len > 0)
+        {
+            size_t half = len >> 1;
+            if(hashAt(first + half) < hash)
+            {
+                first += half + 1;
+                len -= half + 1;
+            }
+            else
+                len = half;
+        }
+        return first;
+    }
+};
+
+/*
+   The field stripped from one of the records doesn't prevent the match
+ */
+static bool sameField(const uint8_t *a, uint32_t aLength, const uint8_t *b, uint32_t bLength)
+{
+    if(!a || !b)
+        return true;
+    return aLength == bLength && std::memcmp(a, b, aLength) == 0;
+}
+
+static bool sameKey(const QmRecordX &a, const QmRecordX &b)
+{
+    return sameField(a.context, a.contextLength, b.context, b.contextLength) &&
+           sameField(a.sourceText, a.sourceTextLength, b.sourceText, b.sourceTextLength) &&
+           sameField(a.comment, a.commentLength, b.comment, b.commentLength);
+}
+
+static bool sameTranslations(const QmRecordX &a, const QmRecordX &b)
+{
+    if(a.translations != b.translations)
+        return false;
+    for(uint32_t i = 0; i < a.translations; ++i)
+    {
+        const uint8_t *aData = nullptr, *bData = nullptr;
+        uint32_t aLength = 0, bLength = 0;
+        bool aFound = recordTranslation(a, i, &aData, &aLength);
+        bool bFound = recordTranslation(b, i, &bData, &bLength);
+        if(aFound != bFound || aLength != bLength)
+            return false;
+        if(aLength && std::memcmp(aData, bData, aLength) != 0)
+            return false;
+    }
+    return true;
+}
+
+struct QmDiffPartX
+{
+    std::vector<QmCatalogDiffX::Change> changes;
+    size_t unchanged;
+    QmDiffPartX() : unchanged(0) {}
+};
+
+static void addChange(QmDiffPartX &part, QmCatalogDiffX::ChangeType type,
+                      const QmDiffSideX &oldSide, size_t oldIndex,
+                      const QmDiffSideX &newSide, size_t newIndex)
+{
+    QmCatalogDiffX::Change change;
+    change.type = type;
+    change.oldIndex = uint32_t(oldIndex);
+    change.newIndex = uint32_t(newIndex);
+    if(oldIndex != QmCatalogDiffX::npos)
+        change.oldMessage = oldSide.translator->message(oldIndex);
+    if(newIndex != QmCatalogDiffX::npos)
+        change.newMessage = newSide.translator->message(newIndex);
+    part.changes.push_back(change);
+}
+
+/*
+   Merge-join of the entries [oldFirst, oldLast) and [newFirst, newLast),
+   the runs of equal hashes are paired by the keys of the records
+ */
+static void comparePart(QmDiffPartX &part,
+                        const QmDiffSideX &oldSide, size_t oldFirst, size_t oldLast,
+                        const QmDiffSideX &newSide, size_t newFirst, size_t newLast)
+{
+    const size_t npos = QmCatalogDiffX::npos;
+    QmRecordX oldRecord, newRecord;
+    std::vector<QmRecordX> newRun;
+    std::vector<size_t> newRunIndex;
+
+    size_t i = oldFirst, j = newFirst;
+    while(i < oldLast || j < newLast)
+    {
+        uint32_t oldHash = i < oldLast ? oldSide.hashAt(i) : 0;
+        uint32_t newHash = j < newLast ? newSide.hashAt(j) : 0;
+
+        if(j == newLast || (i < oldLast && oldHash < newHash))
+        {
+            if(oldSide.recordAt(i, oldRecord))
+                addChange(part, QmCatalogDiffX::Removed, oldSide, i, newSide, npos);
+            ++i;
+            continue;
+        }
+
+        if(i == oldLast || newHash < oldHash)
+        {
+            if(newSide.recordAt(j, newRecord))
+                addChange(part, QmCatalogDiffX::Added, oldSide, npos, newSide, j);
+            ++j;
+            continue;
+        }
+
+        // The same hash on both sides, usually a single message each
+        newRun.clear();
+        newRunIndex.clear();
+        for(; j < newLast && newSide.hashAt(j) == newHash; ++j)
+        {
+            if(newSide.recordAt(j, newRecord))
+            {
+                newRun.push_back(newRecord);
+                newRunIndex.push_back(j);
+            }
+        }
+
+        for(; i < oldLast && oldSide.hashAt(i) == oldHash; ++i)
+        {
+            if(!oldSide.recordAt(i, oldRecord))
+                continue;
+
+            size_t match = npos;
+            for(size_t k = 0; k < newRun.size(); ++k)
+            {
+                if(newRunIndex[k] != npos && sameKey(oldRecord, newRun[k]))
+                {
+                    match = k;
+                    break;
+                }
+            }
+
+            if(match == npos)
+                addChange(part, QmCatalogDiffX::Removed, oldSide, i, newSide, npos);
+            else
+            {
+                if(sameTranslations(oldRecord, newRun[match]))
+                    ++part.unchanged;
+                else
+                    addChange(part, QmCatalogDiffX::Changed, oldSide, i, newSide, newRunIndex[match]);
+                newRunIndex[match] = npos;
+            }
+        }
+
+        for(size_t k = 0; k < newRun.size(); ++k)
+        {
+            if(newRunIndex[k] != npos)
+                addChange(part, QmCatalogDiffX::Added, oldSide, npos, newSide, newRunIndex[k]);
+        }
+    }
+}
+
+QmCatalogDiffX::QmCatalogDiffX() :
+    m_added(0), m_removed(0), m_changed(0), m_unchanged(0)
+{}
+
+void QmCatalogDiffX::compare(const QmTranslatorX &oldCatalog, const QmTranslatorX &newCatalog,
+                             unsigned threadsCount)
+{
+    clear();
+
+    QmDiffSideX sides[2];
+    const QmTranslatorX *catalogs[2] = {&oldCatalog, &newCatalog};
+    for(int s = 0; s < 2; ++s)
+    {
+        const QmTranslatorX *t = catalogs[s];
+        sides[s].translator = t;
+        sides[s].entries = t->m_offsetArray;
+        sides[s].messages = t->messageArray();
+        sides[s].count = sides[s].messages ? t->messagesCount() : 0;
+        sides[s].messagesLength = t->m_messageLength;
+    }
+    const QmDiffSideX &oldSide = sides[0], &newSide = sides[1];
+
+    if(threadsCount == 0)
+        threadsCount = std::max(1u, std::thread::hardware_concurrency());
+    const size_t minPartSize = 1024;
+    const QmDiffSideX &larger = oldSide.count >= newSide.count ? oldSide : newSide;
+    const size_t partsCount = std::min<size_t>(threadsCount, larger.count / minPartSize + 1);
+
+    // Parts are the ranges of hashes split evenly by the larger catalog,
+    // then every catalog is cut at the same hashes
+    std::vector<size_t> oldBounds(partsCount + 1), newBounds(partsCount + 1);
+    oldBounds[0] = newBounds[0] = 0;
+    oldBounds[partsCount] = oldSide.count;
+    newBounds[partsCount] = newSide.count;
+    for(size_t part = 1; part < partsCount; ++part)
+    {
+        uint32_t hash = larger.hashAt(larger.count * part / partsCount);
+        oldBounds[part] = std::max(oldBounds[part - 1], oldSide.lowerBound(hash));
+        newBounds[part] = std::max(newBounds[part - 1], newSide.lowerBound(hash));
+    }
+
+    std::vector<QmDiffPartX> parts(partsCount);
+    auto comparePartAt = [&](size_t part)
+    {
+        comparePart(parts[part],
+                    oldSide, oldBounds[part], oldBounds[part + 1],
+                    newSide, newBounds[part], newBounds[part + 1]);
+    };
+
+    std::vector<std::thread> threads;
+    for(size_t part = 1; part < partsCount; ++part)
+        threads.push_back(std::thread(comparePartAt, part));
+    comparePartAt(0);
+    for(std::thread &t : threads)
+        t.join();
+
+    size_t total = 0;
+    for(const QmDiffPartX &part : parts)
+        total += part.changes.size();
+    m_changes.reserve(total);
+
+    for(QmDiffPartX &part : parts)
+    {
+        for(const Change &change : part.changes)
+        {
+            if(change.type == Added)
+                ++m_added;
+            else if(change.type == Removed)
+                ++m_removed;
+            else
+                ++m_changed;
+        }
+        m_changes.insert(m_changes.end(), part.changes.begin(), part.changes.end());
+        m_unchanged += part.unchanged;
+    }
+}
+
+void QmCatalogDiffX::clear()
+{
+    m_changes.clear();
+    m_added = m_removed = m_changed = m_unchanged = 0;
+}
+
+const std::vector<QmCatalogDiffX::Change> &QmCatalogDiffX::changes() const
+{
+    return m_changes;
+}
+
+bool QmCatalogDiffX::identical() const
+{
+    return m_changes.empty();
+}
+
+size_t QmCatalogDiffX::addedCount() const
+{
+    return m_added;
+}
+
+size_t QmCatalogDiffX::removedCount() const
+{
+    return m_removed;
+}
+
+size_t QmCatalogDiffX::changedCount() const
+{
+    return m_changed;
+}
+
+size_t QmCatalogDiffX::unchangedCount() const
+{
+    return m_unchanged;
+}
@@ -0,0 +1,114 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** Copyright (C) 2016-2020 Vitaly Novichkov <admin@wohlnet.ru>
+**
+** This file use a part of the QtCore module of the Qt Toolkit,
+** ported into pure STL to allow support of qm translations in the non-Qt projects.
+**
+** To use this code statically linked with the non-GPL projects
+** you must have commercial license from the Qt rightholder
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial Qt License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl-3.0.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or (at your option) the GNU General
+** Public license version 3 or any later version approved by the KDE Free
+** Qt Foundation. The licenses are as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL2 and LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-2.0.html and
+** https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+#ifndef QMDIFFX_H
+#define QMDIFFX_H
+
+#include <vector>
+#include <cstdint>
+
+#include "qm_translator.h"
+
+/**
+ * @brief Differences between the translations of two loaded catalogs
+ *
+ * Both "Hashes" blocks are sorted by the key hash, so the catalogs are walked
+ * side by side as a merge-join, split into the ranges of hashes compared on
+ * several threads. Messages of the same hash are paired by their keys and the
+ * raw UTF-16 translations are compared byte by byte without decoding.
+ * Keys stripped from the catalog (qm_compiler -compress) don't prevent the pairing.
+ */
+class QmCatalogDiffX
+{
+public:
+    enum ChangeType
+    {
+        //! The message exists in the new catalog only
+        Added = 0,
+        //! The message exists in the old catalog only
+        Removed,
+        //! Translations or the number of plural forms differ
+        Changed
+    };
+
+    struct Change
+    {
+        ChangeType     type;
+        //! Index of the message in the "Hashes" block, npos when there is no such message
+        uint32_t       oldIndex;
+        uint32_t       newIndex;
+        //! Views into the compared catalogs, empty for the missing side
+        QmMessageViewX oldMessage;
+        QmMessageViewX newMessage;
+    };
+
+    static const uint32_t npos = 0xFFFFFFFF;
+
+    QmCatalogDiffX();
+
+    //Compare the messages of two catalogs (without dependencies) on several threads
+    //(0 - by the number of CPU cores). The catalogs must stay loaded while the changes are used.
+    void compare(const QmTranslatorX &oldCatalog, const QmTranslatorX &newCatalog,
+                 unsigned threadsCount = 0);
+    void clear();
+
+    //Changes in the order of the key hashes
+    const std::vector<Change> &changes() const;
+    bool identical() const;
+    size_t addedCount() const;
+    size_t removedCount() const;
+    size_t changedCount() const;
+    size_t unchangedCount() const;
+
+private:
+    std::vector<Change> m_changes;
+    size_t              m_added;
+    size_t              m_removed;
+    size_t              m_changed;
+    size_t              m_unchanged;
+};
+
+#endif // QMDIFFX_H
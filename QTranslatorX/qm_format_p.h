@@ -0,0 +1,985 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** Copyright (C) 2016-2020 Vitaly Novichkov <admin@wohlnet.ru>
+**
+** This file use a part of the QtCore module of the Qt Toolkit,
+** ported into pure STL to allow support of qm translations in the non-Qt projects.
+**
+** To use this code statically linked with the non-GPL projects
+** you must have commercial license from the Qt rightholder
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial Qt License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl-3.0.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or (at your option) the GNU General
+** Public license version 3 or any later version approved by the KDE Free
+** Qt Foundation. The licenses are as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL2 and LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-2.0.html and
+** https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QMFORMAT_P_H
+#define QMFORMAT_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the public API. It contains the definitions
+// of the qm-file format shared between the translator and the writer,
+// and may change from version to version without notice.
+//
+
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+typedef uint8_t     uchar;
+
+//magic number for the file
+static const int32_t g_qm_magicLength = 16;
+static const uint8_t g_qm_magic[g_qm_magicLength] =
+{
+    0x3c, 0xb8, 0x64, 0x18, 0xca, 0xef, 0x9c, 0x95,
+    0xcd, 0x21, 0x1c, 0xbf, 0x60, 0xa1, 0xbd, 0xdd
+};
+
+/**
+ *  \name The two types of endianness
+ */
+/* @{ */
+#define MACHINE_LITTLE_ENDIAN   1234
+#define MACHINE_BIG_ENDIAN      4321
+/* @} */
+
+#ifndef MACHINE_BYTEORDER
+#   if defined(__EMSCRIPTEN__)
+#       define MACHINE_BYTEORDER   MACHINE_LITTLE_ENDIAN
+#   elif defined(__linux__) || defined(__HAIKU__)
+#       include <endian.h>
+#       define MACHINE_BYTEORDER  __BYTE_ORDER
+#   else /* __linux__ */
+#       if defined(__hppa__) || \
+        defined(__m68k__) || defined(mc68000) || defined(_M_M68K) || \
+        (defined(__MIPS__) && defined(__MISPEB__)) || \
+        defined(__ppc__) || defined(__POWERPC__) || defined(_M_PPC) || \
+        defined(__sparc__)
+#           define MACHINE_BYTEORDER   MACHINE_BIG_ENDIAN
+#       else
+#           define MACHINE_BYTEORDER   MACHINE_LITTLE_ENDIAN
+#       endif
+#   endif /* __linux__ */
+#endif /* !SDL_BYTEORDER */
+
+enum
+{
+    Q_EQ          = 0x01,
+    Q_LT          = 0x02,
+    Q_LEQ         = 0x03,
+    Q_BETWEEN     = 0x04,
+
+    Q_NOT         = 0x08,
+    Q_MOD_10      = 0x10,
+    Q_MOD_100     = 0x20,
+    Q_LEAD_1000   = 0x40,
+
+    Q_AND         = 0xFD,
+    Q_OR          = 0xFE,
+    Q_NEWRULE     = 0xFF,
+
+    Q_OP_MASK     = 0x07,
+
+    Q_NEQ         = Q_NOT | Q_EQ,
+    Q_GT          = Q_NOT | Q_LEQ,
+    Q_GEQ         = Q_NOT | Q_LT,
+    Q_NOT_BETWEEN = Q_NOT | Q_BETWEEN
+};
+
+struct QTranslatorEntryTypes
+{
+    enum
+    {
+        Contexts     = 0x2f,
+        Hashes       = 0x42,
+        Messages     = 0x69,
+        NumerusRules = 0x88,
+        Dependencies = 0x96,
+        // QTranslatorX extensions, skipped by the QTranslator of Qt
+        PerfectHash  = 0xc3,
+        PackedMessages = 0xc4
+    };
+};
+
+enum Tag
+{
+    Tag_End = 1,
+    Tag_SourceText16,
+    Tag_Translation,
+    Tag_Context16,
+    Tag_Obsolete1,
+    Tag_SourceText,
+    Tag_Context,
+    Tag_Comment,
+    Tag_Obsolete2
+};
+
+
+static inline uint8_t read8(const uint8_t *data)
+{
+    return data[0];
+}
+
+static inline uint16_t read16be(const uint8_t *data)
+{
+    return ((uint16_t(data[0]) << 8) & 0xFF00) |
+           ((uint16_t(data[1]) << 0) & 0x00FF);
+}
+
+static inline uint32_t read32be(const uint8_t *data)
+{
+    return ((uint32_t(data[0]) << 24) & 0xFF000000) |
+           ((uint32_t(data[1]) << 16) & 0x00FF0000) |
+           ((uint32_t(data[2]) << 8)  & 0x0000FF00) |
+           ((uint32_t(data[3]) << 0)  & 0x000000FF);
+}
+
+static inline void write16be(uint8_t *data, uint16_t value)
+{
+    data[0] = uint8_t((value >> 8) & 0xFF);
+    data[1] = uint8_t((value >> 0) & 0xFF);
+}
+
+static inline void write32be(uint8_t *data, uint32_t value)
+{
+    data[0] = uint8_t((value >> 24) & 0xFF);
+    data[1] = uint8_t((value >> 16) & 0xFF);
+    data[2] = uint8_t((value >> 8)  & 0xFF);
+    data[3] = uint8_t((value >> 0)  & 0xFF);
+}
+
+static inline uint64_t read64be(const uint8_t *data)
+{
+    return (uint64_t(read32be(data)) << 32) | read32be(data + 4);
+}
+
+static inline void write64be(uint8_t *data, uint64_t v)
+{
+    write32be(data, uint32_t(v >> 32));
+    write32be(data + 4, uint32_t(v));
+}
+
+
+static inline void elfHash_continue(const char *name, uint32_t &h)
+{
+    const uchar *k;
+    uint32_t g;
+
+    k = reinterpret_cast<const uchar *>(name);
+    while(*k)
+    {
+        h = (h << 4) + *k++;
+        if((g = (h & 0xf0000000)) != 0)
+            h ^= g >> 24;
+        h &= ~g;
+    }
+}
+
+static inline void elfHash_finish(uint32_t &h)
+{
+    if(!h)
+        h = 1;
+}
+
+static inline uint32_t elfHash(const char *name)
+{
+    uint32_t hash = 0;
+    elfHash_continue(name, hash);
+    elfHash_finish(hash);
+    return hash;
+}
+
+
+/*
+   Parsed message record: the key fields point into the record and are null
+   when the record has no such tag (see the -compress mode of the lrelease)
+ */
+struct QmRecordX
+{
+    const uint8_t *begin;
+    const uint8_t *end;
+    const uint8_t *context;
+    const uint8_t *sourceText;
+    const uint8_t *comment;
+    uint32_t       contextLength;
+    uint32_t       sourceTextLength;
+    uint32_t       commentLength;
+    uint32_t       translations;
+};
+
+static inline uint32_t normalizedLength(const uint8_t *data, uint32_t len)
+{
+    // Some generators include the zero-terminating symbol into the length
+    if(len > 0 && data[len - 1] == '\0')
+        --len;
+    return len;
+}
+
+/*
+   Reads the tags of the record at \a m until the Tag_End,
+   returns false if the record is malformed
+ */
+static inline bool readRecord(const uint8_t *m, const uint8_t *end, QmRecordX &record)
+{
+    std::memset(&record, 0, sizeof(record));
+    record.begin = m;
+
+    for(;;)
+    {
+        if(m >= end)
+            return false;
+        uint8_t tag = read8(m++);
+        if(tag == Tag_End)
+            break;
+
+        if(tag != Tag_Translation && tag != Tag_Obsolete1 && tag != Tag_SourceText &&
+           tag != Tag_Context && tag != Tag_Comment)
+            return false;
+
+        if(end - m < 4)
+            return false;
+        uint32_t len = read32be(m);
+        m += 4;
+
+        if(tag == Tag_Obsolete1)
+            continue;
+        if(tag == Tag_Translation && len == 0xFFFFFFFF)
+            len = 0; // Null string
+        if(uint32_t(end - m) < len)
+            return false;
+
+        switch(tag)
+        {
+        case Tag_Translation:
+            if(len % 2)
+                return false;
+            record.translations++;
+            break;
+        case Tag_SourceText:
+            record.sourceText = m;
+            record.sourceTextLength = normalizedLength(m, len);
+            break;
+        case Tag_Context:
+            record.context = m;
+            record.contextLength = normalizedLength(m, len);
+            break;
+        case Tag_Comment:
+            record.comment = m;
+            record.commentLength = normalizedLength(m, len);
+            break;
+        }
+        m += len;
+    }
+
+    record.end = m;
+    return true;
+}
+
+/*
+   Finds the translation of the \a index inside of the valid record,
+   returns the UTF-16BE data and its length in bytes
+ */
+static inline bool recordTranslation(const QmRecordX &record, uint32_t index,
+                                     const uint8_t **data, uint32_t *len)
+{
+    const uint8_t *m = record.begin;
+    while(m < record.end)
+    {
+        uint8_t tag = read8(m++);
+        if(tag == Tag_End)
+            break;
+        uint32_t l = read32be(m);
+        m += 4;
+        if(tag == Tag_Obsolete1)
+            continue;
+        if(tag == Tag_Translation && l == 0xFFFFFFFF)
+            l = 0;
+        if(tag == Tag_Translation && index-- == 0)
+        {
+            *data = m;
+            *len = l;
+            return true;
+        }
+        m += l;
+    }
+    return false;
+}
+
+
+/*
+   The perfect hash block (QTranslatorEntryTypes::PerfectHash) maps every key
+   of the catalog to its own slot, by the "hash and displace" method:
+       quint32 seed;
+       quint32 slotsCount;
+       quint32 bucketsCount;
+       quint32 displacement[bucketsCount];
+       struct { quint32 fingerprint; quint32 offset; } slots[slotsCount];
+   The key (context, source text, comment) is hashed into the bucket which
+   gives the displacement, the displacement gives the slot of the key, and
+   the fingerprint of the slot rejects most of the keys absent in the catalog.
+ */
+static const uint32_t g_phash_headerSize = 12;
+
+static inline uint64_t phashMix(uint64_t h)
+{
+    h ^= h >> 30;
+    h *= 0xBF58476D1CE4E5B9ULL;
+    h ^= h >> 27;
+    h *= 0x94D049BB133111EBULL;
+    h ^= h >> 31;
+    return h;
+}
+
+static inline uint64_t phashStart(uint32_t seed)
+{
+    return 0xCBF29CE484222325ULL ^ (uint64_t(seed) * 0x9E3779B97F4A7C15ULL);
+}
+
+// Hashes the string together with the zero terminator separating the key fields
+static inline void phashContinue(uint64_t &h, const uint8_t *data, size_t len)
+{
+    for(size_t i = 0; i < len; ++i)
+    {
+        h ^= data[i];
+        h *= 0x100000001B3ULL;
+    }
+    h *= 0x100000001B3ULL;
+}
+
+static inline void phashContinue(uint64_t &h, const char *str)
+{
+    const uint8_t *k = reinterpret_cast<const uint8_t *>(str);
+    while(*k)
+    {
+        h ^= *k++;
+        h *= 0x100000001B3ULL;
+    }
+    h *= 0x100000001B3ULL;
+}
+
+static inline uint64_t phashKey(const char *context, const char *sourceText, const char *comment, uint32_t seed)
+{
+    uint64_t h = phashStart(seed);
+    phashContinue(h, context);
+    phashContinue(h, sourceText);
+    phashContinue(h, comment);
+    return phashMix(h);
+}
+
+static inline uint32_t phashBucket(uint64_t h, uint32_t bucketsCount)
+{
+    return uint32_t(h % bucketsCount);
+}
+
+static inline uint32_t phashFingerprint(uint64_t h)
+{
+    return uint32_t(h >> 32);
+}
+
+static inline uint32_t phashSlot(uint64_t h, uint32_t displacement, uint32_t slotsCount)
+{
+    return uint32_t(phashMix(h ^ (uint64_t(displacement) * 0x9E3779B97F4A7C15ULL)) % slotsCount);
+}
+
+struct PerfectHashKey
+{
+    const uint8_t *context;
+    const uint8_t *sourceText;
+    const uint8_t *comment;
+    uint32_t       contextLength;
+    uint32_t       sourceTextLength;
+    uint32_t       commentLength;
+    uint32_t       offset;
+};
+
+static inline bool sameHashKey(const PerfectHashKey &a, const PerfectHashKey &b)
+{
+    return a.contextLength == b.contextLength &&
+           a.sourceTextLength == b.sourceTextLength &&
+           a.commentLength == b.commentLength &&
+           std::memcmp(a.context, b.context, a.contextLength) == 0 &&
+           std::memcmp(a.sourceText, b.sourceText, a.sourceTextLength) == 0 &&
+           std::memcmp(a.comment, b.comment, a.commentLength) == 0;
+}
+
+/*
+   Parallel loops over the items of the catalog: splitParts() gives the number
+   of parts (one per thread, 0 threads means all CPU cores), runParts() calls
+   the function for every part, the part 0 runs on the calling thread
+ */
+static inline size_t splitParts(size_t count, unsigned threadsCount, size_t minPartSize = 1024)
+{
+    if(threadsCount == 0)
+        threadsCount = std::max(1u, std::thread::hardware_concurrency());
+    // Don't spawn threads for tiny catalogs
+    return std::min<size_t>(threadsCount, count / minPartSize + 1);
+}
+
+static inline size_t partBegin(size_t count, size_t part, size_t partsCount)
+{
+    return size_t(uint64_t(count) * part / partsCount);
+}
+
+static inline void runParts(size_t partsCount, const std::function<void(size_t part)> &func)
+{
+    std::vector<std::thread> threads;
+    threads.reserve(partsCount);
+
+    for(size_t part = 1; part < partsCount; ++part)
+        threads.push_back(std::thread(func, part));
+
+    if(partsCount)
+        func(0);
+
+    for(std::thread &t : threads)
+        t.join();
+}
+
+/*
+   Builds the perfect hash block (see qm_format_p.h) over the keys,
+   keeps the lowest offset of the repeating keys. The result doesn't
+   depend on the number of threads.
+ */
+static inline bool buildPerfectHash(const std::vector<PerfectHashKey> &keys, std::vector<uint8_t> &out,
+                                    unsigned threadsCount = 1)
+{
+    const uint32_t maxSeeds = 32;
+    const uint32_t maxDisplacement = 0x1000000;
+    const size_t keysCount = keys.size();
+    const size_t partsCount = splitParts(keysCount, threadsCount);
+
+    for(uint32_t seed = 0; seed < maxSeeds; ++seed)
+    {
+        // Every part gets hashed and sorted by its thread, then the parts get merged pairwise
+        typedef std::vector<std::pair<uint64_t, uint32_t> >::iterator HashIterator;
+        std::vector<std::pair<uint64_t, uint32_t> > hashes(keysCount);
+        runParts(partsCount, [&keys, &hashes, keysCount, partsCount, seed](size_t part)
+        {
+            const size_t first = partBegin(keysCount, part, partsCount);
+            const size_t last = partBegin(keysCount, part + 1, partsCount);
+            for(size_t i = first; i < last; ++i)
+            {
+                const PerfectHashKey &k = keys[i];
+                uint64_t h = phashStart(seed);
+                phashContinue(h, k.context, k.contextLength);
+                phashContinue(h, k.sourceText, k.sourceTextLength);
+                phashContinue(h, k.comment, k.commentLength);
+                hashes[i] = std::make_pair(phashMix(h), uint32_t(i));
+            }
+            std::sort(hashes.begin() + first, hashes.begin() + last);
+        });
+
+        for(size_t width = 1; width < partsCount; width *= 2)
+        {
+            runParts((partsCount + width * 2 - 1) / (width * 2),
+                     [&hashes, keysCount, partsCount, width](size_t pair)
+            {
+                const size_t first = pair * width * 2;
+                const size_t middle = std::min(first + width, partsCount);
+                const size_t last = std::min(first + width * 2, partsCount);
+                HashIterator begin = hashes.begin();
+                std::inplace_merge(begin + partBegin(keysCount, first, partsCount),
+                                   begin + partBegin(keysCount, middle, partsCount),
+                                   begin + partBegin(keysCount, last, partsCount));
+            });
+        }
+
+        // Drop the repeating keys, try another seed on the hash collision
+        bool collision = false;
+        std::vector<std::pair<uint64_t, uint32_t> > unique;
+        unique.reserve(hashes.size());
+        for(const std::pair<uint64_t, uint32_t> &h : hashes)
+        {
+            if(!unique.empty() && unique.back().first == h.first)
+            {
+                if(!sameHashKey(keys[unique.back().second], keys[h.second]))
+                {
+                    collision = true;
+                    break;
+                }
+                if(keys[h.second].offset < keys[unique.back().second].offset)
+                    unique.back().second = h.second;
+                continue;
+            }
+            unique.push_back(h);
+        }
+        if(collision)
+            continue;
+
+        const uint32_t slotsCount = uint32_t(unique.size());
+        const uint32_t bucketsCount = (slotsCount + 3) / 4;
+        if(slotsCount == 0)
+            return false;
+
+        std::vector<std::vector<uint32_t> > buckets(bucketsCount);
+        for(uint32_t i = 0; i < slotsCount; ++i)
+            buckets[phashBucket(unique[i].first, bucketsCount)].push_back(i);
+
+        // Place the largest buckets first while the table is still empty
+        std::vector<uint32_t> order(bucketsCount);
+        for(uint32_t i = 0; i < bucketsCount; ++i)
+            order[i] = i;
+        std::stable_sort(order.begin(), order.end(), [&buckets](uint32_t a, uint32_t b)
+        {
+            return buckets[a].size() > buckets[b].size();
+        });
+        while(!order.empty() && buckets[order.back()].empty())
+            order.pop_back();
+
+        std::vector<uint32_t> displacement(bucketsCount, 0);
+        std::vector<uint32_t> slots(slotsCount, 0xFFFFFFFF);
+        std::vector<uint32_t> placed;
+        bool failed = false;
+
+        // The first displacement in [d, last) which puts all keys of the bucket into the free slots
+        auto fit = [&buckets, &unique, &slots, slotsCount]
+                   (uint32_t b, uint32_t d, uint32_t last, std::vector<uint32_t> &placed) -> uint32_t
+        {
+            const std::vector<uint32_t> &bucket = buckets[b];
+            for(; d < last; ++d)
+            {
+                placed.clear();
+                bool fits = true;
+                for(uint32_t k : bucket)
+                {
+                    uint32_t slot = phashSlot(unique[k].first, d, slotsCount);
+                    if(slots[slot] != 0xFFFFFFFF ||
+                       std::find(placed.begin(), placed.end(), slot) != placed.end())
+                    {
+                        fits = false;
+                        break;
+                    }
+                    placed.push_back(slot);
+                }
+                if(fits)
+                    break;
+            }
+            return d;
+        };
+
+        /*
+           The slots only get taken, so the displacement which doesn't fit now
+           won't fit later: the threads find the first fitting displacement of
+           every bucket of the batch against the current table, then the buckets
+           get placed in order. When the slots were taken by the bucket placed
+           before in the same batch, the search goes on for a few displacements,
+           then the next batch starts from that bucket. The batches get smaller
+           as the table fills up to keep such conflicts rare.
+         */
+        const uint32_t maxConflictSearch = partsCount > 1 ? 256 : maxDisplacement;
+        const size_t maxBatchSize = partsCount * 1024;
+        std::vector<uint32_t> from(order.size(), 0);
+        size_t freeSlots = slotsCount;
+        size_t first = 0;
+        while(first < order.size())
+        {
+            const size_t count = std::min(std::min(maxBatchSize, std::max<size_t>(freeSlots / 8, 256)),
+                                          order.size() - first);
+            if(partsCount > 1)
+            {
+                const size_t batchParts = splitParts(count, uint32_t(partsCount), 64);
+                runParts(batchParts, [&fit, &order, &from, first, count, batchParts, maxDisplacement](size_t part)
+                {
+                    std::vector<uint32_t> partPlaced;
+                    const size_t last = first + partBegin(count, part + 1, batchParts);
+                    for(size_t i = first + partBegin(count, part, batchParts); i < last; ++i)
+                        from[i] = fit(order[i], from[i], maxDisplacement, partPlaced);
+                });
+            }
+
+            const size_t last = first + count;
+            for(; first < last; ++first)
+            {
+                const uint32_t b = order[first];
+                const std::vector<uint32_t> &bucket = buckets[b];
+                const uint32_t searchEnd = uint32_t(std::min<uint64_t>(uint64_t(from[first]) + maxConflictSearch,
+                                                                       maxDisplacement));
+                const uint32_t d = fit(b, from[first], searchEnd, placed);
+                if(d == maxDisplacement)
+                {
+                    failed = true;
+                    break;
+                }
+                if(d == searchEnd)
+                {
+                    from[first] = d;
+                    break;
+                }
+
+                displacement[b] = d;
+                for(size_t k = 0; k < bucket.size(); ++k)
+                    slots[placed[k]] = bucket[k];
+                freeSlots -= bucket.size();
+            }
+            if(failed)
+                break;
+        }
+        if(failed)
+            continue;
+
+        out.resize(g_phash_headerSize + size_t(bucketsCount) * 4 + size_t(slotsCount) * 8);
+        uint8_t *o = out.data();
+        write32be(o, seed);
+        write32be(o + 4, slotsCount);
+        write32be(o + 8, bucketsCount);
+        o += g_phash_headerSize;
+        for(uint32_t d : displacement)
+        {
+            write32be(o, d);
+            o += 4;
+        }
+        for(uint32_t k : slots)
+        {
+            write32be(o, phashFingerprint(unique[k].first));
+            write32be(o + 4, keys[unique[k].second].offset);
+            o += 8;
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+/*
+   The packed messages block (QTranslatorEntryTypes::PackedMessages) replaces
+   the "Messages" block by the chunks of whole records compressed separately:
+       quint32 unpackedLength;
+       quint32 chunksCount;
+       struct { quint32 unpackedOffset; quint32 packedOffset; } chunks[chunksCount + 1];
+       quint8  packedData[];
+   The last entry of the table has the total lengths. The record offsets of the
+   "Hashes" block point into the unpacked data, so every lookup unpacks one chunk.
+ */
+static const uint32_t g_pack_headerSize = 8;
+static const uint32_t g_pack_chunkSize = 8192;
+
+/*
+   LZ77 compression of the chunk, a sequence of the literals and the match:
+       quint8  token;          // literals count << 4 | (match length - 4)
+       quint8  literalsCount[];// while 255, added to 15 of the token
+       quint8  literals[];
+       quint16 matchOffset;    // distance back, omitted after the last literals
+       quint8  matchLength[];  // while 255, added to 15 of the token
+ */
+static inline void lzAppendLength(std::vector<uint8_t> &out, size_t len)
+{
+    for(; len >= 255; len -= 255)
+        out.push_back(255);
+    out.push_back(uint8_t(len));
+}
+
+static inline void lzAppendSequence(std::vector<uint8_t> &out, const uint8_t *literals, size_t literalsCount,
+                                    size_t offset, size_t matchLength)
+{
+    size_t m = matchLength ? matchLength - 4 : 0;
+    out.push_back(uint8_t(((literalsCount < 15 ? literalsCount : 15) << 4) | (m < 15 ? m : 15)));
+    if(literalsCount >= 15)
+        lzAppendLength(out, literalsCount - 15);
+    out.insert(out.end(), literals, literals + literalsCount);
+    if(!matchLength)
+        return;
+    out.push_back(uint8_t(offset >> 8));
+    out.push_back(uint8_t(offset));
+    if(m >= 15)
+        lzAppendLength(out, m - 15);
+}
+
+/*
+   Greedy parsing, the longest match of the few last positions of the same hash
+ */
+static inline void lzCompress(const uint8_t *src, size_t len, std::vector<uint8_t> &out)
+{
+    const uint32_t hashBits = 14;
+    const uint32_t maxChain = 32;
+    const uint32_t noPos = 0xFFFFFFFF;
+    std::vector<uint32_t> head(size_t(1) << hashBits, noPos);
+    std::vector<uint32_t> prev(len, noPos);
+
+    size_t anchor = 0, i = 0;
+    while(i + 4 <= len)
+    {
+        uint32_t seq;
+        std::memcpy(&seq, src + i, 4);
+        const uint32_t h = (seq * 2654435761U) >> (32 - hashBits);
+
+        size_t best = 0, bestOffset = 0;
+        uint32_t ref = head[h];
+        for(uint32_t chain = 0; ref != noPos && i - ref <= 0xFFFF && chain < maxChain; ++chain, ref = prev[ref])
+        {
+            if(src[ref + best] != src[i + best] || std::memcmp(src + ref, src + i, 4) != 0)
+                continue;
+            size_t m = 4;
+            while(i + m < len && src[ref + m] == src[i + m])
+                ++m;
+            if(m > best)
+            {
+                best = m;
+                bestOffset = i - ref;
+                if(i + m == len)
+                    break;
+            }
+        }
+
+        prev[i] = head[h];
+        head[h] = uint32_t(i);
+        if(!best)
+        {
+            ++i;
+            continue;
+        }
+
+        lzAppendSequence(out, src + anchor, i - anchor, bestOffset, best);
+        // Positions inside of the match are the candidates for the next ones
+        for(size_t k = i + 1; k < i + best && k + 4 <= len; ++k)
+        {
+            std::memcpy(&seq, src + k, 4);
+            const uint32_t hk = (seq * 2654435761U) >> (32 - hashBits);
+            prev[k] = head[hk];
+            head[hk] = uint32_t(k);
+        }
+        i += best;
+        anchor = i;
+    }
+
+    if(anchor < len)
+        lzAppendSequence(out, src + anchor, len - anchor, 0, 0);
+}
+
+static inline bool lzReadLength(const uint8_t *&src, const uint8_t *srcEnd, size_t &len)
+{
+    uint8_t b;
+    do
+    {
+        if(src >= srcEnd)
+            return false;
+        b = *src++;
+        len += b;
+    } while(b == 255);
+    return true;
+}
+
+/*
+   Unpacks exactly dstLen bytes, false if the data is malformed
+ */
+static inline bool lzDecompress(const uint8_t *src, size_t srcLen, uint8_t *dst, size_t dstLen)
+{
+    const uint8_t *srcEnd = src + srcLen;
+    uint8_t *d = dst;
+    uint8_t *dEnd = dst + dstLen;
+
+    while(src < srcEnd)
+    {
+        uint8_t token = *src++;
+        size_t literals = token >> 4;
+        if(literals == 15 && !lzReadLength(src, srcEnd, literals))
+            return false;
+        if(size_t(srcEnd - src) < literals || size_t(dEnd - d) < literals)
+            return false;
+        std::memcpy(d, src, literals);
+        d += literals;
+        src += literals;
+        if(src == srcEnd)
+            break;
+
+        if(srcEnd - src < 2)
+            return false;
+        size_t offset = read16be(src);
+        src += 2;
+        size_t m = token & 15;
+        if(m == 15 && !lzReadLength(src, srcEnd, m))
+            return false;
+        m += 4;
+        if(!offset || offset > size_t(d - dst) || size_t(dEnd - d) < m)
+            return false;
+
+        const uint8_t *ref = d - offset;
+        if(offset >= m)
+            std::memcpy(d, ref, m);
+        else
+        {
+            // Overlapping match repeats the last bytes
+            for(size_t k = 0; k < m; ++k)
+                d[k] = ref[k];
+        }
+        d += m;
+    }
+
+    return d == dEnd;
+}
+
+/*
+   Splits the "Messages" block into the chunks of whole records and
+   compresses them into the packed messages block
+ */
+static inline void packMessages(const uint8_t *messages, uint32_t length, std::vector<uint8_t> &out)
+{
+    std::vector<uint32_t> bounds(1, 0);
+    const uint8_t *end = messages + length;
+    const uint8_t *m = messages;
+    QmRecordX record;
+    while(m < end && readRecord(m, end, record))
+    {
+        m = record.end;
+        if(uint32_t(m - messages) - bounds.back() >= g_pack_chunkSize)
+            bounds.push_back(uint32_t(m - messages));
+    }
+    // The rest (if it's malformed) goes into the last chunk as is
+    if(bounds.back() != length)
+        bounds.push_back(length);
+
+    const uint32_t chunksCount = uint32_t(bounds.size() - 1);
+    std::vector<uint8_t> packed;
+    std::vector<uint32_t> packedOffsets;
+    for(uint32_t c = 0; c < chunksCount; ++c)
+    {
+        packedOffsets.push_back(uint32_t(packed.size()));
+        lzCompress(messages + bounds[c], bounds[c + 1] - bounds[c], packed);
+    }
+    packedOffsets.push_back(uint32_t(packed.size()));
+
+    out.resize(g_pack_headerSize + (size_t(chunksCount) + 1) * 8);
+    uint8_t *o = out.data();
+    write32be(o, length);
+    write32be(o + 4, chunksCount);
+    o += g_pack_headerSize;
+    for(uint32_t c = 0; c <= chunksCount; ++c)
+    {
+        write32be(o, bounds[c]);
+        write32be(o + 4, packedOffsets[c]);
+        o += 8;
+    }
+    out.insert(out.end(), packed.begin(), packed.end());
+}
+
+
+/* ---------------- Files ------------------*/
+
+static inline FILE *openFile(const char *filePath, const char *mode)
+{
+#ifndef _WIN32
+    return std::fopen(filePath, mode);
+#else
+    wchar_t filePathW[MAX_PATH + 1];
+    wchar_t modeW[8];
+    {
+        size_t utf8len  = std::strlen(filePath);
+        size_t utf16len = MAX_PATH;
+        utf16len = MultiByteToWideChar(CP_UTF8, 0,
+                                       filePath,  utf8len,
+                                       filePathW, MAX_PATH);
+        filePathW[utf16len] = L'\0';
+        size_t i = 0;
+        for(; mode[i] && i < 7; ++i)
+            modeW[i] = wchar_t(mode[i]);
+        modeW[i] = L'\0';
+    }
+    return _wfopen(filePathW, modeW);
+#endif
+}
+
+/*
+   Size and modification time of the file, the time is in seconds
+ */
+static inline bool fileStamp(const char *filePath, uint64_t *size, uint64_t *mtime)
+{
+#ifndef _WIN32
+    struct stat st;
+    if(stat(filePath, &st) != 0)
+        return false;
+#else
+    wchar_t filePathW[MAX_PATH + 1];
+    {
+        size_t utf8len  = std::strlen(filePath);
+        size_t utf16len = MAX_PATH;
+        utf16len = MultiByteToWideChar(CP_UTF8, 0,
+                                       filePath,  utf8len,
+                                       filePathW, MAX_PATH);
+        filePathW[utf16len] = L'\0';
+    }
+    struct _stat64 st;
+    if(_wstat64(filePathW, &st) != 0)
+        return false;
+#endif
+    *size = uint64_t(st.st_size);
+    *mtime = uint64_t(st.st_mtime);
+    return true;
+}
+
+static inline bool replaceFile(const char *from, const char *to)
+{
+#ifndef _WIN32
+    return std::rename(from, to) == 0;
+#else
+    wchar_t fromW[MAX_PATH + 1], toW[MAX_PATH + 1];
+    int len = MultiByteToWideChar(CP_UTF8, 0, from, -1, fromW, MAX_PATH);
+    fromW[len > 0 ? len : 0] = L'\0';
+    len = MultiByteToWideChar(CP_UTF8, 0, to, -1, toW, MAX_PATH);
+    toW[len > 0 ? len : 0] = L'\0';
+    return MoveFileExW(fromW, toW, MOVEFILE_REPLACE_EXISTING) != 0;
+#endif
+}
+
+/*
+   Hash of the file content, processed by the 8-byte words. The words are
+   read in the machine byte order, so the hash is only valid on the same machine.
+ */
+static inline uint64_t contentHash(const uint8_t *data, size_t len)
+{
+    uint64_t h = 0xCBF29CE484222325ULL ^ len;
+    for(; len >= 8; data += 8, len -= 8)
+    {
+        uint64_t word;
+        std::memcpy(&word, data, sizeof(word));
+        h = (h ^ word) * 0x100000001B3ULL;
+        h ^= h >> 29;
+    }
+    for(; len > 0; ++data, --len)
+        h = (h ^ *data) * 0x100000001B3ULL;
+    return phashMix(h);
+}
+
+#endif // QMFORMAT_P_H
@@ -0,0 +1,260 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** Copyright (C) 2016-2020 Vitaly Novichkov <admin@wohlnet.ru>
+**
+** This file use a part of the QtCore module of the Qt Toolkit,
+** ported into pure STL to allow support of qm translations in the non-Qt projects.
+**
+** To use this code statically linked with the non-GPL projects
+** you must have commercial license from the Qt rightholder
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial Qt License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl-3.0.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or (at your option) the GNU General
+** Public license version 3 or any later version approved by the KDE Free
+** Qt Foundation. The licenses are as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL2 and LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-2.0.html and
+** https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+#include <stdio.h>
+#include <windows.h>
+#endif
+
+#include "qm_profile.h"
+#include "qm_format_p.h"
+
+static std::string profileKey(const std::string &context, const std::string &sourceText,
+                              const std::string &comment)
+{
+    std::string key;
+    key.reserve(context.size() + sourceText.size() + comment.size() + 2);
+    key.append(context);
+    key.push_back('\0');
+    key.append(sourceText);
+    key.push_back('\0');
+    key.append(comment);
+    return key;
+}
+
+void QmAccessProfileX::appendEscaped(std::string &out, const std::string &str)
+{
+    for(char c : str)
+    {
+        switch(c)
+        {
+        case '\\': out.append("\\\\"); break;
+        case '\t': out.append("\\t"); break;
+        case '\n': out.append("\\n"); break;
+        case '\r': out.append("\\r"); break;
+        default: out.push_back(c); break;
+        }
+    }
+}
+
+std::string QmAccessProfileX::unescape(const char *begin, const char *end)
+{
+    std::string out;
+    out.reserve(size_t(end - begin));
+    for(const char *c = begin; c < end; ++c)
+    {
+        if(*c != '\\' || c + 1 == end)
+        {
+            out.push_back(*c);
+            continue;
+        }
+        switch(*++c)
+        {
+        case 't': out.push_back('\t'); break;
+        case 'n': out.push_back('\n'); break;
+        case 'r': out.push_back('\r'); break;
+        default: out.push_back(*c); break;
+        }
+    }
+    return out;
+}
+
+void QmAccessProfileX::add(const std::string &context, const std::string &sourceText,
+                           const std::string &comment, uint64_t count)
+{
+    m_counts[profileKey(context, sourceText, comment)] += count;
+    m_contexts[context] += count;
+}
+
+void QmAccessProfileX::merge(const QmAccessProfileX &other)
+{
+    for(const std::pair<const std::string, uint64_t> &c : other.m_counts)
+        m_counts[c.first] += c.second;
+    for(const std::pair<const std::string, uint64_t> &c : other.m_contexts)
+        m_contexts[c.first] += c.second;
+}
+
+void QmAccessProfileX::clear()
+{
+    m_counts.clear();
+    m_contexts.clear();
+}
+
+uint64_t QmAccessProfileX::count(const std::string &context, const std::string &sourceText,
+                                 const std::string &comment) const
+{
+    std::unordered_map<std::string, uint64_t>::const_iterator it =
+        m_counts.find(profileKey(context, sourceText, comment));
+    return it != m_counts.end() ? it->second : 0;
+}
+
+uint64_t QmAccessProfileX::contextCount(const std::string &context) const
+{
+    std::unordered_map<std::string, uint64_t>::const_iterator it = m_contexts.find(context);
+    return it != m_contexts.end() ? it->second : 0;
+}
+
+size_t QmAccessProfileX::size() const
+{
+    return m_counts.size();
+}
+
+bool QmAccessProfileX::empty() const
+{
+    return m_counts.empty();
+}
+
+std::vector<QmAccessProfileX::Entry> QmAccessProfileX::entries() const
+{
+    std::vector<Entry> ret;
+    ret.reserve(m_counts.size());
+    for(const std::pair<const std::string, uint64_t> &c : m_counts)
+    {
+        Entry e;
+        std::string::size_type s1 = c.first.find('\0');
+        std::string::size_type s2 = c.first.find('\0', s1 + 1);
+        e.context = c.first.substr(0, s1);
+        e.sourceText = c.first.substr(s1 + 1, s2 - s1 - 1);
+        e.comment = c.first.substr(s2 + 1);
+        e.count = c.second;
+        ret.push_back(e);
+    }
+
+    std::sort(ret.begin(), ret.end(), [](const Entry &a, const Entry &b)
+    {
+        if(a.count != b.count)
+            return a.count > b.count;
+        if(a.context != b.context)
+            return a.context < b.context;
+        if(a.sourceText != b.sourceText)
+            return a.sourceText < b.sourceText;
+        return a.comment < b.comment;
+    });
+
+    return ret;
+}
+
+bool QmAccessProfileX::loadFile(const char *filePath)
+{
+    FILE *file = openFile(filePath, "rb");
+    if(!file)
+        return false;
+
+    std::string data;
+    char buffer[4096];
+    size_t got;
+    while((got = std::fread(buffer, 1, sizeof(buffer), file)) > 0)
+        data.append(buffer, got);
+    std::fclose(file);
+
+    const char *p = data.c_str();
+    const char *end = p + data.size();
+    while(p < end)
+    {
+        const char *eol = std::find(p, end, '\n');
+        const char *lineEnd = eol;
+        if(lineEnd > p && lineEnd[-1] == '\r')
+            --lineEnd;
+
+        // Skip the comments and the empty lines
+        if(p != lineEnd && *p != '#')
+        {
+            std::string fields[4];
+            size_t n = 0;
+            const char *f = p;
+            for(; n < 4; ++n)
+            {
+                const char *tab = std::find(f, lineEnd, '\t');
+                fields[n] = unescape(f, tab);
+                if(tab == lineEnd)
+                {
+                    ++n;
+                    break;
+                }
+                f = tab + 1;
+            }
+            if(n < 3)
+                return false;
+
+            add(fields[1], fields[2], fields[3], std::strtoull(fields[0].c_str(), nullptr, 10));
+        }
+
+        p = eol + 1;
+    }
+
+    return true;
+}
+
+bool QmAccessProfileX::saveFile(const char *filePath) const
+{
+    std::string out("# QTranslatorX access profile: count, context, source text, comment\n");
+    for(const Entry &e : entries())
+    {
+        out.append(std::to_string(e.count));
+        out.push_back('\t');
+        appendEscaped(out, e.context);
+        out.push_back('\t');
+        appendEscaped(out, e.sourceText);
+        out.push_back('\t');
+        appendEscaped(out, e.comment);
+        out.push_back('\n');
+    }
+
+    FILE *file = openFile(filePath, "wb");
+    if(!file)
+        return false;
+    bool ok = std::fwrite(out.data(), 1, out.size(), file) == out.size();
+    return (std::fclose(file) == 0) && ok;
+}
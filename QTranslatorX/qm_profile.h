@@ -0,0 +1,104 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** Copyright (C) 2016-2020 Vitaly Novichkov <admin@wohlnet.ru>
+**
+** This file use a part of the QtCore module of the Qt Toolkit,
+** ported into pure STL to allow support of qm translations in the non-Qt projects.
+**
+** To use this code statically linked with the non-GPL projects
+** you must have commercial license from the Qt rightholder
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial Qt License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl-3.0.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or (at your option) the GNU General
+** Public license version 3 or any later version approved by the KDE Free
+** Qt Foundation. The licenses are as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL2 and LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-2.0.html and
+** https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+#ifndef QMPROFILEX_H
+#define QMPROFILEX_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+/**
+ * @brief Counts of the lookups of the translation keys
+ *
+ * The profile drives the layout of the messages: the messages looked up
+ * together and often get placed next to each other. It's saved as the
+ * text file, one key per line: the count, the context, the source text
+ * and the comment separated by tabs (tabs, line breaks and backslashes
+ * inside of the strings are escaped by the backslash).
+ */
+class QmAccessProfileX
+{
+public:
+    struct Entry
+    {
+        std::string context;
+        std::string sourceText;
+        std::string comment;
+        uint64_t    count;
+    };
+
+    void add(const std::string &context, const std::string &sourceText,
+             const std::string &comment, uint64_t count = 1);
+    void merge(const QmAccessProfileX &other);
+    void clear();
+
+    //Lookups of the key, 0 if it's not in the profile
+    uint64_t count(const std::string &context, const std::string &sourceText,
+                   const std::string &comment) const;
+    //Lookups of all keys of the context
+    uint64_t contextCount(const std::string &context) const;
+    size_t size() const;
+    bool empty() const;
+    //All keys, the most often looked up first
+    std::vector<Entry> entries() const;
+
+    bool loadFile(const char *filePath);
+    bool saveFile(const char *filePath) const;
+
+    //Escape the tabs, line breaks and backslashes of the string like in the profile file,
+    //other tab-separated files (like the input of qm_bulk) use it too
+    static void appendEscaped(std::string &out, const std::string &str);
+    static std::string unescape(const char *begin, const char *end);
+
+private:
+    // Keys are context, source text and comment separated by the zero bytes
+    std::unordered_map<std::string, uint64_t> m_counts;
+    std::unordered_map<std::string, uint64_t> m_contexts;
+};
+
+#endif // QMPROFILEX_H
@@ -0,0 +1,450 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** Copyright (C) 2016-2020 Vitaly Novichkov <admin@wohlnet.ru>
+**
+** This file use a part of the QtCore module of the Qt Toolkit,
+** ported into pure STL to allow support of qm translations in the non-Qt projects.
+**
+** To use this code statically linked with the non-GPL projects
+** you must have commercial license from the Qt rightholder
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial Qt License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl-3.0.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or (at your option) the GNU General
+** Public license version 3 or any later version approved by the KDE Free
+** Qt Foundation. The licenses are as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL2 and LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-2.0.html and
+** https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <cstdint>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+#include <stdio.h>
+#include <windows.h>
+#endif
+
+#include "qm_search.h"
+#include "qm_format_p.h"
+
+static const char     g_search_magic[8] = {'Q', 'm', 'X', 'S', 'e', 'a', 'r', 'c'};
+static const uint32_t g_search_version = 1;
+/*
+   Header: magic[8], version u32, messages count u32, catalog signature u64,
+   trigrams count u32, postings count u32, hash of the payload u64.
+   Then the trigrams, the offsets (one more than trigrams) and the postings, all u32 BE.
+ */
+static const size_t   g_search_headerSize = 40;
+
+/*
+   Simple case folding of the Latin, Greek and Cyrillic letters
+ */
+static char32_t foldCase(char32_t ch)
+{
+    if(ch < 0x80)
+        return (ch >= 'A' && ch <= 'Z') ? ch + 32 : ch;
+    if(ch >= 0xC0 && ch <= 0xDE && ch != 0xD7)
+        return ch + 32;
+    if(ch == 0x178)
+        return 0xFF;
+    if(ch >= 0x100 && ch <= 0x17F)
+    {
+        bool oddUpper = (ch >= 0x139 && ch <= 0x148) || (ch >= 0x179 && ch <= 0x17E);
+        if(ch == 0x130 || ch == 0x131 || ch == 0x138 || ch == 0x149 || ch == 0x17F)
+            return ch;
+        if(oddUpper ? (ch & 1) : !(ch & 1))
+            return ch + 1;
+        return ch;
+    }
+    if(ch >= 0x391 && ch <= 0x3A9 && ch != 0x3A2)
+        return ch + 32;
+    if(ch >= 0x410 && ch <= 0x42F)
+        return ch + 32;
+    if(ch >= 0x400 && ch <= 0x40F)
+        return ch + 80;
+    return ch;
+}
+
+/*
+   Takes the decoded codepoints and appends them as the lowercased UTF-8
+ */
+struct NormalizeSink
+{
+    QmAppendSinkX<std::string> utf8;
+
+    explicit NormalizeSink(std::string &out) : utf8(out) {}
+
+    void put(const char32_t *units, size_t count)
+    {
+        for(size_t i = 0; i < count; ++i)
+            QmUtfEncoderX<1>::put<char>(foldCase(units[i]), utf8);
+    }
+};
+
+std::string QmSearchIndexX::normalize(const uint8_t *utf16be, size_t bytes)
+{
+    std::string out;
+    out.reserve(bytes);
+    NormalizeSink sink(out);
+    qmTranscodeX<char32_t>(utf16be, bytes, sink);
+    return out;
+}
+
+std::string QmSearchIndexX::normalize(const std::string &utf8)
+{
+    // Through UTF-16BE to get the same decoding of the malformed sequences
+    std::string utf16be;
+    utf16be.reserve(utf8.size() * 2);
+    const uint8_t *s = reinterpret_cast<const uint8_t *>(utf8.c_str());
+    const uint8_t *end = s + utf8.size();
+    while(s < end)
+    {
+        char32_t ch = *s;
+        int extra = ch >= 0xF0 ? 3 : ch >= 0xE0 ? 2 : ch >= 0xC0 ? 1 : 0;
+        char32_t value = extra == 3 ? ch & 0x07 : extra == 2 ? ch & 0x0F : ch & 0x1F;
+        bool ok = end - s > extra;
+        for(int i = 1; ok && i <= extra; ++i)
+        {
+            ok = (s[i] & 0xC0) == 0x80;
+            value = (value << 6) | (s[i] & 0x3F);
+        }
+        if(!ok)
+            extra = 0;
+        else if(extra)
+            ch = value;
+        s += extra + 1;
+
+        if(ch >= 0x10000)
+        {
+            ch -= 0x10000;
+            char32_t high = 0xD800 + (ch >> 10), low = 0xDC00 + (ch & 0x3FF);
+            utf16be.push_back(char(high >> 8));
+            utf16be.push_back(char(high & 0xFF));
+            ch = low;
+        }
+        utf16be.push_back(char(ch >> 8));
+        utf16be.push_back(char(ch & 0xFF));
+    }
+    return normalize(reinterpret_cast<const uint8_t *>(utf16be.data()), utf16be.size());
+}
+
+static inline uint32_t trigramAt(const std::string &text, size_t i)
+{
+    return (uint32_t(uint8_t(text[i])) << 16) | (uint32_t(uint8_t(text[i + 1])) << 8) | uint8_t(text[i + 2]);
+}
+
+QmSearchIndexX::QmSearchIndexX() :
+    m_signature(0), m_generation(0), m_messagesCount(0)
+{}
+
+/*
+   Identifies the catalog by its hashes table and the layout of the records,
+   cheap to compute without decoding any translation
+ */
+uint64_t QmSearchIndexX::signature(const QmTranslatorX &translator)
+{
+    std::vector<uint8_t> entries;
+    entries.reserve(translator.messagesCount() * 12);
+    for(const QmMessageViewX &m : translator.messages())
+    {
+        uint8_t e[12];
+        write32be(e, m.hash);
+        write32be(e + 4, m.offset);
+        write32be(e + 8, m.translationsCount);
+        entries.insert(entries.end(), e, e + 12);
+    }
+    return contentHash(entries.data(), entries.size());
+}
+
+bool QmSearchIndexX::build(const QmTranslatorX &translator, unsigned threadsCount)
+{
+    clear();
+    const size_t count = translator.messagesCount();
+    if(!count)
+        return false;
+
+    if(threadsCount == 0)
+        threadsCount = std::max(1u, std::thread::hardware_concurrency());
+    const size_t minPartSize = 1024;
+    const size_t partsCount = std::min<size_t>(threadsCount, count / minPartSize + 1);
+
+    // Every part collects the (trigram << 32 | message) pairs of its range of messages sorted,
+    // the ranges follow each other, so the merged pairs are sorted by trigram, then by message
+    std::vector<std::vector<uint64_t> > parts(partsCount);
+    auto indexPart = [&translator, &parts, count, partsCount](size_t part)
+    {
+        std::vector<uint64_t> &pairs = parts[part];
+        std::vector<uint32_t> trigrams;
+        std::string text;
+        for(size_t i = count * part / partsCount; i < count * (part + 1) / partsCount; ++i)
+        {
+            QmMessageViewX m = translator.message(i);
+            trigrams.clear();
+            for(uint32_t form = 0; form < m.translationsCount; ++form)
+            {
+                QmStringViewX data = m.translationData(form);
+                text = normalize(reinterpret_cast<const uint8_t *>(data.data), data.size);
+                for(size_t t = 0; t + 3 <= text.size(); ++t)
+                    trigrams.push_back(trigramAt(text, t));
+            }
+            std::sort(trigrams.begin(), trigrams.end());
+            trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+            for(uint32_t t : trigrams)
+                pairs.push_back((uint64_t(t) << 32) | i);
+        }
+        std::sort(pairs.begin(), pairs.end());
+    };
+
+    std::vector<std::thread> threads;
+    for(size_t part = 1; part < partsCount; ++part)
+        threads.push_back(std::thread(indexPart, part));
+    indexPart(0);
+    for(std::thread &t : threads)
+        t.join();
+
+    std::vector<uint64_t> pairs;
+    for(std::vector<uint64_t> &part : parts)
+    {
+        size_t middle = pairs.size();
+        pairs.insert(pairs.end(), part.begin(), part.end());
+        std::inplace_merge(pairs.begin(), pairs.begin() + std::ptrdiff_t(middle), pairs.end());
+        std::vector<uint64_t>().swap(part);
+    }
+
+    m_postings.reserve(pairs.size());
+    for(uint64_t p : pairs)
+    {
+        uint32_t trigram = uint32_t(p >> 32);
+        if(m_trigrams.empty() || m_trigrams.back() != trigram)
+        {
+            m_trigrams.push_back(trigram);
+            m_offsets.push_back(uint32_t(m_postings.size()));
+        }
+        m_postings.push_back(uint32_t(p));
+    }
+    m_offsets.push_back(uint32_t(m_postings.size()));
+
+    m_messagesCount = uint32_t(count);
+    m_signature = signature(translator);
+    m_generation = translator.m_generation;
+    return true;
+}
+
+std::vector<QmSearchIndexX::Hit> QmSearchIndexX::search(const QmTranslatorX &translator,
+                                                       const std::string &text, size_t maxHits) const
+{
+    std::vector<Hit> hits;
+    const std::string query = normalize(text);
+    if(query.empty() || m_offsets.empty() || translator.messagesCount() != m_messagesCount)
+        return hits;
+    // The indexes of the messages mean nothing for another catalog of the same size
+    if(translator.m_generation != m_generation && signature(translator) != m_signature)
+        return hits;
+
+    // Candidates have all trigrams of the query, the rarest are intersected first
+    std::vector<uint32_t> candidates;
+    bool allMessages = query.size() < 3;
+    if(!allMessages)
+    {
+        std::vector<std::pair<uint32_t, uint32_t> > lists;
+        for(size_t t = 0; t + 3 <= query.size(); ++t)
+        {
+            std::vector<uint32_t>::const_iterator it =
+                std::lower_bound(m_trigrams.begin(), m_trigrams.end(), trigramAt(query, t));
+            if(it == m_trigrams.end() || *it != trigramAt(query, t))
+                return hits;
+            size_t i = size_t(it - m_trigrams.begin());
+            lists.push_back(std::make_pair(m_offsets[i], m_offsets[i + 1]));
+        }
+        std::sort(lists.begin(), lists.end(), [](const std::pair<uint32_t, uint32_t> &a,
+                                                 const std::pair<uint32_t, uint32_t> &b)
+        {
+            return a.second - a.first < b.second - b.first;
+        });
+        lists.erase(std::unique(lists.begin(), lists.end()), lists.end());
+
+        candidates.assign(m_postings.begin() + lists[0].first, m_postings.begin() + lists[0].second);
+        std::vector<uint32_t> next;
+        for(size_t l = 1; l < lists.size() && !candidates.empty(); ++l)
+        {
+            next.clear();
+            std::set_intersection(candidates.begin(), candidates.end(),
+                                  m_postings.begin() + lists[l].first, m_postings.begin() + lists[l].second,
+                                  std::back_inserter(next));
+            candidates.swap(next);
+        }
+    }
+
+    // The trigrams don't keep the positions, check the text itself
+    const size_t total = allMessages ? m_messagesCount : candidates.size();
+    for(size_t c = 0; c < total; ++c)
+    {
+        const uint32_t index = allMessages ? uint32_t(c) : candidates[c];
+        QmMessageViewX m = translator.message(index);
+        for(uint32_t form = 0; form < m.translationsCount; ++form)
+        {
+            QmStringViewX data = m.translationData(form);
+            if(normalize(reinterpret_cast<const uint8_t *>(data.data), data.size).find(query) == std::string::npos)
+                continue;
+
+            Hit hit;
+            hit.message = index;
+            hit.form = form;
+            hit.context = m.context;
+            hit.sourceText = m.sourceText;
+            hit.comment = m.comment;
+            hits.push_back(hit);
+            break;
+        }
+        if(maxHits && hits.size() >= maxHits)
+            break;
+    }
+
+    return hits;
+}
+
+bool QmSearchIndexX::saveFile(const char *filePath) const
+{
+    if(m_offsets.empty())
+        return false;
+
+    std::vector<uint8_t> out(g_search_headerSize + (m_trigrams.size() + m_offsets.size() + m_postings.size()) * 4);
+    uint8_t *o = out.data();
+    std::memcpy(o, g_search_magic, sizeof(g_search_magic));
+    write32be(o + 8, g_search_version);
+    write32be(o + 12, m_messagesCount);
+    write64be(o + 16, m_signature);
+    write32be(o + 24, uint32_t(m_trigrams.size()));
+    write32be(o + 28, uint32_t(m_postings.size()));
+
+    o += g_search_headerSize;
+    for(uint32_t v : m_trigrams)
+        write32be(o, v), o += 4;
+    for(uint32_t v : m_offsets)
+        write32be(o, v), o += 4;
+    for(uint32_t v : m_postings)
+        write32be(o, v), o += 4;
+    write64be(out.data() + 32, contentHash(out.data() + g_search_headerSize, out.size() - g_search_headerSize));
+
+    // Write the temporary file first, so the readers never see a partial index
+    std::string tmp = std::string(filePath) + ".tmp";
+    FILE *file = openFile(tmp.c_str(), "wb");
+    if(!file)
+        return false;
+
+    bool ok = std::fwrite(out.data(), 1, out.size(), file) == out.size();
+    ok = (std::fclose(file) == 0) && ok;
+    if(!ok || !replaceFile(tmp.c_str(), filePath))
+    {
+        std::remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool QmSearchIndexX::loadFile(const char *filePath, const QmTranslatorX &translator)
+{
+    clear();
+    FILE *file = openFile(filePath, "rb");
+    if(!file)
+        return false;
+
+    std::vector<uint8_t> data;
+    uint8_t buffer[4096];
+    size_t got;
+    while((got = std::fread(buffer, 1, sizeof(buffer), file)) > 0)
+        data.insert(data.end(), buffer, buffer + got);
+    std::fclose(file);
+
+    if(data.size() < g_search_headerSize ||
+       std::memcmp(data.data(), g_search_magic, sizeof(g_search_magic)) != 0 ||
+       read32be(data.data() + 8) != g_search_version ||
+       read32be(data.data() + 12) != translator.messagesCount())
+        return false;
+
+    const uint32_t trigrams = read32be(data.data() + 24);
+    const uint32_t postings = read32be(data.data() + 28);
+    if(data.size() != g_search_headerSize + (uint64_t(trigrams) * 2 + 1 + postings) * 4 ||
+       read64be(data.data() + 32) != contentHash(data.data() + g_search_headerSize,
+                                                 data.size() - g_search_headerSize) ||
+       read64be(data.data() + 16) != signature(translator))
+        return false;
+
+    const uint8_t *d = data.data() + g_search_headerSize;
+    m_trigrams.resize(trigrams);
+    m_offsets.resize(size_t(trigrams) + 1);
+    m_postings.resize(postings);
+    for(uint32_t &v : m_trigrams)
+        v = read32be(d), d += 4;
+    for(uint32_t &v : m_offsets)
+        v = read32be(d), d += 4;
+    for(uint32_t &v : m_postings)
+        v = read32be(d), d += 4;
+
+    // Offsets must grow up to the postings count, the postings must be the messages
+    bool ok = m_offsets.front() == 0 && m_offsets.back() == postings;
+    for(size_t i = 0; ok && i < trigrams; ++i)
+        ok = m_offsets[i] <= m_offsets[i + 1] && (i == 0 || m_trigrams[i - 1] < m_trigrams[i]);
+    for(size_t i = 0; ok && i < postings; ++i)
+        ok = m_postings[i] < read32be(data.data() + 12);
+    if(!ok)
+    {
+        clear();
+        return false;
+    }
+
+    m_messagesCount = read32be(data.data() + 12);
+    m_signature = read64be(data.data() + 16);
+    m_generation = translator.m_generation;
+    return true;
+}
+
+void QmSearchIndexX::clear()
+{
+    m_signature = 0;
+    m_generation = 0;
+    m_messagesCount = 0;
+    m_trigrams.clear();
+    m_offsets.clear();
+    m_postings.clear();
+}
+
+bool QmSearchIndexX::empty() const
+{
+    return m_offsets.empty();
+}
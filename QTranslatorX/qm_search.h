@@ -0,0 +1,118 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** Copyright (C) 2016-2020 Vitaly Novichkov <admin@wohlnet.ru>
+**
+** This file use a part of the QtCore module of the Qt Toolkit,
+** ported into pure STL to allow support of qm translations in the non-Qt projects.
+**
+** To use this code statically linked with the non-GPL projects
+** you must have commercial license from the Qt rightholder
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial Qt License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl-3.0.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or (at your option) the GNU General
+** Public license version 3 or any later version approved by the KDE Free
+** Qt Foundation. The licenses are as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL2 and LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-2.0.html and
+** https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+#ifndef QMSEARCHX_H
+#define QMSEARCHX_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "qm_translator.h"
+
+/**
+ * @brief Full-text search index of the translations of one catalog
+ *
+ * Every translation gets normalized (lowercased Latin, Greek and Cyrillic, in UTF-8)
+ * and split into the byte trigrams, each trigram keeps the sorted list of the messages
+ * having it. The query is answered by intersecting the lists of its trigrams and
+ * checking the few candidates left, without decoding the whole catalog.
+ * The index can be saved next to the qm-file and loaded back on the next run.
+ */
+class QmSearchIndexX
+{
+public:
+    struct Hit
+    {
+        //! Index of the message in the "Hashes" block, see QmTranslatorX::message()
+        uint32_t      message;
+        //! Plural form containing the text
+        uint32_t      form;
+        //! Key of the message, empty when the catalog was compiled with stripped keys
+        QmStringViewX context;
+        QmStringViewX sourceText;
+        QmStringViewX comment;
+    };
+
+    QmSearchIndexX();
+
+    //Index all translations of the catalog (without dependencies) on several threads
+    //(0 - by the number of CPU cores)
+    bool build(const QmTranslatorX &translator, unsigned threadsCount = 0);
+    //Load the index saved for this catalog, false if the file is damaged or was built
+    //for another catalog
+    bool loadFile(const char *filePath, const QmTranslatorX &translator);
+    bool saveFile(const char *filePath) const;
+    void clear();
+    bool empty() const;
+
+    //Messages having the text in any of their translations (case-insensitive),
+    //in the order of the "Hashes" block, up to the maxHits (0 - all of them).
+    //The translator must have the catalog the index was built for: the catalog given to
+    //the build() or loadFile() is trusted, another one (like the same file loaded again)
+    //gets its signature compared on every search.
+    std::vector<Hit> search(const QmTranslatorX &translator, const std::string &text,
+                            size_t maxHits = 0) const;
+
+    //Lowercased UTF-8 of the UTF-16BE data, as the translations are indexed
+    static std::string normalize(const uint8_t *utf16be, size_t bytes);
+    static std::string normalize(const std::string &utf8);
+
+private:
+    static uint64_t signature(const QmTranslatorX &translator);
+
+    uint64_t              m_signature;
+    // Generation of the catalog given to the build() or loadFile(), trusted by the search()
+    uint64_t              m_generation;
+    uint32_t              m_messagesCount;
+    // Sorted trigrams, the messages of m_trigrams[i] are
+    // m_postings[m_offsets[i]] ... m_postings[m_offsets[i + 1] - 1]
+    std::vector<uint32_t> m_trigrams;
+    std::vector<uint32_t> m_offsets;
+    std::vector<uint32_t> m_postings;
+};
+
+#endif // QMSEARCHX_H
@@ -0,0 +1,286 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** Copyright (C) 2016-2020 Vitaly Novichkov <admin@wohlnet.ru>
+**
+** This file use a part of the QtCore module of the Qt Toolkit,
+** ported into pure STL to allow support of qm translations in the non-Qt projects.
+**
+** To use this code statically linked with the non-GPL projects
+** you must have commercial license from the Qt rightholder
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial Qt License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl-3.0.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or (at your option) the GNU General
+** Public license version 3 or any later version approved by the KDE Free
+** Qt Foundation. The licenses are as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL2 and LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-2.0.html and
+** https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+#ifndef QMTRANSCODEX_H
+#define QMTRANSCODEX_H
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+/*
+ * The UTF-8 encoder is based on the ConvertUTF.c of the Unicode, Inc.:
+ *
+ * Copyright 2001-2004 Unicode, Inc.
+ *
+ * Disclaimer
+ *
+ * This source code is provided as is by Unicode, Inc. No claims are
+ * made as to fitness for any particular purpose. No warranties of any
+ * kind are expressed or implied. The recipient agrees to determine
+ * applicability of information provided. If this file has been
+ * purchased on magnetic or optical media from Unicode, Inc., the
+ * sole remedy for any claim will be exchange of defective media
+ * within 90 days of receipt.
+ *
+ * Limitations on Rights to Redistribute This Code
+ *
+ * Unicode, Inc. hereby grants the right to freely use the information
+ * supplied in this file in the creation of products supporting the
+ * Unicode Standard, and to make copies of this file in any form
+ * for internal or external distribution as long as this notice
+ * remains attached.
+ */
+
+/**
+ * @brief Encoders of the codepoint into the code units of the CharSize bytes
+ *
+ * The unpaired surrogates are kept as is (like the lenient mode of the
+ * ConvertUTF16toUTF* of the Unicode, Inc.). Every encoder writes the units
+ * of the codepoint into the sink at once by the sink.put(units, count).
+ */
+template<size_t CharSize>
+struct QmUtfEncoderX;
+
+template<>
+struct QmUtfEncoderX<1>
+{
+    template<typename CharT, class Sink>
+    static inline void put(char32_t ch, Sink &sink)
+    {
+        static const uint8_t firstByteMark[5] = { 0x00, 0x00, 0xC0, 0xE0, 0xF0 };
+        const char32_t byteMask = 0xBF;
+        const char32_t byteMark = 0x80;
+        CharT units[4];
+        size_t bytesToWrite;
+
+        /* Figure out how many bytes the result will require */
+        if(ch < 0x80)
+            bytesToWrite = 1;
+        else if(ch < 0x800)
+            bytesToWrite = 2;
+        else if(ch < 0x10000)
+            bytesToWrite = 3;
+        else
+            bytesToWrite = 4;
+
+        CharT *target = units + bytesToWrite;
+        switch(bytesToWrite)    /* note: everything falls through. */
+        {
+        case 4: *--target = CharT((ch | byteMark) & byteMask); ch >>= 6; /*fallthrough*/
+        case 3: *--target = CharT((ch | byteMark) & byteMask); ch >>= 6; /*fallthrough*/
+        case 2: *--target = CharT((ch | byteMark) & byteMask); ch >>= 6; /*fallthrough*/
+        case 1: *--target = CharT(ch | firstByteMark[bytesToWrite]);  /*fallthrough*/
+        }
+        sink.put(units, bytesToWrite);
+    }
+};
+
+template<>
+struct QmUtfEncoderX<2>
+{
+    template<typename CharT, class Sink>
+    static inline void put(char32_t ch, Sink &sink)
+    {
+        CharT units[2];
+        if(ch < 0x10000)
+        {
+            units[0] = CharT(ch);
+            sink.put(units, 1);
+            return;
+        }
+        ch -= 0x10000;
+        units[0] = CharT(0xD800 + (ch >> 10));
+        units[1] = CharT(0xDC00 + (ch & 0x3FF));
+        sink.put(units, 2);
+    }
+};
+
+template<>
+struct QmUtfEncoderX<4>
+{
+    template<typename CharT, class Sink>
+    static inline void put(char32_t ch, Sink &sink)
+    {
+        CharT unit = CharT(ch);
+        sink.put(&unit, 1);
+    }
+};
+
+/**
+ * @brief Writes the UTF-16BE data of the catalog into the sink as CharT units
+ *
+ * The encoding is chosen by the size of CharT: UTF-8 for char, UTF-16 for
+ * char16_t (and wchar_t on Windows), UTF-32 for char32_t (and wchar_t on
+ * Unix-like systems). The high surrogate at the end of the data is dropped.
+ */
+template<typename CharT, class Sink>
+inline void qmTranscodeX(const uint8_t *data, size_t bytes, Sink &sink)
+{
+    const uint8_t *source = data;
+    const uint8_t *sourceEnd = data + (bytes & ~size_t(1));
+
+    while(source < sourceEnd)
+    {
+        char32_t ch = char32_t((source[0] << 8) | source[1]);
+        source += 2;
+        /* If we have a surrogate pair, convert to UTF32 first. */
+        if(ch >= 0xD800 && ch <= 0xDBFF)
+        {
+            /* We don't have the 16 bits following the high surrogate. */
+            if(source >= sourceEnd)
+                break;
+            char32_t ch2 = char32_t((source[0] << 8) | source[1]);
+            /* If it's a low surrogate, convert to UTF32. */
+            if(ch2 >= 0xDC00 && ch2 <= 0xDFFF)
+            {
+                ch = ((ch - 0xD800) << 10) + (ch2 - 0xDC00) + 0x10000;
+                source += 2;
+            }
+        }
+        QmUtfEncoderX<sizeof(CharT)>::template put<CharT>(ch, sink);
+    }
+}
+
+//! Sink appending to the container having push_back() (std::basic_string, std::vector, ...)
+template<class Container>
+class QmAppendSinkX
+{
+    Container &m_container;
+public:
+    explicit QmAppendSinkX(Container &container) : m_container(container) {}
+
+    template<typename CharT>
+    void put(const CharT *units, size_t count)
+    {
+        for(size_t i = 0; i < count; ++i)
+            m_container.push_back(units[i]);
+    }
+};
+
+//! Sink writing into the fixed buffer, always null-terminated. The characters
+//! which don't fit are dropped as a whole, the truncated() tells about that.
+template<typename CharT>
+class QmSpanSinkX
+{
+    CharT  *m_data;
+    size_t  m_capacity;
+    size_t  m_size;
+    bool    m_truncated;
+public:
+    QmSpanSinkX(CharT *data, size_t capacity) :
+        m_data(data), m_capacity(capacity), m_size(0), m_truncated(false)
+    {
+        if(m_capacity)
+            m_data[0] = 0;
+    }
+
+    void put(const CharT *units, size_t count)
+    {
+        if(m_truncated || m_size + count >= m_capacity)
+        {
+            m_truncated = true;
+            return;
+        }
+        for(size_t i = 0; i < count; ++i)
+            m_data[m_size++] = units[i];
+        m_data[m_size] = 0;
+    }
+
+    size_t size() const { return m_size; }
+    bool truncated() const { return m_truncated; }
+};
+
+//! Sink writing through the output iterator
+template<class OutputIt>
+class QmIteratorSinkX
+{
+    OutputIt m_it;
+public:
+    explicit QmIteratorSinkX(OutputIt it) : m_it(it) {}
+
+    template<typename CharT>
+    void put(const CharT *units, size_t count)
+    {
+        for(size_t i = 0; i < count; ++i)
+            *m_it++ = units[i];
+    }
+
+    OutputIt iterator() const { return m_it; }
+};
+
+//! Sink counting the units, to allocate the result of the exact size
+class QmCountSinkX
+{
+    size_t m_count;
+public:
+    QmCountSinkX() : m_count(0) {}
+
+    template<typename CharT>
+    void put(const CharT *, size_t count) { m_count += count; }
+
+    size_t size() const { return m_count; }
+};
+
+template<class Container>
+inline QmAppendSinkX<Container> qmAppendSinkX(Container &container)
+{
+    return QmAppendSinkX<Container>(container);
+}
+
+template<typename CharT, size_t N>
+inline QmSpanSinkX<CharT> qmSpanSinkX(CharT (&buffer)[N])
+{
+    return QmSpanSinkX<CharT>(buffer, N);
+}
+
+template<class OutputIt>
+inline QmIteratorSinkX<OutputIt> qmIteratorSinkX(OutputIt it)
+{
+    return QmIteratorSinkX<OutputIt>(it);
+}
+
+#endif // QMTRANSCODEX_H
@@ -51,6 +51,16 @@
 #include <cstdlib>
 #include <cstdio>
 #include <cstring>
+#include <cctype>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <atomic>
+#include <list>
+#include <condition_variable>
+#include <chrono>
 
 #ifdef _WIN32
 #include <stdio.h>
@@ -58,429 +68,7 @@
 #endif
 
 #include "qm_translator.h"
-
-
-/* ---------------- UTF converters ------------------*/
-
-/*
- * Copyright 2001-2004 Unicode, Inc.
- *
- * Disclaimer
- *
- * This source code is provided as is by Unicode, Inc. No claims are
- * made as to fitness for any particular purpose. No warranties of any
- * kind are expressed or implied. The recipient agrees to determine
- * applicability of information provided. If this file has been
- * purchased on magnetic or optical media from Unicode, Inc., the
- * sole remedy for any claim will be exchange of defective media
- * within 90 days of receipt.
- *
- * Limitations on Rights to Redistribute This Code
- *
- * Unicode, Inc. hereby grants the right to freely use the information
- * supplied in this file in the creation of products supporting the
- * Unicode Standard, and to make copies of this file in any form
- * for internal or external distribution as long as this notice
- * remains attached.
- */
-
-typedef uint32_t  UTF32;  /* at least 32 bits */
-typedef uint16_t  UTF16;  /* at least 16 bits */
-typedef uint8_t   UTF8;   /* typically 8 bits */
-
-/* Some fundamental constants */
-#define UNI_REPLACEMENT_CHAR static_cast<UTF32>(0x0000FFFDu)
-#define UNI_MAX_BMP          static_cast<UTF32>(0x0000FFFFu)
-#define UNI_MAX_UTF16        static_cast<UTF32>(0x0010FFFFu)
-#define UNI_MAX_UTF32        static_cast<UTF32>(0x7FFFFFFFu)
-#define UNI_MAX_LEGAL_UTF32  static_cast<UTF32>(0x0010FFFFu)
-
-typedef enum
-{
-    conversionOK,       /* conversion successful */
-    sourceExhausted,    /* partial character in source, but hit end */
-    targetExhausted,    /* insuff. room in target for conversion */
-    sourceIllegal       /* source sequence is illegal/malformed */
-} qmTrConversionResult;
-
-typedef enum
-{
-    strictConversion = 0,
-    lenientConversion
-} qmTrConversionFlags;
-
-static const int   g_halfShift  = 10; /* used for shifting by 10 bits */
-
-static const UTF32 g_halfBase = 0x0010000UL;
-static const UTF32 g_halfMask = 0x3FFUL;
-
-#define UNI_SUR_HIGH_START  static_cast<UTF32>(0xD800u)
-#define UNI_SUR_HIGH_END    static_cast<UTF32>(0xDBFFu)
-#define UNI_SUR_LOW_START   static_cast<UTF32>(0xDC00u)
-#define UNI_SUR_LOW_END     static_cast<UTF32>(0xDFFFu)
-
-/*
- * Once the bits are split out into bytes of UTF-8, this is a mask OR-ed
- * into the first byte, depending on how many bytes follow.  There are
- * as many entries in this table as there are UTF-8 sequence types.
- * (I.e., one byte sequence, two byte... etc.). Remember that sequencs
- * for *legal* UTF-8 will be 4 or fewer bytes total.
- */
-static const UTF8 g_utf_firstByteMark[7] = { 0x00, 0x00, 0xC0, 0xE0, 0xF0, 0xF8, 0xFC };
-
-/* The interface converts a whole buffer to avoid function-call overhead.
- * Constants have been gathered. Loops & conditionals have been removed as
- * much as possible for efficiency, in favor of drop-through switches.
- * (See "Note A" at the bottom of the file for equivalent code.)
- * If your compiler supports it, the "isLegalUTF8" call can be turned
- * into an inline function.
- */
-static qmTrConversionResult qmTr_ConvertUTF16toUTF8(
-    const std::u16string &sourceStr,
-    std::string &targetStr,
-    qmTrConversionFlags flags
-)
-{
-    qmTrConversionResult result = conversionOK;
-    const UTF16 *source;
-    const UTF16 *sourceEnd;
-    UTF8 *targetStart;
-    UTF8 *target;
-    UTF8 *targetEnd;
-    size_t writeLength = 0;
-
-    if(sourceStr.empty())
-        return result;
-
-    targetStr.clear();
-    targetStr.resize(sourceStr.size() * sizeof(char32_t) + 1);
-
-    source = reinterpret_cast<const UTF16*>(sourceStr.data());
-    sourceEnd = source + sourceStr.size();
-    target = reinterpret_cast<UTF8*>(&targetStr[0]);
-    targetStart = target;
-    targetEnd = target + targetStr.size();
-
-    while(source < sourceEnd)
-    {
-        UTF32 ch;
-        unsigned short bytesToWrite = 0;
-        const UTF32 byteMask = 0xBF;
-        const UTF32 byteMark = 0x80;
-        const UTF16 *oldSource = source; /* In case we have to back up because of target overflow. */
-        ch = *source++;
-        /* If we have a surrogate pair, convert to UTF32 first. */
-        if(ch >= UNI_SUR_HIGH_START && ch <= UNI_SUR_HIGH_END)
-        {
-            /* If the 16 bits following the high surrogate are in the source buffer... */
-            if(source < sourceEnd)
-            {
-                UTF32 ch2 = *source;
-                /* If it's a low surrogate, convert to UTF32. */
-                if(ch2 >= UNI_SUR_LOW_START && ch2 <= UNI_SUR_LOW_END)
-                {
-                    ch = ((ch - UNI_SUR_HIGH_START) << g_halfShift)
-                         + (ch2 - UNI_SUR_LOW_START) + g_halfBase;
-                    ++source;
-                }
-                else if(flags == strictConversion)      /* it's an unpaired high surrogate */
-                {
-                    --source; /* return to the illegal value itself */
-                    result = sourceIllegal;
-                    break;
-                }
-            }
-            else
-            {
-                /* We don't have the 16 bits following the high surrogate. */
-                --source; /* return to the high surrogate */
-                result = sourceExhausted;
-                break;
-            }
-        }
-        else if(flags == strictConversion)
-        {
-            /* UTF-16 surrogate values are illegal in UTF-32 */
-            if(ch >= UNI_SUR_LOW_START && ch <= UNI_SUR_LOW_END)
-            {
-                --source; /* return to the illegal value itself */
-                result = sourceIllegal;
-                break;
-            }
-        }
-        /* Figure out how many bytes the result will require */
-        if(ch < (UTF32)0x80)
-            bytesToWrite = 1;
-        else if(ch < (UTF32)0x800)
-            bytesToWrite = 2;
-        else if(ch < (UTF32)0x10000)
-            bytesToWrite = 3;
-        else if(ch < (UTF32)0x110000)
-            bytesToWrite = 4;
-        else
-        {
-            bytesToWrite = 3;
-            ch = UNI_REPLACEMENT_CHAR;
-        }
-
-        target += bytesToWrite;
-        if(target >= targetEnd)
-        {
-            source = oldSource; /* Back up source pointer! */
-            target -= bytesToWrite;
-            result = targetExhausted;
-            break;
-        }
-        switch(bytesToWrite)    /* note: everything falls through. */
-        {
-        case 4: *--target = (UTF8)((ch | byteMark) & byteMask); ch >>= 6; /*fallthrough*/
-        case 3: *--target = (UTF8)((ch | byteMark) & byteMask); ch >>= 6; /*fallthrough*/
-        case 2: *--target = (UTF8)((ch | byteMark) & byteMask); ch >>= 6; /*fallthrough*/
-        case 1: *--target = (UTF8)(ch | g_utf_firstByteMark[bytesToWrite]);  /*fallthrough*/
-        }
-        target += bytesToWrite;
-    }
-
-    writeLength = static_cast<size_t>(target - targetStart);
-
-    targetStr[writeLength] = '\0';
-    targetStr.resize(writeLength);
-
-    return result;
-}
-
-
-static qmTrConversionResult qmTr_ConvertUTF16toUTF32(
-    const std::u16string &sourceStr,
-    std::u32string &targetStr,
-    qmTrConversionFlags flags
-)
-{
-    qmTrConversionResult result = conversionOK;
-    const UTF16 *source;
-    const UTF16 *sourceEnd;
-    UTF32 *targetStart;
-    UTF32 *target;
-    UTF32 *targetEnd;
-    UTF32 ch, ch2;
-    size_t writeLength = 0;
-
-    if(sourceStr.empty())
-        return result;
-
-    targetStr.clear();
-    targetStr.resize(sourceStr.size() * sizeof(char32_t) + 1);
-
-    source = reinterpret_cast<const UTF16*>(sourceStr.data());
-    sourceEnd = source + sourceStr.size();
-    target = reinterpret_cast<UTF32*>(&targetStr[0]);
-    targetStart = target;
-    targetEnd = target + targetStr.size();
-
-    while(source < sourceEnd)
-    {
-        const UTF16 *oldSource = source; /*  In case we have to back up because of target overflow. */
-        ch = *source++;
-        /* If we have a surrogate pair, convert to UTF32 first. */
-        if(ch >= UNI_SUR_HIGH_START && ch <= UNI_SUR_HIGH_END)
-        {
-            /* If the 16 bits following the high surrogate are in the source buffer... */
-            if(source < sourceEnd)
-            {
-                ch2 = *source;
-                /* If it's a low surrogate, convert to UTF32. */
-                if(ch2 >= UNI_SUR_LOW_START && ch2 <= UNI_SUR_LOW_END)
-                {
-                    ch = ((ch - UNI_SUR_HIGH_START) << g_halfShift)
-                         + (ch2 - UNI_SUR_LOW_START) + g_halfBase;
-                    ++source;
-                }
-                else if(flags == strictConversion)      /* it's an unpaired high surrogate */
-                {
-                    --source; /* return to the illegal value itself */
-                    result = sourceIllegal;
-                    break;
-                }
-            }
-            else     /* We don't have the 16 bits following the high surrogate. */
-            {
-                --source; /* return to the high surrogate */
-                result = sourceExhausted;
-                break;
-            }
-        }
-        else if(flags == strictConversion)
-        {
-            /* UTF-16 surrogate values are illegal in UTF-32 */
-            if(ch >= UNI_SUR_LOW_START && ch <= UNI_SUR_LOW_END)
-            {
-                --source; /* return to the illegal value itself */
-                result = sourceIllegal;
-                break;
-            }
-        }
-        if(target >= targetEnd)
-        {
-            source = oldSource; /* Back up source pointer! */
-            result = targetExhausted;
-            break;
-        }
-        *target++ = ch;
-    }
-
-    writeLength = static_cast<size_t>(target - targetStart);
-
-    targetStr[writeLength] = 0;
-    targetStr.resize(writeLength);
-
-#ifdef CVTUTF_DEBUG
-    if(result == sourceIllegal)
-    {
-        fprintf(stderr, "ConvertUTF16toUTF32 illegal seq 0x%04x,%04x\n", ch, ch2);
-        fflush(stderr);
-    }
-#endif
-
-    return result;
-}
-
-/* ---------------- UTF converters --END-------------*/
-
-typedef uint8_t     uchar;
-
-//magic number for the file
-static const int32_t g_qm_magicLength = 16;
-static const uint8_t g_qm_magic[g_qm_magicLength] =
-{
-    0x3c, 0xb8, 0x64, 0x18, 0xca, 0xef, 0x9c, 0x95,
-    0xcd, 0x21, 0x1c, 0xbf, 0x60, 0xa1, 0xbd, 0xdd
-};
-
-/**
- *  \name The two types of endianness
- */
-/* @{ */
-#define MACHINE_LITTLE_ENDIAN   1234
-#define MACHINE_BIG_ENDIAN      4321
-/* @} */
-
-#ifndef MACHINE_BYTEORDER
-#   if defined(__EMSCRIPTEN__)
-#       define MACHINE_BYTEORDER   MACHINE_LITTLE_ENDIAN
-#   elif defined(__linux__) || defined(__HAIKU__)
-#       include <endian.h>
-#       define MACHINE_BYTEORDER  __BYTE_ORDER
-#   else /* __linux__ */
-#       if defined(__hppa__) || \
-        defined(__m68k__) || defined(mc68000) || defined(_M_M68K) || \
-        (defined(__MIPS__) && defined(__MISPEB__)) || \
-        defined(__ppc__) || defined(__POWERPC__) || defined(_M_PPC) || \
-        defined(__sparc__)
-#           define MACHINE_BYTEORDER   MACHINE_BIG_ENDIAN
-#       else
-#           define MACHINE_BYTEORDER   MACHINE_LITTLE_ENDIAN
-#       endif
-#   endif /* __linux__ */
-#endif /* !SDL_BYTEORDER */
-
-enum
-{
-    Q_EQ          = 0x01,
-    Q_LT          = 0x02,
-    Q_LEQ         = 0x03,
-    Q_BETWEEN     = 0x04,
-
-    Q_NOT         = 0x08,
-    Q_MOD_10      = 0x10,
-    Q_MOD_100     = 0x20,
-    Q_LEAD_1000   = 0x40,
-
-    Q_AND         = 0xFD,
-    Q_OR          = 0xFE,
-    Q_NEWRULE     = 0xFF,
-
-    Q_OP_MASK     = 0x07,
-
-    Q_NEQ         = Q_NOT | Q_EQ,
-    Q_GT          = Q_NOT | Q_LEQ,
-    Q_GEQ         = Q_NOT | Q_LT,
-    Q_NOT_BETWEEN = Q_NOT | Q_BETWEEN
-};
-
-struct QTranslatorEntryTypes
-{
-    enum
-    {
-        Contexts     = 0x2f,
-        Hashes       = 0x42,
-        Messages     = 0x69,
-        NumerusRules = 0x88,
-        Dependencies = 0x96
-    };
-};
-
-enum Tag
-{
-    Tag_End = 1,
-    Tag_SourceText16,
-    Tag_Translation,
-    Tag_Context16,
-    Tag_Obsolete1,
-    Tag_SourceText,
-    Tag_Context,
-    Tag_Comment,
-    Tag_Obsolete2
-};
-
-
-static uint8_t read8(const uint8_t *data)
-{
-    return data[0];
-}
-
-static uint16_t read16be(const uint8_t *data)
-{
-    return ((uint16_t(data[0]) << 8) & 0xFF00) |
-           ((uint16_t(data[1]) << 0) & 0x00FF);
-}
-
-static uint32_t read32be(const uint8_t *data)
-{
-    return ((uint32_t(data[0]) << 24) & 0xFF000000) |
-           ((uint32_t(data[1]) << 16) & 0x00FF0000) |
-           ((uint32_t(data[2]) << 8)  & 0x0000FF00) |
-           ((uint32_t(data[3]) << 0)  & 0x000000FF);
-}
-
-
-static void elfHash_continue(const char *name, uint32_t &h)
-{
-    const uchar *k;
-    uint32_t g;
-
-    k = reinterpret_cast<const uchar *>(name);
-    while(*k)
-    {
-        h = (h << 4) + *k++;
-        if((g = (h & 0xf0000000)) != 0)
-            h ^= g >> 24;
-        h &= ~g;
-    }
-}
-
-static void elfHash_finish(uint32_t &h)
-{
-    if(!h)
-        h = 1;
-}
-
-static uint32_t elfHash(const char *name)
-{
-    uint32_t hash = 0;
-    elfHash_continue(name, hash);
-    elfHash_finish(hash);
-    return hash;
-}
+#include "qm_format_p.h"
 
 
 static bool match(const uchar *found, uint32_t foundLen, const char *target, uint32_t targetLen)
@@ -656,8 +244,82 @@ static uint32_t numerusHelper(int32_t n, const uint8_t *rules, uint32_t rulesSiz
     return 0;
 }
 
-static std::u16string getMessage(const uint8_t *m, const uint8_t *end, const char *context,
-                                 const char *sourceText, const char *comment, uint32_t numerus)
+static std::u16string fromUtf16be(const uint8_t *data, size_t bytes)
+{
+    const uint16_t *utf16str = reinterpret_cast<const uint16_t *>(data);
+    size_t  utf16str_len = bytes / 2;
+
+#if MACHINE_BYTEORDER == MACHINE_LITTLE_ENDIAN
+    std::u16string outStr(reinterpret_cast<const char16_t *>(utf16str), utf16str_len);
+    char16_t *ustr = &outStr[0];
+    for(size_t i = 0; i < utf16str_len; i++)
+        ustr[i] = ((ustr[i] >> 8) & 0x00FF) + ((ustr[i] << 8) & 0xFF00);
+    return outStr;
+#else
+    return std::u16string(reinterpret_cast<const char16_t *>(utf16str), utf16str_len);
+#endif
+}
+
+static inline uint64_t poolHashUnit(uint64_t h, char16_t unit)
+{
+    h = (h ^ (unit & 0xFF)) * 0x100000001B3ull;
+    return (h ^ (unit >> 8)) * 0x100000001B3ull;
+}
+
+static uint64_t poolHash(const std::u16string &str)
+{
+    uint64_t h = 0xCBF29CE484222325ull;
+    for(char16_t unit : str)
+        h = poolHashUnit(h, unit);
+    return h;
+}
+
+static uint64_t poolHashUtf16be(const uint8_t *data, size_t bytes)
+{
+    const size_t units = bytes / 2;
+    uint64_t h = 0xCBF29CE484222325ull;
+    for(size_t i = 0; i < units; ++i)
+        h = poolHashUnit(h, char16_t(read16be(data + i * 2)));
+    return h;
+}
+
+static bool equalsUtf16be(const std::u16string &str, const uint8_t *data, size_t bytes)
+{
+    const size_t units = bytes / 2;
+    if(str.size() != units)
+        return false;
+
+    size_t i = 0;
+    while(i < units && str[i] == char16_t(read16be(data + i * 2)))
+        ++i;
+    return i == units;
+}
+
+/*
+   Errors of the malformed records, returned as translations in UTF-16BE
+ */
+#define QM_ERROR_UTF16BE(n) "\0<\0q\0m\0-\0e\0r\0r\0o\0r\0 \0" #n "\0>"
+static const char g_qm_errors[8][25] =
+{
+    QM_ERROR_UTF16BE(0), QM_ERROR_UTF16BE(1), QM_ERROR_UTF16BE(2), QM_ERROR_UTF16BE(3),
+    QM_ERROR_UTF16BE(4), QM_ERROR_UTF16BE(5), QM_ERROR_UTF16BE(6), QM_ERROR_UTF16BE(7)
+};
+#undef QM_ERROR_UTF16BE
+
+static bool qmError(int code, const uint8_t **tn, uint32_t *tnLength)
+{
+    *tn = reinterpret_cast<const uint8_t *>(g_qm_errors[code]);
+    *tnLength = sizeof(g_qm_errors[code]) - 1;
+    return true;
+}
+
+/*
+   Finds the translation inside of the record, returns the UTF-16BE data
+   and its length in bytes. Empty translations are not found.
+ */
+static bool getMessage(const uint8_t *m, const uint8_t *end, const char *context,
+                       const char *sourceText, const char *comment, uint32_t numerus,
+                       const uint8_t **translation, uint32_t *translationLength)
 {
 #ifdef QMTRANSLATPR_DEEP_DEBUG
     printf("-----> Try take message...!\n");
@@ -681,10 +343,10 @@ static std::u16string getMessage(const uint8_t *m, const uint8_t *end, const cha
         case Tag_Translation:
         {
             if(m >= (end - 4))
-                return std::u16string(u"<qm-error 0>");
+                return qmError(0, translation, translationLength);
             int32_t len = static_cast<int32_t>(read32be(m));
             if(len % 2) //In the Qt here was a bug: byte lenght must be multiple two, but was %1
-                return std::u16string(u"<qm-error 1>");
+                return qmError(1, translation, translationLength);
             m += 4;
             if(!numerus--)
             {
@@ -696,23 +358,23 @@ static std::u16string getMessage(const uint8_t *m, const uint8_t *end, const cha
         }
         case Tag_Obsolete1:
             if(m >= (end - 4))
-                return std::u16string(u"<qm-error 2>");
+                return qmError(2, translation, translationLength);
             m += 4;
             break;
         case Tag_SourceText:
         {
             if(m >= (end - 4))
-                return std::u16string(u"<qm-error 3>");
+                return qmError(3, translation, translationLength);
             uint32_t len = read32be(m);
             m += 4;
             if((m + len) >= end)
-                return std::u16string(u"<qm-error 4>");
+                return qmError(4, translation, translationLength);
             if(!match(m, len, sourceText, sourceTextLen))
             {
 #ifdef QMTRANSLATPR_DEEP_DEBUG
                 printf("-----> Source text doesn't match!\n");
 #endif
-                return std::u16string();
+                return false;
             }
             m += len;
         }
@@ -720,17 +382,17 @@ static std::u16string getMessage(const uint8_t *m, const uint8_t *end, const cha
         case Tag_Context:
         {
             if(m >= (end - 4))
-                return std::u16string(u"<qm-error 5>");
+                return qmError(5, translation, translationLength);
             uint32_t len = read32be(m);
             m += 4;
             if((m + len) >= end)
-                return std::u16string(u"<qm-error 6>");
+                return qmError(6, translation, translationLength);
             if(!match(m, len, context, contextLen))
             {
 #ifdef QMTRANSLATPR_DEEP_DEBUG
                 printf("-----> Tag gontext doesn't match!\n");
 #endif
-                return std::u16string();
+                return false;
             }
             m += len;
         }
@@ -738,13 +400,13 @@ static std::u16string getMessage(const uint8_t *m, const uint8_t *end, const cha
         case Tag_Comment:
         {
             if(m >= (end - 4))
-                return std::u16string(u"<qm-error 6>");
+                return qmError(6, translation, translationLength);
             uint32_t len = read32be(m);
             m += 4;
             if((m + len) >= end)
-                return std::u16string(u"<qm-error 7>");
+                return qmError(7, translation, translationLength);
             if(*m && !match(m, len, comment, commentLen))
-                return std::u16string();
+                return false;
             m += len;
         }
         break;
@@ -752,7 +414,7 @@ static std::u16string getMessage(const uint8_t *m, const uint8_t *end, const cha
 #ifdef QMTRANSLATPR_DEEP_DEBUG
             printf("-----> Wrong tag!\n");
 #endif
-            return std::u16string();
+            return false;
         }
     }
 end:
@@ -761,158 +423,773 @@ end:
 #ifdef QMTRANSLATPR_DEEP_DEBUG
         printf("-----> Empty TN!\n");
 #endif
-        return std::u16string();
+        return false;
     }
 #ifdef QMTRANSLATPR_DEEP_DEBUG
     printf("-----> Almost got...!\n");
 #endif
 
-    UTF16   *utf16str = reinterpret_cast<UTF16 *>(const_cast<uchar *>(tn));
-    size_t  utf16str_len = tn_length / 2;
+    if(!tn_length)
+        return false;
 
-#if MACHINE_BYTEORDER == MACHINE_LITTLE_ENDIAN
-    std::u16string outStr(reinterpret_cast<char16_t *>(utf16str), utf16str_len);
-    char16_t *ustr = &outStr[0];
-    for(uint32_t i = 0; i < utf16str_len; i++)
-        ustr[i] = ((ustr[i] >> 8) & 0x00FF) + ((ustr[i] << 8) & 0xFF00);
-    return outStr;
-#else
-    return std::u16string((char16_t *)utf16str, utf16str_len);
-#endif
+    *translation = tn;
+    *translationLength = tn_length;
+    return true;
 }
 
 
-QmTranslatorX::QmTranslatorX() :
-    m_fileData(nullptr), m_fileLength(0),
-    m_messageArray(nullptr), m_offsetArray(nullptr), m_contextArray(nullptr), m_numerusRulesArray(nullptr),
-    m_messageLength(0),      m_offsetLength(0),      m_contextLength(0),      m_numerusRulesLength(0)
-{}
-
-QmTranslatorX::~QmTranslatorX()
-{
-    close();
-}
-
-std::u16string QmTranslatorX::do_translate(const char *context, const char *sourceText, const char *comment, int32_t n)
+/*
+   Direct-mapped table of the fallbacks which resolved the keys: the hash of
+   the key with the number of the fallback in the low byte. An entry is only
+   a hint, the overwritten or the wrong one costs the walk over the fallbacks.
+ */
+struct QmTranslatorX::FallbackCache
 {
-    if(context == 0)
-        context = "";
-    if(sourceText == 0)
-        sourceText = "";
-    if(comment == 0)
-        comment = "";
+    enum { SlotsCount = 4096 };
+    std::atomic<uint64_t> slots[SlotsCount];
 
-    uint32_t numerus = 0;
-    size_t numItems = 0;
+    FallbackCache()
+    {
+        clear();
+    }
 
-    if(!m_offsetLength)
+    void clear()
     {
-#ifdef QMTRANSLATPR_DEEP_DEBUG
-        printf("--> ZERO OFFSETS LENGTH!");
-#endif
-        goto searchDependencies;
+        for(std::atomic<uint64_t> &slot : slots)
+            slot.store(0, std::memory_order_relaxed);
     }
+};
 
-    /*
-        Check if the context belongs to this QTranslator. If many
-        translators are installed, this step is necessary.
-    */
-    if(m_contextLength)
+static std::atomic<uint64_t> g_internedSerial(0);
+
+struct QmTranslatorX::Interned
+{
+    // Distinguishes the sets of strings for the strings pinned by the threads,
+    // changes when the strings get released
+    uint64_t serial;
+    std::mutex mutex;
+    // Strings of the global pool by the hash of their UTF-16BE data
+    std::unordered_multimap<uint64_t, const std::u16string *> strings;
+
+    Interned() : serial(++g_internedSerial) {}
+
+    // The string of the pool equal to the UTF-16BE data, added on the first request
+    const std::u16string *intern(const uint8_t *data, uint32_t size)
     {
-#ifdef QMTRANSLATPR_DEEP_DEBUG
-        printf("--> Finding contexts...!");
-#endif
-        uint16_t hTableSize = read16be(m_contextArray);
-        uint32_t g = elfHash(context) % hTableSize;
-        const uint8_t *c = m_contextArray + 2 + (g << 1);
-        uint16_t off = read16be(c);
-        c += 2;
-        if(off == 0)
+        const uint64_t h = poolHashUtf16be(data, size);
+        std::lock_guard<std::mutex> lock(mutex);
+        auto range = strings.equal_range(h);
+        for(auto it = range.first; it != range.second; ++it)
         {
-#ifdef QMTRANSLATPR_DEEP_DEBUG
-            printf("--> Zero offset...!\n");
-#endif
-            return std::u16string();
+            if(equalsUtf16be(*it->second, data, size))
+                return it->second;
         }
-        c = m_contextArray + (2 + (hTableSize << 1) + (off << 1));
 
-        const uint32_t contextLen = uint32_t(std::strlen(context));
-        for(;;)
-        {
-            uint8_t len = read8(c++);
-            if(len == 0)
-            {
-#ifdef QMTRANSLATPR_DEEP_DEBUG
-                printf("--> Zero length...!\n");
-#endif
-                return std::u16string();
-            }
-            if(match(c, len, context, contextLen))
-                break;
-            c += len;
-        }
-    }
-    else
-    {
-#ifdef QMTRANSLATPR_DEEP_DEBUG
-        printf("--> Contexts are empty!\n");
-#endif
+        const std::u16string *str = &QmStringPoolX::global().internUtf16be(data, size);
+        strings.insert(std::make_pair(h, str));
+        return str;
     }
 
-    numItems = m_offsetLength / (2 * sizeof(unsigned));
-    if(!numItems)
+    void release()
     {
-#ifdef QMTRANSLATPR_DEEP_DEBUG
-        printf("--> NO ITEMS!\n");
-#endif
-        goto searchDependencies;
+        for(const std::pair<const uint64_t, const std::u16string *> &s : strings)
+            QmStringPoolX::global().release(*s.second);
+        strings.clear();
+        serial = ++g_internedSerial;
     }
+};
 
-    if(n >= 0)
-        numerus = numerusHelper(n, m_numerusRulesArray, m_numerusRulesLength);
+/*
+   Strings returned by the recent translateInterned() calls of the thread, by
+   the address of the translation data. The address may get reused by other
+   data (like the chunks of the packed catalogs), so the content gets compared.
+ */
+struct InternedPin
+{
+    uint64_t serial;
+    const uint8_t *data;
+    const std::u16string *str;
+};
 
-    for(;;)
+static const size_t g_internedPinsCount = 256;
+static thread_local InternedPin g_internedPins[g_internedPinsCount];
+
+static std::atomic<uint64_t> g_catalogGeneration(0);
+
+struct QmTranslatorX::AsyncLoad
+{
+    std::mutex mutex;
+    std::thread thread;
+    std::unique_ptr<QmTranslatorX> loaded;
+    std::atomic<bool> ready;
+
+    AsyncLoad() : ready(false) {}
+};
+
+static std::atomic<uint64_t> g_recorderSerial(0);
+
+struct QmTranslatorX::Recorder
+{
+    /*
+       Key looked up by one thread: the strings are copied on the first lookup,
+       then only the count grows. The count is written by that thread only and
+       read by the accessProfile(), the rest doesn't change once published.
+     */
+    struct Key
+    {
+        uint64_t hash;
+        // Context, source text and comment separated by the zero bytes
+        std::string key;
+        std::atomic<uint64_t> count;
+        // Count at the last clearAccessProfile(), guarded by the mutex
+        uint64_t cleared;
+        Key *next;
+
+        Key(uint64_t h, std::string &&k) :
+            hash(h), key(std::move(k)), count(0), cleared(0), next(nullptr)
+        {}
+    };
+
+    // Keys of one thread, the index by the key hash is used by the owner thread only
+    struct Log
     {
-        uint32_t h = 0;
-        elfHash_continue(sourceText, h);
-        elfHash_continue(comment, h);
-        elfHash_finish(h);
+        std::thread::id owner;
+        Log *next;
+        std::unordered_map<uint64_t, Key *> index;
+        std::atomic<Key *> keys;
+
+        Log() : owner(std::this_thread::get_id()), next(nullptr), keys(nullptr) {}
+    };
+
+    // Distinguishes the recorders for the logs pinned by the threads
+    const uint64_t serial;
+    std::atomic<uint32_t> sampleRate;
+    std::atomic<Log *> logs;
+    std::mutex mutex;
 
-        const uint8_t *start = m_offsetArray;
-        const uint8_t *end = start + ((numItems - 1) << 3);
-        while(start <= end)
+    Recorder() : serial(++g_recorderSerial), sampleRate(0), logs(nullptr) {}
+
+    ~Recorder()
+    {
+        Log *log = logs.load(std::memory_order_acquire);
+        while(log)
         {
-            const uint8_t *middle = start + (((end - start) >> 4) << 3);
-            uint32_t hash = read32be(middle);
-            if(h == hash)
+            Key *key = log->keys.load(std::memory_order_acquire);
+            while(key)
             {
-                start = middle;
-                break;
+                Key *next = key->next;
+                delete key;
+                key = next;
             }
-            else if(hash < h)
-                start = middle + 8;
-            else
-                end = middle - 8;
+            Log *next = log->next;
+            delete log;
+            log = next;
         }
+    }
+
+    Log *threadLog();
+};
+
+static std::atomic<uint64_t> g_missesSerial(0);
+
+struct QmTranslatorX::Misses
+{
+    /*
+       Keys missed by one thread, written by that thread only and read by the
+       drain: the records are the key hash u64, the key length u32 and the key
+       (context, source text and comment separated by the zero bytes), aligned
+       by 4 bytes. The record not fitting before the end of the buffer goes to
+       its beginning after the wrapMark. Positions only grow, the buffer offset
+       is the position modulo the capacity.
+     */
+    struct Ring
+    {
+        static const uint32_t wrapMark = 0xFFFFFFFF;
+        static const size_t seenSize = 4096;
+
+        std::thread::id owner;
+        Ring *next;
+        std::vector<uint8_t> data;
+        std::atomic<size_t> head;
+        std::atomic<size_t> tail;
+        // Hashes of the keys already put by the thread, by the low bits of the hash
+        std::vector<uint64_t> seen;
+
+        Ring(size_t capacity) :
+            owner(std::this_thread::get_id()), next(nullptr), data(capacity),
+            head(0), tail(0), seen(seenSize, 0)
+        {}
+    };
+
+    // Distinguishes the collectors for the rings pinned by the threads
+    const uint64_t serial;
+    const size_t ringBytes;
+    std::atomic<Ring *> rings;
+    std::atomic<uint64_t> dropped;
+
+    std::mutex drainMutex;
+    // Hashes of the keys passed to the drains, every key is passed once
+    std::unordered_set<uint64_t> drained;
+
+    std::thread drainThread;
+    std::mutex waitMutex;
+    std::condition_variable wake;
+    bool stop;
+
+    Misses(size_t bytes) :
+        serial(++g_missesSerial), ringBytes((std::max<size_t>(bytes, 256) + 3) & ~size_t(3)),
+        rings(nullptr), dropped(0), stop(false)
+    {}
+
+    ~Misses()
+    {
+        stopDrain();
+        Ring *r = rings.load(std::memory_order_acquire);
+        while(r)
+        {
+            Ring *next = r->next;
+            delete r;
+            r = next;
+        }
+    }
+
+    Ring *threadRing();
+    void put(const char *context, const char *sourceText, const char *comment);
+    size_t drain(const std::function<void(const char *context, const char *sourceText, const char *comment)> &func);
+    bool drainToFile(const std::string &filePath);
+    void startDrain(uint32_t intervalMs, const std::function<void()> &job);
+    void stopDrain();
+};
+
+struct QmTranslatorX::Prewarm
+{
+    std::thread thread;
+    std::atomic<bool> cancel;
+    std::unordered_set<std::string> contexts;
+    // Strings of the catalog prewarm() was called for, the translations get decoded into
+    Interned *interned;
+    // The cancelled prewarm, joined by the thread of this one
+    std::unique_ptr<Prewarm> previous;
+
+    Prewarm() : cancel(false), interned(nullptr) {}
+};
+
+static std::atomic<uint64_t> g_pseudoSerial(0);
+
+struct QmTranslatorX::PseudoLocale
+{
+    QmPseudoLocaleX settings;
+    // Distinguishes the translations cached by the threads, changes with the
+    // settings and on close() since the numerus rules may change
+    uint64_t serial;
+
+    PseudoLocale() : serial(++g_pseudoSerial) {}
+};
+
+/*
+   UTF-16BE translation of the pseudo-locale synthesized by the thread, by the
+   hash of the source text and the plural form. The slots are overwritten, so
+   the cache stays bounded and needs no lock.
+ */
+struct PseudoSlot
+{
+    uint64_t serial;
+    uint64_t hash;
+    int32_t form;
+    std::string sourceText;
+    std::string translation;
+};
+
+static const size_t g_pseudoSlotsCount = 512;
+static thread_local PseudoSlot g_pseudoSlots[g_pseudoSlotsCount];
+
+struct QmTranslatorX::MessageIds
+{
+    // Catalog having the message of the ID, its numerus rules choose the plural form
+    struct Owner
+    {
+        const QmTranslatorX *catalog;
+        // Translations are forms[firstForm] ... forms[firstForm + formsCount - 1], one per plural form
+        uint32_t firstForm;
+        uint32_t formsCount;
+    };
+
+    const QmMessageKeyX *keys;
+    size_t count;
+    // Owners of the ID are owners[first[id]] ... owners[first[id + 1] - 1], in the order of the lookup
+    std::vector<uint32_t> first;
+    std::vector<Owner> owners;
+    std::vector<QmStringViewX> forms;
+    // Generations of the fallbacks when resolved, any change of them voids the resolved IDs
+    std::vector<uint64_t> fallbackGenerations;
+
+    MessageIds() : keys(nullptr), count(0) {}
+
+    void clear()
+    {
+        first.clear();
+        owners.clear();
+        forms.clear();
+        fallbackGenerations.clear();
+    }
+};
+
+// Resolved owners of the IDs of one part, with the plural form numbers of every catalog
+struct QmTranslatorX::IdResolve
+{
+    const std::unordered_map<const QmTranslatorX *, std::vector<int32_t> > &formNumbers;
+    std::vector<uint32_t> ownersCount;
+    std::vector<MessageIds::Owner> owners;
+    std::vector<QmStringViewX> forms;
+
+    IdResolve(const std::unordered_map<const QmTranslatorX *, std::vector<int32_t> > &numbers) :
+        formNumbers(numbers)
+    {}
+};
+
+/*
+   Split block Bloom filter of the "Hashes" block values (the hashes of the
+   source text and the comment): every hash sets one bit in each of the eight
+   64-bit words of its 64-byte block, so the check touches one cache line.
+   About 12 bits per key give below 1% of the false positives.
+ */
+struct QmTranslatorX::KeyFilter
+{
+    static const size_t bitsPerKey = 12;
+
+    std::vector<uint64_t> blocks;
+    uint32_t blocksCount;
+
+    KeyFilter(size_t keysCount) :
+        blocksCount(uint32_t(std::max<size_t>(1, (keysCount * bitsPerKey + 511) / 512)))
+    {
+        blocks.assign(size_t(blocksCount) * 8, 0);
+    }
+
+    // Index of the first word of the block, by the high bits of the hash
+    size_t blockAt(uint64_t h) const
+    {
+        return size_t(((h >> 32) * blocksCount) >> 32) << 3;
+    }
+
+    static uint64_t bitOf(uint64_t h, size_t word)
+    {
+        static const uint32_t salt[8] =
+        {
+            0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+            0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U
+        };
+        return uint64_t(1) << ((uint32_t(h) * salt[word]) >> 26);
+    }
+
+    void insert(uint32_t hash)
+    {
+        const uint64_t h = phashMix(hash);
+        uint64_t *block = blocks.data() + blockAt(h);
+        for(size_t w = 0; w < 8; ++w)
+            block[w] |= bitOf(h, w);
+    }
+
+    bool mayContain(uint32_t hash) const
+    {
+        const uint64_t h = phashMix(hash);
+        const uint64_t *block = blocks.data() + blockAt(h);
+        for(size_t w = 0; w < 8; ++w)
+        {
+            if(!(block[w] & bitOf(h, w)))
+                return false;
+        }
+        return true;
+    }
+};
+
+struct QmTranslatorX::IdIndex
+{
+    struct Slot
+    {
+        uint32_t hash;
+        uint32_t id;            // Offset of the ID (the source text) in the "Messages" block
+        uint32_t idLength;
+        uint32_t record;        // Offset of the record, NoRecord for the empty slot
+        uint32_t translation;   // Offset of the first translation
+        uint32_t translationLength;
+    };
+
+    static const uint32_t NoRecord = 0xFFFFFFFF;
+    // Open addressing with the linear probing, the size is a power of two
+    std::vector<Slot> slots;
+    uint32_t mask;
+
+    IdIndex() : mask(0) {}
+
+    static uint32_t hash(const char *id, size_t len)
+    {
+        uint64_t h = phashStart(0);
+        phashContinue(h, reinterpret_cast<const uint8_t *>(id), len);
+        return uint32_t(phashMix(h));
+    }
+};
+
+// Threads building the load-time indexes, see setLoadThreads()
+static std::atomic<unsigned> g_loadThreads(0);
+static std::atomic<size_t> g_packedCacheLimit(1024 * 1024);
+static std::atomic<uint64_t> g_packedSerial(0);
+
+struct QmTranslatorX::Packed
+{
+    typedef std::shared_ptr<const std::vector<uint8_t> > Chunk;
+    typedef std::list<std::pair<uint32_t, Chunk> > ChunkList;
+
+    // Distinguishes the catalogs for the chunks pinned by the threads
+    uint64_t serial;
+    const uint8_t *table;
+    const uint8_t *data;
+    uint32_t chunksCount;
+    uint32_t length;
+
+    std::mutex mutex;
+    // Unpacked chunks, the most recently used go first
+    ChunkList lru;
+    std::unordered_map<uint32_t, ChunkList::iterator> cached;
+    size_t cachedBytes;
+
+    // The whole block unpacked on the first request
+    std::once_flag unpackOnce;
+    std::vector<uint8_t> unpacked;
+    std::atomic<const uint8_t *> unpackedArray;
+
+    Packed() :
+        serial(++g_packedSerial), table(nullptr), data(nullptr), chunksCount(0), length(0),
+        cachedBytes(0), unpackedArray(nullptr)
+    {}
+
+    uint32_t chunkBegin(uint32_t c) const { return read32be(table + (size_t(c) << 3)); }
+    uint32_t packedBegin(uint32_t c) const { return read32be(table + (size_t(c) << 3) + 4); }
+
+    bool read(const uint8_t *block, uint32_t blockLen)
+    {
+        if(blockLen < g_pack_headerSize)
+            return false;
+        length = read32be(block);
+        chunksCount = read32be(block + 4);
+        const uint64_t tableLength = (uint64_t(chunksCount) + 1) << 3;
+        if(tableLength > blockLen - g_pack_headerSize)
+            return false;
+        table = block + g_pack_headerSize;
+        data = table + tableLength;
+
+        if(chunkBegin(0) != 0 || packedBegin(0) != 0 || chunkBegin(chunksCount) != length ||
+           packedBegin(chunksCount) != blockLen - g_pack_headerSize - tableLength)
+            return false;
+        for(uint32_t c = 0; c < chunksCount; ++c)
+        {
+            if(chunkBegin(c + 1) < chunkBegin(c) || packedBegin(c + 1) < packedBegin(c))
+                return false;
+        }
+        return true;
+    }
+
+    bool unpackChunk(uint32_t c, uint8_t *out) const
+    {
+        return lzDecompress(data + packedBegin(c), packedBegin(c + 1) - packedBegin(c),
+                            out, chunkBegin(c + 1) - chunkBegin(c));
+    }
+
+    Chunk chunk(uint32_t c)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            std::unordered_map<uint32_t, ChunkList::iterator>::iterator it = cached.find(c);
+            if(it != cached.end())
+            {
+                lru.splice(lru.begin(), lru, it->second);
+                return it->second->second;
+            }
+        }
+
+        // Unpacked out of the lock, the threads missing the same chunk may unpack it twice
+        std::shared_ptr<std::vector<uint8_t> > unpackedChunk(new std::vector<uint8_t>(chunkBegin(c + 1) - chunkBegin(c)));
+        if(!unpackChunk(c, unpackedChunk->data()))
+            return Chunk();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        std::unordered_map<uint32_t, ChunkList::iterator>::iterator it = cached.find(c);
+        if(it != cached.end())
+        {
+            lru.splice(lru.begin(), lru, it->second);
+            return it->second->second;
+        }
+
+        lru.push_front(std::make_pair(c, Chunk(unpackedChunk)));
+        cached[c] = lru.begin();
+        cachedBytes += unpackedChunk->size();
+        const size_t limit = g_packedCacheLimit.load(std::memory_order_relaxed);
+        while(cachedBytes > limit && lru.size() > 1)
+        {
+            cachedBytes -= lru.back().second->size();
+            cached.erase(lru.back().first);
+            lru.pop_back();
+        }
+        return lru.front().second;
+    }
+};
+
+// The chunk of the last packed record read by the thread, the translation found
+// in it stays valid until the next lookup even if the cache drops the chunk
+struct PackedPin
+{
+    uint64_t serial;
+    uint32_t begin;
+    uint32_t end;
+    std::shared_ptr<const std::vector<uint8_t> > chunk;
+};
+
+static thread_local PackedPin g_packedPin;
+
+QmTranslatorX::QmTranslatorX() :
+    m_fileData(nullptr), m_fileLength(0),
+    m_messageArray(nullptr), m_offsetArray(nullptr), m_contextArray(nullptr), m_numerusRulesArray(nullptr),
+    m_perfectHashArray(nullptr),
+    m_messageLength(0),      m_offsetLength(0),      m_contextLength(0),      m_numerusRulesLength(0),
+    m_perfectHashLength(0),
+    m_generation(++g_catalogGeneration),
+    m_interned(nullptr)
+{}
+
+QmTranslatorX::~QmTranslatorX()
+{
+    close();
+    delete m_interned.load(std::memory_order_relaxed);
+}
+
+QmTranslatorX::QmTranslatorX(QmTranslatorX &&other) noexcept :
+    QmTranslatorX()
+{
+    *this = std::move(other);
+}
+
+QmTranslatorX &QmTranslatorX::operator=(QmTranslatorX &&other) noexcept
+{
+    if(this == &other)
+        return *this;
+
+    close();
+    // The prewarm thread works on the other object itself, the background load
+    // only knows its AsyncLoad which moves together with the catalog
+    other.stopPrewarm();
+    swapCatalog(other);
+
+    m_fallbacks = std::move(other.m_fallbacks);
+    other.m_fallbacks.clear();
+    m_fallbackCache = std::move(other.m_fallbackCache);
+    m_asyncLoad = std::move(other.m_asyncLoad);
+    m_recorder = std::move(other.m_recorder);
+    m_prewarm = std::move(other.m_prewarm);
+    m_pseudoLocale = std::move(other.m_pseudoLocale);
+    m_messageIds = std::move(other.m_messageIds);
+    m_misses = std::move(other.m_misses);
+
+    return *this;
+}
+
+void QmTranslatorX::swapCatalog(QmTranslatorX &other)
+{
+    std::swap(m_fileData, other.m_fileData);
+    std::swap(m_fileLength, other.m_fileLength);
+    std::swap(m_messageArray, other.m_messageArray);
+    std::swap(m_offsetArray, other.m_offsetArray);
+    std::swap(m_contextArray, other.m_contextArray);
+    std::swap(m_numerusRulesArray, other.m_numerusRulesArray);
+    std::swap(m_perfectHashArray, other.m_perfectHashArray);
+    std::swap(m_messageLength, other.m_messageLength);
+    std::swap(m_offsetLength, other.m_offsetLength);
+    std::swap(m_contextLength, other.m_contextLength);
+    std::swap(m_numerusRulesLength, other.m_numerusRulesLength);
+    std::swap(m_perfectHashLength, other.m_perfectHashLength);
+    m_subTranslators.swap(other.m_subTranslators);
+    m_codepoints.swap(other.m_codepoints);
+    m_ownCodepoints.swap(other.m_ownCodepoints);
+    m_indexData.swap(other.m_indexData);
+    m_layoutData.swap(other.m_layoutData);
+    m_idIndex.swap(other.m_idIndex);
+    m_keyFilter.swap(other.m_keyFilter);
+    m_packed.swap(other.m_packed);
+    Interned *interned = m_interned.load(std::memory_order_relaxed);
+    m_interned.store(other.m_interned.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    other.m_interned.store(interned, std::memory_order_relaxed);
+    m_generation = ++g_catalogGeneration;
+    other.m_generation = ++g_catalogGeneration;
+
+    if(m_fallbackCache)
+        m_fallbackCache->clear();
+}
+
+std::u16string QmTranslatorX::do_translate(const char *context, const char *sourceText, const char *comment, int32_t n)
+{
+    QmStringViewX tn;
+    if(!findTranslation(context, sourceText, comment, n, tn))
+        return std::u16string();
+    return fromUtf16be(reinterpret_cast<const uint8_t *>(tn.data), tn.size);
+}
+
+bool QmTranslatorX::findTranslation(const char *context, const char *sourceText, const char *comment,
+                                    int32_t n, QmStringViewX &translation)
+{
+    if(m_recorder)
+        recordLookup(context, sourceText, comment);
+    if(m_pseudoLocale)
+        return findPseudo(sourceText, n, translation);
+
+    const uint8_t *tn;
+    uint32_t tnLength;
+
+    if(!findOwn(context, sourceText, comment, n, &tn, &tnLength) &&
+       (m_fallbacks.empty() || !findFallback(context, sourceText, comment, n, &tn, &tnLength)))
+    {
+        if(m_misses)
+            recordMiss(context, sourceText, comment);
+        return false;
+    }
+
+    translation = QmStringViewX(reinterpret_cast<const char *>(tn), tnLength);
+    return true;
+}
+
+/*
+   Finds the translation in this catalog and its dependencies (unless told not to)
+ */
+bool QmTranslatorX::findOwn(const char *context, const char *sourceText, const char *comment, int32_t n,
+                            const uint8_t **translation, uint32_t *translationLength, bool dependencies)
+{
+    if(context == 0)
+        context = "";
+    if(sourceText == 0)
+        sourceText = "";
+    if(comment == 0)
+        comment = "";
+
+    // The dependencies get the whole key whatever this catalog and its filter
+    // tried, they retry it without the comment themselves
+    const char *const keyComment = comment;
+    uint32_t numerus = 0;
+    size_t numItems = 0;
+    uint32_t keyHash[2];
+    bool keyMayExist[2];
 
-        if(start <= end)
+    if(!m_offsetLength)
+    {
+#ifdef QMTRANSLATPR_DEEP_DEBUG
+        printf("--> ZERO OFFSETS LENGTH!");
+#endif
+        goto searchDependencies;
+    }
+
+    /*
+        The perfect hash covers every key of the catalog: one probe
+        either finds the message or proves that it's absent.
+    */
+    if(m_perfectHashLength)
+    {
+        if(n >= 0)
+            numerus = numerusHelper(n, m_numerusRulesArray, m_numerusRulesLength);
+
+        for(;;)
         {
-            // go back on equal key
-            while(start != m_offsetArray && read32be(start) == read32be(start - 8))
-                start -= 8;
+            if(findPerfectHash(context, sourceText, comment, numerus, translation, translationLength))
+                return true;
+            if(!comment[0])
+                break;
+            comment = "";
+        }
+
+        // The context absent in the contexts table skips the dependencies, like below
+        if(m_contextLength && !m_subTranslators.empty() && !hasContext(context))
+            return false;
+        goto searchDependencies;
+    }
+
+    /*
+        The hashes of the key with the comment and without it. The keys
+        absent in the catalog are mostly rejected by the filter before
+        the contexts and the hashes are looked at.
+    */
+    keyHash[0] = 0;
+    elfHash_continue(sourceText, keyHash[0]);
+    keyHash[1] = keyHash[0];
+    elfHash_continue(comment, keyHash[0]);
+    elfHash_finish(keyHash[0]);
+    elfHash_finish(keyHash[1]);
+    keyMayExist[0] = !m_keyFilter || m_keyFilter->mayContain(keyHash[0]);
+    keyMayExist[1] = comment[0] && (!m_keyFilter || m_keyFilter->mayContain(keyHash[1]));
+    if(!keyMayExist[0] && !keyMayExist[1])
+    {
+        // The context absent in the contexts table skips the dependencies, like below
+        if(m_contextLength && !m_subTranslators.empty() && !hasContext(context))
+            return false;
+        goto searchDependencies;
+    }
+
+    /*
+        Check if the context belongs to this QTranslator. If many
+        translators are installed, this step is necessary.
+    */
+    if(m_contextLength && !hasContext(context))
+        return false;
+
+    numItems = m_offsetLength / (2 * sizeof(unsigned));
+    if(!numItems)
+    {
+#ifdef QMTRANSLATPR_DEEP_DEBUG
+        printf("--> NO ITEMS!\n");
+#endif
+        goto searchDependencies;
+    }
+
+    if(n >= 0)
+        numerus = numerusHelper(n, m_numerusRulesArray, m_numerusRulesLength);
 
-            while(start < m_offsetArray + m_offsetLength)
+    for(int pass = 0; ; ++pass)
+    {
+        const uint32_t h = keyHash[pass];
+        if(keyMayExist[pass])
+        {
+            const uint8_t *start = m_offsetArray;
+            const uint8_t *end = start + ((numItems - 1) << 3);
+            while(start <= end)
             {
-                uint32_t rh = read32be(start);
-                start += 4;
-                if(rh != h)
+                const uint8_t *middle = start + (((end - start) >> 4) << 3);
+                uint32_t hash = read32be(middle);
+                if(h == hash)
+                {
+                    start = middle;
                     break;
-                uint32_t ro = read32be(start);
-                start += 4;
-                std::u16string tn = getMessage(m_messageArray + ro, m_messageArray + m_messageLength, context,
-                                               sourceText, comment, numerus);
-                if(!tn.empty())
-                    return tn;
+                }
+                else if(hash < h)
+                    start = middle + 8;
+                else
+                    end = middle - 8;
+            }
+
+            if(start <= end)
+            {
+                // go back on equal key
+                while(start != m_offsetArray && read32be(start) == read32be(start - 8))
+                    start -= 8;
+
+                while(start < m_offsetArray + m_offsetLength)
+                {
+                    uint32_t rh = read32be(start);
+                    start += 4;
+                    if(rh != h)
+                        break;
+                    uint32_t ro = read32be(start);
+                    start += 4;
+                    const uint8_t *record, *recordEnd;
+                    if(recordAt(ro, &record, &recordEnd) &&
+                       getMessage(record, recordEnd, context, sourceText, comment, numerus,
+                                  translation, translationLength))
+                        return true;
+                }
             }
         }
         if(!comment[0])
@@ -924,285 +1201,2819 @@ std::u16string QmTranslatorX::do_translate(const char *context, const char *sour
     printf("--> Nothing found!\n");
 #endif
 
-searchDependencies:
-    for(QmTranslatorX *translator : m_subTranslators)
+searchDependencies:
+    if(!dependencies)
+        return false;
+    for(QmTranslatorX *translator : m_subTranslators)
+    {
+        if(translator->findOwn(context, sourceText, keyComment, n, translation, translationLength))
+            return true;
+    }
+    return false;
+}
+
+/*
+   Checks if the context has messages in this catalog by the contexts table
+ */
+bool QmTranslatorX::hasContext(const char *context) const
+{
+#ifdef QMTRANSLATPR_DEEP_DEBUG
+    printf("--> Finding contexts...!");
+#endif
+    uint16_t hTableSize = read16be(m_contextArray);
+    uint32_t g = elfHash(context) % hTableSize;
+    const uint8_t *c = m_contextArray + 2 + (g << 1);
+    uint16_t off = read16be(c);
+    if(off == 0)
+    {
+#ifdef QMTRANSLATPR_DEEP_DEBUG
+        printf("--> Zero offset...!\n");
+#endif
+        return false;
+    }
+    c = m_contextArray + (2 + (hTableSize << 1) + (off << 1));
+
+    const uint32_t contextLen = uint32_t(std::strlen(context));
+    for(;;)
+    {
+        uint8_t len = read8(c++);
+        if(len == 0)
+        {
+#ifdef QMTRANSLATPR_DEEP_DEBUG
+            printf("--> Zero length...!\n");
+#endif
+            return false;
+        }
+        if(match(c, len, context, contextLen))
+            return true;
+        c += len;
+    }
+}
+
+/*
+   Walks the fallback catalogs for the key which this catalog lacks. The
+   fallback having the key is remembered, so the next lookups of the key
+   go to that catalog first. The key absent in all of the fallbacks is
+   remembered too (the catalogs with the perfect hash have no key filter to
+   reject it cheaply) for the number it was looked up with. Both are tagged
+   by the generations of the fallbacks, so loading any fallback again makes
+   them stale.
+ */
+bool QmTranslatorX::findFallback(const char *context, const char *sourceText, const char *comment, int32_t n,
+                                 const uint8_t **translation, uint32_t *translationLength)
+{
+    const uint64_t h = phashKey(context ? context : "", sourceText ? sourceText : "",
+                                comment ? comment : "", 0);
+    std::atomic<uint64_t> &slot = m_fallbackCache->slots[(h >> 8) % FallbackCache::SlotsCount];
+
+    uint64_t generations = 0;
+    for(const QmTranslatorX *fallback : m_fallbacks)
+        generations = phashMix(generations ^ fallback->m_generation);
+    const uint64_t tag = (h ^ generations) & ~uint64_t(0xFF);
+    const uint64_t absent = ((h ^ phashMix(generations ^ uint32_t(n))) & ~uint64_t(0xFF)) | 0xFF;
+
+    const uint64_t hint = slot.load(std::memory_order_relaxed);
+    if(hint == absent)
+        return false;
+    size_t hinted = m_fallbacks.size();
+    if((hint & ~uint64_t(0xFF)) == tag && (hint & 0xFF) != 0 && (hint & 0xFF) != 0xFF)
+    {
+        hinted = size_t(hint & 0xFF) - 1;
+        if(hinted < m_fallbacks.size() &&
+           m_fallbacks[hinted]->findOwn(context, sourceText, comment, n, translation, translationLength))
+            return true;
+    }
+
+    for(size_t i = 0; i < m_fallbacks.size(); ++i)
+    {
+        if(i == hinted)
+            continue;
+        if(m_fallbacks[i]->findOwn(context, sourceText, comment, n, translation, translationLength))
+        {
+            // The first fallback is probed first anyway
+            if(i > 0 && i < 0xFE)
+                slot.store(tag | (i + 1), std::memory_order_relaxed);
+            return true;
+        }
+    }
+
+    slot.store(absent, std::memory_order_relaxed);
+    return false;
+}
+
+void QmTranslatorX::setFallbacks(const std::vector<QmTranslatorX *> &fallbacks)
+{
+    m_fallbacks.clear();
+    for(QmTranslatorX *fallback : fallbacks)
+    {
+        if(fallback && fallback != this)
+            m_fallbacks.push_back(fallback);
+    }
+
+    if(!m_fallbackCache)
+        m_fallbackCache.reset(new FallbackCache);
+    m_fallbackCache->clear();
+    resolveMessageIds();
+}
+
+const std::vector<QmTranslatorX *> &QmTranslatorX::fallbacks() const
+{
+    return m_fallbacks;
+}
+
+bool QmTranslatorX::findPerfectHash(const char *context, const char *sourceText, const char *comment,
+                                    uint32_t numerus, const uint8_t **translation, uint32_t *translationLength)
+{
+    const uint32_t seed = read32be(m_perfectHashArray);
+    const uint32_t slotsCount = read32be(m_perfectHashArray + 4);
+    const uint32_t bucketsCount = read32be(m_perfectHashArray + 8);
+    const uint8_t *displacements = m_perfectHashArray + g_phash_headerSize;
+    const uint8_t *slots = displacements + (size_t(bucketsCount) << 2);
+
+    uint64_t h = phashKey(context, sourceText, comment, seed);
+    uint32_t d = read32be(displacements + (size_t(phashBucket(h, bucketsCount)) << 2));
+    const uint8_t *slot = slots + (size_t(phashSlot(h, d, slotsCount)) << 3);
+
+    if(read32be(slot) != phashFingerprint(h))
+        return false;
+
+    const uint8_t *record, *recordEnd;
+    if(!recordAt(read32be(slot + 4), &record, &recordEnd))
+        return false;
+
+    // The record tags (if kept) verify the key completely
+    return getMessage(record, recordEnd, context, sourceText, comment, numerus,
+                      translation, translationLength);
+}
+
+/*
+   The catalog takes one reference to every pool string it returned, all
+   of them are released when the catalog is closed or replaced
+ */
+const std::u16string &QmTranslatorX::translateInterned(const char *context, const char *sourceText,
+                                                      const char *comment, int32_t n)
+{
+    static const std::u16string empty;
+    QmStringViewX tn;
+    if(!findTranslation(context, sourceText, comment, n, tn))
+        return empty;
+
+    // The string returned for the same data by the thread before needs no lock
+    Interned *interned = internedStrings();
+    const uint8_t *data = reinterpret_cast<const uint8_t *>(tn.data);
+    InternedPin &pin = g_internedPins[(reinterpret_cast<uintptr_t>(data) >> 1) % g_internedPinsCount];
+    if(pin.serial == interned->serial && pin.data == data && equalsUtf16be(*pin.str, data, tn.size))
+        return *pin.str;
+
+    const std::u16string *str = interned->intern(data, tn.size);
+    pin.serial = interned->serial;
+    pin.data = data;
+    pin.str = str;
+    return *str;
+}
+
+/*
+   The strings interned for this catalog, allocated on the first use by any thread
+ */
+QmTranslatorX::Interned *QmTranslatorX::internedStrings()
+{
+    Interned *interned = m_interned.load(std::memory_order_acquire);
+    if(interned)
+        return interned;
+
+    std::unique_ptr<Interned> created(new Interned);
+    if(m_interned.compare_exchange_strong(interned, created.get(), std::memory_order_acq_rel,
+                                          std::memory_order_acquire))
+        return created.release();
+    return interned;
+}
+
+std::string QmTranslatorX::do_translate8(const char *context, const char *sourceText, const char *comment, int32_t n)
+{
+    return translateAs<std::string>(context, sourceText, comment, n);
+}
+
+std::u32string QmTranslatorX::do_translate32(const char *context, const char *sourceText, const char *comment, int32_t n)
+{
+    return translateAs<std::u32string>(context, sourceText, comment, n);
+}
+
+/*
+   Converts the translation into the small string of the exact size
+ */
+template<class SmallString>
+static SmallString translateSmallString(QmTranslatorX &translator, const char *context, const char *sourceText,
+                                        const char *comment, int32_t n)
+{
+    typedef typename SmallString::value_type CharT;
+    SmallString outstr;
+    QmStringViewX tn;
+    if(!translator.findTranslation(context, sourceText, comment, n, tn))
+        return outstr;
+
+    const uint8_t *data = reinterpret_cast<const uint8_t *>(tn.data);
+    QmCountSinkX count;
+    qmTranscodeX<CharT>(data, tn.size, count);
+    QmIteratorSinkX<CharT *> sink(outstr.allocate(count.size()));
+    qmTranscodeX<CharT>(data, tn.size, sink);
+
+    return outstr;
+}
+
+QmSmallString8X QmTranslatorX::translateSmall8(const char *context, const char *sourceText, const char *comment, int32_t n)
+{
+    return translateSmallString<QmSmallString8X>(*this, context, sourceText, comment, n);
+}
+
+QmSmallString16X QmTranslatorX::translateSmall(const char *context, const char *sourceText, const char *comment, int32_t n)
+{
+    return translateSmallString<QmSmallString16X>(*this, context, sourceText, comment, n);
+}
+
+QmSmallString32X QmTranslatorX::translateSmall32(const char *context, const char *sourceText, const char *comment, int32_t n)
+{
+    return translateSmallString<QmSmallString32X>(*this, context, sourceText, comment, n);
+}
+
+bool QmTranslatorX::loadFile(const char *filePath, uint8_t *directory)
+{
+    uint8_t magicBuffer[g_qm_magicLength];
+    size_t  fileGotLen = 0;
+
+    // Even the empty translator may have the pending result of loadFileAsync(),
+    // which must not replace the catalog loaded explicitly
+    close();
+
+    FILE *file = openFile(filePath, "rb");
+    if(!file)
+        return false;//err("Can't open file!", 2);
+
+    if(std::fread(magicBuffer, 1, g_qm_magicLength, file) < g_qm_magicLength)
+    {
+        std::fclose(file);
+        return false;//err("ERROR READING MAGIC NUMBER!!!", 3);
+    }
+
+    if(std::memcmp(magicBuffer, g_qm_magic, g_qm_magicLength) != 0)
+    {
+        std::fclose(file);
+        return false;//err("MAGIC NUMBER DOESN'T CASE!", 4);
+    }
+
+    std::fseek(file, 0L, SEEK_END);
+
+    long fileLength = std::ftell(file);
+    if(fileLength < 0)
+    {
+        std::fclose(file);
+        return false;//err("FAIL TO SEEK END!", 4);
+    }
+
+    m_fileLength = static_cast<size_t>(fileLength);
+    std::fseek(file, 0L, SEEK_SET);
+
+    m_fileData = reinterpret_cast<uint8_t *>(std::malloc(m_fileLength));
+    if(!m_fileData)
+    {
+        std::fclose(file);
+        return false;//err("OUT OF MEMORY!", 5);
+    }
+    fileGotLen = std::fread(m_fileData, 1, m_fileLength, file);
+    std::fclose(file);
+    m_fileLength = fileGotLen;
+    return loadDataPrivate(m_fileData, m_fileLength, directory);
+}
+
+bool QmTranslatorX::loadData(const uint8_t *data, size_t len, uint8_t *directory)
+{
+    if(!data || len == 0)
+        return false;
+    close();
+
+    m_fileData = reinterpret_cast<uint8_t *>(std::malloc(len));
+    if(!m_fileData)
+        return false;//err("OUT OF MEMORY!", 5);
+    std::memcpy(m_fileData, data, len);
+    m_fileLength = len;
+    return loadDataPrivate(m_fileData, m_fileLength, directory);
+}
+
+bool QmTranslatorX::loadStaticData(const uint8_t *data, size_t len, uint8_t *directory)
+{
+    if(!data || len == 0)
+        return false;
+    close();
+
+    return loadDataPrivate(data, len, directory);
+}
+
+bool QmTranslatorX::loadEmbedded(const QmEmbeddedCatalogX &catalog, uint8_t *directory)
+{
+    return loadStaticData(catalog.data, catalog.size, directory);
+}
+
+bool QmTranslatorX::loadEmbedded(const QmEmbeddedCatalogX *catalogs, const char *name, uint8_t *directory)
+{
+    for(const QmEmbeddedCatalogX *c = catalogs; c && c->name; ++c)
+    {
+        if(std::strcmp(c->name, name) == 0)
+            return loadEmbedded(*c, directory);
+    }
+    return false;
+}
+
+bool QmTranslatorX::loadDataPrivate(const uint8_t *data, size_t len, uint8_t *directory)
+{
+    std::vector<std::string> dependencies;
+    bool ok = true;
+    const uint8_t *end = data + len;
+
+    data += g_qm_magicLength;
+    while(data < end - 4)
+    {
+        uint8_t  tag = read8(data++);
+        uint32_t blockLen = read32be(data);
+        data += 4;
+        if(!tag || !blockLen)
+            break;
+        if(uint32_t(end - data) < blockLen)
+        {
+            ok = false;
+            break;
+        }
+
+        if(tag == QTranslatorEntryTypes::Contexts)
+        {
+            m_contextArray = data;
+            m_contextLength = blockLen;
+#ifdef QMTRANSLATPR_DEEP_DEBUG
+            printf("Has contexts array!\n");
+#endif
+        }
+        else if(tag == QTranslatorEntryTypes::Hashes)
+        {
+            m_offsetArray = data;
+            m_offsetLength = blockLen;
+#ifdef QMTRANSLATPR_DEEP_DEBUG
+            printf("Has hashes! %i\n", offsetLength);
+#endif
+        }
+        else if(tag == QTranslatorEntryTypes::Messages)
+        {
+            m_packed.reset();
+            m_messageArray = data;
+            m_messageLength = blockLen;
+#ifdef QMTRANSLATPR_DEEP_DEBUG
+            printf("Has messages! %i\n", messageLength);
+#endif
+        }
+        else if(tag == QTranslatorEntryTypes::PackedMessages)
+        {
+            // Ignore the block which doesn't match its header
+            std::unique_ptr<Packed> packed(new Packed);
+            if(!m_messageArray && packed->read(data, blockLen))
+            {
+                m_packed = std::move(packed);
+                m_messageLength = m_packed->length;
+            }
+#ifdef QMTRANSLATPR_DEEP_DEBUG
+            printf("Has packed messages! %i\n", m_messageLength);
+#endif
+        }
+        else if(tag == QTranslatorEntryTypes::NumerusRules)
+        {
+            m_numerusRulesArray = data;
+            m_numerusRulesLength = blockLen;
+#ifdef QMTRANSLATPR_DEEP_DEBUG
+            printf("Has numerus rules! %i\n", numerusRulesLength);
+#endif
+        }
+        else if(tag == QTranslatorEntryTypes::PerfectHash)
+        {
+            // Ignore the block which doesn't match its header
+            if(blockLen >= g_phash_headerSize)
+            {
+                uint64_t slotsCount = read32be(data + 4);
+                uint64_t bucketsCount = read32be(data + 8);
+                if(slotsCount && bucketsCount &&
+                   blockLen == g_phash_headerSize + (bucketsCount << 2) + (slotsCount << 3))
+                {
+                    m_perfectHashArray = data;
+                    m_perfectHashLength = blockLen;
+                }
+            }
+#ifdef QMTRANSLATPR_DEEP_DEBUG
+            printf("Has perfect hash! %i\n", m_perfectHashLength);
+#endif
+        }
+        else if(tag == QTranslatorEntryTypes::Dependencies)
+        {
+            /*
+                The names of the dependent files are QStrings of the QDataStream
+                one after another: the length in bytes (0xFFFFFFFF is the null
+                string) and the UTF-16BE data
+            */
+            const uint8_t *dep = data;
+            const uint8_t *depsEnd = data + blockLen;
+            while(depsEnd - dep >= 4)
+            {
+                uint32_t depLen = read32be(dep);
+                dep += 4;
+                if(depLen == 0xFFFFFFFF)
+                    continue;
+                if(depLen > uint32_t(depsEnd - dep))
+                {
+                    ok = false;
+                    break;
+                }
+
+                std::string name;
+                QmAppendSinkX<std::string> sink(name);
+                qmTranscodeX<char>(dep, depLen, sink);
+                dep += depLen;
+                if(!name.empty())
+                {
+                    //List of dependent files
+                    dependencies.push_back(name);
+#ifdef QMTRANSLATPR_DEEP_DEBUG
+                    printf("Dependency: %s\n", name.c_str());
+#endif
+                }
+            }
+#ifdef QMTRANSLATPR_DEEP_DEBUG
+            printf("Had deps!\n");
+#endif
+        }
+        data += blockLen;
+    }
+
+    if(dependencies.empty() && (!m_offsetArray || (!m_messageArray && !m_packed)))
+        ok = false;
+
+#ifdef QMTRANSLATPR_DEEP_DEBUG
+    printf("Dependencies valid: %i\n", ok);
+#endif
+
+    if(ok && !isValidNumerusRules(m_numerusRulesArray, m_numerusRulesLength))
+        ok = false;
+
+#ifdef QMTRANSLATPR_DEEP_DEBUG
+    printf("Numerus rules valid: %i\n", ok);
+#endif
+
+    //Process loading of sub-translators
+    if(ok)
+    {
+        const size_t dependenciesCount = dependencies.size();
+        m_subTranslators.reserve(dependenciesCount);
+        for(size_t i = 0 ; i < dependenciesCount; ++i)
+        {
+            QmTranslatorX *translator = new QmTranslatorX;
+            m_subTranslators.push_back(translator);
+            ok = translator->loadFile(dependencies[i].c_str(), directory);
+            if(!ok)
+                break;
+        }
+
+        // In case some dependencies fail to load, unload all the other ones too.
+        if(!ok)
+        {
+            for(QmTranslatorX *it : m_subTranslators)
+                delete it;
+            m_subTranslators.clear();
+        }
+    }
+
+    if(!ok)
+    {
+        m_messageArray    = 0;
+        m_contextArray    = 0;
+        m_offsetArray     = 0;
+        m_numerusRulesArray = 0;
+        m_perfectHashArray = 0;
+        m_messageLength   = 0;
+        m_contextLength   = 0;
+        m_offsetLength    = 0;
+        m_numerusRulesLength = 0;
+        m_perfectHashLength = 0;
+        m_packed.reset();
+#ifdef QMTRANSLATPR_DEEP_DEBUG
+        printf("LOADING FAILED!\n");
+#endif
+        return false;
+    }
+    else
+    {
+#ifdef QMTRANSLATPR_DEEP_DEBUG
+        printf("LOADING PASSED!\n");
+#endif
+        buildIdIndex();
+        buildKeyFilter();
+        resolveMessageIds();
+        return true;
+    }
+}
+
+std::future<bool> QmTranslatorX::loadFileAsync(const char *filePath, uint8_t *directory,
+                                               const std::function<void(bool)> &callback)
+{
+    waitAsyncLoad();
+    if(!m_asyncLoad)
+        m_asyncLoad.reset(new AsyncLoad);
+
+    std::shared_ptr<std::promise<bool> > promise(new std::promise<bool>);
+    std::future<bool> result = promise->get_future();
+    std::string path(filePath ? filePath : "");
+    AsyncLoad *async = m_asyncLoad.get();
+
+    async->thread = std::thread([async, path, directory, callback, promise]()
+    {
+        std::unique_ptr<QmTranslatorX> loaded(new QmTranslatorX);
+        bool ok = loaded->loadFile(path.c_str(), directory);
+        if(ok)
+        {
+            std::lock_guard<std::mutex> lock(async->mutex);
+            async->loaded = std::move(loaded);
+            async->ready.store(true, std::memory_order_release);
+        }
+
+        promise->set_value(ok);
+        if(callback)
+            callback(ok);
+    });
+
+    return result;
+}
+
+bool QmTranslatorX::applyLoaded()
+{
+    if(!m_asyncLoad || !m_asyncLoad->ready.load(std::memory_order_acquire))
+        return false;
+
+    std::unique_ptr<QmTranslatorX> loaded;
+    {
+        std::lock_guard<std::mutex> lock(m_asyncLoad->mutex);
+        loaded = std::move(m_asyncLoad->loaded);
+        m_asyncLoad->ready.store(false, std::memory_order_relaxed);
+    }
+
+    if(!loaded)
+        return false;
+
+    // The previous catalog gets freed together with the loader's translator
+    stopPrewarm();
+    swapCatalog(*loaded);
+    resolveMessageIds();
+    return true;
+}
+
+std::future<size_t> QmTranslatorX::prewarm(const std::vector<std::string> &contexts)
+{
+    std::unique_ptr<Prewarm> job(new Prewarm);
+    job->contexts.insert(contexts.begin(), contexts.end());
+    job->interned = internedStrings();
+
+    // The previous prewarm gets cancelled, the caller doesn't wait for it to stop
+    if(m_prewarm)
+    {
+        m_prewarm->cancel.store(true, std::memory_order_relaxed);
+        job->previous = std::move(m_prewarm);
+    }
+
+    std::shared_ptr<std::promise<size_t> > promise(new std::promise<size_t>);
+    std::future<size_t> result = promise->get_future();
+
+    Prewarm *j = job.get();
+    job->thread = std::thread([this, j, promise]()
+    {
+        if(j->previous)
+        {
+            if(j->previous->thread.joinable())
+                j->previous->thread.join();
+            j->previous.reset();
+        }
+        promise->set_value(prewarmMessages(*j));
+    });
+    m_prewarm = std::move(job);
+
+    return result;
+}
+
+/*
+   Resolves the records of the requested contexts the way the lookups do and
+   decodes their translations into the strings of translateInterned(). Every
+   record is visited once in the order of the "Messages" block. The chunks of
+   the packed catalog are scanned in a private buffer, so only the chunks
+   having the requested contexts go through the cache shared with the lookups.
+ */
+size_t QmTranslatorX::prewarmMessages(const Prewarm &job)
+{
+    size_t resolved = 0;
+    const size_t count = messagesCount();
+    std::vector<uint32_t> offsets(count);
+    for(size_t i = 0; i < count; ++i)
+        offsets[i] = read32be(m_offsetArray + (i << 3) + 4);
+    std::sort(offsets.begin(), offsets.end());
+    offsets.erase(std::unique(offsets.begin(), offsets.end()), offsets.end());
+
+    const Packed *packed = m_packed && !m_packed->unpackedArray.load(std::memory_order_acquire) ?
+                           m_packed.get() : nullptr;
+    std::vector<uint8_t> chunk;
+    uint32_t c = 0, chunkLoaded = 0xFFFFFFFF;
+    std::string context, sourceText, comment;
+    const uint8_t *tn;
+    uint32_t tnLength;
+    QmRecordX record;
+
+    for(uint32_t offset : offsets)
+    {
+        if(job.cancel.load(std::memory_order_relaxed))
+            break;
+
+        const uint8_t *m, *end;
+        if(packed)
+        {
+            if(offset >= packed->length)
+                continue;
+            while(packed->chunkBegin(c + 1) <= offset)
+                ++c;
+            if(c != chunkLoaded)
+            {
+                chunk.resize(packed->chunkBegin(c + 1) - packed->chunkBegin(c));
+                chunkLoaded = packed->unpackChunk(c, chunk.data()) ? c : 0xFFFFFFFF;
+            }
+            if(c != chunkLoaded)
+                continue;
+            m = chunk.data() + (offset - packed->chunkBegin(c));
+            end = chunk.data() + chunk.size();
+        }
+        else if(!recordAt(offset, &m, &end))
+            continue;
+
+        if(!readRecord(m, end, record))
+            continue;
+        context.assign(reinterpret_cast<const char *>(record.context), record.contextLength);
+        if(!job.contexts.count(context))
+            continue;
+
+        // Same path as the translation call takes, so the same pages and chunks get loaded
+        if(record.sourceTextLength)
+        {
+            sourceText.assign(reinterpret_cast<const char *>(record.sourceText), record.sourceTextLength);
+            comment.assign(reinterpret_cast<const char *>(record.comment), record.commentLength);
+            findOwn(context.c_str(), sourceText.c_str(), comment.c_str(), -1, &tn, &tnLength);
+        }
+
+        for(uint32_t i = 0; i < record.translations; ++i)
+        {
+            const uint8_t *data;
+            uint32_t len;
+            if(job.interned && recordTranslation(record, i, &data, &len))
+                job.interned->intern(data, len);
+        }
+        ++resolved;
+    }
+
+    for(QmTranslatorX *sub : m_subTranslators)
+    {
+        if(job.cancel.load(std::memory_order_relaxed))
+            break;
+        resolved += sub->prewarmMessages(job);
+    }
+
+    return resolved;
+}
+
+void QmTranslatorX::stopPrewarm()
+{
+    if(m_prewarm && m_prewarm->thread.joinable())
+    {
+        m_prewarm->cancel.store(true, std::memory_order_relaxed);
+        m_prewarm->thread.join();
+    }
+}
+
+void QmTranslatorX::waitAsyncLoad()
+{
+    if(m_asyncLoad && m_asyncLoad->thread.joinable())
+        m_asyncLoad->thread.join();
+}
+
+bool QmTranslatorX::isPacked() const
+{
+    return m_packed != nullptr;
+}
+
+void QmTranslatorX::setPackedCacheLimit(size_t bytes)
+{
+    g_packedCacheLimit.store(bytes, std::memory_order_relaxed);
+}
+
+void QmTranslatorX::setLoadThreads(unsigned threadsCount)
+{
+    g_loadThreads.store(threadsCount, std::memory_order_relaxed);
+}
+
+/*
+   The "Messages" block, unpacked once for the whole catalog operations
+   if the catalog is packed
+ */
+const uint8_t *QmTranslatorX::messageArray() const
+{
+    if(!m_packed)
+        return m_messageArray;
+
+    Packed &packed = *m_packed;
+    std::call_once(packed.unpackOnce, [&packed]()
+    {
+        // The chunks are independent, every thread unpacks its part of them
+        std::vector<uint8_t> unpacked(packed.length);
+        std::atomic<bool> failed(false);
+        const size_t partsCount = splitParts(packed.chunksCount, g_loadThreads.load(std::memory_order_relaxed), 16);
+        runParts(partsCount, [&packed, &unpacked, &failed, partsCount](size_t part)
+        {
+            const uint32_t last = uint32_t(partBegin(packed.chunksCount, part + 1, partsCount));
+            for(uint32_t c = uint32_t(partBegin(packed.chunksCount, part, partsCount)); c < last; ++c)
+            {
+                if(!packed.unpackChunk(c, unpacked.data() + packed.chunkBegin(c)))
+                    failed.store(true, std::memory_order_relaxed);
+            }
+        });
+        if(failed.load(std::memory_order_relaxed))
+            return;
+        packed.unpacked.swap(unpacked);
+        packed.unpackedArray.store(packed.unpacked.data(), std::memory_order_release);
+
+        // The lookups use the unpacked block from now on
+        std::lock_guard<std::mutex> lock(packed.mutex);
+        packed.lru.clear();
+        packed.cached.clear();
+        packed.cachedBytes = 0;
+    });
+
+    return packed.unpackedArray.load(std::memory_order_acquire);
+}
+
+void QmTranslatorX::unpackAll()
+{
+    messageArray();
+    for(QmTranslatorX *translator : m_subTranslators)
+        translator->unpackAll();
+}
+
+/*
+   The record at the offset of the "Messages" block and the end of the data
+   having it, which is the end of the chunk for the packed catalogs
+ */
+bool QmTranslatorX::recordAt(uint32_t offset, const uint8_t **record, const uint8_t **recordEnd) const
+{
+    if(m_packed)
+        return unpackedRecord(offset, record, recordEnd);
+    if(offset >= m_messageLength)
+        return false;
+    *record = m_messageArray + offset;
+    *recordEnd = m_messageArray + m_messageLength;
+    return true;
+}
+
+bool QmTranslatorX::unpackedRecord(uint32_t offset, const uint8_t **record, const uint8_t **recordEnd) const
+{
+    Packed &packed = *m_packed;
+    if(offset >= packed.length)
+        return false;
+
+    const uint8_t *unpacked = packed.unpackedArray.load(std::memory_order_acquire);
+    if(unpacked)
+    {
+        *record = unpacked + offset;
+        *recordEnd = unpacked + packed.length;
+        return true;
+    }
+
+    PackedPin &pin = g_packedPin;
+    if(pin.serial != packed.serial || offset < pin.begin || offset >= pin.end)
+    {
+        // The last chunk beginning at or before the offset
+        uint32_t first = 0, last = packed.chunksCount;
+        while(last - first > 1)
+        {
+            uint32_t middle = first + (last - first) / 2;
+            if(packed.chunkBegin(middle) <= offset)
+                first = middle;
+            else
+                last = middle;
+        }
+
+        Packed::Chunk chunk = packed.chunk(first);
+        if(!chunk)
+            return false;
+        pin.serial = packed.serial;
+        pin.begin = packed.chunkBegin(first);
+        pin.end = packed.chunkBegin(first + 1);
+        pin.chunk = std::move(chunk);
+    }
+
+    *record = pin.chunk->data() + (offset - pin.begin);
+    *recordEnd = pin.chunk->data() + pin.chunk->size();
+    return true;
+}
+
+bool QmTranslatorX::isEmpty()
+{
+    return !m_fileData && !m_fileLength && !m_messageArray && !m_packed &&
+           !m_offsetArray && !m_contextArray && m_subTranslators.empty();
+}
+
+void QmTranslatorX::close()
+{
+    stopPrewarm();
+    if(m_pseudoLocale)
+        m_pseudoLocale->serial = ++g_pseudoSerial;
+    if(m_messageIds)
+        m_messageIds->clear();
+    m_generation = ++g_catalogGeneration;
+    m_idIndex.reset();
+    m_keyFilter.reset();
+    m_packed.reset();
+    if(Interned *interned = m_interned.load(std::memory_order_relaxed))
+        interned->release();
+
+    // Discard the catalog being loaded asynchronously
+    if(m_asyncLoad)
+    {
+        waitAsyncLoad();
+        m_asyncLoad->loaded.reset();
+        m_asyncLoad->ready.store(false, std::memory_order_relaxed);
+    }
+
+    m_messageArray = nullptr;
+    m_contextArray = nullptr;
+    m_offsetArray = nullptr;
+    m_numerusRulesArray = nullptr;
+    m_perfectHashArray = nullptr;
+    m_messageLength = 0;
+    m_contextLength = 0;
+    m_offsetLength = 0;
+    m_numerusRulesLength = 0;
+    m_perfectHashLength = 0;
+    if(m_fileData)
+        std::free(m_fileData);
+    m_fileData = nullptr;
+    m_fileLength = 0;
+    for(QmTranslatorX *it : m_subTranslators)
+        delete it;
+    m_subTranslators.clear();
+    m_codepoints.reset();
+    m_ownCodepoints.reset();
+    m_indexData.clear();
+    m_layoutData.clear();
+    if(m_fallbackCache)
+        m_fallbackCache->clear();
+}
+
+
+QmMessageViewX::QmMessageViewX() :
+    m_record(nullptr), m_recordEnd(nullptr),
+    hash(0), offset(0), translationsCount(0)
+{}
+
+QmStringViewX QmMessageViewX::translationData(uint32_t index) const
+{
+    QmRecordX record;
+    const uint8_t *data;
+    uint32_t len;
+
+    record.begin = m_record;
+    record.end = m_recordEnd;
+    if(!m_record || !recordTranslation(record, index, &data, &len))
+        return QmStringViewX();
+
+    return QmStringViewX(reinterpret_cast<const char *>(data), len);
+}
+
+std::u16string QmMessageViewX::translation(uint32_t index) const
+{
+    QmStringViewX data = translationData(index);
+    return fromUtf16be(reinterpret_cast<const uint8_t *>(data.data), data.size);
+}
+
+std::string QmMessageViewX::translation8(uint32_t index) const
+{
+    QmStringViewX tn = translationData(index);
+    std::string outstr;
+    QmAppendSinkX<std::string> sink(outstr);
+    qmTranscodeX<char>(reinterpret_cast<const uint8_t *>(tn.data), tn.size, sink);
+    return outstr;
+}
+
+QmMessageIteratorX::QmMessageIteratorX() :
+    m_entry(nullptr), m_entriesEnd(nullptr),
+    m_messageArray(nullptr), m_messageLength(0)
+{}
+
+QmMessageIteratorX::QmMessageIteratorX(const uint8_t *entry, const uint8_t *entriesEnd,
+                                       const uint8_t *messageArray, uint32_t messageLength) :
+    m_entry(entry), m_entriesEnd(entriesEnd),
+    m_messageArray(messageArray), m_messageLength(messageLength)
+{
+    fetch();
+}
+
+/*
+   Reads the record of the current entry, the entries of malformed
+   records are skipped
+ */
+void QmMessageIteratorX::fetch()
+{
+    QmRecordX record;
+
+    for(; m_entry < m_entriesEnd; m_entry += 8)
+    {
+        uint32_t ro = read32be(m_entry + 4);
+        if(ro >= m_messageLength ||
+           !readRecord(m_messageArray + ro, m_messageArray + m_messageLength, record))
+            continue;
+
+        m_message.m_record = record.begin;
+        m_message.m_recordEnd = record.end;
+        m_message.context = QmStringViewX(reinterpret_cast<const char *>(record.context), record.contextLength);
+        m_message.sourceText = QmStringViewX(reinterpret_cast<const char *>(record.sourceText), record.sourceTextLength);
+        m_message.comment = QmStringViewX(reinterpret_cast<const char *>(record.comment), record.commentLength);
+        m_message.hash = read32be(m_entry);
+        m_message.offset = ro;
+        m_message.translationsCount = record.translations;
+        return;
+    }
+
+    m_entry = m_entriesEnd;
+}
+
+QmMessageIteratorX &QmMessageIteratorX::operator++()
+{
+    if(m_entry < m_entriesEnd)
+    {
+        m_entry += 8;
+        fetch();
+    }
+    return *this;
+}
+
+QmMessageIteratorX QmMessageIteratorX::operator++(int)
+{
+    QmMessageIteratorX old = *this;
+    ++(*this);
+    return old;
+}
+
+size_t QmTranslatorX::messagesCount() const
+{
+    return m_offsetArray ? (m_offsetLength / 8) : 0;
+}
+
+QmMessageRangeX QmTranslatorX::messages() const
+{
+    return messages(0, 1);
+}
+
+QmMessageViewX QmTranslatorX::message(size_t index) const
+{
+    const uint8_t *messageData = messageArray();
+    if(index >= messagesCount() || !messageData)
+        return QmMessageViewX();
+
+    const uint8_t *entry = m_offsetArray + (index << 3);
+    QmMessageIteratorX it(entry, entry + 8, messageData, m_messageLength);
+    if(it == QmMessageIteratorX(entry + 8, entry + 8, messageData, m_messageLength))
+        return QmMessageViewX();
+    return *it;
+}
+
+QmMessageRangeX QmTranslatorX::messages(size_t part, size_t partsCount) const
+{
+    QmMessageRangeX range;
+    const size_t count = messagesCount();
+    const uint8_t *messageData = messageArray();
+
+    if(!count || !messageData || partsCount == 0 || part >= partsCount)
+        return range;
+
+    const uint8_t *first = m_offsetArray + ((count * part / partsCount) << 3);
+    const uint8_t *last = m_offsetArray + ((count * (part + 1) / partsCount) << 3);
+
+    // Iterators of the range end where the next range begins
+    range.first = QmMessageIteratorX(first, last, messageData, m_messageLength);
+    range.last = QmMessageIteratorX(last, last, messageData, m_messageLength);
+
+    return range;
+}
+
+void QmTranslatorX::forEachMessage(const std::function<void(const QmMessageViewX &, size_t)> &func,
+                                   unsigned threadsCount) const
+{
+    if(threadsCount == 0)
+        threadsCount = std::max(1u, std::thread::hardware_concurrency());
+
+    // Don't spawn threads for tiny catalogs
+    const size_t minPartSize = 1024;
+    size_t partsCount = std::min<size_t>(threadsCount, messagesCount() / minPartSize + 1);
+
+    std::vector<std::thread> threads;
+    threads.reserve(partsCount);
+
+    for(size_t part = 1; part < partsCount; ++part)
+    {
+        threads.push_back(std::thread([this, &func, part, partsCount]()
+        {
+            for(const QmMessageViewX &m : messages(part, partsCount))
+                func(m, part);
+        }));
+    }
+
+    for(const QmMessageViewX &m : messages(0, partsCount))
+        func(m, 0);
+
+    for(std::thread &t : threads)
+        t.join();
+}
+
+
+void QmCodepointSetX::insert(char32_t codepoint)
+{
+    if(codepoint > maxCodepoint)
+        return;
+
+    if(m_pages.empty())
+        m_pages.assign((maxCodepoint >> 8) + 1, 0xFFFF);
+
+    uint16_t &page = m_pages[codepoint >> 8];
+    if(page == 0xFFFF)
+    {
+        page = static_cast<uint16_t>(m_bits.size() / 4);
+        m_bits.resize(m_bits.size() + 4, 0);
+    }
+
+    m_bits[page * 4 + ((codepoint >> 6) & 3)] |= uint64_t(1) << (codepoint & 63);
+}
+
+bool QmCodepointSetX::contains(char32_t codepoint) const
+{
+    if(codepoint > maxCodepoint || m_pages.empty())
+        return false;
+
+    uint16_t page = m_pages[codepoint >> 8];
+    if(page == 0xFFFF)
+        return false;
+
+    return (m_bits[page * 4 + ((codepoint >> 6) & 3)] >> (codepoint & 63)) & 1;
+}
+
+void QmCodepointSetX::unite(const QmCodepointSetX &other)
+{
+    if(other.m_pages.empty())
+        return;
+
+    if(m_pages.empty())
+    {
+        *this = other;
+        return;
+    }
+
+    for(size_t i = 0; i < other.m_pages.size(); ++i)
+    {
+        uint16_t src = other.m_pages[i];
+        if(src == 0xFFFF)
+            continue;
+
+        uint16_t &dst = m_pages[i];
+        if(dst == 0xFFFF)
+        {
+            dst = static_cast<uint16_t>(m_bits.size() / 4);
+            m_bits.resize(m_bits.size() + 4, 0);
+        }
+
+        for(size_t w = 0; w < 4; ++w)
+            m_bits[dst * 4 + w] |= other.m_bits[src * 4 + w];
+    }
+}
+
+size_t QmCodepointSetX::count() const
+{
+    size_t ret = 0;
+    for(uint64_t w : m_bits)
+    {
+        for(; w; w &= w - 1)
+            ++ret;
+    }
+    return ret;
+}
+
+bool QmCodepointSetX::empty() const
+{
+    for(uint64_t w : m_bits)
+    {
+        if(w)
+            return false;
+    }
+    return true;
+}
+
+void QmCodepointSetX::clear()
+{
+    m_pages.clear();
+    m_bits.clear();
+}
+
+std::vector<char32_t> QmCodepointSetX::codepoints() const
+{
+    std::vector<char32_t> ret;
+    for(size_t i = 0; i < m_pages.size(); ++i)
+    {
+        uint16_t page = m_pages[i];
+        if(page == 0xFFFF)
+            continue;
+
+        for(size_t w = 0; w < 4; ++w)
+        {
+            for(uint64_t bits = m_bits[page * 4 + w]; bits; bits &= bits - 1)
+            {
+                char32_t bit = 0;
+                while(!((bits >> bit) & 1))
+                    ++bit;
+                ret.push_back(char32_t((i << 8) | (w << 6)) | bit);
+            }
+        }
+    }
+    return ret;
+}
+
+/*
+   Collects codepoints of the UTF-16BE string. The characters below U+0100 are
+   checked four at a time: when the high bytes of the four units (the even bytes
+   of the big-endian data) are all zero, the low bytes are marked in the
+   \a latin1 bitmap directly without decoding. Unpaired surrogates are ignored.
+ */
+static void scanUtf16be(const uint8_t *data, size_t bytes, uint64_t latin1[4], QmCodepointSetX &set)
+{
+    static const uint8_t highBytes[8] = {0xFF, 0, 0xFF, 0, 0xFF, 0, 0xFF, 0};
+    uint64_t highMask;
+    std::memcpy(&highMask, highBytes, sizeof(highMask));
+
+    const uint8_t *p = data;
+    const uint8_t *end = data + (bytes & ~size_t(1));
+
+    while(p < end)
+    {
+        if(end - p >= 8)
+        {
+            uint64_t word;
+            std::memcpy(&word, p, sizeof(word));
+            if((word & highMask) == 0)
+            {
+                latin1[p[1] >> 6] |= uint64_t(1) << (p[1] & 63);
+                latin1[p[3] >> 6] |= uint64_t(1) << (p[3] & 63);
+                latin1[p[5] >> 6] |= uint64_t(1) << (p[5] & 63);
+                latin1[p[7] >> 6] |= uint64_t(1) << (p[7] & 63);
+                p += 8;
+                continue;
+            }
+        }
+
+        char32_t ch = read16be(p);
+        p += 2;
+
+        if(ch < 0x100)
+            latin1[ch >> 6] |= uint64_t(1) << (ch & 63);
+        else if(ch >= 0xD800 && ch <= 0xDBFF)
+        {
+            if(p < end)
+            {
+                char32_t low = read16be(p);
+                if(low >= 0xDC00 && low <= 0xDFFF)
+                {
+                    p += 2;
+                    set.insert(((ch - 0xD800) << 10) + (low - 0xDC00) + 0x10000);
+                }
+            }
+        }
+        else if(ch < 0xDC00 || ch > 0xDFFF)
+            set.insert(ch);
+    }
+}
+
+static void scanRecord(const QmRecordX &record, uint64_t latin1[4], QmCodepointSetX &set)
+{
+    for(uint32_t i = 0; i < record.translations; ++i)
+    {
+        const uint8_t *data;
+        uint32_t len;
+        if(recordTranslation(record, i, &data, &len))
+            scanUtf16be(data, len, latin1, set);
+    }
+}
+
+void QmTranslatorX::scanCodepoints(QmCodepointSetX &set) const
+{
+    const uint8_t *messageData = messageArray();
+    uint64_t latin1[4] = {0, 0, 0, 0};
+    const size_t count = messagesCount();
+    const size_t partsCount = splitParts(count, g_loadThreads.load(std::memory_order_relaxed));
+
+    if(messageData)
+    {
+        // Records are stored back to back, so they are scanned in sequential passes,
+        // one per part of the "Messages" block. The parts are split at the records
+        // the "Hashes" block points to, so every thread scans the whole records.
+        std::vector<uint32_t> begins(partsCount + 1, m_messageLength);
+        begins[0] = 0;
+        for(size_t i = 0; i < count && partsCount > 1; ++i)
+        {
+            const uint32_t offset = read32be(m_offsetArray + i * 8 + 4);
+            for(size_t part = 1; part < partsCount; ++part)
+            {
+                if(offset >= partBegin(m_messageLength, part, partsCount) && offset < begins[part])
+                    begins[part] = offset;
+            }
+        }
+
+        std::vector<QmCodepointSetX> partSets(partsCount);
+        std::vector<uint64_t> partLatin1(partsCount * 4, 0);
+        std::vector<uint8_t> partComplete(partsCount, 0);
+        runParts(partsCount, [messageData, &begins, &partSets, &partLatin1, &partComplete](size_t part)
+        {
+            const uint8_t *m = messageData + begins[part];
+            const uint8_t *end = messageData + begins[part + 1];
+            uint64_t bits[4] = {0, 0, 0, 0};
+            QmRecordX record;
+
+            while(m < end && readRecord(m, end, record))
+            {
+                scanRecord(record, bits, partSets[part]);
+                m = record.end;
+            }
+            std::copy(bits, bits + 4, partLatin1.begin() + part * 4);
+            partComplete[part] = m == end;
+        });
+
+        bool complete = true;
+        for(size_t part = 0; part < partsCount; ++part)
+        {
+            set.unite(partSets[part]);
+            for(size_t i = 0; i < 4; ++i)
+                latin1[i] |= partLatin1[part * 4 + i];
+            complete = complete && partComplete[part];
+        }
+
+        // Walk the "Hashes" block instead if the block has unknown tags
+        if(!complete)
+        {
+            for(const QmMessageViewX &message : messages())
+            {
+                for(uint32_t i = 0; i < message.translationsCount; ++i)
+                {
+                    QmStringViewX data = message.translationData(i);
+                    scanUtf16be(reinterpret_cast<const uint8_t *>(data.data), data.size, latin1, set);
+                }
+            }
+        }
+    }
+
+    for(char32_t ch = 0; ch < 0x100; ++ch)
+    {
+        if((latin1[ch >> 6] >> (ch & 63)) & 1)
+            set.insert(ch);
+    }
+}
+
+const QmCodepointSetX &QmTranslatorX::codepoints()
+{
+    if(m_codepoints)
+        return *m_codepoints;
+
+    if(!m_ownCodepoints)
+    {
+        m_ownCodepoints.reset(new QmCodepointSetX);
+        scanCodepoints(*m_ownCodepoints);
+    }
+
+    m_codepoints.reset(new QmCodepointSetX(*m_ownCodepoints));
+    for(QmTranslatorX *sub : m_subTranslators)
+        m_codepoints->unite(sub->codepoints());
+
+    return *m_codepoints;
+}
+
+
+/*
+   Strings are addressed by the FNV-1a hash of the UTF-16 code units, so the
+   catalog data is hashed in place and gets decoded only once
+ */
+static const size_t g_pool_shards = 16;
+
+struct QmStringPoolX::Shard
+{
+    struct Entry
+    {
+        std::u16string str;
+        // Catalogs (and other callers of the intern*()) holding the string
+        size_t refs;
+    };
+
+    std::mutex mutex;
+    std::unordered_multimap<uint64_t, std::unique_ptr<Entry> > strings;
+    size_t bytes;
+    size_t requests;
+    size_t hits;
+    size_t savedBytes;
+
+    Shard() : bytes(0), requests(0), hits(0), savedBytes(0) {}
+
+    const std::u16string &add(uint64_t h, std::u16string &&str)
+    {
+        std::unique_ptr<Entry> stored(new Entry);
+        stored->str = std::move(str);
+        stored->refs = 1;
+        bytes += stored->str.size() * sizeof(char16_t);
+        return strings.insert(std::make_pair(h, std::move(stored)))->second->str;
+    }
+};
+
+QmStringPoolX::QmStringPoolX() :
+    m_shards(new Shard[g_pool_shards])
+{}
+
+QmStringPoolX::~QmStringPoolX()
+{}
+
+QmStringPoolX &QmStringPoolX::global()
+{
+    // Never destroyed: the static translators release their strings at the exit
+    static QmStringPoolX *pool = new QmStringPoolX;
+    return *pool;
+}
+
+const std::u16string &QmStringPoolX::intern(const std::u16string &str)
+{
+    const uint64_t h = poolHash(str);
+    Shard &shard = m_shards[h % g_pool_shards];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.requests++;
+
+    auto range = shard.strings.equal_range(h);
+    for(auto it = range.first; it != range.second; ++it)
+    {
+        if(it->second->str == str)
+        {
+            it->second->refs++;
+            shard.hits++;
+            shard.savedBytes += str.size() * sizeof(char16_t);
+            return it->second->str;
+        }
+    }
+
+    return shard.add(h, std::u16string(str));
+}
+
+const std::u16string &QmStringPoolX::internUtf16be(const uint8_t *data, size_t bytes)
+{
+    const uint64_t h = poolHashUtf16be(data, bytes);
+    Shard &shard = m_shards[h % g_pool_shards];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.requests++;
+
+    auto range = shard.strings.equal_range(h);
+    for(auto it = range.first; it != range.second; ++it)
+    {
+        if(equalsUtf16be(it->second->str, data, bytes))
+        {
+            it->second->refs++;
+            shard.hits++;
+            shard.savedBytes += (bytes / 2) * sizeof(char16_t);
+            return it->second->str;
+        }
+    }
+
+    return shard.add(h, fromUtf16be(data, bytes));
+}
+
+void QmStringPoolX::release(const std::u16string &str)
+{
+    const uint64_t h = poolHash(str);
+    Shard &shard = m_shards[h % g_pool_shards];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    auto range = shard.strings.equal_range(h);
+    for(auto it = range.first; it != range.second; ++it)
+    {
+        if(&it->second->str != &str)
+            continue;
+        if(--it->second->refs == 0)
+        {
+            shard.bytes -= str.size() * sizeof(char16_t);
+            shard.strings.erase(it);
+        }
+        return;
+    }
+}
+
+QmStringPoolX::Stats QmStringPoolX::stats() const
+{
+    Stats ret = {0, 0, 0, 0, 0};
+    for(size_t i = 0; i < g_pool_shards; ++i)
+    {
+        Shard &shard = m_shards[i];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        ret.strings += shard.strings.size();
+        ret.bytes += shard.bytes;
+        ret.requests += shard.requests;
+        ret.hits += shard.hits;
+        ret.savedBytes += shard.savedBytes;
+    }
+    return ret;
+}
+
+
+/*
+   The lookup index cache file (all numbers are big-endian):
+
+   magic[8], version u32, reserved u32, then the size, the modification time
+   and the content hash of the qm-file and the hash of the sections (u64 each).
+   Sections follow as the tag u8, the length u32 and the data.
+ */
+static const uint8_t g_cache_magic[8] = {'Q', 'm', 'X', 'I', 'n', 'd', 'e', 'x'};
+static const uint32_t g_cache_version = 1;
+static const size_t g_cache_headerSize = 48;
+
+enum CacheSections
+{
+    CacheSection_PerfectHash = 1,
+    CacheSection_Codepoints = 2
+};
+
+static bool isValidPerfectHash(const uint8_t *data, size_t len)
+{
+    if(len < g_phash_headerSize)
+        return false;
+    uint64_t slotsCount = read32be(data + 4);
+    uint64_t bucketsCount = read32be(data + 8);
+    return slotsCount && bucketsCount &&
+           len == g_phash_headerSize + (bucketsCount << 2) + (slotsCount << 3);
+}
+
+bool QmTranslatorX::buildIndex()
+{
+    const uint8_t *messageData = messageArray();
+    if(m_perfectHashLength)
+        return true;
+    if(!m_offsetArray || !messageData)
+        return false;
+
+    stopPrewarm();
+
+    // Every thread reads the records of its part of the "Hashes" block
+    const unsigned threadsCount = g_loadThreads.load(std::memory_order_relaxed);
+    const size_t count = messagesCount();
+    const size_t partsCount = splitParts(count, threadsCount);
+    std::vector<PerfectHashKey> keys(count);
+    std::atomic<bool> failed(false);
+    runParts(partsCount, [this, messageData, &keys, &failed, count, partsCount](size_t part)
+    {
+        const size_t last = partBegin(count, part + 1, partsCount);
+        for(size_t i = partBegin(count, part, partsCount); i < last; ++i)
+        {
+            uint32_t offset = read32be(m_offsetArray + i * 8 + 4);
+            QmRecordX record;
+            // Without the keys the hash can't tell the messages apart
+            if(offset >= m_messageLength ||
+               !readRecord(messageData + offset, messageData + m_messageLength, record) ||
+               !record.context || !record.sourceText || !record.comment)
+            {
+                failed.store(true, std::memory_order_relaxed);
+                return;
+            }
+
+            PerfectHashKey &k = keys[i];
+            k.context = record.context;
+            k.contextLength = record.contextLength;
+            k.sourceText = record.sourceText;
+            k.sourceTextLength = record.sourceTextLength;
+            k.comment = record.comment;
+            k.commentLength = record.commentLength;
+            k.offset = offset;
+        }
+    });
+    if(failed.load(std::memory_order_relaxed))
+        return false;
+
+    std::vector<uint8_t> index;
+    if(!buildPerfectHash(keys, index, threadsCount))
+        return false;
+
+    m_indexData.swap(index);
+    m_perfectHashArray = m_indexData.data();
+    m_perfectHashLength = uint32_t(m_indexData.size());
+    // The perfect hash rejects the absent keys by itself
+    m_keyFilter.reset();
+    return true;
+}
+
+bool QmTranslatorX::loadFileCached(const char *filePath, const char *cacheFile, uint8_t *directory)
+{
+    if(!loadFile(filePath, directory))
+        return false;
+
+    uint64_t size, mtime;
+    if(!cacheFile || !fileStamp(filePath, &size, &mtime) || size != m_fileLength)
+        return true;
+
+    uint64_t hash = contentHash(m_fileData, m_fileLength);
+    if(readIndexCache(cacheFile, size, mtime, hash))
+        return true;
+
+    // Build what the cache keeps, a failure only means the slower lookups
+    buildIndex();
+    m_ownCodepoints.reset(new QmCodepointSetX);
+    scanCodepoints(*m_ownCodepoints);
+    writeIndexCache(cacheFile, size, mtime, hash);
+
+    return true;
+}
+
+bool QmTranslatorX::readIndexCache(const char *cacheFile, uint64_t size, uint64_t mtime, uint64_t hash)
+{
+    FILE *file = openFile(cacheFile, "rb");
+    if(!file)
+        return false;
+
+    std::vector<uint8_t> data;
+    uint8_t buffer[4096];
+    size_t got;
+    while((got = std::fread(buffer, 1, sizeof(buffer), file)) > 0)
+        data.insert(data.end(), buffer, buffer + got);
+    std::fclose(file);
+
+    if(data.size() < g_cache_headerSize ||
+       std::memcmp(data.data(), g_cache_magic, sizeof(g_cache_magic)) != 0 ||
+       read32be(data.data() + 8) != g_cache_version ||
+       read64be(data.data() + 16) != size ||
+       read64be(data.data() + 24) != mtime ||
+       read64be(data.data() + 32) != hash ||
+       read64be(data.data() + 40) != contentHash(data.data() + g_cache_headerSize,
+                                                 data.size() - g_cache_headerSize))
+        return false;
+
+    const uint8_t *perfectHash = nullptr;
+    size_t perfectHashLength = 0;
+    std::unique_ptr<QmCodepointSetX> codepoints;
+
+    const uint8_t *d = data.data() + g_cache_headerSize;
+    const uint8_t *end = data.data() + data.size();
+    while(end - d >= 5)
+    {
+        uint8_t tag = read8(d);
+        uint32_t len = read32be(d + 1);
+        d += 5;
+        if(uint32_t(end - d) < len)
+            return false;
+
+        if(tag == CacheSection_PerfectHash)
+        {
+            if(!isValidPerfectHash(d, len))
+                return false;
+            perfectHash = d;
+            perfectHashLength = len;
+        }
+        else if(tag == CacheSection_Codepoints)
+        {
+            // Pages count u32, then the page number u16 and four bit words u64 per page
+            if(len < 4 || len != 4 + size_t(read32be(d)) * 34)
+                return false;
+
+            codepoints.reset(new QmCodepointSetX);
+            const uint32_t pages = read32be(d);
+            codepoints->m_pages.assign((QmCodepointSetX::maxCodepoint >> 8) + 1, 0xFFFF);
+            codepoints->m_bits.resize(size_t(pages) * 4);
+            for(uint32_t i = 0; i < pages; ++i)
+            {
+                const uint8_t *p = d + 4 + size_t(i) * 34;
+                uint16_t page = read16be(p);
+                if(page >= codepoints->m_pages.size() || codepoints->m_pages[page] != 0xFFFF)
+                    return false;
+                codepoints->m_pages[page] = uint16_t(i);
+                for(size_t w = 0; w < 4; ++w)
+                    codepoints->m_bits[i * 4 + w] = read64be(p + 2 + w * 8);
+            }
+        }
+        d += len;
+    }
+
+    if(!codepoints)
+        return false;
+
+    // The perfect hash is used right from the cache data
+    if(perfectHash && !m_perfectHashLength)
+    {
+        const size_t offset = size_t(perfectHash - data.data());
+        m_indexData.swap(data);
+        m_perfectHashArray = m_indexData.data() + offset;
+        m_perfectHashLength = uint32_t(perfectHashLength);
+        m_keyFilter.reset();
+    }
+
+    m_ownCodepoints = std::move(codepoints);
+    return true;
+}
+
+bool QmTranslatorX::writeIndexCache(const char *cacheFile, uint64_t size, uint64_t mtime, uint64_t hash)
+{
+    std::vector<uint8_t> out(g_cache_headerSize, 0);
+    std::memcpy(out.data(), g_cache_magic, sizeof(g_cache_magic));
+    write32be(out.data() + 8, g_cache_version);
+    write64be(out.data() + 16, size);
+    write64be(out.data() + 24, mtime);
+    write64be(out.data() + 32, hash);
+
+    // Only the perfect hash built at runtime, the one of the qm-file is there anyway
+    if(!m_indexData.empty() && m_perfectHashLength)
+    {
+        out.push_back(CacheSection_PerfectHash);
+        out.resize(out.size() + 4);
+        write32be(out.data() + out.size() - 4, m_perfectHashLength);
+        out.insert(out.end(), m_perfectHashArray, m_perfectHashArray + m_perfectHashLength);
+    }
+
+    if(m_ownCodepoints)
+    {
+        const QmCodepointSetX &set = *m_ownCodepoints;
+        const uint32_t pages = uint32_t(set.m_bits.size() / 4);
+        out.push_back(CacheSection_Codepoints);
+        out.resize(out.size() + 8 + size_t(pages) * 34);
+        uint8_t *o = out.data() + out.size() - 8 - size_t(pages) * 34;
+        write32be(o, 4 + pages * 34);
+        write32be(o + 4, pages);
+        o += 8;
+        for(size_t page = 0; page < set.m_pages.size(); ++page)
+        {
+            uint16_t i = set.m_pages[page];
+            if(i == 0xFFFF)
+                continue;
+            uint8_t *p = o + size_t(i) * 34;
+            write16be(p, uint16_t(page));
+            for(size_t w = 0; w < 4; ++w)
+                write64be(p + 2 + w * 8, set.m_bits[size_t(i) * 4 + w]);
+        }
+    }
+
+    write64be(out.data() + 40, contentHash(out.data() + g_cache_headerSize, out.size() - g_cache_headerSize));
+
+    // Write the temporary file first, so the readers never see a partial cache
+    std::string tmp = std::string(cacheFile) + ".tmp";
+    FILE *file = openFile(tmp.c_str(), "wb");
+    if(!file)
+        return false;
+
+    bool ok = std::fwrite(out.data(), 1, out.size(), file) == out.size();
+    ok = (std::fclose(file) == 0) && ok;
+    if(!ok || !replaceFile(tmp.c_str(), cacheFile))
+    {
+        std::remove(tmp.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+
+struct RelayoutRecord
+{
+    uint32_t    offset;
+    uint32_t    length;
+    uint32_t    newOffset;
+    std::string context;
+    uint64_t    hits;
+};
+
+static void appendLayoutBlock(std::vector<uint8_t> &layout, const uint8_t *block, uint32_t length,
+                              size_t *offset)
+{
+    *offset = layout.size();
+    if(block)
+        layout.insert(layout.end(), block, block + length);
+}
+
+bool QmTranslatorX::relayout(const QmAccessProfileX *profile)
+{
+    const uint8_t *messageData = messageArray();
+    if(!m_offsetArray || !messageData)
+        return false;
+
+    stopPrewarm();
+
+    // The records without keys are matched to the profile by the hash
+    std::unordered_map<uint32_t, uint64_t> hashHits;
+    if(profile)
+    {
+        for(const QmAccessProfileX::Entry &e : profile->entries())
+            hashHits[elfHash((e.sourceText + e.comment).c_str())] += e.count;
+    }
+
+    std::vector<RelayoutRecord> records;
+    std::unordered_map<uint32_t, size_t> byOffset;
+    records.reserve(m_offsetLength / 8);
+
+    for(uint32_t i = 0; i + 8 <= m_offsetLength; i += 8)
+    {
+        const uint32_t hash = read32be(m_offsetArray + i);
+        const uint32_t ro = read32be(m_offsetArray + i + 4);
+        QmRecordX record;
+        if(ro >= m_messageLength ||
+           !readRecord(messageData + ro, messageData + m_messageLength, record))
+            return false;
+
+        std::pair<std::unordered_map<uint32_t, size_t>::iterator, bool> r =
+            byOffset.insert(std::make_pair(ro, records.size()));
+        if(r.second)
+        {
+            RelayoutRecord rec;
+            rec.offset = ro;
+            rec.length = uint32_t(record.end - record.begin);
+            rec.newOffset = 0;
+            rec.context.assign(reinterpret_cast<const char *>(record.context), record.contextLength);
+            rec.hits = 0;
+            records.push_back(rec);
+        }
+
+        uint64_t hits = 0;
+        if(profile && record.sourceText)
+        {
+            std::string context(reinterpret_cast<const char *>(record.context), record.contextLength);
+            std::string sourceText(reinterpret_cast<const char *>(record.sourceText), record.sourceTextLength);
+            std::string comment(reinterpret_cast<const char *>(record.comment), record.commentLength);
+            hits = profile->count(context, sourceText, comment);
+        }
+        else if(profile)
+        {
+            std::unordered_map<uint32_t, uint64_t>::const_iterator it = hashHits.find(hash);
+            if(it != hashHits.end())
+                hits = it->second;
+        }
+
+        RelayoutRecord &rec = records[r.first->second];
+        rec.hits = std::max(rec.hits, hits);
+    }
+
+    std::unordered_map<std::string, uint64_t> contextHits;
+    for(const RelayoutRecord &rec : records)
+        contextHits[rec.context] += rec.hits;
+
+    std::vector<size_t> order(records.size());
+    for(size_t i = 0; i < order.size(); ++i)
+        order[i] = i;
+    std::sort(order.begin(), order.end(), [&records, &contextHits](size_t ia, size_t ib)
+    {
+        const RelayoutRecord &a = records[ia];
+        const RelayoutRecord &b = records[ib];
+        if(a.context != b.context)
+        {
+            uint64_t ha = contextHits[a.context], hb = contextHits[b.context];
+            if(ha != hb)
+                return ha > hb;
+            return a.context < b.context;
+        }
+        if(a.hits != b.hits)
+            return a.hits > b.hits;
+        return a.offset < b.offset;
+    });
+
+    // All blocks go into the new buffer, so the file data can be freed
+    std::vector<uint8_t> layout;
+    size_t offsetsAt, messagesAt, contextsAt, numerusAt, perfectHashAt;
+    layout.reserve(size_t(m_offsetLength) + m_messageLength + m_contextLength +
+                   m_numerusRulesLength + m_perfectHashLength);
+
+    appendLayoutBlock(layout, m_offsetArray, m_offsetLength, &offsetsAt);
+    messagesAt = layout.size();
+    for(size_t i : order)
+    {
+        RelayoutRecord &rec = records[i];
+        rec.newOffset = uint32_t(layout.size() - messagesAt);
+        layout.insert(layout.end(), messageData + rec.offset, messageData + rec.offset + rec.length);
+    }
+    const uint32_t messageLength = uint32_t(layout.size() - messagesAt);
+    appendLayoutBlock(layout, m_contextArray, m_contextLength, &contextsAt);
+    appendLayoutBlock(layout, m_numerusRulesArray, m_numerusRulesLength, &numerusAt);
+    appendLayoutBlock(layout, m_perfectHashArray, m_perfectHashLength, &perfectHashAt);
+
+    for(uint32_t i = 0; i + 8 <= m_offsetLength; i += 8)
+    {
+        uint8_t *entry = layout.data() + offsetsAt + i;
+        write32be(entry + 4, records[byOffset[read32be(entry + 4)]].newOffset);
+    }
+
+    if(m_perfectHashLength)
+    {
+        uint8_t *ph = layout.data() + perfectHashAt;
+        uint8_t *slot = ph + g_phash_headerSize + (size_t(read32be(ph + 8)) << 2);
+        for(; slot < ph + m_perfectHashLength; slot += 8)
+        {
+            std::unordered_map<uint32_t, size_t>::const_iterator it = byOffset.find(read32be(slot + 4));
+            // Slots of the missing records point past the messages and never match
+            write32be(slot + 4, it != byOffset.end() ? records[it->second].newOffset : 0xFFFFFFFF);
+        }
+    }
+
+    m_layoutData.swap(layout);
+    m_offsetArray = m_layoutData.data() + offsetsAt;
+    m_messageArray = m_layoutData.data() + messagesAt;
+    m_messageLength = messageLength;
+    if(m_contextArray)
+        m_contextArray = m_layoutData.data() + contextsAt;
+    if(m_numerusRulesArray)
+        m_numerusRulesArray = m_layoutData.data() + numerusAt;
+    if(m_perfectHashArray)
+        m_perfectHashArray = m_layoutData.data() + perfectHashAt;
+
+    m_indexData.clear();
+    m_packed.reset();
+    if(m_fileData)
+        std::free(m_fileData);
+    m_fileData = nullptr;
+    m_fileLength = 0;
+
+    m_generation = ++g_catalogGeneration;
+    // The packed ID-based catalog gets the index of IDs once it's unpacked
+    buildIdIndex();
+    buildKeyFilter();
+    resolveMessageIds();
+    return true;
+}
+
+
+void QmTranslatorX::setProfiling(uint32_t sampleRate)
+{
+    if(!m_recorder)
+    {
+        if(!sampleRate)
+            return;
+        m_recorder.reset(new Recorder);
+    }
+    m_recorder->sampleRate.store(sampleRate, std::memory_order_relaxed);
+}
+
+uint32_t QmTranslatorX::profilingRate() const
+{
+    return m_recorder ? m_recorder->sampleRate.load(std::memory_order_relaxed) : 0;
+}
+
+QmTranslatorX::Recorder::Log *QmTranslatorX::Recorder::threadLog()
+{
+    struct Pin
+    {
+        uint64_t serial;
+        Log *log;
+    };
+    static thread_local Pin pin = {0, nullptr};
+    if(pin.serial == serial)
+        return pin.log;
+
+    const std::thread::id self = std::this_thread::get_id();
+    Log *log = logs.load(std::memory_order_acquire);
+    while(log && log->owner != self)
+        log = log->next;
+
+    if(!log)
+    {
+        // Logs are only added while the recorder lives, so the list is walked without locking
+        log = new Log;
+        log->next = logs.load(std::memory_order_relaxed);
+        while(!logs.compare_exchange_weak(log->next, log, std::memory_order_release, std::memory_order_relaxed))
+        {}
+    }
+
+    pin.serial = serial;
+    pin.log = log;
+    return log;
+}
+
+void QmTranslatorX::recordLookup(const char *context, const char *sourceText, const char *comment)
+{
+    const uint32_t rate = m_recorder->sampleRate.load(std::memory_order_relaxed);
+    if(!rate)
+        return;
+
+    // Shared by all translators of the thread, that's enough for sampling
+    static thread_local uint32_t countdown = 0;
+    if(countdown > 0 && countdown < rate)
+    {
+        --countdown;
+        return;
+    }
+    countdown = rate - 1;
+
+    if(context == 0)
+        context = "";
+    if(sourceText == 0)
+        sourceText = "";
+    if(comment == 0)
+        comment = "";
+
+    // The keys are told apart by their 64-bit hashes, only the new key of the thread gets copied
+    Recorder::Log *log = m_recorder->threadLog();
+    const uint64_t h = phashKey(context, sourceText, comment, 0);
+    Recorder::Key *k;
+    std::unordered_map<uint64_t, Recorder::Key *>::const_iterator it = log->index.find(h);
+    if(it != log->index.end())
+        k = it->second;
+    else
+    {
+        std::string key(context);
+        key.push_back('\0');
+        key.append(sourceText);
+        key.push_back('\0');
+        key.append(comment);
+
+        k = new Recorder::Key(h, std::move(key));
+        log->index[h] = k;
+        k->next = log->keys.load(std::memory_order_relaxed);
+        log->keys.store(k, std::memory_order_release);
+    }
+    k->count.store(k->count.load(std::memory_order_relaxed) + rate, std::memory_order_relaxed);
+}
+
+QmAccessProfileX QmTranslatorX::accessProfile() const
+{
+    QmAccessProfileX profile;
+    if(!m_recorder)
+        return profile;
+
+    std::lock_guard<std::mutex> lock(m_recorder->mutex);
+    for(Recorder::Log *log = m_recorder->logs.load(std::memory_order_acquire); log; log = log->next)
+    {
+        for(Recorder::Key *k = log->keys.load(std::memory_order_acquire); k; k = k->next)
+        {
+            const uint64_t count = k->count.load(std::memory_order_relaxed) - k->cleared;
+            if(!count)
+                continue;
+            const std::string &key = k->key;
+            size_t sourceAt = key.find('\0') + 1;
+            size_t commentAt = key.find('\0', sourceAt) + 1;
+            profile.add(key.substr(0, sourceAt - 1),
+                        key.substr(sourceAt, commentAt - sourceAt - 1),
+                        key.substr(commentAt), count);
+        }
+    }
+    return profile;
+}
+
+bool QmTranslatorX::saveAccessProfile(const char *filePath) const
+{
+    return accessProfile().saveFile(filePath);
+}
+
+void QmTranslatorX::clearAccessProfile()
+{
+    if(!m_recorder)
+        return;
+
+    // The keys stay for the threads still counting them, only the counts so far are dropped
+    std::lock_guard<std::mutex> lock(m_recorder->mutex);
+    for(Recorder::Log *log = m_recorder->logs.load(std::memory_order_acquire); log; log = log->next)
+    {
+        for(Recorder::Key *k = log->keys.load(std::memory_order_acquire); k; k = k->next)
+            k->cleared = k->count.load(std::memory_order_relaxed);
+    }
+}
+
+
+QmTranslatorX::Misses::Ring *QmTranslatorX::Misses::threadRing()
+{
+    struct Pin
+    {
+        uint64_t serial;
+        Ring *ring;
+    };
+    static thread_local Pin pin = {0, nullptr};
+    if(pin.serial == serial)
+        return pin.ring;
+
+    const std::thread::id self = std::this_thread::get_id();
+    Ring *ring = rings.load(std::memory_order_acquire);
+    while(ring && ring->owner != self)
+        ring = ring->next;
+
+    if(!ring)
+    {
+        // Rings are only added while the collector lives, so the list is walked without locking
+        ring = new Ring(ringBytes);
+        ring->next = rings.load(std::memory_order_relaxed);
+        while(!rings.compare_exchange_weak(ring->next, ring, std::memory_order_release, std::memory_order_relaxed))
+        {}
+    }
+
+    pin.serial = serial;
+    pin.ring = ring;
+    return ring;
+}
+
+void QmTranslatorX::Misses::put(const char *context, const char *sourceText, const char *comment)
+{
+    const uint64_t hash = phashKey(context, sourceText, comment, 0);
+    Ring *ring = threadRing();
+    uint64_t &seen = ring->seen[hash & (Ring::seenSize - 1)];
+    if(seen == hash)
+        return;
+
+    const size_t contextLength = std::strlen(context) + 1;
+    const size_t sourceTextLength = std::strlen(sourceText) + 1;
+    const size_t commentLength = std::strlen(comment) + 1;
+    const size_t keyLength = contextLength + sourceTextLength + commentLength;
+    const size_t recordSize = (12 + keyLength + 3) & ~size_t(3);
+    const size_t capacity = ring->data.size();
+
+    size_t head = ring->head.load(std::memory_order_relaxed);
+    const size_t tail = ring->tail.load(std::memory_order_acquire);
+    const size_t skip = capacity - head % capacity < recordSize ? capacity - head % capacity : 0;
+
+    // The full ring drops the key, it's put again after the drain frees the space
+    if(head + skip + recordSize - tail > capacity)
+    {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    if(skip)
+    {
+        const uint32_t mark = Ring::wrapMark;
+        std::memcpy(ring->data.data() + head % capacity, &mark, 4);
+        head += skip;
+    }
+
+    uint8_t *r = ring->data.data() + head % capacity;
+    const uint32_t length = uint32_t(keyLength);
+    std::memcpy(r, &length, 4);
+    std::memcpy(r + 4, &hash, 8);
+    std::memcpy(r + 12, context, contextLength);
+    std::memcpy(r + 12 + contextLength, sourceText, sourceTextLength);
+    std::memcpy(r + 12 + contextLength + sourceTextLength, comment, commentLength);
+
+    ring->head.store(head + recordSize, std::memory_order_release);
+    seen = hash;
+}
+
+size_t QmTranslatorX::Misses::drain(const std::function<void(const char *, const char *, const char *)> &func)
+{
+    std::lock_guard<std::mutex> lock(drainMutex);
+    size_t count = 0;
+
+    for(Ring *ring = rings.load(std::memory_order_acquire); ring; ring = ring->next)
+    {
+        const size_t capacity = ring->data.size();
+        const size_t head = ring->head.load(std::memory_order_acquire);
+        size_t tail = ring->tail.load(std::memory_order_relaxed);
+
+        while(tail != head)
+        {
+            const uint8_t *r = ring->data.data() + tail % capacity;
+            uint32_t length;
+            std::memcpy(&length, r, 4);
+            if(length == Ring::wrapMark)
+            {
+                tail += capacity - tail % capacity;
+                continue;
+            }
+
+            uint64_t hash;
+            std::memcpy(&hash, r + 4, 8);
+            if(drained.insert(hash).second)
+            {
+                const char *context = reinterpret_cast<const char *>(r + 12);
+                const char *sourceText = context + std::strlen(context) + 1;
+                const char *comment = sourceText + std::strlen(sourceText) + 1;
+                if(func)
+                    func(context, sourceText, comment);
+                ++count;
+            }
+            tail += (12 + length + 3) & ~size_t(3);
+        }
+
+        ring->tail.store(tail, std::memory_order_release);
+    }
+
+    return count;
+}
+
+void QmTranslatorX::Misses::startDrain(uint32_t intervalMs, const std::function<void()> &job)
+{
+    stopDrain();
+    if(!intervalMs || !job)
+        return;
+
+    stop = false;
+    drainThread = std::thread([this, intervalMs, job]()
+    {
+        // The last drain runs on stop, so the keys missed before it aren't lost
+        std::unique_lock<std::mutex> lock(waitMutex);
+        while(!stop)
+        {
+            wake.wait_for(lock, std::chrono::milliseconds(intervalMs), [this]() { return stop; });
+            lock.unlock();
+            job();
+            lock.lock();
+        }
+    });
+}
+
+void QmTranslatorX::Misses::stopDrain()
+{
+    if(!drainThread.joinable())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(waitMutex);
+        stop = true;
+    }
+    wake.notify_all();
+    drainThread.join();
+}
+
+/*
+   Adds the drained keys to the access profile file, the count of the
+   key is the number of the drains (the program runs) which missed it
+ */
+bool QmTranslatorX::Misses::drainToFile(const std::string &filePath)
+{
+    QmAccessProfileX profile;
+    const size_t count = drain([&profile](const char *context, const char *sourceText, const char *comment)
+    {
+        profile.add(context, sourceText, comment);
+    });
+    if(!count)
+        return true;
+
+    QmAccessProfileX saved;
+    if(saved.loadFile(filePath.c_str()))
+        profile.merge(saved);
+    return profile.saveFile(filePath.c_str());
+}
+
+void QmTranslatorX::setMissCollector(size_t ringBytes)
+{
+    m_misses.reset(ringBytes ? new Misses(ringBytes) : nullptr);
+}
+
+bool QmTranslatorX::isCollectingMisses() const
+{
+    return m_misses != nullptr;
+}
+
+size_t QmTranslatorX::drainMisses(const std::function<void(const char *context, const char *sourceText,
+                                                           const char *comment)> &func)
+{
+    return m_misses ? m_misses->drain(func) : 0;
+}
+
+bool QmTranslatorX::drainMisses(const char *filePath)
+{
+    if(!m_misses || !filePath)
+        return false;
+    return m_misses->drainToFile(filePath);
+}
+
+void QmTranslatorX::setMissDrain(uint32_t intervalMs,
+                                 const std::function<void(const char *context, const char *sourceText,
+                                                          const char *comment)> &func)
+{
+    if(!m_misses)
+        return;
+    Misses *misses = m_misses.get();
+    m_misses->startDrain(intervalMs, func ? std::function<void()>([misses, func]() { misses->drain(func); })
+                                          : std::function<void()>());
+}
+
+void QmTranslatorX::setMissDrain(uint32_t intervalMs, const char *filePath)
+{
+    if(!m_misses)
+        return;
+    Misses *misses = m_misses.get();
+    const std::string path(filePath ? filePath : "");
+    m_misses->startDrain(intervalMs, filePath ? std::function<void()>([misses, path]() { misses->drainToFile(path); })
+                                              : std::function<void()>());
+}
+
+uint64_t QmTranslatorX::droppedMisses() const
+{
+    return m_misses ? m_misses->dropped.load(std::memory_order_relaxed) : 0;
+}
+
+void QmTranslatorX::recordMiss(const char *context, const char *sourceText, const char *comment)
+{
+    m_misses->put(context ? context : "", sourceText ? sourceText : "", comment ? comment : "");
+}
+
+
+static void appendUtf16be(std::string &out, uint32_t ch)
+{
+    if(ch >= 0x10000)
+    {
+        ch -= 0x10000;
+        appendUtf16be(out, 0xD800 + (ch >> 10));
+        appendUtf16be(out, 0xDC00 + (ch & 0x3FF));
+        return;
+    }
+    out.push_back(char(ch >> 8));
+    out.push_back(char(ch & 0xFF));
+}
+
+/*
+   Decodes one character of UTF-8, the malformed bytes are taken as Latin-1
+ */
+static uint32_t readUtf8(const char *&str)
+{
+    const uint8_t *s = reinterpret_cast<const uint8_t *>(str);
+    uint32_t ch = *s;
+    int extra = ch >= 0xF0 ? 3 : ch >= 0xE0 ? 2 : ch >= 0xC0 ? 1 : 0;
+    uint32_t value = extra == 3 ? ch & 0x07 : extra == 2 ? ch & 0x0F : ch & 0x1F;
+    for(int i = 1; i <= extra; ++i)
+    {
+        if((s[i] & 0xC0) != 0x80)
+        {
+            extra = 0;
+            break;
+        }
+        value = (value << 6) | (s[i] & 0x3F);
+    }
+    str += extra + 1;
+    return extra ? value : ch;
+}
+
+static const uint16_t g_pseudoAccents[2][26] =
+{
+    {
+        0x00C5, 0x0181, 0x00C7, 0x0110, 0x00C9, 0x0191, 0x011C, 0x0124, 0x00CE, 0x0134, 0x0136, 0x0139, 0x1E40,
+        0x00D1, 0x00D6, 0x00DE, 0x01EA, 0x0154, 0x0160, 0x0162, 0x00DC, 0x1E7C, 0x0174, 0x1E8A, 0x00DD, 0x017D
+    },
+    {
+        0x00E0, 0x0180, 0x00E7, 0x0111, 0x00E9, 0x0192, 0x011D, 0x0125, 0x00EE, 0x0135, 0x0137, 0x013A, 0x0271,
+        0x00F1, 0x00F6, 0x00FE, 0x01EB, 0x0155, 0x0161, 0x0163, 0x00FC, 0x1E7D, 0x0175, 0x1E8B, 0x00FD, 0x017E
+    }
+};
+
+/*
+   Length of the placeholder which must stay untouched: %1, %L1, %n, %%,
+   printf-like %5.2f, HTML tags and entities
+ */
+static size_t pseudoPlaceholder(const char *s)
+{
+    const char *e = s + 1;
+    if(*s == '%')
+    {
+        if(*e == '%' || *e == 'n')
+            return 2;
+        if(*e == 'L')
+            ++e;
+        if(*e >= '0' && *e <= '9')
+        {
+            while(*e >= '0' && *e <= '9')
+                ++e;
+            return size_t(e - s);
+        }
+        e = s + 1;
+        while(*e && std::strchr("-+ #0123456789.lh", *e))
+            ++e;
+        if(*e && std::strchr("sdiuxXcpfeEgG", *e))
+            return size_t(e - s + 1);
+    }
+    else if(*s == '<')
+    {
+        while(*e && *e != '>' && *e != '<')
+            ++e;
+        if(*e == '>')
+            return size_t(e - s + 1);
+    }
+    else if(*s == '&')
+    {
+        while(std::isalnum(uint8_t(*e)) || *e == '#')
+            ++e;
+        if(*e == ';' && e > s + 1)
+            return size_t(e - s + 1);
+    }
+    return 0;
+}
+
+static void pseudoTranslate(const char *sourceText, int32_t form, const QmPseudoLocaleX &settings,
+                            std::string &out)
+{
+    uint32_t length = 0;
+
+    if(settings.bidi)
+        appendUtf16be(out, 0x202B); // RIGHT-TO-LEFT EMBEDDING
+    if(settings.brackets)
+        appendUtf16be(out, '[');
+
+    for(const char *s = sourceText; *s;)
+    {
+        size_t placeholder = pseudoPlaceholder(s);
+        if(placeholder)
+        {
+            for(size_t i = 0; i < placeholder; ++i)
+                appendUtf16be(out, uint8_t(*s++));
+            length += uint32_t(placeholder);
+            continue;
+        }
+
+        uint32_t ch = readUtf8(s);
+        if(settings.accents && ((ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z')))
+            ch = g_pseudoAccents[ch >= 'a'][(ch | 0x20) - 'a'];
+        appendUtf16be(out, ch);
+        ++length;
+    }
+
+    uint32_t padding = uint32_t((uint64_t(length) * settings.expansion + 99) / 100);
+    if(padding)
+        appendUtf16be(out, ' ');
+    for(uint32_t i = 1; i < padding; ++i)
+        appendUtf16be(out, settings.surrogates && (i & 1) ? 0x1D4D0 + (i % 26) : 0x00B7);
+
+    if(form >= 0)
+    {
+        appendUtf16be(out, '{');
+        for(char c : std::to_string(form))
+            appendUtf16be(out, uint8_t(c));
+        appendUtf16be(out, '}');
+    }
+
+    if(settings.brackets)
+        appendUtf16be(out, ']');
+    if(settings.bidi)
+        appendUtf16be(out, 0x202C); // POP DIRECTIONAL FORMATTING
+}
+
+void QmTranslatorX::setPseudoLocale(const QmPseudoLocaleX *settings)
+{
+    if(!settings)
+    {
+        m_pseudoLocale.reset();
+        return;
+    }
+
+    if(!m_pseudoLocale)
+        m_pseudoLocale.reset(new PseudoLocale);
+    m_pseudoLocale->settings = *settings;
+    m_pseudoLocale->serial = ++g_pseudoSerial;
+}
+
+bool QmTranslatorX::findPseudo(const char *sourceText, int32_t n, QmStringViewX &translation)
+{
+    if(!sourceText)
+        return false;
+
+    const QmPseudoLocaleX &settings = m_pseudoLocale->settings;
+    int32_t form = -1;
+    if(n >= 0)
+    {
+        if(m_numerusRulesLength)
+            form = int32_t(numerusHelper(n, m_numerusRulesArray, m_numerusRulesLength));
+        else if(settings.pluralForms > 1)
+            form = n == 1 ? 0 : int32_t(1 + uint32_t(n) % (settings.pluralForms - 1));
+        else
+            form = 0;
+    }
+
+    uint64_t h = phashStart(0);
+    phashContinue(h, sourceText);
+    h = phashMix(h ^ uint32_t(form));
+
+    PseudoSlot &slot = g_pseudoSlots[h % g_pseudoSlotsCount];
+    if(slot.serial != m_pseudoLocale->serial || slot.hash != h || slot.form != form ||
+       slot.sourceText != sourceText)
     {
-        std::u16string tn = translator->do_translate(context, sourceText, comment, n);
-        if(!tn.empty())
-            return tn;
+        slot.serial = m_pseudoLocale->serial;
+        slot.hash = h;
+        slot.form = form;
+        slot.sourceText.assign(sourceText);
+        slot.translation.clear();
+        pseudoTranslate(sourceText, form, settings, slot.translation);
     }
-    return std::u16string();
+
+    // The slot keeps the data until the next lookup of this thread replaces it
+    translation = QmStringViewX(slot.translation.data(), uint32_t(slot.translation.size()));
+    return true;
 }
 
-std::string QmTranslatorX::do_translate8(const char *context, const char *sourceText, const char *comment, int32_t n)
-{
-    std::u16string str  = do_translate(context, sourceText, comment, n);
-    std::string outstr;
 
-    qmTr_ConvertUTF16toUTF8(str, outstr, lenientConversion);
+void QmTranslatorX::bindMessageIds(const QmMessageKeyX *keys, size_t count)
+{
+    if(!keys || !count)
+    {
+        m_messageIds.reset();
+        return;
+    }
 
-    return outstr;
+    if(!m_messageIds)
+        m_messageIds.reset(new MessageIds);
+    m_messageIds->keys = keys;
+    m_messageIds->count = count;
+    resolveMessageIds();
 }
 
-std::u32string QmTranslatorX::do_translate32(const char *context, const char *sourceText, const char *comment, int32_t n)
+/*
+   The smallest numbers choosing every plural form by the numerus rules,
+   -1 for the forms which no number chooses
+ */
+static std::vector<int32_t> pluralFormNumbers(const uint8_t *rules, uint32_t rulesLength)
 {
-    std::u16string str = do_translate(context, sourceText, comment, n);
-    std::u32string outstr;
-
-    qmTr_ConvertUTF16toUTF32(str, outstr, lenientConversion);
+    std::vector<int32_t> formNumbers(1, 1);
+    if(!rulesLength)
+        return formNumbers;
 
-    return outstr;
+    formNumbers.clear();
+    for(int32_t n = 0; n < 1000; ++n)
+    {
+        uint32_t form = numerusHelper(n, rules, rulesLength);
+        if(form < 64 && form >= formNumbers.size())
+            formNumbers.resize(form + 1, -1);
+        if(form < 64 && formNumbers[form] < 0)
+            formNumbers[form] = n;
+    }
+    return formNumbers;
 }
 
-bool QmTranslatorX::loadFile(const char *filePath, uint8_t *directory)
+void QmTranslatorX::resolveMessageIds()
 {
-    uint8_t magicBuffer[g_qm_magicLength];
-    size_t  fileGotLen = 0;
-
-    if(m_fileData)
-        close();
-
-#ifndef _WIN32
-    FILE *file = std::fopen(filePath, "rb");
-#else
-    wchar_t filePathW[MAX_PATH + 1];
+    if(!m_messageIds)
+        return;
+
+    MessageIds &ids = *m_messageIds;
+    ids.clear();
+    if(isEmpty() && m_fallbacks.empty())
+        return;
+
+    // The resolved translations must stay in place, the packed catalogs get unpacked
+    unpackAll();
+    for(QmTranslatorX *fallback : m_fallbacks)
+        fallback->unpackAll();
+
+    // Every catalog of the lookup chooses the plural form by its own numerus rules
+    std::unordered_map<const QmTranslatorX *, std::vector<int32_t> > formNumbers;
+    std::vector<const QmTranslatorX *> pending(1, this);
+    pending.insert(pending.end(), m_fallbacks.begin(), m_fallbacks.end());
+    while(!pending.empty())
     {
-        size_t utf8len  = std::strlen(filePath);
-        size_t utf16len = MAX_PATH;
-        utf16len = MultiByteToWideChar(CP_UTF8, 0,
-                                       filePath,  utf8len,
-                                       filePathW, MAX_PATH);
-        filePathW[utf16len] = L'\0';
+        const QmTranslatorX *catalog = pending.back();
+        pending.pop_back();
+        if(formNumbers.count(catalog))
+            continue;
+        formNumbers[catalog] = pluralFormNumbers(catalog->m_numerusRulesArray, catalog->m_numerusRulesLength);
+        pending.insert(pending.end(), catalog->m_subTranslators.begin(), catalog->m_subTranslators.end());
     }
-    FILE *file = _wfopen(filePathW, L"rb");
-#endif
-    if(!file)
-        return false;//err("Can't open file!", 2);
 
-    if(std::fread(magicBuffer, 1, g_qm_magicLength, file) < g_qm_magicLength)
+    // The lookups only read the catalogs, so the threads resolve their parts of the IDs
+    const size_t partsCount = splitParts(ids.count, g_loadThreads.load(std::memory_order_relaxed));
+    std::vector<std::unique_ptr<IdResolve> > parts(partsCount);
+    runParts(partsCount, [this, &ids, &formNumbers, &parts, partsCount](size_t part)
     {
-        std::fclose(file);
-        return false;//err("ERROR READING MAGIC NUMBER!!!", 3);
-    }
+        std::unique_ptr<IdResolve> resolve(new IdResolve(formNumbers));
+        const size_t begin = partBegin(ids.count, part, partsCount);
+        const size_t last = partBegin(ids.count, part + 1, partsCount);
+        resolve->ownersCount.reserve(last - begin);
+        for(size_t id = begin; id < last; ++id)
+        {
+            const size_t ownersBefore = resolve->owners.size();
+            resolveIdOwners(ids.keys[id], *resolve);
+            for(QmTranslatorX *fallback : m_fallbacks)
+                fallback->resolveIdOwners(ids.keys[id], *resolve);
+            resolve->ownersCount.push_back(uint32_t(resolve->owners.size() - ownersBefore));
+        }
+        parts[part] = std::move(resolve);
+    });
 
-    if(std::memcmp(magicBuffer, g_qm_magic, g_qm_magicLength) != 0)
+    ids.first.reserve(ids.count + 1);
+    for(const std::unique_ptr<IdResolve> &resolve : parts)
     {
-        std::fclose(file);
-        return false;//err("MAGIC NUMBER DOESN'T CASE!", 4);
+        const uint32_t formsBefore = uint32_t(ids.forms.size());
+        size_t o = 0;
+        for(uint32_t count : resolve->ownersCount)
+        {
+            ids.first.push_back(uint32_t(ids.owners.size()));
+            for(uint32_t i = 0; i < count; ++i, ++o)
+            {
+                MessageIds::Owner owner = resolve->owners[o];
+                owner.firstForm += formsBefore;
+                ids.owners.push_back(owner);
+            }
+        }
+        ids.forms.insert(ids.forms.end(), resolve->forms.begin(), resolve->forms.end());
     }
+    ids.first.push_back(uint32_t(ids.owners.size()));
 
-    std::fseek(file, 0L, SEEK_END);
+    for(QmTranslatorX *fallback : m_fallbacks)
+        ids.fallbackGenerations.push_back(fallback->m_generation);
+}
 
-    long fileLength = std::ftell(file);
-    if(fileLength < 0)
+/*
+   Adds this catalog and then its dependencies to the owners of the key, if
+   they have the message. Every plural form of the catalog is resolved by the
+   smallest number choosing it, so the lookup by the ID takes the same
+   translation as the lookup by the key for any number.
+ */
+void QmTranslatorX::resolveIdOwners(const QmMessageKeyX &key, IdResolve &resolve)
+{
+    // Same as findOwn(): the context absent in the contexts table skips the dependencies too
+    if(m_offsetLength && !m_perfectHashLength && m_contextLength && !hasContext(key.context ? key.context : ""))
+        return;
+
+    const std::vector<int32_t> &formNumbers = resolve.formNumbers.at(this);
+    MessageIds::Owner owner;
+    owner.catalog = this;
+    owner.firstForm = uint32_t(resolve.forms.size());
+    owner.formsCount = key.numerus ? uint32_t(formNumbers.size()) : 1;
+
+    bool found = false;
+    for(uint32_t form = 0; form < owner.formsCount; ++form)
     {
-        std::fclose(file);
-        return false;//err("FAIL TO SEEK END!", 4);
+        const uint8_t *tn = nullptr;
+        uint32_t tnLength = 0;
+        const int32_t n = key.numerus ? formNumbers[form] : -1;
+        if(!(key.numerus && n < 0) &&
+           findOwn(key.context, key.sourceText, key.comment, n, &tn, &tnLength, false))
+        {
+            resolve.forms.push_back(QmStringViewX(reinterpret_cast<const char *>(tn), tnLength));
+            found = true;
+        }
+        else
+            resolve.forms.push_back(QmStringViewX());
     }
 
-    m_fileLength = static_cast<size_t>(fileLength);
-    std::fseek(file, 0L, SEEK_SET);
+    if(found)
+        resolve.owners.push_back(owner);
+    else
+        resolve.forms.resize(owner.firstForm);
 
-    m_fileData = reinterpret_cast<uint8_t *>(std::malloc(m_fileLength));
-    if(!m_fileData)
+    for(QmTranslatorX *sub : m_subTranslators)
+        sub->resolveIdOwners(key, resolve);
+}
+
+bool QmTranslatorX::findTranslationById(uint32_t id, int32_t n, QmStringViewX &translation)
+{
+    if(!m_messageIds || id >= m_messageIds->count)
+        return false;
+
+    const MessageIds &ids = *m_messageIds;
+    bool resolved = !m_recorder && !m_pseudoLocale && !ids.first.empty();
+    // The reloaded or reordered fallback has freed the resolved translations
+    for(size_t i = 0; resolved && i < ids.fallbackGenerations.size(); ++i)
+        resolved = m_fallbacks[i]->m_generation == ids.fallbackGenerations[i];
+    if(!resolved)
     {
-        std::fclose(file);
-        return false;//err("OUT OF MEMORY!", 5);
+        const QmMessageKeyX &key = ids.keys[id];
+        return findTranslation(key.context, key.sourceText, key.comment, n, translation);
     }
-    fileGotLen = std::fread(m_fileData, 1, m_fileLength, file);
-    std::fclose(file);
-    m_fileLength = fileGotLen;
-    return loadDataPrivate(m_fileData, m_fileLength, directory);
+
+    // Like the lookup by key, the missing plural form means there is no translation in that catalog
+    for(uint32_t o = ids.first[id]; o < ids.first[id + 1]; ++o)
+    {
+        const MessageIds::Owner &owner = ids.owners[o];
+        const uint32_t numerus = n >= 0 ? numerusHelper(n, owner.catalog->m_numerusRulesArray,
+                                                        owner.catalog->m_numerusRulesLength) : 0;
+        if(numerus < owner.formsCount)
+        {
+            translation = ids.forms[owner.firstForm + numerus];
+            if(translation.size != 0)
+                return true;
+        }
+    }
+
+    if(m_misses)
+        recordMiss(ids.keys[id].context, ids.keys[id].sourceText, ids.keys[id].comment);
+    return false;
 }
 
-bool QmTranslatorX::loadData(const uint8_t *data, size_t len, uint8_t *directory)
+template<class String>
+static String translateByIdAs(QmTranslatorX &translator, uint32_t id, int32_t n)
 {
-    if(!data || len == 0)
-        return false;
-    if(m_fileData)
-        close();
+    typedef typename String::value_type CharT;
+    String outstr;
+    QmStringViewX tn;
+    if(!translator.findTranslationById(id, n, tn))
+        return outstr;
+
+    QmAppendSinkX<String> sink(outstr);
+    qmTranscodeX<CharT>(reinterpret_cast<const uint8_t *>(tn.data), tn.size, sink);
+    return outstr;
+}
 
-    m_fileData = reinterpret_cast<uint8_t *>(std::malloc(len));
-    if(!m_fileData)
-        return false;//err("OUT OF MEMORY!", 5);
-    std::memcpy(m_fileData, data, len);
-    m_fileLength = len;
-    return loadDataPrivate(m_fileData, m_fileLength, directory);
+std::string QmTranslatorX::translateById8(uint32_t id, int32_t n)
+{
+    return translateByIdAs<std::string>(*this, id, n);
 }
 
-bool QmTranslatorX::loadDataPrivate(uint8_t *data, size_t len, uint8_t *directory)
+std::u16string QmTranslatorX::translateById(uint32_t id, int32_t n)
 {
-    std::vector<std::string> dependencies;
-    bool ok = true;
-    const uint8_t *end = data + len;
+    return translateByIdAs<std::u16string>(*this, id, n);
+}
 
-    data += g_qm_magicLength;
-    while(data < end - 4)
+std::u32string QmTranslatorX::translateById32(uint32_t id, int32_t n)
+{
+    return translateByIdAs<std::u32string>(*this, id, n);
+}
+
+
+/*
+   Detects the catalog compiled with -idbased: every record has the source
+   text (the ID) and neither context nor comment. Then indexes the IDs.
+ */
+void QmTranslatorX::buildIdIndex()
+{
+    m_idIndex.reset();
+    // The packed catalogs keep the regular lookups not to get unpacked on load
+    if(!m_offsetArray || !m_messageArray || m_offsetLength < 8)
+        return;
+
+    std::unique_ptr<IdIndex> index(new IdIndex);
+    uint32_t size = 16;
+    while(size < (m_offsetLength / 8) * 2)
+        size <<= 1;
+    IdIndex::Slot empty = {0, 0, 0, IdIndex::NoRecord, 0, 0};
+    index->slots.assign(size, empty);
+    index->mask = size - 1;
+
+    // The records get parsed and hashed by the threads, one part of the
+    // "Hashes" block each, then the slots get inserted in the block order
+    const size_t count = messagesCount();
+    const size_t partsCount = splitParts(count, g_loadThreads.load(std::memory_order_relaxed));
+    std::vector<IdIndex::Slot> parsed(count);
+    std::atomic<bool> failed(false);
+    runParts(partsCount, [this, &parsed, &failed, count, partsCount](size_t part)
     {
-        uint8_t  tag = read8(data++);
-        uint32_t blockLen = read32be(data);
-        data += 4;
-        if(!tag || !blockLen)
-            break;
-        if(uint32_t(end - data) < blockLen)
+        const size_t last = partBegin(count, part + 1, partsCount);
+        for(size_t i = partBegin(count, part, partsCount); i < last; ++i)
         {
-            ok = false;
-            break;
-        }
+            const uint32_t ro = read32be(m_offsetArray + i * 8 + 4);
+            QmRecordX record;
+            if(ro >= m_messageLength ||
+               !readRecord(m_messageArray + ro, m_messageArray + m_messageLength, record) ||
+               !record.sourceText || record.contextLength || record.commentLength)
+            {
+                failed.store(true, std::memory_order_relaxed);
+                return;
+            }
 
-        if(tag == QTranslatorEntryTypes::Contexts)
-        {
-            m_contextArray = data;
-            m_contextLength = blockLen;
-#ifdef QMTRANSLATPR_DEEP_DEBUG
-            printf("Has contexts array!\n");
-#endif
-        }
-        else if(tag == QTranslatorEntryTypes::Hashes)
-        {
-            m_offsetArray = data;
-            m_offsetLength = blockLen;
-#ifdef QMTRANSLATPR_DEEP_DEBUG
-            printf("Has hashes! %i\n", offsetLength);
-#endif
-        }
-        else if(tag == QTranslatorEntryTypes::Messages)
-        {
-            m_messageArray = data;
-            m_messageLength = blockLen;
-#ifdef QMTRANSLATPR_DEEP_DEBUG
-            printf("Has messages! %i\n", messageLength);
-#endif
-        }
-        else if(tag == QTranslatorEntryTypes::NumerusRules)
-        {
-            m_numerusRulesArray = data;
-            m_numerusRulesLength = blockLen;
-#ifdef QMTRANSLATPR_DEEP_DEBUG
-            printf("Has numerus rules! %i\n", numerusRulesLength);
-#endif
+            IdIndex::Slot &slot = parsed[i];
+            slot.hash = IdIndex::hash(reinterpret_cast<const char *>(record.sourceText), record.sourceTextLength);
+            slot.id = uint32_t(record.sourceText - m_messageArray);
+            slot.idLength = record.sourceTextLength;
+            slot.record = ro;
+            slot.translation = 0;
+            slot.translationLength = 0;
+            const uint8_t *tn;
+            if(recordTranslation(record, 0, &tn, &slot.translationLength))
+                slot.translation = uint32_t(tn - m_messageArray);
         }
-        else if(tag == QTranslatorEntryTypes::Dependencies)
+    });
+    if(failed.load(std::memory_order_relaxed))
+        return;
+
+    for(const IdIndex::Slot &slot : parsed)
+    {
+        // The first record of the ID wins, like in the Hashes block order
+        uint32_t s = slot.hash & index->mask;
+        for(;; s = (s + 1) & index->mask)
         {
-            std::string dep;
-            uint8_t *end   = data + blockLen;
-            while(blockLen != 0)
+            IdIndex::Slot &o = index->slots[s];
+            if(o.record == IdIndex::NoRecord)
             {
-                uint8_t *begin = data;
-                while((data != end) && (*data != '\0'))
-                    data++;
-
-                std::string::size_type gotLen = std::string::size_type(data - begin);
-
-                //Avoid infinite loop if got len is zero or larger than left bytes block
-                if((gotLen == 0) || (gotLen > blockLen))
-                {
-#ifdef QMTRANSLATPR_DEEP_DEBUG
-                    printf("Dependencies tag loop: INFINITE LOOP DETECTED!\n");
-#endif
-                    break;
-                }
-
-                dep = std::string(reinterpret_cast<char *>(begin), gotLen);
-                if(dep.size() > 0)
-                {
-                    //List of dependent files
-                    dependencies.push_back(dep);
-#ifdef QMTRANSLATPR_DEEP_DEBUG
-                    printf("Dependency: %s\n", dep.c_str());
-#endif
-                }
-                blockLen -= gotLen;
+                o = slot;
+                break;
             }
-#ifdef QMTRANSLATPR_DEEP_DEBUG
-            printf("Had deps!\n");
-#endif
+            if(o.hash == slot.hash && o.idLength == slot.idLength &&
+               std::memcmp(m_messageArray + o.id, m_messageArray + slot.id, slot.idLength) == 0)
+                break;
         }
-        data += blockLen;
     }
 
-    if(dependencies.empty() && (!m_offsetArray || !m_messageArray))
-        ok = false;
+    m_idIndex = std::move(index);
+}
 
-#ifdef QMTRANSLATPR_DEEP_DEBUG
-    printf("Dependencies valid: %i\n", ok);
-#endif
+/*
+   Builds the Bloom filter of the keys from the "Hashes" block alone, so
+   the records aren't read and the packed catalogs stay packed
+ */
+void QmTranslatorX::buildKeyFilter()
+{
+    m_keyFilter.reset();
+    // The perfect hash rejects the absent keys by one probe already, while the index
+    // of IDs only serves the lookups by IDs and the others still go through the hashes
+    const size_t count = messagesCount();
+    if(!count || m_perfectHashLength)
+        return;
+
+    std::unique_ptr<KeyFilter> filter(new KeyFilter(count));
+    for(size_t i = 0; i < count; ++i)
+        filter->insert(read32be(m_offsetArray + i * 8));
+    m_keyFilter = std::move(filter);
+}
 
-    if(ok && !isValidNumerusRules(m_numerusRulesArray, m_numerusRulesLength))
-        ok = false;
+bool QmTranslatorX::isIdBased() const
+{
+    return m_idIndex != nullptr;
+}
 
-#ifdef QMTRANSLATPR_DEEP_DEBUG
-    printf("Numerus rules valid: %i\n", ok);
-#endif
+bool QmTranslatorX::findOwnId(const char *id, int32_t n, const uint8_t **translation, uint32_t *translationLength)
+{
+    if(!m_idIndex)
+        return findOwn("", id, "", n, translation, translationLength);
 
-    //Process loading of sub-translators
-    if(ok)
+    const size_t len = std::strlen(id);
+    const uint32_t hash = IdIndex::hash(id, len);
+    const IdIndex &index = *m_idIndex;
+    for(uint32_t s = hash & index.mask;; s = (s + 1) & index.mask)
     {
-        const size_t dependenciesCount = dependencies.size();
-        m_subTranslators.reserve(dependenciesCount);
-        for(size_t i = 0 ; i < dependenciesCount; ++i)
+        const IdIndex::Slot &slot = index.slots[s];
+        if(slot.record == IdIndex::NoRecord)
+            break;
+        if(slot.hash != hash || slot.idLength != len ||
+           std::memcmp(m_messageArray + slot.id, id, len) != 0)
+            continue;
+
+        bool found = true;
+        if(n < 0 || !m_numerusRulesLength)
         {
-            QmTranslatorX *translator = new QmTranslatorX;
-            m_subTranslators.push_back(translator);
-            ok = translator->loadFile(dependencies[i].c_str(), directory);
-            if(!ok)
-                break;
+            *translation = m_messageArray + slot.translation;
+            *translationLength = slot.translationLength;
         }
-
-        // In case some dependencies fail to load, unload all the other ones too.
-        if(!ok)
+        else
         {
-            for(QmTranslatorX *it : m_subTranslators)
-                delete it;
-            m_subTranslators.clear();
+            QmRecordX record;
+            readRecord(m_messageArray + slot.record, m_messageArray + m_messageLength, record);
+            found = recordTranslation(record, numerusHelper(n, m_numerusRulesArray, m_numerusRulesLength),
+                                      translation, translationLength);
         }
+        if(found && *translationLength)
+            return true;
+        break;
     }
 
-    if(!ok)
+    for(QmTranslatorX *translator : m_subTranslators)
     {
-        m_messageArray    = 0;
-        m_contextArray    = 0;
-        m_offsetArray     = 0;
-        m_numerusRulesArray = 0;
-        m_messageLength   = 0;
-        m_contextLength   = 0;
-        m_offsetLength    = 0;
-        m_numerusRulesLength = 0;
-#ifdef QMTRANSLATPR_DEEP_DEBUG
-        printf("LOADING FAILED!\n");
-#endif
+        if(translator->findOwnId(id, n, translation, translationLength))
+            return true;
+    }
+    return false;
+}
+
+bool QmTranslatorX::findTranslationId(const char *id, int32_t n, QmStringViewX &translation)
+{
+    if(!id)
         return false;
+    if(m_recorder || m_pseudoLocale)
+        return findTranslation("", id, "", n, translation);
+
+    const uint8_t *tn;
+    uint32_t tnLength;
+    if(!findOwnId(id, n, &tn, &tnLength))
+    {
+        bool found = false;
+        for(size_t i = 0; i < m_fallbacks.size() && !found; ++i)
+            found = m_fallbacks[i]->findOwnId(id, n, &tn, &tnLength);
+        if(!found)
+        {
+            if(m_misses)
+                recordMiss("", id, "");
+            return false;
+        }
     }
-    else
+
+    translation = QmStringViewX(reinterpret_cast<const char *>(tn), tnLength);
+    return true;
+}
+
+std::string QmTranslatorX::translateId8(const char *id, int32_t n)
+{
+    QmStringViewX tn;
+    std::string out;
+    if(findTranslationId(id, n, tn))
     {
-#ifdef QMTRANSLATPR_DEEP_DEBUG
-        printf("LOADING PASSED!\n");
-#endif
-        return true;
+        QmAppendSinkX<std::string> sink(out);
+        qmTranscodeX<char>(reinterpret_cast<const uint8_t *>(tn.data), tn.size, sink);
     }
+    return out;
 }
 
-bool QmTranslatorX::isEmpty()
+std::u16string QmTranslatorX::translateId(const char *id, int32_t n)
 {
-    return !m_fileData && !m_fileLength && !m_messageArray &&
-           !m_offsetArray && !m_contextArray && m_subTranslators.empty();
+    QmStringViewX tn;
+    if(!findTranslationId(id, n, tn))
+        return std::u16string();
+    return fromUtf16be(reinterpret_cast<const uint8_t *>(tn.data), tn.size);
 }
 
-void QmTranslatorX::close()
+std::u32string QmTranslatorX::translateId32(const char *id, int32_t n)
 {
-    m_messageArray = nullptr;
-    m_contextArray = nullptr;
-    m_offsetArray = nullptr;
-    m_numerusRulesArray = nullptr;
-    m_messageLength = 0;
-    m_contextLength = 0;
-    m_offsetLength = 0;
-    m_numerusRulesLength = 0;
-    if(m_fileData)
-        std::free(m_fileData);
-    m_fileData = nullptr;
-    m_fileLength = 0;
-    for(QmTranslatorX *it : m_subTranslators)
-        delete it;
-    m_subTranslators.clear();
+    QmStringViewX tn;
+    std::u32string out;
+    if(findTranslationId(id, n, tn))
+    {
+        QmAppendSinkX<std::u32string> sink(out);
+        qmTranscodeX<char32_t>(reinterpret_cast<const uint8_t *>(tn.data), tn.size, sink);
+    }
+    return out;
 }
@@ -48,26 +48,369 @@
 
 #include <string>
 #include <vector>
+#include <iterator>
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <future>
+#include <atomic>
+
+#include "qm_transcode.h"
+#include "qm_profile.h"
+
+//! Catalog compiled into the executable by the qtranslatorx_embed_translations() CMake function
+struct QmEmbeddedCatalogX
+{
+    const char    *name;
+    const uint8_t *data;
+    size_t         size;
+};
+
+//! Key of the message with the dense ID, generated by qm_compiler -idheader
+struct QmMessageKeyX
+{
+    const char *context;
+    const char *sourceText;
+    const char *comment;
+    bool        numerus;
+};
+
+/**
+ * @brief Move-only string keeping short translations inside of the object
+ *
+ * Strings up to N characters don't touch the heap, longer ones take exactly
+ * as much memory as they need. The data is always null-terminated.
+ */
+template<typename CharT, size_t N = 24>
+class QmSmallStringX
+{
+    CharT  *m_data;
+    size_t  m_size;
+    CharT   m_buffer[N + 1];
+
+    void release()
+    {
+        if(m_data != m_buffer)
+            delete[] m_data;
+        m_data = m_buffer;
+        m_size = 0;
+        m_buffer[0] = 0;
+    }
+
+    void moveFrom(QmSmallStringX &o)
+    {
+        m_size = o.m_size;
+        if(o.m_data == o.m_buffer)
+        {
+            m_data = m_buffer;
+            std::char_traits<CharT>::copy(m_buffer, o.m_buffer, o.m_size + 1);
+        }
+        else
+        {
+            m_data = o.m_data;
+            o.m_data = o.m_buffer;
+        }
+        o.m_size = 0;
+        o.m_buffer[0] = 0;
+    }
+
+public:
+    typedef CharT value_type;
+    typedef const CharT *const_iterator;
+
+    QmSmallStringX() : m_data(m_buffer), m_size(0) { m_buffer[0] = 0; }
+    ~QmSmallStringX() { release(); }
+    QmSmallStringX(QmSmallStringX &&o) : m_data(m_buffer), m_size(0) { moveFrom(o); }
+    QmSmallStringX &operator=(QmSmallStringX &&o)
+    {
+        if(this != &o)
+        {
+            release();
+            moveFrom(o);
+        }
+        return *this;
+    }
+    QmSmallStringX(const QmSmallStringX &) = delete;
+    QmSmallStringX &operator=(const QmSmallStringX &) = delete;
+
+    //Make room for the len characters, returns the buffer to fill
+    CharT *allocate(size_t len)
+    {
+        release();
+        if(len > N)
+            m_data = new CharT[len + 1];
+        m_size = len;
+        m_data[len] = 0;
+        return m_data;
+    }
+
+    const CharT *data() const { return m_data; }
+    const CharT *c_str() const { return m_data; }
+    size_t size() const { return m_size; }
+    size_t length() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+    //Whether the string is stored inside of the object
+    bool isInline() const { return m_data == m_buffer; }
+    const_iterator begin() const { return m_data; }
+    const_iterator end() const { return m_data + m_size; }
+    const CharT &operator[](size_t i) const { return m_data[i]; }
+
+    std::basic_string<CharT> str() const { return std::basic_string<CharT>(m_data, m_size); }
+    operator std::basic_string<CharT>() const { return str(); }
+};
+
+typedef QmSmallStringX<char>     QmSmallString8X;
+typedef QmSmallStringX<char16_t> QmSmallString16X;
+typedef QmSmallStringX<char32_t> QmSmallString32X;
+
+//! Bytes inside of the catalog, not zero-terminated
+struct QmStringViewX
+{
+    const char *data;
+    size_t      size;
+
+    QmStringViewX() : data(nullptr), size(0) {}
+    QmStringViewX(const char *d, size_t s) : data(d), size(s) {}
+    bool empty() const { return size == 0; }
+    std::string toString() const { return std::string(data, size); }
+};
+
+//! Message of the loaded catalog, points into the catalog data
+class QmMessageViewX
+{
+    friend class QmMessageIteratorX;
+    const uint8_t *m_record;
+    const uint8_t *m_recordEnd;
+
+public:
+    //! Key fields are empty when the catalog was compiled with stripped keys
+    QmStringViewX context;
+    QmStringViewX sourceText;
+    QmStringViewX comment;
+    //! Hash of the source text and comment from the "Hashes" block
+    uint32_t      hash;
+    //! Offset of the record in the "Messages" block
+    uint32_t      offset;
+    //! Number of translations (more than one for plural forms)
+    uint32_t      translationsCount;
+
+    QmMessageViewX();
+
+    //Raw UTF-16BE data of the translation, size is in bytes
+    QmStringViewX  translationData(uint32_t index = 0) const;
+    std::u16string translation(uint32_t index = 0) const;
+    std::string    translation8(uint32_t index = 0) const;
+};
+
+//! Forward iterator over the messages of the catalog in the order of the "Hashes" block
+class QmMessageIteratorX
+{
+    const uint8_t  *m_entry;
+    const uint8_t  *m_entriesEnd;
+    const uint8_t  *m_messageArray;
+    uint32_t        m_messageLength;
+    QmMessageViewX  m_message;
+
+    void fetch();
+
+public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef QmMessageViewX            value_type;
+    typedef std::ptrdiff_t            difference_type;
+    typedef const QmMessageViewX     *pointer;
+    typedef const QmMessageViewX     &reference;
+
+    QmMessageIteratorX();
+    QmMessageIteratorX(const uint8_t *entry, const uint8_t *entriesEnd,
+                       const uint8_t *messageArray, uint32_t messageLength);
+
+    reference operator*() const { return m_message; }
+    pointer operator->() const { return &m_message; }
+    QmMessageIteratorX &operator++();
+    QmMessageIteratorX operator++(int);
+    bool operator==(const QmMessageIteratorX &o) const { return m_entry == o.m_entry; }
+    bool operator!=(const QmMessageIteratorX &o) const { return m_entry != o.m_entry; }
+};
+
+struct QmMessageRangeX
+{
+    QmMessageIteratorX first;
+    QmMessageIteratorX last;
+
+    QmMessageIteratorX begin() const { return first; }
+    QmMessageIteratorX end() const { return last; }
+};
+
+//! Set of Unicode codepoints, a bitmap of 256-codepoint pages allocated on demand
+class QmCodepointSetX
+{
+    friend class QmTranslatorX;
+
+    // Index of the page in m_bits for every 256 codepoints, 0xFFFF when the page is empty
+    std::vector<uint16_t> m_pages;
+    std::vector<uint64_t> m_bits;
+
+public:
+    static const char32_t maxCodepoint = 0x10FFFF;
+
+    void insert(char32_t codepoint);
+    bool contains(char32_t codepoint) const;
+    //Adds all codepoints of the other set
+    void unite(const QmCodepointSetX &other);
+    //Number of codepoints in the set
+    size_t count() const;
+    bool empty() const;
+    void clear();
+    //Sorted list of the codepoints
+    std::vector<char32_t> codepoints() const;
+};
+
+/**
+ * @brief Process-wide pool of decoded strings shared by all translators
+ *
+ * Every distinct string is stored once while it's referenced: intern() adds
+ * the reference to the string, release() drops it and the string is freed
+ * together with its last reference. The pool is split into the shards locked
+ * separately.
+ */
+class QmStringPoolX
+{
+public:
+    struct Stats
+    {
+        //! Distinct strings stored and the bytes they occupy
+        size_t strings;
+        size_t bytes;
+        //! Interning requests and those which found the string in the pool
+        size_t requests;
+        size_t hits;
+        //! Bytes which separate copies of the found strings would occupy
+        size_t savedBytes;
+    };
+
+    QmStringPoolX();
+    ~QmStringPoolX();
+
+    static QmStringPoolX &global();
+
+    const std::u16string &intern(const std::u16string &str);
+    //Intern the UTF-16BE data of the catalog, decoded only when it's not in the pool yet
+    const std::u16string &internUtf16be(const uint8_t *data, size_t bytes);
+    //Drop the reference added by the intern*(), the str must be the returned one
+    void release(const std::u16string &str);
+    Stats stats() const;
+
+private:
+    QmStringPoolX(const QmStringPoolX &) = delete;
+    QmStringPoolX &operator=(const QmStringPoolX &) = delete;
+
+    struct Shard;
+    std::unique_ptr<Shard[]> m_shards;
+};
+
+//! Settings of the pseudo-locale synthesized from the source texts (see QmTranslatorX::setPseudoLocale)
+struct QmPseudoLocaleX
+{
+    //! Length added to the translation, in percents of the source text length
+    uint32_t expansion;
+    //! Replace the Latin letters with the accented ones
+    bool accents;
+    //! Enclose the translation in brackets to reveal the truncated text
+    bool brackets;
+    //! Embed the translation as the right-to-left text
+    bool bidi;
+    //! Pad with the characters outside of the BMP (the surrogate pairs in UTF-16)
+    bool surrogates;
+    //! Plural forms used without the numerus rules of the loaded catalog: the form 0
+    //! for one item, others go in turn by the number of items
+    uint32_t pluralForms;
+
+    QmPseudoLocaleX() :
+        expansion(30), accents(true), brackets(true), bidi(false), surrogates(false),
+        pluralForms(2)
+    {}
+};
 
 class QmTranslatorX
 {
+    friend class QmCatalogDiffX;
+    friend class QmSearchIndexX;
+
     uint8_t  *m_fileData;
     size_t    m_fileLength;
 
     // Pointers and offsets into FileData[FileLength] array, or user
     // provided data array
-    uint8_t  *m_messageArray;
-    uint8_t  *m_offsetArray;
-    uint8_t  *m_contextArray;
-    uint8_t  *m_numerusRulesArray;
+    const uint8_t *m_messageArray;
+    const uint8_t *m_offsetArray;
+    const uint8_t *m_contextArray;
+    const uint8_t *m_numerusRulesArray;
+    const uint8_t *m_perfectHashArray;
     uint32_t  m_messageLength;
     uint32_t  m_offsetLength;
     uint32_t  m_contextLength;
     uint32_t  m_numerusRulesLength;
+    uint32_t  m_perfectHashLength;
     std::vector<QmTranslatorX *> m_subTranslators;
+    // Codepoints of all translations, computed on the first request
+    std::unique_ptr<QmCodepointSetX> m_codepoints;
+    // Codepoints of this catalog only (without dependencies)
+    std::unique_ptr<QmCodepointSetX> m_ownCodepoints;
+    // Lookup index built at runtime or read from the cache file
+    std::vector<uint8_t> m_indexData;
+    // Blocks of the catalog copied in the new order of messages by relayout()
+    std::vector<uint8_t> m_layoutData;
+    // Not owned catalogs of the fallback locales, in the order of priority
+    std::vector<QmTranslatorX *> m_fallbacks;
+    // Bounded lock-free table of the fallback catalogs which resolved the keys
+    // and of the keys absent from all of them
+    struct FallbackCache;
+    std::unique_ptr<FallbackCache> m_fallbackCache;
+    // Changes on every load, close and relayout of the catalog, so the translators having it
+    // as a fallback notice that their memo and their resolved message IDs point to the old data
+    uint64_t m_generation;
+    // Strings of the global pool returned by translateInterned(), released with the catalog,
+    // allocated by the first translateInterned()
+    struct Interned;
+    std::atomic<Interned *> m_interned;
+    // Catalog loaded in background, waiting to replace the current one
+    struct AsyncLoad;
+    std::unique_ptr<AsyncLoad> m_asyncLoad;
+    // Sampled keys of the lookups, kept across the catalog reloads
+    struct Recorder;
+    std::unique_ptr<Recorder> m_recorder;
+    // Keys of the lookups found nowhere, kept across the catalog reloads
+    struct Misses;
+    std::unique_ptr<Misses> m_misses;
+    // Background resolving of the contexts requested by prewarm()
+    struct Prewarm;
+    std::unique_ptr<Prewarm> m_prewarm;
+    // Settings and the translations of the pseudo-locale
+    struct PseudoLocale;
+    std::unique_ptr<PseudoLocale> m_pseudoLocale;
+    // Translations of the messages by the dense IDs
+    struct MessageIds;
+    std::unique_ptr<MessageIds> m_messageIds;
+    // Index of the catalogs compiled with -idbased, nullptr for others
+    struct IdIndex;
+    std::unique_ptr<IdIndex> m_idIndex;
+    // Bloom filter of the keys rejecting the lookups of the absent keys,
+    // nullptr for the catalogs with the perfect hash
+    struct KeyFilter;
+    std::unique_ptr<KeyFilter> m_keyFilter;
+    // Chunks of the packed "Messages" block and the cache of the unpacked ones,
+    // nullptr for the regular catalogs
+    struct Packed;
+    std::unique_ptr<Packed> m_packed;
 
 public:
     QmTranslatorX();
+    //Take over the loaded catalog, its dependencies and the settings of the other translator
+    //without copying the data, the other one is left empty. Translators having the other one
+    //as a fallback must be given this one. Don't move while other threads use the translators.
+    QmTranslatorX(QmTranslatorX &&other) noexcept;
+    QmTranslatorX &operator=(QmTranslatorX &&other) noexcept;
     virtual ~QmTranslatorX();
 
     //Return UTF-8 string
@@ -82,13 +425,236 @@ public:
     std::u32string do_translate32(const char *context, const char *sourceText,
                                   const char *comment = nullptr, int32_t n = -1);
 
+    //Write the translation into the sink (see qm_transcode.h) as the CharT units straight
+    //from the catalog, the encoding is chosen by the size of CharT. False if there is no translation.
+    //The sink may be a temporary (like qmAppendSinkX(str)). Only the transcoding is inlined,
+    //the lookup is the out-of-line findTranslation().
+    template<typename CharT, class Sink>
+    bool translate(Sink &&sink, const char *context, const char *sourceText,
+                   const char *comment = nullptr, int32_t n = -1);
+
+    //Return the translation as any string type (like std::wstring), allocated of the exact size
+    template<class String>
+    String translateAs(const char *context, const char *sourceText,
+                       const char *comment = nullptr, int32_t n = -1);
+
+    //Same as the do_translate*(), but the translations shorter than 25 characters
+    //are returned without the heap allocation
+    QmSmallString8X  translateSmall8(const char *context, const char *sourceText,
+                                     const char *comment = nullptr, int32_t n = -1);
+    QmSmallString16X translateSmall(const char *context, const char *sourceText,
+                                    const char *comment = nullptr, int32_t n = -1);
+    QmSmallString32X translateSmall32(const char *context, const char *sourceText,
+                                      const char *comment = nullptr, int32_t n = -1);
+
+    //Return the translation stored in the global string pool, identical translations of all
+    //catalogs share one copy. The reference stays valid until the catalog is closed or replaced.
+    const std::u16string &translateInterned(const char *context, const char *sourceText,
+                                            const char *comment = nullptr, int32_t n = -1);
+
+    //Find the raw UTF-16BE data of the translation (size is in bytes) without decoding it,
+    //the data stays valid until the catalog having it is closed. The data of the packed
+    //catalog (see isPacked) and of the pseudo-locale (see setPseudoLocale) stays valid until
+    //the next lookup made by the same thread.
+    bool findTranslation(const char *context, const char *sourceText, const char *comment,
+                         int32_t n, QmStringViewX &translation);
+
+    //Lookup by the ID of the catalog compiled with -idbased (like qtTrId), without the context and
+    //the comment handling. Such catalogs are detected at load and get the dedicated index of IDs,
+    //others are searched for the ID with the empty context and comment.
+    bool findTranslationId(const char *id, int32_t n, QmStringViewX &translation);
+    std::string    translateId8(const char *id, int32_t n = -1);
+    std::u16string translateId(const char *id, int32_t n = -1);
+    std::u32string translateId32(const char *id, int32_t n = -1);
+    //True if all messages of the catalog are keyed by the IDs only. The packed catalogs keep
+    //the regular lookups not to get unpacked at load, until relayout() unpacks them.
+    bool isIdBased() const;
+
+    //Use the dense message IDs of the header generated by qm_compiler -idheader: the keys get
+    //resolved once now and on every load of the catalog, then the lookup by ID is one array
+    //read. The keys must stay valid while bound, nullptr unbinds them. After a fallback catalog
+    //changes, the lookups by ID go by the key until setFallbacks() or bindMessageIds() is called.
+    void bindMessageIds(const QmMessageKeyX *keys, size_t count);
+    bool findTranslationById(uint32_t id, int32_t n, QmStringViewX &translation);
+    std::string    translateById8(uint32_t id, int32_t n = -1);
+    std::u16string translateById(uint32_t id, int32_t n = -1);
+    std::u32string translateById32(uint32_t id, int32_t n = -1);
+
     bool loadFile(const char *filePath, uint8_t *directory = nullptr);
     bool loadData(const uint8_t *data, size_t len, uint8_t *directory = nullptr);
+    //Use the data in place without copying, it must stay valid until close()
+    bool loadStaticData(const uint8_t *data, size_t len, uint8_t *directory = nullptr);
+    bool loadEmbedded(const QmEmbeddedCatalogX &catalog, uint8_t *directory = nullptr);
+    //Find the catalog by name in the null-terminated list and load it
+    bool loadEmbedded(const QmEmbeddedCatalogX *catalogs, const char *name, uint8_t *directory = nullptr);
+    //Load the qm-file and the lookup index (the perfect hash of the keys and the codepoints)
+    //saved into the cacheFile by the previous run. The cache is checked by the size, the
+    //modification time and the content hash of the qm-file, stale or damaged cache gets rebuilt.
+    bool loadFileCached(const char *filePath, const char *cacheFile, uint8_t *directory = nullptr);
+    //Build the perfect hash of the keys for the catalog compiled without it. Fails when
+    //the records have no keys (the catalog compiled with the -compress option).
+    bool buildIndex();
+    //Rewrite the "Messages" block grouped by context: the contexts and the messages looked up
+    //more often (by the profile, if given) go first, so the strings of one screen share the cache
+    //lines and pages. The catalog gets copied into the new buffer, the message views become invalid.
+    bool relayout(const QmAccessProfileX *profile = nullptr);
+
+    //Load the qm-file on the background thread, the current catalog keeps serving the translations
+    //until the new one is loaded and applied by the applyLoaded(). The callback gets called on the
+    //background thread. Waits for the previous asynchronous load if it's still running. The loads
+    //and the close() discard the pending result of the asynchronous load.
+    std::future<bool> loadFileAsync(const char *filePath, uint8_t *directory = nullptr,
+                                    const std::function<void(bool ok)> &callback = nullptr);
+    //Replace the current catalog with the one loaded asynchronously, if it's ready. The old catalog
+    //gets freed, so call it where no other thread translates (like at the start of the frame).
+    bool applyLoaded();
+    //Resolve all messages of the contexts on the background thread ahead of use: the key filter,
+    //the lookup tables and the records get touched (and the chunks of the packed catalog having
+    //the contexts get unpacked) the way the lookups read them, the translations get decoded for
+    //translateInterned(). The future gets the number of messages resolved. Records of the catalogs
+    //compiled with -compress have no context and can't be prewarmed. The next prewarm(), replacing,
+    //closing or reordering the catalog cancels the prewarm.
+    std::future<size_t> prewarm(const std::vector<std::string> &contexts);
+    //True if the catalog was compiled with qm_compiler -pack: the lookups unpack only the chunk
+    //of the "Messages" block having the record. Enumerating the messages, the dense message IDs,
+    //the codepoints, buildIndex() and relayout() unpack the whole block once.
+    bool isPacked() const;
+    //Memory for the unpacked chunks kept by every packed catalog, the least recently used
+    //chunks get dropped beyond it (1 MiB by default)
+    static void setPackedCacheLimit(size_t bytes);
+    //Threads building the indexes of the big catalogs: the ID index and the dense message IDs
+    //at load, buildIndex(), codepoints() and the unpacking of the packed catalogs. 0 (default)
+    //uses all CPU cores, 1 builds everything on the calling thread. The result is the same.
+    static void setLoadThreads(unsigned threadsCount);
     bool isEmpty();
     void close();
 
+    //Set the catalogs of the fallback locales (like "pt" and "en" for the "pt_BR"), those are
+    //searched in order when this catalog and its dependencies have no translation. The catalogs
+    //aren't owned and must stay alive while set. The chain is resolved once per key and
+    //remembered, call this again after loading other data into any of the fallbacks.
+    void setFallbacks(const std::vector<QmTranslatorX *> &fallbacks);
+    const std::vector<QmTranslatorX *> &fallbacks() const;
+
+    //Synthesize all translations from the source texts instead of looking them up (the
+    //pseudo-locale to test the layout and rendering), nullptr turns it off. The numerus rules
+    //of the loaded catalog are used, if any. Every thread caches the recently synthesized
+    //translations until the next call or close(). Don't call it while translating from other
+    //threads: the settings are read by the lookups without the lock.
+    void setPseudoLocale(const QmPseudoLocaleX *settings);
+
+    //Number of entries in the "Hashes" block of this catalog (without dependencies)
+    size_t messagesCount() const;
+    //All messages of this catalog, without dependencies
+    QmMessageRangeX messages() const;
+    //Message of the entry of the "Hashes" block, the empty view if the record is malformed
+    QmMessageViewX message(size_t index) const;
+    //The part of the messages split into the partsCount ranges of equal size
+    QmMessageRangeX messages(size_t part, size_t partsCount) const;
+    //Calls the function for every message from several threads (0 - by the number of CPU cores),
+    //the part is the index of the range processed by the thread
+    void forEachMessage(const std::function<void(const QmMessageViewX &message, size_t part)> &func,
+                        unsigned threadsCount = 0) const;
+
+    //Codepoints used by all translations of this catalog and its dependencies,
+    //computed in one pass on the first call and cached until close()
+    const QmCodepointSetX &codepoints();
+
+    //Record the keys of the lookups (found or not) into the access profile: every sampleRate-th
+    //lookup of every thread gets counted as sampleRate lookups, 0 pauses the recording. Enable
+    //it before translating from other threads, the recorded keys survive loading other catalogs.
+    void setProfiling(uint32_t sampleRate = 1);
+    uint32_t profilingRate() const;
+    //Keys recorded so far, for the relayout(), the -order context and -trim of qm_compiler
+    QmAccessProfileX accessProfile() const;
+    bool saveAccessProfile(const char *filePath) const;
+    void clearAccessProfile();
+
+    //Collect the keys of the lookups which found no translation in the catalog, its dependencies
+    //and the fallbacks. Every thread puts the keys into its own ring buffer of ringBytes without
+    //locking, skipping the keys it has already put; the full ring drops the keys until drained.
+    //The found translations cost nothing. Set it before translating from other threads, 0 stops.
+    void setMissCollector(size_t ringBytes = 64 * 1024);
+    bool isCollectingMisses() const;
+    //Pass the keys collected since the previous drain to the function, every key only once for
+    //the collector. Any thread may drain, the number of new keys is returned.
+    size_t drainMisses(const std::function<void(const char *context, const char *sourceText,
+                                                const char *comment)> &func);
+    //Add the new keys to the file of the access profile format, the count of the key is the
+    //number of drains that had it
+    bool drainMisses(const char *filePath);
+    //Drain every intervalMs on the background thread (and once more when stopped), 0 stops
+    void setMissDrain(uint32_t intervalMs, const std::function<void(const char *context, const char *sourceText,
+                                                                    const char *comment)> &func);
+    void setMissDrain(uint32_t intervalMs, const char *filePath);
+    //Number of the keys dropped by the full rings
+    uint64_t droppedMisses() const;
+
 private:
-    bool loadDataPrivate(uint8_t *data, size_t len, uint8_t *directory = nullptr);
+    QmTranslatorX(const QmTranslatorX &) = delete;
+    QmTranslatorX &operator=(const QmTranslatorX &) = delete;
+
+    void swapCatalog(QmTranslatorX &other);
+    const uint8_t *messageArray() const;
+    bool recordAt(uint32_t offset, const uint8_t **record, const uint8_t **recordEnd) const;
+    bool unpackedRecord(uint32_t offset, const uint8_t **record, const uint8_t **recordEnd) const;
+    void unpackAll();
+    void waitAsyncLoad();
+    void stopPrewarm();
+    bool findPseudo(const char *sourceText, int32_t n, QmStringViewX &translation);
+    void resolveMessageIds();
+    struct IdResolve;
+    void resolveIdOwners(const QmMessageKeyX &key, IdResolve &resolve);
+    bool hasContext(const char *context) const;
+    void buildIdIndex();
+    void buildKeyFilter();
+    bool findOwnId(const char *id, int32_t n, const uint8_t **translation, uint32_t *translationLength);
+    size_t prewarmMessages(const Prewarm &job);
+    Interned *internedStrings();
+    void recordLookup(const char *context, const char *sourceText, const char *comment);
+    void recordMiss(const char *context, const char *sourceText, const char *comment);
+    void scanCodepoints(QmCodepointSetX &set) const;
+    bool readIndexCache(const char *cacheFile, uint64_t size, uint64_t mtime, uint64_t hash);
+    bool writeIndexCache(const char *cacheFile, uint64_t size, uint64_t mtime, uint64_t hash);
+    bool findOwn(const char *context, const char *sourceText, const char *comment, int32_t n,
+                 const uint8_t **translation, uint32_t *translationLength, bool dependencies = true);
+    bool findFallback(const char *context, const char *sourceText, const char *comment, int32_t n,
+                      const uint8_t **translation, uint32_t *translationLength);
+    bool loadDataPrivate(const uint8_t *data, size_t len, uint8_t *directory = nullptr);
+    bool findPerfectHash(const char *context, const char *sourceText, const char *comment,
+                         uint32_t numerus, const uint8_t **translation, uint32_t *translationLength);
 };
 
+template<typename CharT, class Sink>
+bool QmTranslatorX::translate(Sink &&sink, const char *context, const char *sourceText,
+                              const char *comment, int32_t n)
+{
+    QmStringViewX tn;
+    if(!findTranslation(context, sourceText, comment, n, tn))
+        return false;
+
+    qmTranscodeX<CharT>(reinterpret_cast<const uint8_t *>(tn.data), tn.size, sink);
+    return true;
+}
+
+template<class String>
+String QmTranslatorX::translateAs(const char *context, const char *sourceText,
+                                  const char *comment, int32_t n)
+{
+    typedef typename String::value_type CharT;
+    String outstr;
+    QmStringViewX tn;
+    if(!findTranslation(context, sourceText, comment, n, tn))
+        return outstr;
+
+    const uint8_t *data = reinterpret_cast<const uint8_t *>(tn.data);
+    QmCountSinkX count;
+    qmTranscodeX<CharT>(data, tn.size, count);
+    outstr.reserve(count.size());
+    QmAppendSinkX<String> sink(outstr);
+    qmTranscodeX<CharT>(data, tn.size, sink);
+
+    return outstr;
+}
+
 #endif // QMTRANSLATORX_H
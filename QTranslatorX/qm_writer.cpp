@@ -0,0 +1,1379 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** Copyright (C) 2016-2020 Vitaly Novichkov <admin@wohlnet.ru>
+**
+** This file use a part of the QtCore module of the Qt Toolkit,
+** ported into pure STL to allow support of qm translations in the non-Qt projects.
+**
+** To use this code statically linked with the non-GPL projects
+** you must have commercial license from the Qt rightholder
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial Qt License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl-3.0.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or (at your option) the GNU General
+** Public license version 3 or any later version approved by the KDE Free
+** Qt Foundation. The licenses are as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL2 and LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-2.0.html and
+** https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+#include <stdio.h>
+#include <windows.h>
+#endif
+
+#include "qm_writer.h"
+#include "qm_format_p.h"
+
+
+/* ---------------- Numerus rules ------------------*/
+
+/*
+   The plural rules of the languages, taken from the numerus.cpp of the
+   Qt Linguist in the compiled form expected by the numerusHelper()
+ */
+static const uint8_t g_rules_english[] = { Q_EQ, 1 };
+static const uint8_t g_rules_french[] = { Q_LEQ, 1 };
+static const uint8_t g_rules_latvian[] =
+    { Q_MOD_10 | Q_EQ, 1, Q_AND, Q_MOD_100 | Q_NEQ, 11, Q_NEWRULE, Q_NEQ, 0 };
+static const uint8_t g_rules_icelandic[] =
+    { Q_MOD_10 | Q_EQ, 1, Q_AND, Q_MOD_100 | Q_NEQ, 11 };
+static const uint8_t g_rules_irish[] = { Q_EQ, 1, Q_NEWRULE, Q_EQ, 2 };
+static const uint8_t g_rules_gaelic[] =
+    { Q_EQ, 1, Q_OR, Q_EQ, 11, Q_NEWRULE, Q_EQ, 2, Q_OR, Q_EQ, 12, Q_NEWRULE, Q_BETWEEN, 3, 19 };
+static const uint8_t g_rules_slovak[] = { Q_EQ, 1, Q_NEWRULE, Q_BETWEEN, 2, 4 };
+static const uint8_t g_rules_macedonian[] =
+    { Q_MOD_10 | Q_EQ, 1, Q_NEWRULE, Q_MOD_10 | Q_EQ, 2 };
+static const uint8_t g_rules_lithuanian[] =
+    { Q_MOD_10 | Q_EQ, 1, Q_AND, Q_MOD_100 | Q_NEQ, 11, Q_NEWRULE,
+      Q_MOD_10 | Q_NEQ, 0, Q_AND, Q_MOD_100 | Q_NOT_BETWEEN, 10, 19 };
+static const uint8_t g_rules_russian[] =
+    { Q_MOD_10 | Q_EQ, 1, Q_AND, Q_MOD_100 | Q_NEQ, 11, Q_NEWRULE,
+      Q_MOD_10 | Q_BETWEEN, 2, 4, Q_AND, Q_MOD_100 | Q_NOT_BETWEEN, 10, 19 };
+static const uint8_t g_rules_polish[] =
+    { Q_EQ, 1, Q_NEWRULE, Q_MOD_10 | Q_BETWEEN, 2, 4, Q_AND, Q_MOD_100 | Q_NOT_BETWEEN, 10, 19 };
+static const uint8_t g_rules_romanian[] =
+    { Q_EQ, 1, Q_NEWRULE, Q_EQ, 0, Q_OR, Q_MOD_100 | Q_BETWEEN, 1, 19 };
+static const uint8_t g_rules_slovenian[] =
+    { Q_MOD_100 | Q_EQ, 1, Q_NEWRULE, Q_MOD_100 | Q_EQ, 2, Q_NEWRULE, Q_MOD_100 | Q_BETWEEN, 3, 4 };
+static const uint8_t g_rules_maltese[] =
+    { Q_EQ, 1, Q_NEWRULE, Q_EQ, 0, Q_OR, Q_MOD_100 | Q_BETWEEN, 1, 10, Q_NEWRULE,
+      Q_MOD_100 | Q_BETWEEN, 11, 19 };
+static const uint8_t g_rules_welsh[] =
+    { Q_EQ, 0, Q_NEWRULE, Q_EQ, 1, Q_NEWRULE, Q_BETWEEN, 2, 5, Q_NEWRULE, Q_EQ, 6 };
+static const uint8_t g_rules_arabic[] =
+    { Q_EQ, 0, Q_NEWRULE, Q_EQ, 1, Q_NEWRULE, Q_EQ, 2, Q_NEWRULE,
+      Q_MOD_100 | Q_BETWEEN, 3, 10, Q_NEWRULE, Q_MOD_100 | Q_GEQ, 11 };
+
+static const char *const g_lang_japanese[] =
+{
+    "bi", "my", "zh", "dz", "fj", "gn", "hu", "id", "ja", "jv", "ko", "ms",
+    "na", "om", "fa", "su", "tt", "th", "bo", "tr", "vi", "yo", "za", nullptr
+};
+static const char *const g_lang_english[] =
+{
+    "aa", "ab", "af", "am", "as", "ay", "az", "ba", "bg", "bn", "br", "ca",
+    "co", "da", "de", "el", "en", "eo", "es", "et", "eu", "fi", "fo", "fy",
+    "gl", "gu", "ha", "he", "hi", "ia", "ie", "it", "ka", "kk", "kl", "km",
+    "kn", "ks", "ku", "ky", "la", "ln", "lo", "mg", "ml", "mn", "mr", "nb",
+    "ne", "nl", "nn", "no", "oc", "or", "pa", "ps", "pt", "qu", "rm", "rn",
+    "rw", "sa", "sd", "sg", "si", "sn", "so", "sq", "ss", "st", "sv", "sw",
+    "ta", "te", "tg", "tk", "tn", "to", "ts", "tw", "ug", "ur", "uz", "vo",
+    "wo", "xh", "yi", "zu", nullptr
+};
+static const char *const g_lang_french[] = { "pt_BR", "hy", "fr", "fil", "ti", "wa", nullptr };
+static const char *const g_lang_latvian[] = { "lv", nullptr };
+static const char *const g_lang_icelandic[] = { "is", nullptr };
+static const char *const g_lang_irish[] = { "ga", nullptr };
+static const char *const g_lang_gaelic[] = { "gd", nullptr };
+static const char *const g_lang_slovak[] = { "sk", "cs", nullptr };
+static const char *const g_lang_macedonian[] = { "mk", nullptr };
+static const char *const g_lang_lithuanian[] = { "lt", nullptr };
+static const char *const g_lang_russian[] = { "bs", "be", "hr", "ru", "sr", "uk", nullptr };
+static const char *const g_lang_polish[] = { "pl", nullptr };
+static const char *const g_lang_romanian[] = { "ro", "mo", nullptr };
+static const char *const g_lang_slovenian[] = { "sl", nullptr };
+static const char *const g_lang_maltese[] = { "mt", nullptr };
+static const char *const g_lang_welsh[] = { "cy", nullptr };
+static const char *const g_lang_arabic[] = { "ar", nullptr };
+
+struct NumerusTableEntry
+{
+    const uint8_t      *rules;
+    size_t              rulesSize;
+    const char *const  *languages;
+};
+
+#define NUMERUS_ENTRY(rules, langs) { rules, sizeof(rules), langs }
+
+// Entries with country-specific languages go first
+static const NumerusTableEntry g_numerusTable[] =
+{
+    NUMERUS_ENTRY(g_rules_french,     g_lang_french),
+    { nullptr, 0, g_lang_japanese },
+    NUMERUS_ENTRY(g_rules_english,    g_lang_english),
+    NUMERUS_ENTRY(g_rules_latvian,    g_lang_latvian),
+    NUMERUS_ENTRY(g_rules_icelandic,  g_lang_icelandic),
+    NUMERUS_ENTRY(g_rules_irish,      g_lang_irish),
+    NUMERUS_ENTRY(g_rules_gaelic,     g_lang_gaelic),
+    NUMERUS_ENTRY(g_rules_slovak,     g_lang_slovak),
+    NUMERUS_ENTRY(g_rules_macedonian, g_lang_macedonian),
+    NUMERUS_ENTRY(g_rules_lithuanian, g_lang_lithuanian),
+    NUMERUS_ENTRY(g_rules_russian,    g_lang_russian),
+    NUMERUS_ENTRY(g_rules_polish,     g_lang_polish),
+    NUMERUS_ENTRY(g_rules_romanian,   g_lang_romanian),
+    NUMERUS_ENTRY(g_rules_slovenian,  g_lang_slovenian),
+    NUMERUS_ENTRY(g_rules_maltese,    g_lang_maltese),
+    NUMERUS_ENTRY(g_rules_welsh,      g_lang_welsh),
+    NUMERUS_ENTRY(g_rules_arabic,     g_lang_arabic)
+};
+
+#undef NUMERUS_ENTRY
+
+static const NumerusTableEntry *findNumerusRules(const std::string &language)
+{
+    // Normalize "pt-br" and "pt_BR.UTF-8" into "pt_BR"
+    std::string lang, country;
+    std::string *dst = &lang;
+    for(char c : language)
+    {
+        if(c == '_' || c == '-')
+        {
+            if(dst == &country)
+                break;
+            dst = &country;
+            continue;
+        }
+        if(c == '.' || c == '@')
+            break;
+        if(dst == &lang && c >= 'A' && c <= 'Z')
+            c = char(c - 'A' + 'a');
+        else if(dst == &country && c >= 'a' && c <= 'z')
+            c = char(c - 'a' + 'A');
+        dst->push_back(c);
+    }
+
+    const std::string full = country.empty() ? lang : lang + "_" + country;
+
+    for(const NumerusTableEntry &e : g_numerusTable)
+    {
+        for(const char *const *l = e.languages; *l; ++l)
+        {
+            if(full == *l || lang == *l)
+                return &e;
+        }
+    }
+
+    return nullptr;
+}
+
+
+/* ---------------- String helpers ------------------*/
+
+static void appendUtf8(std::string &out, uint32_t ch)
+{
+    if(ch < 0x80)
+        out.push_back(char(ch));
+    else if(ch < 0x800)
+    {
+        out.push_back(char(0xC0 | (ch >> 6)));
+        out.push_back(char(0x80 | (ch & 0x3F)));
+    }
+    else if(ch < 0x10000)
+    {
+        out.push_back(char(0xE0 | (ch >> 12)));
+        out.push_back(char(0x80 | ((ch >> 6) & 0x3F)));
+        out.push_back(char(0x80 | (ch & 0x3F)));
+    }
+    else
+    {
+        out.push_back(char(0xF0 | (ch >> 18)));
+        out.push_back(char(0x80 | ((ch >> 12) & 0x3F)));
+        out.push_back(char(0x80 | ((ch >> 6) & 0x3F)));
+        out.push_back(char(0x80 | (ch & 0x3F)));
+    }
+}
+
+static std::u16string utf8ToUtf16(const std::string &in)
+{
+    std::u16string out;
+    out.reserve(in.size());
+
+    const uint8_t *s = reinterpret_cast<const uint8_t *>(in.data());
+    const uint8_t *end = s + in.size();
+
+    while(s < end)
+    {
+        uint32_t ch = *s++;
+        int extra = 0;
+
+        if(ch >= 0xF0 && ch < 0xF8)
+        {
+            ch &= 0x07;
+            extra = 3;
+        }
+        else if(ch >= 0xE0)
+        {
+            ch &= 0x0F;
+            extra = 2;
+        }
+        else if(ch >= 0xC0)
+        {
+            ch &= 0x1F;
+            extra = 1;
+        }
+        else if(ch >= 0x80)
+        {
+            out.push_back(u'\xFFFD');
+            continue;
+        }
+
+        if(ch >= 0xF8 || (end - s) < extra)
+        {
+            out.push_back(u'\xFFFD');
+            break;
+        }
+
+        bool valid = true;
+        for(int i = 0; i < extra; ++i)
+        {
+            if((s[i] & 0xC0) != 0x80)
+            {
+                valid = false;
+                break;
+            }
+            ch = (ch << 6) | (s[i] & 0x3F);
+        }
+
+        if(!valid || ch > 0x10FFFF || (ch >= 0xD800 && ch <= 0xDFFF))
+        {
+            out.push_back(u'\xFFFD');
+            ++s;
+            continue;
+        }
+
+        s += extra;
+
+        if(ch >= 0x10000)
+        {
+            ch -= 0x10000;
+            out.push_back(char16_t(0xD800 + (ch >> 10)));
+            out.push_back(char16_t(0xDC00 + (ch & 0x3FF)));
+        }
+        else
+            out.push_back(char16_t(ch));
+    }
+
+    return out;
+}
+
+static void append8(std::vector<uint8_t> &out, uint8_t value)
+{
+    out.push_back(value);
+}
+
+static void append32be(std::vector<uint8_t> &out, uint32_t value)
+{
+    size_t pos = out.size();
+    out.resize(pos + 4);
+    write32be(out.data() + pos, value);
+}
+
+static void appendBytes(std::vector<uint8_t> &out, const std::string &bytes)
+{
+    append32be(out, uint32_t(bytes.size()));
+    out.insert(out.end(), bytes.begin(), bytes.end());
+}
+
+static void appendUtf16be(std::vector<uint8_t> &out, const std::u16string &str)
+{
+    append32be(out, uint32_t(str.size() * 2));
+    for(char16_t c : str)
+    {
+        out.push_back(uint8_t((c >> 8) & 0xFF));
+        out.push_back(uint8_t(c & 0xFF));
+    }
+}
+
+static void appendBlock(std::vector<uint8_t> &out, uint8_t tag, const std::vector<uint8_t> &block)
+{
+    if(block.empty())
+        return;
+    append8(out, tag);
+    append32be(out, uint32_t(block.size()));
+    out.insert(out.end(), block.begin(), block.end());
+}
+
+/* ---------------- TS reader ------------------*/
+
+/*
+   A tiny XML reader that understands just enough of the XML to read
+   the translation sources produced by the lupdate and the Qt Linguist
+ */
+class TsReader
+{
+    typedef std::vector<std::pair<std::string, std::string> > Attributes;
+
+    const char  *m_cur;
+    const char  *m_end;
+    QmWriterX   &m_writer;
+    std::string &m_error;
+
+    std::vector<std::string> m_elements;
+    std::string  m_context;
+    QmMessageX   m_message;
+    std::string  m_buffer;
+    std::string *m_text;
+    bool         m_inMessage;
+
+public:
+    TsReader(const char *data, size_t len, QmWriterX &writer, std::string &error) :
+        m_cur(data), m_end(data + len), m_writer(writer), m_error(error),
+        m_text(nullptr), m_inMessage(false)
+    {}
+
+    bool read()
+    {
+        // Skip the UTF-8 BOM
+        if(m_end - m_cur >= 3 && std::memcmp(m_cur, "\xEF\xBB\xBF", 3) == 0)
+            m_cur += 3;
+
+        while(m_cur < m_end)
+        {
+            if(*m_cur != '<')
+            {
+                const char *begin = m_cur;
+                while(m_cur < m_end && *m_cur != '<')
+                    m_cur++;
+                if(m_text)
+                    decodeText(begin, m_cur, *m_text);
+                continue;
+            }
+
+            if(startsWith("<?"))
+            {
+                if(!skipPast("?>"))
+                    return fail("Unterminated processing instruction");
+            }
+            else if(startsWith("<!--"))
+            {
+                if(!skipPast("-->"))
+                    return fail("Unterminated comment");
+            }
+            else if(startsWith("<![CDATA["))
+            {
+                m_cur += 9;
+                const char *begin = m_cur;
+                if(!skipPast("]]>"))
+                    return fail("Unterminated CDATA section");
+                if(m_text)
+                    m_text->append(begin, size_t(m_cur - 3 - begin));
+            }
+            else if(startsWith("<!"))
+            {
+                if(!skipPast(">"))
+                    return fail("Unterminated declaration");
+            }
+            else if(startsWith("</"))
+            {
+                m_cur += 2;
+                std::string name = readName();
+                skipSpaces();
+                if(m_cur >= m_end || *m_cur != '>')
+                    return fail("Malformed closing tag");
+                m_cur++;
+                if(m_elements.empty() || m_elements.back() != name)
+                    return fail("Mismatched closing tag </" + name + ">");
+                m_elements.pop_back();
+                endElement(name);
+            }
+            else
+            {
+                m_cur++;
+                std::string name = readName();
+                if(name.empty())
+                    return fail("Malformed tag");
+
+                Attributes attrs;
+                bool selfClosed = false;
+                for(;;)
+                {
+                    skipSpaces();
+                    if(m_cur >= m_end)
+                        return fail("Unterminated tag <" + name + ">");
+                    if(*m_cur == '>')
+                    {
+                        m_cur++;
+                        break;
+                    }
+                    if(startsWith("/>"))
+                    {
+                        m_cur += 2;
+                        selfClosed = true;
+                        break;
+                    }
+
+                    std::string attrName = readName();
+                    skipSpaces();
+                    if(attrName.empty() || m_cur >= m_end || *m_cur != '=')
+                        return fail("Malformed attribute of <" + name + ">");
+                    m_cur++;
+                    skipSpaces();
+                    if(m_cur >= m_end || (*m_cur != '"' && *m_cur != '\''))
+                        return fail("Malformed attribute of <" + name + ">");
+                    char quote = *m_cur++;
+                    const char *begin = m_cur;
+                    while(m_cur < m_end && *m_cur != quote)
+                        m_cur++;
+                    if(m_cur >= m_end)
+                        return fail("Unterminated attribute of <" + name + ">");
+                    std::string value;
+                    decodeText(begin, m_cur, value);
+                    m_cur++;
+                    attrs.push_back(std::make_pair(attrName, value));
+                }
+
+                m_elements.push_back(name);
+                startElement(name, attrs);
+                if(selfClosed)
+                {
+                    m_elements.pop_back();
+                    endElement(name);
+                }
+            }
+        }
+
+        if(!m_elements.empty())
+            return fail("Unexpected end of file inside of <" + m_elements.back() + ">");
+
+        return true;
+    }
+
+private:
+    bool fail(const std::string &message)
+    {
+        m_error = message;
+        return false;
+    }
+
+    bool startsWith(const char *str) const
+    {
+        size_t len = std::strlen(str);
+        return size_t(m_end - m_cur) >= len && std::memcmp(m_cur, str, len) == 0;
+    }
+
+    bool skipPast(const char *str)
+    {
+        size_t len = std::strlen(str);
+        while(size_t(m_end - m_cur) >= len)
+        {
+            if(std::memcmp(m_cur, str, len) == 0)
+            {
+                m_cur += len;
+                return true;
+            }
+            m_cur++;
+        }
+        m_cur = m_end;
+        return false;
+    }
+
+    void skipSpaces()
+    {
+        while(m_cur < m_end && (*m_cur == ' ' || *m_cur == '\t' || *m_cur == '\r' || *m_cur == '\n'))
+            m_cur++;
+    }
+
+    std::string readName()
+    {
+        const char *begin = m_cur;
+        while(m_cur < m_end && *m_cur != ' ' && *m_cur != '\t' && *m_cur != '\r' && *m_cur != '\n' &&
+              *m_cur != '>' && *m_cur != '/' && *m_cur != '=')
+            m_cur++;
+        return std::string(begin, m_cur);
+    }
+
+    static void decodeText(const char *begin, const char *end, std::string &out)
+    {
+        while(begin < end)
+        {
+            if(*begin != '&')
+            {
+                out.push_back(*begin++);
+                continue;
+            }
+
+            const char *semi = begin;
+            while(semi < end && *semi != ';')
+                semi++;
+            if(semi == end)
+            {
+                out.append(begin, end);
+                return;
+            }
+
+            std::string entity(begin + 1, semi);
+            if(entity == "lt")
+                out.push_back('<');
+            else if(entity == "gt")
+                out.push_back('>');
+            else if(entity == "amp")
+                out.push_back('&');
+            else if(entity == "quot")
+                out.push_back('"');
+            else if(entity == "apos")
+                out.push_back('\'');
+            else if(entity.size() > 1 && entity[0] == '#')
+            {
+                uint32_t ch;
+                if(entity[1] == 'x' || entity[1] == 'X')
+                    ch = uint32_t(std::strtoul(entity.c_str() + 2, nullptr, 16));
+                else
+                    ch = uint32_t(std::strtoul(entity.c_str() + 1, nullptr, 10));
+                appendUtf8(out, ch);
+            }
+            else
+                out.append(begin, semi + 1);
+
+            begin = semi + 1;
+        }
+    }
+
+    static const std::string *attribute(const Attributes &attrs, const char *name)
+    {
+        for(const std::pair<std::string, std::string> &a : attrs)
+        {
+            if(a.first == name)
+                return &a.second;
+        }
+        return nullptr;
+    }
+
+    void startElement(const std::string &name, const Attributes &attrs)
+    {
+        const std::string *a;
+
+        if(name == "TS")
+        {
+            a = attribute(attrs, "language");
+            if(a && m_writer.language().empty())
+                m_writer.setLanguage(*a);
+        }
+        else if(name == "context")
+            m_context.clear();
+        else if(name == "name" && !m_inMessage)
+        {
+            m_context.clear();
+            m_text = &m_context;
+        }
+        else if(name == "dependency")
+        {
+            a = attribute(attrs, "catalog");
+            if(a && !a->empty())
+                m_writer.addDependency(*a + ".qm");
+        }
+        else if(name == "message")
+        {
+            m_message = QmMessageX();
+            m_message.context = m_context;
+            a = attribute(attrs, "id");
+            if(a)
+                m_message.id = *a;
+            a = attribute(attrs, "numerus");
+            m_message.numerus = (a && *a == "yes");
+            m_inMessage = true;
+        }
+        else if(!m_inMessage)
+            return;
+        else if(name == "source")
+            m_text = &m_message.sourceText;
+        else if(name == "comment")
+            m_text = &m_message.comment;
+        else if(name == "translation")
+        {
+            a = attribute(attrs, "type");
+            if(a)
+            {
+                m_message.unfinished = (*a == "unfinished");
+                m_message.obsolete = (*a == "obsolete" || *a == "vanished");
+            }
+            m_buffer.clear();
+            if(!m_message.numerus)
+                m_text = &m_buffer;
+        }
+        else if(name == "numerusform")
+        {
+            m_buffer.clear();
+            m_text = &m_buffer;
+        }
+        else if(name == "lengthvariant")
+        {
+            // Qt joins the length variants with the U+009C separator
+            if(m_text && !m_text->empty())
+                appendUtf8(*m_text, 0x9C);
+        }
+        else if(name == "byte")
+        {
+            a = attribute(attrs, "value");
+            if(a && m_text)
+            {
+                uint32_t ch;
+                if(!a->empty() && ((*a)[0] == 'x' || (*a)[0] == 'X'))
+                    ch = uint32_t(std::strtoul(a->c_str() + 1, nullptr, 16));
+                else
+                    ch = uint32_t(std::strtoul(a->c_str(), nullptr, 10));
+                appendUtf8(*m_text, ch);
+            }
+        }
+    }
+
+    void endElement(const std::string &name)
+    {
+        if(name == "message")
+        {
+            m_writer.addMessage(m_message);
+            m_inMessage = false;
+            m_text = nullptr;
+        }
+        else if(name == "name" || name == "source" || name == "comment")
+            m_text = nullptr;
+        else if(name == "numerusform" && m_inMessage)
+        {
+            m_message.translations.push_back(utf8ToUtf16(m_buffer));
+            m_text = nullptr;
+        }
+        else if(name == "translation" && m_inMessage)
+        {
+            if(!m_message.numerus)
+                m_message.translations.push_back(utf8ToUtf16(m_buffer));
+            m_text = nullptr;
+        }
+    }
+};
+
+
+/* ---------------- Writer ------------------*/
+
+enum Prefix
+{
+    NoPrefix,
+    Hash,
+    HashContext,
+    HashContextSourceText,
+    HashContextSourceTextComment
+};
+
+struct ByteMessage
+{
+    std::string context;
+    std::string sourceText;
+    std::string comment;
+    const std::vector<std::u16string> *translations;
+    //! The message to group by its context (the ID-based keys have no context)
+    const QmMessageX *message;
+    uint64_t    hits;
+    uint32_t    hash;
+    Prefix      prefix;
+};
+
+static bool byKey(const ByteMessage &a, const ByteMessage &b)
+{
+    if(a.context != b.context)
+        return a.context < b.context;
+    if(a.sourceText != b.sourceText)
+        return a.sourceText < b.sourceText;
+    return a.comment < b.comment;
+}
+
+static bool sameKey(const ByteMessage &a, const ByteMessage &b)
+{
+    return a.context == b.context && a.sourceText == b.sourceText && a.comment == b.comment;
+}
+
+static bool byHash(const ByteMessage &a, const ByteMessage &b)
+{
+    return a.hash < b.hash;
+}
+
+/*
+   Groups the messages by context to keep the strings of one screen on the
+   same pages. The contexts and the messages looked up more often go first.
+ */
+static void orderByContext(std::vector<ByteMessage> &messages, const QmAccessProfileX &profile)
+{
+    std::map<std::string, uint64_t> contextHits;
+    for(ByteMessage &m : messages)
+    {
+        if(!profile.empty())
+            m.hits = profile.count(m.context, m.sourceText, m.comment);
+        contextHits[m.message->context] += m.hits;
+    }
+
+    std::stable_sort(messages.begin(), messages.end(),
+                     [&contextHits](const ByteMessage &a, const ByteMessage &b)
+    {
+        const std::string &ca = a.message->context;
+        const std::string &cb = b.message->context;
+        if(ca != cb)
+        {
+            uint64_t ha = contextHits[ca], hb = contextHits[cb];
+            if(ha != hb)
+                return ha > hb;
+            return ca < cb;
+        }
+        if(a.hits != b.hits)
+            return a.hits > b.hits;
+        return byKey(a, b);
+    });
+}
+
+/*
+   Finds how many key tags are needed to tell the message apart
+   from other messages sharing the same hash
+ */
+static Prefix uniquePrefix(const ByteMessage &m, const ByteMessage *begin, const ByteMessage *end)
+{
+    Prefix prefix = NoPrefix;
+    for(const ByteMessage *o = begin; o != end; ++o)
+    {
+        if(o == &m)
+            continue;
+        if(o->context != m.context)
+            prefix = std::max(prefix, HashContext);
+        else if(o->sourceText != m.sourceText)
+            prefix = std::max(prefix, HashContextSourceText);
+        else
+            prefix = HashContextSourceTextComment;
+    }
+    return prefix;
+}
+
+static void writeRecord(std::vector<uint8_t> &out, const ByteMessage &m)
+{
+    for(const std::u16string &tr : *m.translations)
+    {
+        append8(out, Tag_Translation);
+        appendUtf16be(out, tr);
+    }
+
+    switch(m.prefix)
+    {
+    default:
+    case HashContextSourceTextComment:
+        append8(out, Tag_Comment);
+        appendBytes(out, m.comment);
+        /*fallthrough*/
+    case HashContextSourceText:
+        append8(out, Tag_SourceText);
+        appendBytes(out, m.sourceText);
+        /*fallthrough*/
+    case HashContext:
+        append8(out, Tag_Context);
+        appendBytes(out, m.context);
+        break;
+    case Hash:
+    case NoPrefix:
+        break;
+    }
+
+    append8(out, Tag_End);
+}
+
+/*
+   The contexts found in the catalog are stored in a hash table
+   to provide the fast rejection of unknown contexts:
+       quint16 hTableSize;
+       quint16 hTable[hTableSize];
+       quint8  contextPool[...];
+   The context pool stores the contexts as Pascal strings, every
+   bucket is terminated with the empty string:
+       quint8  len;
+       quint8  data[len];
+ */
+static bool writeContexts(std::vector<uint8_t> &out, const std::vector<ByteMessage> &messages)
+{
+    std::vector<std::string> contexts;
+    contexts.reserve(messages.size());
+    for(const ByteMessage &m : messages)
+    {
+        // The empty string terminates the bucket, can't be stored
+        if(m.context.empty() || m.context.size() > 255)
+            return false;
+        contexts.push_back(m.context);
+    }
+    std::sort(contexts.begin(), contexts.end());
+    contexts.erase(std::unique(contexts.begin(), contexts.end()), contexts.end());
+
+    uint16_t hTableSize;
+    if(contexts.size() < 200)
+        hTableSize = (contexts.size() < 60) ? 151 : 503;
+    else if(contexts.size() < 2500)
+        hTableSize = 3079;
+    else if(contexts.size() < 10000)
+        hTableSize = 12289;
+    else
+        hTableSize = 49157;
+
+    std::multimap<uint32_t, const std::string *> buckets;
+    for(const std::string &c : contexts)
+        buckets.insert(std::make_pair(elfHash(c.c_str()) % hTableSize, &c));
+
+    std::vector<uint16_t> hTable(hTableSize, 0);
+    // The entry at offset 0 can't be used
+    std::vector<uint8_t> pool(2, 0);
+
+    std::multimap<uint32_t, const std::string *>::const_iterator it = buckets.begin();
+    while(it != buckets.end())
+    {
+        uint32_t bucket = it->first;
+        if((pool.size() >> 1) > 0xFFFF)
+            return false;
+        hTable[bucket] = uint16_t(pool.size() >> 1);
+        do
+        {
+            pool.push_back(uint8_t(it->second->size()));
+            pool.insert(pool.end(), it->second->begin(), it->second->end());
+            ++it;
+        }
+        while(it != buckets.end() && it->first == bucket);
+        pool.push_back(0);
+        // offsets have to be even
+        if(pool.size() & 0x1)
+            pool.push_back(0);
+    }
+
+    out.resize(2 + (size_t(hTableSize) << 1));
+    write16be(out.data(), hTableSize);
+    for(uint16_t i = 0; i < hTableSize; ++i)
+        write16be(out.data() + 2 + (size_t(i) << 1), hTable[i]);
+    out.insert(out.end(), pool.begin(), pool.end());
+
+    return true;
+}
+
+
+static PerfectHashKey perfectHashKey(const std::string &context, const std::string &sourceText,
+                                     const std::string &comment, uint32_t offset)
+{
+    PerfectHashKey k;
+    k.context = reinterpret_cast<const uint8_t *>(context.data());
+    k.contextLength = uint32_t(context.size());
+    k.sourceText = reinterpret_cast<const uint8_t *>(sourceText.data());
+    k.sourceTextLength = uint32_t(sourceText.size());
+    k.comment = reinterpret_cast<const uint8_t *>(comment.data());
+    k.commentLength = uint32_t(comment.size());
+    k.offset = offset;
+    return k;
+}
+
+
+QmWriterX::QmWriterX()
+{}
+
+bool QmWriterX::loadTsFile(const char *filePath)
+{
+    FILE *file = openFile(filePath, "rb");
+    if(!file)
+    {
+        m_errorString = std::string("Can't open file ") + filePath;
+        return false;
+    }
+
+    std::string data;
+    char buffer[4096];
+    size_t got;
+    while((got = std::fread(buffer, 1, sizeof(buffer), file)) > 0)
+        data.append(buffer, got);
+    std::fclose(file);
+
+    if(!loadTsData(data.data(), data.size()))
+    {
+        m_errorString = std::string(filePath) + ": " + m_errorString;
+        return false;
+    }
+
+    return true;
+}
+
+bool QmWriterX::loadTsData(const char *data, size_t len)
+{
+    TsReader reader(data, len, *this, m_errorString);
+    return reader.read();
+}
+
+void QmWriterX::addMessage(const QmMessageX &message)
+{
+    m_messages.push_back(message);
+}
+
+void QmWriterX::addDependency(const std::string &dependency)
+{
+    m_dependencies.push_back(dependency);
+}
+
+bool QmWriterX::setLanguage(const std::string &language)
+{
+    m_language = language;
+    m_numerusRules.clear();
+
+    const NumerusTableEntry *e = findNumerusRules(language);
+    if(!e)
+    {
+        m_errorString = "Unknown plural rules of the language " + language;
+        return false;
+    }
+
+    if(e->rules)
+        m_numerusRules.assign(e->rules, e->rules + e->rulesSize);
+
+    return true;
+}
+
+void QmWriterX::setNumerusRules(const uint8_t *rules, size_t len)
+{
+    m_numerusRules.assign(rules, rules + len);
+}
+
+void QmWriterX::clear()
+{
+    m_messages.clear();
+    m_dependencies.clear();
+    m_numerusRules.clear();
+    m_language.clear();
+    m_errorString.clear();
+}
+
+std::vector<QmMessageX> &QmWriterX::messages()
+{
+    return m_messages;
+}
+
+const std::vector<QmMessageX> &QmWriterX::messages() const
+{
+    return m_messages;
+}
+
+QmWriterX::Options &QmWriterX::options()
+{
+    return m_options;
+}
+
+void QmWriterX::setProfile(const QmAccessProfileX &profile)
+{
+    m_profile = profile;
+}
+
+const QmWriterX::Options &QmWriterX::options() const
+{
+    return m_options;
+}
+
+const std::string &QmWriterX::language() const
+{
+    return m_language;
+}
+
+const std::string &QmWriterX::errorString() const
+{
+    return m_errorString;
+}
+
+bool QmWriterX::save(std::vector<uint8_t> &out)
+{
+    std::vector<ByteMessage> messages;
+    std::vector<std::vector<std::u16string> > idTranslations;
+    messages.reserve(m_messages.size());
+    idTranslations.reserve(m_messages.size());
+
+    // The lookups with a comment fall back to the message without the comment
+    std::set<std::pair<std::string, std::string> > profileSources;
+    if(m_options.trimByProfile)
+    {
+        for(const QmAccessProfileX::Entry &e : m_profile.entries())
+            profileSources.insert(std::make_pair(e.context, e.sourceText));
+    }
+
+    for(const QmMessageX &msg : m_messages)
+    {
+        if(msg.obsolete && m_options.stripObsolete)
+            continue;
+        if(msg.unfinished && m_options.noUnfinished)
+            continue;
+
+        bool translated = false;
+        for(const std::u16string &tr : msg.translations)
+            translated |= !tr.empty();
+
+        ByteMessage m;
+        m.translations = &msg.translations;
+        m.message = &msg;
+        m.hits = 0;
+        m.prefix = HashContextSourceTextComment;
+
+        if(m_options.idBased)
+        {
+            if(msg.id.empty())
+                continue;
+            m.sourceText = msg.id;
+            // Like lrelease, use the engineering English for the untranslated ID-based messages
+            if(!translated)
+            {
+                if(msg.sourceText.empty())
+                    continue;
+                idTranslations.push_back(std::vector<std::u16string>(1, utf8ToUtf16(msg.sourceText)));
+                m.translations = &idTranslations.back();
+            }
+        }
+        else
+        {
+            if(!translated)
+                continue;
+            m.context = msg.context;
+            m.sourceText = msg.sourceText;
+            m.comment = msg.comment;
+        }
+
+        if(m_options.removeIdentical && m.translations->size() == 1 &&
+           m.translations->front() == utf8ToUtf16(msg.sourceText))
+            continue;
+
+        if(m_options.trimByProfile && !m_profile.count(m.context, m.sourceText, m.comment) &&
+           (!m.comment.empty() || !profileSources.count(std::make_pair(m.context, m.sourceText))))
+            continue;
+
+        m.hash = 0;
+        elfHash_continue(m.sourceText.c_str(), m.hash);
+        elfHash_continue(m.comment.c_str(), m.hash);
+        elfHash_finish(m.hash);
+
+        messages.push_back(m);
+    }
+
+    // Keep the first one of the messages with the same key
+    std::stable_sort(messages.begin(), messages.end(), byKey);
+    messages.erase(std::unique(messages.begin(), messages.end(), sameKey), messages.end());
+
+    std::vector<uint8_t> contextArray;
+    if(m_options.stripKeys && !messages.empty())
+    {
+        std::stable_sort(messages.begin(), messages.end(), byHash);
+        size_t i = 0;
+        while(i < messages.size())
+        {
+            size_t j = i + 1;
+            while(j < messages.size() && messages[j].hash == messages[i].hash)
+                ++j;
+            for(size_t k = i; k < j; ++k)
+                messages[k].prefix = uniquePrefix(messages[k], &messages[i], &messages[0] + j);
+            i = j;
+        }
+
+        // The contexts of the ID-based messages are all empty, so there is no contexts
+        // table. Their records keep the IDs, which the index of IDs is built from.
+        if(m_options.idBased)
+        {
+            for(ByteMessage &m : messages)
+                m.prefix = std::max(m.prefix, HashContextSourceText);
+        }
+        // Without the contexts table the records must keep the context
+        else if(!writeContexts(contextArray, messages))
+        {
+            contextArray.clear();
+            for(ByteMessage &m : messages)
+                m.prefix = std::max(m.prefix, HashContext);
+        }
+
+        if(m_options.order == OrderByKey)
+            std::stable_sort(messages.begin(), messages.end(), byKey);
+    }
+    else if(m_options.order == OrderByHash)
+        std::stable_sort(messages.begin(), messages.end(), byHash);
+
+    if(m_options.order == OrderByContext)
+        orderByContext(messages, m_profile);
+
+    std::vector<uint8_t> messageArray;
+    std::vector<std::pair<uint32_t, uint32_t> > offsets;
+    std::map<std::vector<uint8_t>, uint32_t> records;
+    std::vector<uint8_t> record;
+    offsets.reserve(messages.size());
+
+    for(const ByteMessage &m : messages)
+    {
+        record.clear();
+        writeRecord(record, m);
+
+        uint32_t offset = uint32_t(messageArray.size());
+        if(m_options.dedupMessages)
+        {
+            std::pair<std::map<std::vector<uint8_t>, uint32_t>::iterator, bool> r =
+                records.insert(std::make_pair(record, offset));
+            if(!r.second)
+            {
+                offsets.push_back(std::make_pair(m.hash, r.first->second));
+                continue;
+            }
+        }
+
+        messageArray.insert(messageArray.end(), record.begin(), record.end());
+        offsets.push_back(std::make_pair(m.hash, offset));
+    }
+
+    std::vector<uint8_t> perfectHashArray;
+    if(m_options.perfectHash && !messages.empty())
+    {
+        std::vector<PerfectHashKey> keys;
+        keys.reserve(messages.size());
+        for(size_t i = 0; i < messages.size(); ++i)
+        {
+            const ByteMessage &m = messages[i];
+            keys.push_back(perfectHashKey(m.context, m.sourceText, m.comment, offsets[i].second));
+        }
+        if(!buildPerfectHash(keys, perfectHashArray))
+        {
+            m_errorString = "Can't build the perfect hash";
+            return false;
+        }
+    }
+
+    std::sort(offsets.begin(), offsets.end());
+
+    std::vector<uint8_t> offsetArray;
+    offsetArray.reserve(offsets.size() * 8);
+    for(const std::pair<uint32_t, uint32_t> &o : offsets)
+    {
+        append32be(offsetArray, o.first);
+        append32be(offsetArray, o.second);
+    }
+
+    // The QStrings of the QDataStream one after another, as the lrelease writes them
+    std::vector<uint8_t> dependencyArray;
+    for(const std::string &dep : m_dependencies)
+        appendUtf16be(dependencyArray, utf8ToUtf16(dep));
+
+    out.clear();
+    out.insert(out.end(), g_qm_magic, g_qm_magic + g_qm_magicLength);
+    appendBlock(out, QTranslatorEntryTypes::Dependencies, dependencyArray);
+    appendBlock(out, QTranslatorEntryTypes::Hashes, offsetArray);
+    if(m_options.packMessages)
+    {
+        std::vector<uint8_t> packedArray;
+        packMessages(messageArray.data(), uint32_t(messageArray.size()), packedArray);
+        appendBlock(out, QTranslatorEntryTypes::PackedMessages, packedArray);
+    }
+    else
+        appendBlock(out, QTranslatorEntryTypes::Messages, messageArray);
+    appendBlock(out, QTranslatorEntryTypes::Contexts, contextArray);
+    appendBlock(out, QTranslatorEntryTypes::NumerusRules, m_numerusRules);
+    appendBlock(out, QTranslatorEntryTypes::PerfectHash, perfectHashArray);
+
+    return true;
+}
+
+bool QmWriterX::addPerfectHash(const uint8_t *data, size_t len, std::vector<uint8_t> &out)
+{
+    const uint8_t *end = data + len;
+    const uint8_t *offsetArray = nullptr;
+    const uint8_t *messageArray = nullptr;
+    uint32_t offsetLength = 0;
+    uint32_t messageLength = 0;
+
+    if(len < size_t(g_qm_magicLength) || std::memcmp(data, g_qm_magic, g_qm_magicLength) != 0)
+    {
+        m_errorString = "Not a qm-file";
+        return false;
+    }
+
+    out.clear();
+    out.insert(out.end(), data, data + g_qm_magicLength);
+
+    data += g_qm_magicLength;
+    while(data < end - 4)
+    {
+        const uint8_t *block = data;
+        uint8_t  tag = read8(data++);
+        uint32_t blockLen = read32be(data);
+        data += 4;
+        if(!tag || !blockLen)
+            break;
+        if(uint32_t(end - data) < blockLen)
+        {
+            m_errorString = "Truncated qm-file";
+            return false;
+        }
+
+        if(tag == QTranslatorEntryTypes::Hashes)
+        {
+            offsetArray = data;
+            offsetLength = blockLen;
+        }
+        else if(tag == QTranslatorEntryTypes::Messages)
+        {
+            messageArray = data;
+            messageLength = blockLen;
+        }
+
+        // The old perfect hash gets replaced
+        if(tag != QTranslatorEntryTypes::PerfectHash)
+            out.insert(out.end(), block, data + blockLen);
+        data += blockLen;
+    }
+
+    if(!offsetArray || !messageArray)
+    {
+        m_errorString = "The qm-file has no messages";
+        return false;
+    }
+
+    std::vector<PerfectHashKey> keys;
+    keys.reserve(offsetLength / 8);
+    for(uint32_t i = 0; i + 8 <= offsetLength; i += 8)
+    {
+        uint32_t offset = read32be(offsetArray + i + 4);
+        QmRecordX record;
+        if(offset >= messageLength ||
+           !readRecord(messageArray + offset, messageArray + messageLength, record))
+        {
+            m_errorString = "Malformed message record";
+            return false;
+        }
+
+        if(!record.context || !record.sourceText || !record.comment)
+        {
+            m_errorString = "The message records have no keys, the catalog must be compiled without the -compress option";
+            return false;
+        }
+
+        PerfectHashKey k;
+        k.context = record.context;
+        k.contextLength = record.contextLength;
+        k.sourceText = record.sourceText;
+        k.sourceTextLength = record.sourceTextLength;
+        k.comment = record.comment;
+        k.commentLength = record.commentLength;
+        k.offset = offset;
+        keys.push_back(k);
+    }
+
+    std::vector<uint8_t> perfectHashArray;
+    if(!buildPerfectHash(keys, perfectHashArray))
+    {
+        m_errorString = "Can't build the perfect hash";
+        return false;
+    }
+
+    appendBlock(out, QTranslatorEntryTypes::PerfectHash, perfectHashArray);
+
+    return true;
+}
+
+bool QmWriterX::pack(const uint8_t *data, size_t len, std::vector<uint8_t> &out)
+{
+    const uint8_t *end = data + len;
+    bool hasMessages = false;
+
+    if(len < size_t(g_qm_magicLength) || std::memcmp(data, g_qm_magic, g_qm_magicLength) != 0)
+    {
+        m_errorString = "Not a qm-file";
+        return false;
+    }
+
+    out.clear();
+    out.insert(out.end(), data, data + g_qm_magicLength);
+
+    data += g_qm_magicLength;
+    while(data < end - 4)
+    {
+        const uint8_t *block = data;
+        uint8_t  tag = read8(data++);
+        uint32_t blockLen = read32be(data);
+        data += 4;
+        if(!tag || !blockLen)
+            break;
+        if(uint32_t(end - data) < blockLen)
+        {
+            m_errorString = "Truncated qm-file";
+            return false;
+        }
+
+        if(tag == QTranslatorEntryTypes::Messages)
+        {
+            std::vector<uint8_t> packedArray;
+            packMessages(data, blockLen, packedArray);
+            appendBlock(out, QTranslatorEntryTypes::PackedMessages, packedArray);
+            hasMessages = true;
+        }
+        else
+        {
+            hasMessages |= tag == QTranslatorEntryTypes::PackedMessages;
+            out.insert(out.end(), block, data + blockLen);
+        }
+        data += blockLen;
+    }
+
+    if(!hasMessages)
+    {
+        m_errorString = "The qm-file has no messages";
+        return false;
+    }
+
+    return true;
+}
+
+bool QmWriterX::saveFile(const char *filePath)
+{
+    std::vector<uint8_t> data;
+    if(!save(data))
+        return false;
+
+    FILE *file = openFile(filePath, "wb");
+    if(!file)
+    {
+        m_errorString = std::string("Can't open file ") + filePath + " for writing";
+        return false;
+    }
+
+    size_t written = std::fwrite(data.data(), 1, data.size(), file);
+    bool ok = (std::fclose(file) == 0) && (written == data.size());
+    if(!ok)
+        m_errorString = std::string("Can't write file ") + filePath;
+
+    return ok;
+}
@@ -0,0 +1,163 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** Copyright (C) 2016-2020 Vitaly Novichkov <admin@wohlnet.ru>
+**
+** This file use a part of the QtCore module of the Qt Toolkit,
+** ported into pure STL to allow support of qm translations in the non-Qt projects.
+**
+** To use this code statically linked with the non-GPL projects
+** you must have commercial license from the Qt rightholder
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial Qt License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl-3.0.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or (at your option) the GNU General
+** Public license version 3 or any later version approved by the KDE Free
+** Qt Foundation. The licenses are as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL2 and LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-2.0.html and
+** https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QMWRITERX_H
+#define QMWRITERX_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "qm_profile.h"
+
+struct QmMessageX
+{
+    std::string context;
+    std::string sourceText;
+    std::string comment;
+    //! Message ID, used instead of the source text when writing ID-based catalogs
+    std::string id;
+    //! One entry for a regular message, one entry per plural form for numerus messages
+    std::vector<std::u16string> translations;
+    bool numerus;
+    bool unfinished;
+    bool obsolete;
+
+    QmMessageX() :
+        numerus(false), unfinished(false), obsolete(false)
+    {}
+};
+
+/**
+ * @brief Serializer of the compiled qm-files, a replacement of the lrelease utility
+ *
+ * Collect messages from the ts-files (or add them manually), then write the
+ * catalog that can be loaded by the QmTranslatorX (and by the QTranslator of Qt).
+ */
+class QmWriterX
+{
+public:
+    enum MessageOrder
+    {
+        //! Sort messages by context, source text and comment (lrelease's order)
+        OrderByKey = 0,
+        //! Sort messages by the key hash to match the order of the "Hashes" block
+        OrderByHash,
+        //! Keep messages of the same context together, the contexts and the messages
+        //! looked up more often (by the access profile, if set) go first
+        OrderByContext
+    };
+
+    struct Options
+    {
+        //! Use message IDs as the keys (lrelease -idbased)
+        bool idBased;
+        //! Keep only as many key tags as needed to resolve hash collisions and
+        //! write the contexts table (lrelease -compress)
+        bool stripKeys;
+        //! Don't release obsolete and vanished messages
+        bool stripObsolete;
+        //! Don't release unfinished translations (lrelease -nounfinished)
+        bool noUnfinished;
+        //! Don't release translations equal to the source text (lrelease -removeidentical)
+        bool removeIdentical;
+        //! Share one record between messages with byte-identical records
+        //! (takes effect together with the stripKeys option)
+        bool dedupMessages;
+        //! Write the perfect hash block for the one-probe lookups of the fully static catalogs
+        bool perfectHash;
+        //! Release only the messages looked up in the access profile (see setProfile)
+        bool trimByProfile;
+        //! Compress the "Messages" block by the chunks unpacked on demand,
+        //! such catalogs are readable by the QmTranslatorX only
+        bool packMessages;
+        MessageOrder order;
+
+        Options() :
+            idBased(false), stripKeys(false), stripObsolete(true),
+            noUnfinished(false), removeIdentical(false), dedupMessages(true),
+            perfectHash(false), trimByProfile(false), packMessages(false), order(OrderByHash)
+        {}
+    };
+
+    QmWriterX();
+
+    bool loadTsFile(const char *filePath);
+    bool loadTsData(const char *data, size_t len);
+
+    void addMessage(const QmMessageX &message);
+    void addDependency(const std::string &dependency);
+    //Set numerus rules by the language code like "ru" or "pt_BR"
+    bool setLanguage(const std::string &language);
+    void setNumerusRules(const uint8_t *rules, size_t len);
+    //Access profile for the OrderByContext order and the trimByProfile option
+    void setProfile(const QmAccessProfileX &profile);
+    void clear();
+
+    std::vector<QmMessageX> &messages();
+    const std::vector<QmMessageX> &messages() const;
+    Options &options();
+    const Options &options() const;
+    const std::string &language() const;
+
+    bool save(std::vector<uint8_t> &out);
+    bool saveFile(const char *filePath);
+    //Copy the compiled qm-file with the perfect hash block (re)generated
+    bool addPerfectHash(const uint8_t *data, size_t len, std::vector<uint8_t> &out);
+    //Copy the compiled qm-file with the "Messages" block compressed (see Options::packMessages)
+    bool pack(const uint8_t *data, size_t len, std::vector<uint8_t> &out);
+    const std::string &errorString() const;
+
+private:
+    std::vector<QmMessageX>   m_messages;
+    std::vector<std::string>  m_dependencies;
+    std::vector<uint8_t>      m_numerusRules;
+    std::string               m_language;
+    std::string               m_errorString;
+    Options                   m_options;
+    QmAccessProfileX          m_profile;
+};
+
+#endif // QMWRITERX_H
@@ -0,0 +1,499 @@
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+
+#include "QTranslatorX/QTranslatorX"
+#include "qm_tools.h"
+
+static void printUsage()
+{
+    printf("Usage:\n"
+           "    qm_bulk [options] qm-file input-file [output-file]\n\n"
+           "Translates every key of the input file by the qm-file on all CPU cores,\n"
+           "the translations are written in the order of the input, one per line.\n"
+           "Input is read from the stdin if the input-file is \"-\",\n"
+           "output goes to the stdout if the output-file isn't given.\n\n"
+           "Input formats:\n"
+           "    context<TAB>source text[<TAB>n[<TAB>comment]]   one key per line,\n"
+           "        \\t, \\n and \\\\ are escaped, n is the number for plural forms\n"
+           "    {\"context\": \"...\", \"source\": \"...\", \"comment\": \"...\", \"n\": 5}\n"
+           "        one JSON object per line (JSON Lines), the output is JSON Lines too\n\n"
+           "Options:\n"
+           "    -json             Read and write JSON Lines (default for *.json, *.jsonl)\n"
+           "    -threads count    Number of threads (default: number of CPU cores)\n"
+           "    -nosource         Write empty lines for keys without translation\n"
+           "                      instead of the source text\n"
+           "    -quiet            Don't report the throughput\n");
+}
+
+struct BulkKey
+{
+    std::string context;
+    std::string sourceText;
+    std::string comment;
+    int32_t     n;
+};
+
+/*
+   Line formats: the tab-separated fields and the JSON object
+ */
+static bool parseTsvLine(const std::string &line, BulkKey &key)
+{
+    std::string fields[4];
+    size_t count = 0;
+    const char *c = line.c_str(), *end = c + line.size();
+    while(count < 4)
+    {
+        const char *tab = static_cast<const char *>(std::memchr(c, '\t', size_t(end - c)));
+        const char *fieldEnd = tab ? tab : end;
+        fields[count++] = QmAccessProfileX::unescape(c, fieldEnd);
+        if(!tab)
+            break;
+        c = tab + 1;
+    }
+
+    if(count < 2)
+        return false;
+    key.context = fields[0];
+    key.sourceText = fields[1];
+    key.n = count > 2 && !fields[2].empty() ? int32_t(std::strtol(fields[2].c_str(), nullptr, 10)) : -1;
+    key.comment = fields[3];
+    return true;
+}
+
+static void skipSpaces(const char *&c, const char *end)
+{
+    while(c < end && (*c == ' ' || *c == '\t' || *c == '\r' || *c == '\n'))
+        ++c;
+}
+
+static bool readHex4(const char *&c, const char *end, uint32_t &value)
+{
+    if(end - c < 4)
+        return false;
+    value = 0;
+    for(int i = 0; i < 4; ++i, ++c)
+    {
+        char h = *c;
+        value <<= 4;
+        if(h >= '0' && h <= '9')
+            value |= uint32_t(h - '0');
+        else if(h >= 'a' && h <= 'f')
+            value |= uint32_t(h - 'a' + 10);
+        else if(h >= 'A' && h <= 'F')
+            value |= uint32_t(h - 'A' + 10);
+        else
+            return false;
+    }
+    return true;
+}
+
+static bool readJsonString(const char *&c, const char *end, std::string &out)
+{
+    out.clear();
+    if(c >= end || *c != '"')
+        return false;
+    ++c;
+    while(c < end && *c != '"')
+    {
+        if(*c != '\\')
+        {
+            out.push_back(*c++);
+            continue;
+        }
+        if(++c >= end)
+            return false;
+        char e = *c++;
+        switch(e)
+        {
+        case 'b': out.push_back('\b'); break;
+        case 'f': out.push_back('\f'); break;
+        case 'n': out.push_back('\n'); break;
+        case 'r': out.push_back('\r'); break;
+        case 't': out.push_back('\t'); break;
+        case 'u':
+        {
+            uint32_t ch, low;
+            if(!readHex4(c, end, ch))
+                return false;
+            if(ch >= 0xD800 && ch < 0xDC00 && end - c >= 6 && c[0] == '\\' && c[1] == 'u')
+            {
+                const char *next = c + 2;
+                if(readHex4(next, end, low) && low >= 0xDC00 && low < 0xE000)
+                {
+                    ch = 0x10000 + ((ch - 0xD800) << 10) + (low - 0xDC00);
+                    c = next;
+                }
+            }
+            QmAppendSinkX<std::string> sink(out);
+            QmUtfEncoderX<1>::put<char>(ch, sink);
+            break;
+        }
+        default: out.push_back(e); break;
+        }
+    }
+    if(c >= end)
+        return false;
+    ++c;
+    return true;
+}
+
+static bool parseJsonLine(const std::string &line, BulkKey &key)
+{
+    const char *c = line.c_str(), *end = c + line.size();
+    std::string name, value;
+
+    key.n = -1;
+    skipSpaces(c, end);
+    if(c >= end || *c++ != '{')
+        return false;
+
+    for(;;)
+    {
+        skipSpaces(c, end);
+        if(c < end && *c == '}')
+            return true;
+        if(!readJsonString(c, end, name))
+            return false;
+        skipSpaces(c, end);
+        if(c >= end || *c++ != ':')
+            return false;
+        skipSpaces(c, end);
+
+        if(c < end && *c == '"')
+        {
+            if(!readJsonString(c, end, value))
+                return false;
+            if(name == "context")
+                key.context = value;
+            else if(name == "source")
+                key.sourceText = value;
+            else if(name == "comment")
+                key.comment = value;
+        }
+        else
+        {
+            // Numbers, null and booleans, only the "n" is used
+            const char *begin = c;
+            while(c < end && *c != ',' && *c != '}' && *c != ' ')
+                ++c;
+            if(name == "n" && c > begin && (*begin == '-' || (*begin >= '0' && *begin <= '9')))
+                key.n = int32_t(std::strtol(begin, nullptr, 10));
+        }
+
+        skipSpaces(c, end);
+        if(c < end && *c == ',')
+            ++c;
+        else if(c < end && *c == '}')
+            return true;
+        else
+            return false;
+    }
+}
+
+static void appendJsonEscaped(std::string &out, const std::string &str)
+{
+    static const char hex[] = "0123456789abcdef";
+    out.push_back('"');
+    for(char c : str)
+    {
+        switch(c)
+        {
+        case '"': out.append("\\\""); break;
+        case '\\': out.append("\\\\"); break;
+        case '\n': out.append("\\n"); break;
+        case '\r': out.append("\\r"); break;
+        case '\t': out.append("\\t"); break;
+        default:
+            if(uint8_t(c) < 0x20)
+            {
+                out.append("\\u00");
+                out.push_back(hex[uint8_t(c) >> 4]);
+                out.push_back(hex[uint8_t(c) & 0xF]);
+            }
+            else
+                out.push_back(c);
+            break;
+        }
+    }
+    out.push_back('"');
+}
+
+struct BulkJob
+{
+    QmTranslatorX *translator;
+    bool json;
+    bool sourceFallback;
+    const std::vector<std::string> *lines;
+    std::vector<std::string> outputs;
+    std::atomic<size_t> nextChunk;
+    std::atomic<size_t> badLines;
+
+    // The worker threads live through all batches, every new batch wakes them up
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    uint64_t batch;
+    unsigned busy;
+    bool quit;
+};
+
+// Lines per chunk taken by a thread at once, small enough to keep all threads busy till the end
+static const size_t g_chunkLines = 256;
+// Lines read before translating them, the output is written after every batch
+static const size_t g_batchLines = 65536;
+
+/*
+   Translates the chunks of the batch taken by the threads in turn from the shared
+   counter, so the faster threads take more of them. Every chunk gets written
+   into its own output string to keep the order of the input.
+ */
+static void translateChunks(BulkJob &job)
+{
+    const std::vector<std::string> &lines = *job.lines;
+    const size_t chunks = (lines.size() + g_chunkLines - 1) / g_chunkLines;
+    const bool idBased = job.translator->isIdBased();
+    BulkKey key;
+    std::string translation;
+
+    for(;;)
+    {
+        size_t chunk = job.nextChunk.fetch_add(1, std::memory_order_relaxed);
+        if(chunk >= chunks)
+            break;
+
+        std::string &out = job.outputs[chunk];
+        out.clear();
+        size_t end = std::min(lines.size(), (chunk + 1) * g_chunkLines);
+        for(size_t i = chunk * g_chunkLines; i < end; ++i)
+        {
+            key.context.clear();
+            key.sourceText.clear();
+            key.comment.clear();
+            bool ok = job.json ? parseJsonLine(lines[i], key) : parseTsvLine(lines[i], key);
+            if(!ok)
+                job.badLines.fetch_add(1, std::memory_order_relaxed);
+
+            translation.clear();
+            QmStringViewX tn;
+            bool found = ok && (idBased && key.context.empty() && key.comment.empty() ?
+                                job.translator->findTranslationId(key.sourceText.c_str(), key.n, tn) :
+                                job.translator->findTranslation(key.context.c_str(), key.sourceText.c_str(),
+                                                                key.comment.c_str(), key.n, tn));
+            if(found)
+            {
+                QmAppendSinkX<std::string> sink(translation);
+                qmTranscodeX<char>(reinterpret_cast<const uint8_t *>(tn.data), tn.size, sink);
+            }
+            else if(job.sourceFallback)
+                translation = key.sourceText;
+
+            if(job.json)
+            {
+                out.append("{\"translation\": ");
+                appendJsonEscaped(out, translation);
+                out.append(found ? "}\n" : ", \"untranslated\": true}\n");
+            }
+            else
+            {
+                QmAccessProfileX::appendEscaped(out, translation);
+                out.push_back('\n');
+            }
+        }
+    }
+}
+
+static void runWorker(BulkJob &job)
+{
+    uint64_t batch = 0;
+    std::unique_lock<std::mutex> lock(job.mutex);
+    for(;;)
+    {
+        job.wake.wait(lock, [&job, batch]() { return job.quit || job.batch != batch; });
+        if(job.quit)
+            return;
+        batch = job.batch;
+
+        lock.unlock();
+        translateChunks(job);
+        lock.lock();
+        if(--job.busy == 0)
+            job.done.notify_one();
+    }
+}
+
+/*
+   Reads up to the maxLines lines, returns false at the end of the input
+ */
+static bool readLines(FILE *in, std::vector<std::string> &lines, size_t maxLines, uint64_t &bytes)
+{
+    static char buffer[1 << 16];
+    std::string line;
+    bool more = true;
+
+    lines.clear();
+    while(lines.size() < maxLines)
+    {
+        if(!std::fgets(buffer, sizeof(buffer), in))
+        {
+            if(!line.empty())
+                lines.push_back(line);
+            more = false;
+            break;
+        }
+
+        size_t len = std::strlen(buffer);
+        bytes += len;
+        line.append(buffer, len);
+        if(line.empty() || line[line.size() - 1] != '\n')
+            continue;
+
+        line.erase(line.size() - 1);
+        if(!line.empty() && line[line.size() - 1] == '\r')
+            line.erase(line.size() - 1);
+        lines.push_back(line);
+        line.clear();
+    }
+    return more;
+}
+
+int main(int argc, char**argv)
+{
+    std::vector<std::string> files;
+    bool json = false, jsonSet = false, sourceFallback = true, quiet = false;
+    unsigned threadsCount = std::thread::hardware_concurrency();
+
+    for(int i = 1; i < argc; ++i)
+    {
+        const char *arg = argv[i];
+        if(!std::strcmp(arg, "-json"))
+            json = jsonSet = true;
+        else if(!std::strcmp(arg, "-threads") && i + 1 < argc)
+            threadsCount = unsigned(std::strtoul(argv[++i], nullptr, 10));
+        else if(!std::strcmp(arg, "-nosource"))
+            sourceFallback = false;
+        else if(!std::strcmp(arg, "-quiet"))
+            quiet = true;
+        else if(!std::strcmp(arg, "-help") || !std::strcmp(arg, "--help"))
+        {
+            printUsage();
+            return 0;
+        }
+        else if(arg[0] == '-' && arg[1])
+        {
+            printUsage();
+            return err("Unknown option!", 1);
+        }
+        else
+            files.push_back(arg);
+    }
+
+    if(files.size() < 2 || files.size() > 3)
+    {
+        printUsage();
+        return err("Missing argument! [must be the qm-file and the input file]!", 1);
+    }
+    if(!threadsCount)
+        threadsCount = 1;
+    if(!jsonSet)
+        json = endsWith(files[1], ".json") || endsWith(files[1], ".jsonl");
+
+    QmTranslatorX translator;
+    if(!translator.loadFile(files[0].c_str()))
+        return err("Can't load translation!", 2);
+
+    FILE *in = files[1] == "-" ? stdin : fopen(files[1].c_str(), "rb");
+    if(!in)
+        return err("Can't open the input file!", 2);
+    FILE *out = files.size() > 2 ? fopen(files[2].c_str(), "wb") : stdout;
+    if(!out)
+    {
+        if(in != stdin)
+            fclose(in);
+        return err("Can't open the output file!", 3);
+    }
+
+    std::vector<std::string> lines;
+    BulkJob job;
+    job.translator = &translator;
+    job.json = json;
+    job.sourceFallback = sourceFallback;
+    job.lines = &lines;
+    job.badLines = 0;
+    job.batch = 0;
+    job.busy = 0;
+    job.quit = false;
+
+    std::vector<std::thread> threads;
+    for(unsigned t = 1; t < threadsCount; ++t)
+        threads.emplace_back(runWorker, std::ref(job));
+
+    uint64_t inputBytes = 0, keys = 0;
+    bool writeFailed = false;
+    auto started = std::chrono::steady_clock::now();
+
+    bool more = true;
+    while(more)
+    {
+        more = readLines(in, lines, g_batchLines, inputBytes);
+        if(lines.empty())
+            break;
+
+        job.outputs.resize((lines.size() + g_chunkLines - 1) / g_chunkLines);
+        job.nextChunk = 0;
+
+        {
+            std::lock_guard<std::mutex> lock(job.mutex);
+            ++job.batch;
+            job.busy = unsigned(threads.size());
+        }
+        job.wake.notify_all();
+        translateChunks(job);
+        {
+            std::unique_lock<std::mutex> lock(job.mutex);
+            job.done.wait(lock, [&job]() { return job.busy == 0; });
+        }
+
+        for(const std::string &chunk : job.outputs)
+            writeFailed |= fwrite(chunk.data(), 1, chunk.size(), out) != chunk.size();
+        keys += lines.size();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(job.mutex);
+        job.quit = true;
+    }
+    job.wake.notify_all();
+    for(std::thread &t : threads)
+        t.join();
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    if(in != stdin)
+        fclose(in);
+    if(out != stdout)
+        writeFailed |= fclose(out) != 0;
+    else
+        fflush(out);
+
+    if(writeFailed)
+        return err("Can't write the output file!", 3);
+    if(job.badLines)
+        fprintf(stderr, "Warning: %zu malformed lines\n", size_t(job.badLines));
+    if(!quiet)
+    {
+        if(seconds <= 0.0)
+            seconds = 1e-9;
+        fprintf(stderr, "%llu keys in %.3f s on %u threads: %.0f keys/s, %.2f MB/s\n",
+                (unsigned long long)keys, seconds, threadsCount,
+                double(keys) / seconds, double(inputBytes) / seconds / (1024.0 * 1024.0));
+    }
+
+    return 0;
+}
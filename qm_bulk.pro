@@ -0,0 +1,22 @@
+CONFIG -= qt
+CONFIG += console
+CONFIG -= app_bundle
+CONFIG += c++11
+CONFIG += thread
+TEMPLATE = app
+
+TARGET = qm_bulk
+
+DESTDIR = $$PWD/bin
+
+HEADERS += \
+    qm_tools.h \
+    QTranslatorX/qm_format_p.h \
+    QTranslatorX/qm_profile.h \
+    QTranslatorX/qm_transcode.h \
+    QTranslatorX/qm_translator.h
+
+SOURCES += \
+    qm_bulk.cpp \
+    QTranslatorX/qm_profile.cpp \
+    QTranslatorX/qm_translator.cpp
@@ -0,0 +1,366 @@
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <set>
+#include <cstring>
+
+#include "QTranslatorX/qm_writer.h"
+#include "qm_tools.h"
+
+static void printUsage()
+{
+    printf("Usage:\n"
+           "    qm_compiler [options] ts-files... [-qm qm-file]\n\n"
+           "Compiles the ts-files into the qm-files without the Qt.\n"
+           "Every ts-file is compiled into the qm-file of the same name,\n"
+           "unless -qm is given: then all ts-files are merged into one qm-file.\n"
+           "The qm-files given as input get the perfect hash block added with -perfecthash\n"
+           "and get packed with -pack.\n\n"
+           "Options:\n"
+           "    -idbased          Use message IDs as the keys\n"
+           "    -compress         Keep only needed key tags and write the contexts table\n"
+           "    -nounfinished     Don't release unfinished translations\n"
+           "    -removeidentical  Don't release translations equal to the source text\n"
+           "    -keepobsolete     Release obsolete and vanished translations too\n"
+           "    -nodedup          Don't share identical message records\n"
+           "    -perfecthash      Add the perfect hash for the one-probe lookups\n"
+           "    -order key|hash|context\n"
+           "                      Order of the message records (default: hash)\n"
+           "    -profile file     Access profile to put the hot messages first with -order context\n"
+           "    -trim             Release only the messages found in the access profile\n"
+           "    -pack             Compress the messages, for QmTranslatorX only (smaller downloads)\n"
+           "    -language code    Override the language of the plural rules\n"
+           "    -idheader file.h  Generate the header of the dense message IDs for QmTranslatorX::bindMessageIds()\n"
+           "    -qm qm-file       Output file\n");
+}
+
+static std::string qmFileName(const std::string &tsFile)
+{
+    std::string::size_type dot = tsFile.rfind('.');
+    std::string::size_type slash = tsFile.find_last_of("/\\");
+    if(dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        return tsFile + ".qm";
+    return tsFile.substr(0, dot) + ".qm";
+}
+
+/*
+   Adds the perfect hash block to the already compiled qm-file
+   and compresses the messages, each if asked
+ */
+static bool processQmFile(QmWriterX &writer, const std::string &inFile, const std::string &outFile,
+                          bool perfectHash, bool pack)
+{
+    std::vector<uint8_t> in, out;
+    FILE *f = fopen(inFile.c_str(), "rb");
+    if(!f)
+    {
+        printf("Can't open file %s\n", inFile.c_str());
+        return false;
+    }
+    uint8_t buffer[4096];
+    size_t got;
+    while((got = fread(buffer, 1, sizeof(buffer), f)) > 0)
+        in.insert(in.end(), buffer, buffer + got);
+    fclose(f);
+
+    if(perfectHash)
+    {
+        if(!writer.addPerfectHash(in.data(), in.size(), out))
+        {
+            printf("%s: %s\n", inFile.c_str(), writer.errorString().c_str());
+            return false;
+        }
+        in.swap(out);
+    }
+    if(pack)
+    {
+        if(!writer.pack(in.data(), in.size(), out))
+        {
+            printf("%s: %s\n", inFile.c_str(), writer.errorString().c_str());
+            return false;
+        }
+        in.swap(out);
+    }
+
+    f = fopen(outFile.c_str(), "wb");
+    if(!f || fwrite(in.data(), 1, in.size(), f) != in.size())
+    {
+        if(f)
+            fclose(f);
+        printf("Can't write file %s\n", outFile.c_str());
+        return false;
+    }
+    fclose(f);
+    printf("Generated %s\n", outFile.c_str());
+    return true;
+}
+
+static std::string identifier(const std::string &str, size_t maxLength)
+{
+    std::string out;
+    for(char c : str)
+    {
+        if(out.size() >= maxLength)
+            break;
+        bool alnum = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9');
+        if(alnum)
+            out.push_back(c);
+        else if(!out.empty() && out.back() != '_')
+            out.push_back('_');
+    }
+    while(!out.empty() && out.back() == '_')
+        out.erase(out.size() - 1);
+    return out;
+}
+
+static std::string cString(const std::string &str)
+{
+    std::string out = "\"";
+    for(char c : str)
+    {
+        uint8_t u = uint8_t(c);
+        if(c == '"' || c == '\\')
+        {
+            out.push_back('\\');
+            out.push_back(c);
+        }
+        else if(u < 0x20 || u >= 0x7F)
+        {
+            char oct[5];
+            snprintf(oct, sizeof(oct), "\\%03o", u);
+            out.append(oct);
+        }
+        else
+            out.push_back(c);
+    }
+    out.push_back('"');
+    return out;
+}
+
+/*
+   Collects the keys of the messages to give them the dense IDs,
+   the same key from several ts-files gets one ID
+ */
+struct MessageIds
+{
+    std::vector<std::string> names;
+    std::vector<bool> numerus;
+    std::vector<std::string> strings;
+    std::set<std::string> seenKeys;
+    std::set<std::string> seenNames;
+
+    void add(const QmWriterX &writer)
+    {
+        const QmWriterX::Options &options = writer.options();
+        for(const QmMessageX &msg : writer.messages())
+        {
+            if(msg.obsolete && options.stripObsolete)
+                continue;
+            if(options.idBased && msg.id.empty())
+                continue;
+
+            std::string context = options.idBased ? std::string() : msg.context;
+            std::string sourceText = options.idBased ? msg.id : msg.sourceText;
+            std::string comment = options.idBased ? std::string() : msg.comment;
+            if(!seenKeys.insert(context + '\0' + sourceText + '\0' + comment).second)
+                continue;
+
+            // Named by the message ID if it has one, otherwise by the context and the source text
+            std::string name = identifier(msg.id, 64);
+            if(name.empty())
+                name = identifier(msg.context, 32);
+            if(name.empty() || msg.id.empty())
+                name += (name.empty() ? "" : "_") + identifier(msg.sourceText, 32);
+            if(name.empty() || (name[0] >= '0' && name[0] <= '9'))
+                name = "id" + name;
+            std::string unique = name;
+            for(int i = 2; !seenNames.insert(unique).second; ++i)
+                unique = name + "_" + std::to_string(i);
+
+            names.push_back(unique);
+            strings.push_back(cString(context));
+            strings.push_back(cString(sourceText));
+            strings.push_back(cString(comment));
+            numerus.push_back(msg.numerus);
+        }
+    }
+
+    bool save(const std::string &headerFile) const
+    {
+        std::string base = headerFile;
+        std::string::size_type slash = base.find_last_of("/\\");
+        if(slash != std::string::npos)
+            base.erase(0, slash + 1);
+        std::string::size_type dot = base.find('.');
+        if(dot != std::string::npos)
+            base.erase(dot);
+        base = identifier(base, 64);
+        if(base.empty() || (base[0] >= '0' && base[0] <= '9'))
+            base = "qm_ids" + base;
+
+        std::string guard;
+        for(char c : base)
+            guard.push_back(char(c >= 'a' && c <= 'z' ? c - 'a' + 'A' : c));
+        guard += "_H";
+
+        FILE *f = fopen(headerFile.c_str(), "wb");
+        if(!f)
+            return false;
+
+        fprintf(f, "// Generated by qm_compiler -idheader, don't edit!\n"
+                   "#ifndef %s\n#define %s\n\n"
+                   "#include \"QTranslatorX/qm_translator.h\"\n\n"
+                   "enum %s\n{\n", guard.c_str(), guard.c_str(), base.c_str());
+        for(const std::string &name : names)
+            fprintf(f, "    %s_%s,\n", base.c_str(), name.c_str());
+        fprintf(f, "    %s_count\n};\n\n", base.c_str());
+
+        fprintf(f, "//! Keys of the messages by ID, for QmTranslatorX::bindMessageIds()\n"
+                   "static const QmMessageKeyX %s_keys[%s_count] =\n{\n", base.c_str(), base.c_str());
+        for(size_t i = 0; i < names.size(); ++i)
+            fprintf(f, "    { %s, %s, %s, %s },\n", strings[i * 3].c_str(), strings[i * 3 + 1].c_str(),
+                    strings[i * 3 + 2].c_str(), numerus[i] ? "true" : "false");
+        fprintf(f, "};\n\n#endif // %s\n", guard.c_str());
+
+        bool ok = !ferror(f);
+        fclose(f);
+        return ok;
+    }
+};
+
+static bool release(QmWriterX &writer, const std::string &qmFile)
+{
+    if(!writer.saveFile(qmFile.c_str()))
+    {
+        printf("%s\n", writer.errorString().c_str());
+        return false;
+    }
+    printf("Generated %s\n", qmFile.c_str());
+    return true;
+}
+
+int main(int argc, char**argv)
+{
+    QmWriterX::Options options;
+    std::vector<std::string> tsFiles;
+    std::string qmFile;
+    std::string language;
+    std::string idHeader;
+    QmAccessProfileX profile;
+    MessageIds messageIds;
+
+    for(int i = 1; i < argc; ++i)
+    {
+        const char *arg = argv[i];
+        if(!std::strcmp(arg, "-idbased"))
+            options.idBased = true;
+        else if(!std::strcmp(arg, "-compress"))
+            options.stripKeys = true;
+        else if(!std::strcmp(arg, "-nounfinished"))
+            options.noUnfinished = true;
+        else if(!std::strcmp(arg, "-removeidentical"))
+            options.removeIdentical = true;
+        else if(!std::strcmp(arg, "-keepobsolete"))
+            options.stripObsolete = false;
+        else if(!std::strcmp(arg, "-nodedup"))
+            options.dedupMessages = false;
+        else if(!std::strcmp(arg, "-perfecthash"))
+            options.perfectHash = true;
+        else if(!std::strcmp(arg, "-order") && i + 1 < argc)
+        {
+            const char *order = argv[++i];
+            if(!std::strcmp(order, "key"))
+                options.order = QmWriterX::OrderByKey;
+            else if(!std::strcmp(order, "hash"))
+                options.order = QmWriterX::OrderByHash;
+            else if(!std::strcmp(order, "context"))
+                options.order = QmWriterX::OrderByContext;
+            else
+                return err("Unknown message order!", 1);
+        }
+        else if(!std::strcmp(arg, "-profile") && i + 1 < argc)
+        {
+            if(!profile.loadFile(argv[++i]))
+                return err("Can't load the access profile!", 1);
+        }
+        else if(!std::strcmp(arg, "-trim"))
+            options.trimByProfile = true;
+        else if(!std::strcmp(arg, "-pack"))
+            options.packMessages = true;
+        else if(!std::strcmp(arg, "-language") && i + 1 < argc)
+            language = argv[++i];
+        else if(!std::strcmp(arg, "-idheader") && i + 1 < argc)
+            idHeader = argv[++i];
+        else if(!std::strcmp(arg, "-qm") && i + 1 < argc)
+            qmFile = argv[++i];
+        else if(!std::strcmp(arg, "-help") || !std::strcmp(arg, "--help"))
+        {
+            printUsage();
+            return 0;
+        }
+        else if(arg[0] == '-')
+        {
+            printUsage();
+            return err("Unknown option!", 1);
+        }
+        else
+            tsFiles.push_back(arg);
+    }
+
+    if(tsFiles.empty())
+    {
+        printUsage();
+        return err("Missing argument! [must be a path to the translation source file]!", 1);
+    }
+
+    if(options.trimByProfile && profile.empty())
+        return err("The -trim requires the access profile!", 1);
+
+    QmWriterX writer;
+    writer.setProfile(profile);
+    if(endsWith(tsFiles[0], ".qm"))
+    {
+        if(!qmFile.empty() && tsFiles.size() > 1)
+            return err("Only one qm-file can be given together with -qm!", 1);
+        if(!options.perfectHash && !options.packMessages)
+            return err("The qm-files need -perfecthash or -pack!", 1);
+        for(const std::string &file : tsFiles)
+        {
+            if(!processQmFile(writer, file, qmFile.empty() ? file : qmFile,
+                              options.perfectHash, options.packMessages))
+                return 3;
+        }
+        return 0;
+    }
+
+    for(size_t i = 0; i < tsFiles.size(); ++i)
+    {
+        if(qmFile.empty() || i == 0)
+        {
+            writer.clear();
+            writer.options() = options;
+            if(!language.empty() && !writer.setLanguage(language))
+                printf("Warning: %s\n", writer.errorString().c_str());
+        }
+
+        if(!writer.loadTsFile(tsFiles[i].c_str()))
+            return err(writer.errorString().c_str(), 2);
+        if(!idHeader.empty() && (qmFile.empty() || i + 1 == tsFiles.size()))
+            messageIds.add(writer);
+
+        if(qmFile.empty() && !release(writer, qmFileName(tsFiles[i])))
+            return 3;
+    }
+
+    if(!qmFile.empty() && !release(writer, qmFile))
+        return 3;
+
+    if(!idHeader.empty())
+    {
+        if(!messageIds.save(idHeader))
+            return err("Can't write the message IDs header!", 3);
+        printf("Generated %s\n", idHeader.c_str());
+    }
+
+    return 0;
+}
@@ -0,0 +1,20 @@
+CONFIG -= qt
+CONFIG += console
+CONFIG -= app_bundle
+CONFIG += c++11
+TEMPLATE = app
+
+TARGET = qm_compiler
+
+DESTDIR = $$PWD/bin
+
+HEADERS += \
+    qm_tools.h \
+    QTranslatorX/qm_format_p.h \
+    QTranslatorX/qm_profile.h \
+    QTranslatorX/qm_writer.h
+
+SOURCES += \
+    qm_compiler.cpp \
+    QTranslatorX/qm_profile.cpp \
+    QTranslatorX/qm_writer.cpp
@@ -0,0 +1,149 @@
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+
+#include "QTranslatorX/qm_diff.h"
+#include "qm_tools.h"
+
+static void printUsage()
+{
+    printf("Usage:\n"
+           "    qm_diff [options] old-qm-file new-qm-file\n\n"
+           "Prints the messages added, removed and changed between two catalogs:\n"
+           "    + [context] source text     added message and its translations\n"
+           "    - [context] source text     removed message and its translations\n"
+           "    * [context] source text     changed message, old and new translations\n"
+           "Exits with 0 if the translations are identical, 1 if they differ, 2 on error.\n\n"
+           "Options:\n"
+           "    -threads count    Number of threads (default: number of CPU cores)\n"
+           "    -summary          Print only the numbers of the changes\n"
+           "    -quiet            Don't report the time taken\n");
+}
+
+static void appendKey(std::string &out, char mark, const QmMessageViewX &m)
+{
+    out.push_back(mark);
+    out.append(" [");
+    out.append(m.context.data ? m.context.data : "", m.context.size);
+    out.append("] ");
+    if(m.sourceText.data)
+        out.append(m.sourceText.data, m.sourceText.size);
+    else
+    {
+        // Keys are stripped, only the hash is known
+        char hash[16];
+        snprintf(hash, sizeof(hash), "#%08x", m.hash);
+        out.append(hash);
+    }
+    if(m.comment.size)
+    {
+        out.append(" (");
+        out.append(m.comment.data, m.comment.size);
+        out.push_back(')');
+    }
+    out.push_back('\n');
+}
+
+static void appendTranslations(std::string &out, const char *prefix, const QmMessageViewX &m)
+{
+    for(uint32_t form = 0; form < m.translationsCount; ++form)
+    {
+        out.append(prefix);
+        if(m.translationsCount > 1)
+            out.append("[" + std::to_string(form) + "] ");
+        out.append(m.translation8(form));
+        out.push_back('\n');
+    }
+}
+
+int main(int argc, char**argv)
+{
+    std::vector<std::string> files;
+    bool summary = false, quiet = false;
+    unsigned threadsCount = std::thread::hardware_concurrency();
+
+    for(int i = 1; i < argc; ++i)
+    {
+        const char *arg = argv[i];
+        if(!std::strcmp(arg, "-threads") && i + 1 < argc)
+            threadsCount = unsigned(std::strtoul(argv[++i], nullptr, 10));
+        else if(!std::strcmp(arg, "-summary"))
+            summary = true;
+        else if(!std::strcmp(arg, "-quiet"))
+            quiet = true;
+        else if(!std::strcmp(arg, "-help") || !std::strcmp(arg, "--help"))
+        {
+            printUsage();
+            return 0;
+        }
+        else if(arg[0] == '-')
+        {
+            printUsage();
+            return err("Unknown option!", 2);
+        }
+        else
+            files.push_back(arg);
+    }
+
+    if(files.size() != 2)
+    {
+        printUsage();
+        return err("Missing argument! [must be the old and the new qm-files]!", 2);
+    }
+    if(!threadsCount)
+        threadsCount = 1;
+
+    QmTranslatorX oldCatalog, newCatalog;
+    if(!oldCatalog.loadFile(files[0].c_str()))
+        return err("Can't load the old translation!", 2);
+    if(!newCatalog.loadFile(files[1].c_str()))
+        return err("Can't load the new translation!", 2);
+
+    QmCatalogDiffX diff;
+    auto started = std::chrono::steady_clock::now();
+    diff.compare(oldCatalog, newCatalog, threadsCount);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+    if(!summary)
+    {
+        std::string out;
+        for(const QmCatalogDiffX::Change &change : diff.changes())
+        {
+            switch(change.type)
+            {
+            case QmCatalogDiffX::Added:
+                appendKey(out, '+', change.newMessage);
+                appendTranslations(out, "    + ", change.newMessage);
+                break;
+            case QmCatalogDiffX::Removed:
+                appendKey(out, '-', change.oldMessage);
+                appendTranslations(out, "    - ", change.oldMessage);
+                break;
+            case QmCatalogDiffX::Changed:
+                appendKey(out, '*', change.newMessage);
+                appendTranslations(out, "    - ", change.oldMessage);
+                appendTranslations(out, "    + ", change.newMessage);
+                break;
+            }
+
+            if(out.size() >= 65536)
+            {
+                fwrite(out.data(), 1, out.size(), stdout);
+                out.clear();
+            }
+        }
+        fwrite(out.data(), 1, out.size(), stdout);
+    }
+
+    printf("%zu added, %zu removed, %zu changed, %zu unchanged\n",
+           diff.addedCount(), diff.removedCount(), diff.changedCount(), diff.unchangedCount());
+    if(!quiet)
+        fprintf(stderr, "Compared %zu and %zu messages in %.3f ms on %u threads\n",
+                oldCatalog.messagesCount(), newCatalog.messagesCount(), seconds * 1000.0, threadsCount);
+
+    return diff.identical() ? 0 : 1;
+}
@@ -1,9 +1,11 @@
 #include <stdio.h>
 #include <string>
 #include <memory.h>
+#include <cstring>
 #include <iostream>
 
 #include "QTranslatorX/QTranslatorX"
+#include "QTranslatorX/qm_search.h"
 
 //Globally declared translator
 QmTranslatorX translator;
@@ -15,7 +17,7 @@ QmTranslatorX translator;
  */
 std::string qtTrId(const char* trSrc)
 {
-    std::string out = translator.do_translate8(0, trSrc, 0, -1);
+    std::string out = translator.translateId8(trSrc);
     if(out.empty())
         return std::string(trSrc);
     else
@@ -57,6 +59,58 @@ int err(const char* errMsg, int code)
     return code;
 }
 
+/**
+ * @brief Prints every message of the loaded catalog
+ */
+void dumpMessages()
+{
+    for(const QmMessageViewX &m : translator.messages())
+    {
+        std::cout << "[" << m.context.toString() << "] "
+                  << m.sourceText.toString();
+        if(!m.comment.empty())
+            std::cout << " (" << m.comment.toString() << ")";
+        std::cout << "\n";
+        for(uint32_t i = 0; i < m.translationsCount; ++i)
+            std::cout << "    -> " << m.translation8(i) << "\n";
+    }
+}
+
+/**
+ * @brief Prints the ranges of codepoints used by the translations
+ */
+void dumpCodepoints()
+{
+    std::vector<char32_t> cps = translator.codepoints().codepoints();
+    std::cout << cps.size() << " codepoints:\n";
+    for(size_t i = 0; i < cps.size(); )
+    {
+        size_t j = i;
+        while(j + 1 < cps.size() && cps[j + 1] == cps[j] + 1)
+            ++j;
+        printf("U+%04X", unsigned(cps[i]));
+        if(j > i)
+            printf("-U+%04X", unsigned(cps[j]));
+        printf("\n");
+        i = j + 1;
+    }
+}
+
+/**
+ * @brief Prints the messages having the text in their translations
+ */
+void searchMessages(const char *text)
+{
+    QmSearchIndexX index;
+    index.build(translator);
+    for(const QmSearchIndexX::Hit &hit : index.search(translator, text))
+    {
+        QmMessageViewX m = translator.message(hit.message);
+        std::cout << "[" << hit.context.toString() << "] " << hit.sourceText.toString()
+                  << "\n    -> " << m.translation8(hit.form) << "\n";
+    }
+}
+
 int main(int argc, char**argv)
 {
     if(argc<=1)
@@ -65,8 +119,27 @@ int main(int argc, char**argv)
     if(!translator.loadFile(argv[1]))
         return err("Can't load translation!", 1);
 
+    if(argc > 2 && std::strcmp(argv[2], "-list") == 0)
+    {
+        dumpMessages();
+        return 0;
+    }
+
+    if(argc > 2 && std::strcmp(argv[2], "-codepoints") == 0)
+    {
+        dumpCodepoints();
+        return 0;
+    }
+
+    if(argc > 3 && std::strcmp(argv[2], "-search") == 0)
+    {
+        searchMessages(argv[3]);
+        return 0;
+    }
+
 
     std::cout << "Testing translations in work:\n";
+    translator.setMissCollector();
 
                  //% "Just a some testing string"
     std::cout << "test 1 (tr-ID): " << qtTrId("SomethingID1") << "\n";
@@ -76,6 +149,11 @@ int main(int argc, char**argv)
     std::cout << "test 3 (\"Fake\" context): " << Fake::tr("Another testing string for some", "Please do accurate translation and never produce shit!") << "\n";
     std::cout << "test 4 (\"Fake\" context): " << Fake::tr("What the heck you still try translate me?!", "Do you like jokes? Translate in Goblin style!") << "\n";
 
+    translator.drainMisses([](const char *context, const char *sourceText, const char *)
+    {
+        std::cout << "untranslated: \"" << context << "\" \"" << sourceText << "\"\n";
+    });
+
     return 0;
 }
 
@@ -2,6 +2,7 @@ CONFIG -= qt
 CONFIG += console
 CONFIG -= app_bundle
 CONFIG += c++11
+CONFIG += thread
 TEMPLATE = app
 
 TARGET = qm_dumper
@@ -16,10 +17,16 @@ CONFIG += trtest
 DESTDIR = $$PWD/bin
 
 HEADERS += \
+    QTranslatorX/qm_format_p.h \
+    QTranslatorX/qm_profile.h \
+    QTranslatorX/qm_search.h \
+    QTranslatorX/qm_transcode.h \
     QTranslatorX/qm_translator.h
 
 SOURCES += \
     qm_dumper.cpp \
+    QTranslatorX/qm_profile.cpp \
+    QTranslatorX/qm_search.cpp \
     QTranslatorX/qm_translator.cpp
 
 # Resolve path to lrelease tool
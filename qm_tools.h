@@ -0,0 +1,25 @@
+#ifndef QMTOOLSX_H
+#define QMTOOLSX_H
+
+#include <stdio.h>
+#include <string>
+#include <cstring>
+
+/*
+   Helpers shared by the command line utilities
+ */
+
+//Print the error message (the stdout may carry the output of the utility) and return the exit code
+static inline int err(const char* errMsg, int code)
+{
+    fprintf(stderr, "\n%s\n", errMsg);
+    return code;
+}
+
+static inline bool endsWith(const std::string &str, const char *suffix)
+{
+    size_t len = std::strlen(suffix);
+    return str.size() >= len && str.compare(str.size() - len, len, suffix) == 0;
+}
+
+#endif // QMTOOLSX_H
@@ -0,0 +1,70 @@
+#ifndef QM_TEST_H
+#define QM_TEST_H
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "QTranslatorX/qm_writer.h"
+#include "QTranslatorX/QTranslatorX"
+
+typedef bool (*QmTestFunc)();
+
+//! Test case registered by the QM_TEST() macro
+struct QmTestCase
+{
+    const char *name;
+    QmTestFunc  func;
+    QmTestCase *next;
+
+    QmTestCase(const char *name, QmTestFunc func);
+};
+
+#define QM_TEST(name) \
+    static bool name(); \
+    static QmTestCase name##_case(#name, name); \
+    static bool name()
+
+#define QM_CHECK(cond) \
+    do { \
+        if(!(cond)) \
+        { \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            return false; \
+        } \
+    } while(0)
+
+//! Key of the synthetic message, see addTestMessages()
+struct TestKey
+{
+    std::string context;
+    std::string sourceText;
+    std::string comment;
+    std::string id;
+    bool numerus;
+};
+
+//Path of the sample file of the bin directory
+std::string testDataPath(const char *name);
+
+//Key of the i-th synthetic message: 100 messages per context, every 7th has
+//the comment, every 11th is numerus with the three plural forms of the "ru"
+TestKey testKey(size_t i);
+//Translation of the i-th synthetic message, the form is ignored by the regular messages
+std::string testTranslation(size_t i, uint32_t form = 0);
+//Plural form of the "ru" rules for the number
+uint32_t testForm(int32_t n);
+
+//Add the count of the synthetic messages and set the "ru" rules
+void addTestMessages(QmWriterX &writer, size_t count);
+//Save the catalog, print the error of the writer on the failure
+bool compileCatalog(QmWriterX &writer, std::vector<uint8_t> &out);
+bool writeTestFile(const char *filePath, const std::vector<uint8_t> &data);
+
+//Translation by the key as UTF-8, false if there is none
+bool lookup(QmTranslatorX &translator, const TestKey &key, int32_t n, std::string &translation);
+//Check the translations of all the synthetic messages and the misses of the absent keys
+bool checkTestMessages(QmTranslatorX &translator, size_t count);
+
+#endif // QM_TEST_H
@@ -0,0 +1,152 @@
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <cstring>
+
+#include "qm_test.h"
+
+static QmTestCase *g_tests = nullptr;
+
+QmTestCase::QmTestCase(const char *name, QmTestFunc func) :
+    name(name), func(func), next(g_tests)
+{
+    g_tests = this;
+}
+
+std::string testDataPath(const char *name)
+{
+    return std::string(QM_TEST_DATA_DIR) + "/" + name;
+}
+
+TestKey testKey(size_t i)
+{
+    TestKey key;
+    key.context = "Context " + std::to_string(i / 100);
+    key.sourceText = "Source text " + std::to_string(i);
+    if(i % 7 == 0)
+        key.comment = "Comment " + std::to_string(i);
+    key.id = "message.id." + std::to_string(i);
+    key.numerus = (i % 11 == 0);
+    return key;
+}
+
+std::string testTranslation(size_t i, uint32_t form)
+{
+    std::string t = "Translation " + std::to_string(i);
+    if(i % 11 == 0)
+        t += " form " + std::to_string(form);
+    return t;
+}
+
+uint32_t testForm(int32_t n)
+{
+    if(n % 10 == 1 && n % 100 != 11)
+        return 0;
+    if(n % 10 >= 2 && n % 10 <= 4 && (n % 100 < 10 || n % 100 >= 20))
+        return 1;
+    return 2;
+}
+
+void addTestMessages(QmWriterX &writer, size_t count)
+{
+    writer.setLanguage("ru");
+    for(size_t i = 0; i < count; ++i)
+    {
+        const TestKey key = testKey(i);
+        QmMessageX m;
+        m.context = key.context;
+        m.sourceText = key.sourceText;
+        m.comment = key.comment;
+        m.id = key.id;
+        m.numerus = key.numerus;
+        for(uint32_t form = 0; form < (key.numerus ? 3u : 1u); ++form)
+        {
+            const std::string t = testTranslation(i, form);
+            m.translations.push_back(std::u16string(t.begin(), t.end()));
+        }
+        writer.addMessage(m);
+    }
+}
+
+bool compileCatalog(QmWriterX &writer, std::vector<uint8_t> &out)
+{
+    if(writer.save(out))
+        return true;
+    printf("Can't compile the catalog: %s\n", writer.errorString().c_str());
+    return false;
+}
+
+bool writeTestFile(const char *filePath, const std::vector<uint8_t> &data)
+{
+    FILE *f = fopen(filePath, "wb");
+    if(!f)
+        return false;
+    bool ok = fwrite(data.data(), 1, data.size(), f) == data.size();
+    return fclose(f) == 0 && ok;
+}
+
+bool lookup(QmTranslatorX &translator, const TestKey &key, int32_t n, std::string &translation)
+{
+    translation.clear();
+    return translator.translate<char>(qmAppendSinkX(translation), key.context.c_str(),
+                                      key.sourceText.c_str(), key.comment.c_str(), n);
+}
+
+bool checkTestMessages(QmTranslatorX &translator, size_t count)
+{
+    std::string t;
+    for(size_t i = 0; i < count; ++i)
+    {
+        const TestKey key = testKey(i);
+        if(key.numerus)
+        {
+            for(int32_t n : {1, 3, 5, 21, 112})
+            {
+                QM_CHECK(lookup(translator, key, n, t));
+                QM_CHECK(t == testTranslation(i, testForm(n)));
+            }
+        }
+        else
+        {
+            QM_CHECK(lookup(translator, key, -1, t));
+            QM_CHECK(t == testTranslation(i));
+        }
+
+        TestKey absent = key;
+        absent.sourceText = "Absent " + key.sourceText;
+        QM_CHECK(!lookup(translator, absent, -1, t));
+    }
+    return true;
+}
+
+/*
+   Runs the tests having the name starting with the argument, or all of them
+ */
+int main(int argc, char **argv)
+{
+    const char *prefix = argc > 1 ? argv[1] : "";
+    std::vector<QmTestCase *> tests;
+    for(QmTestCase *test = g_tests; test; test = test->next)
+    {
+        if(std::strncmp(test->name, prefix, std::strlen(prefix)) == 0)
+            tests.insert(tests.begin(), test);
+    }
+
+    if(tests.empty())
+    {
+        printf("No tests matching \"%s\"!\n", prefix);
+        return 2;
+    }
+
+    int failed = 0;
+    for(QmTestCase *test : tests)
+    {
+        bool ok = test->func();
+        printf("%s %s\n", ok ? "PASS" : "FAIL", test->name);
+        if(!ok)
+            ++failed;
+    }
+
+    printf("%d of %d tests failed\n", failed, int(tests.size()));
+    return failed ? 1 : 0;
+}
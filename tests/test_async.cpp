@@ -0,0 +1,179 @@
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <future>
+
+#include "qm_test.h"
+
+static const char *g_newPrefix = "New ";
+
+/*
+   Writes the synthetic catalog, the new one has the prefixed translations
+ */
+static bool writeCatalog(const char *filePath, size_t count, bool newTranslations)
+{
+    QmWriterX writer;
+    addTestMessages(writer, count);
+    if(newTranslations)
+    {
+        const std::string prefix(g_newPrefix);
+        for(QmMessageX &m : writer.messages())
+        {
+            for(std::u16string &t : m.translations)
+                t.insert(t.begin(), prefix.begin(), prefix.end());
+        }
+    }
+    std::vector<uint8_t> data;
+    QM_CHECK(compileCatalog(writer, data));
+    QM_CHECK(writeTestFile(filePath, data));
+    return true;
+}
+
+/*
+   Translates the messages from several threads for one frame, false if
+   any translation isn't the one of the expected catalog
+ */
+static bool translateFrame(QmTranslatorX &translator, size_t count, bool newTranslations)
+{
+    const unsigned threadsCount = 3;
+    std::atomic<bool> ok(true);
+    std::vector<std::thread> threads;
+    for(unsigned t = 0; t < threadsCount; ++t)
+    {
+        threads.emplace_back([&translator, &ok, t, count, newTranslations]()
+        {
+            std::string tn;
+            for(size_t i = t; i < count; i += threadsCount)
+            {
+                const TestKey key = testKey(i);
+                const int32_t n = key.numerus ? 3 : -1;
+                const std::string expected = (newTranslations ? g_newPrefix : "") +
+                                             testTranslation(i, key.numerus ? testForm(n) : 0);
+                if(!lookup(translator, key, n, tn) || tn != expected)
+                    ok = false;
+            }
+        });
+    }
+    for(std::thread &t : threads)
+        t.join();
+    return ok;
+}
+
+/*
+   The catalog gets loaded on the background while several threads keep
+   translating by the current one every frame, the main thread applies it
+   at the start of the frame once it's ready
+ */
+QM_TEST(async_load_while_translating)
+{
+    const size_t count = 20000;
+    QM_CHECK(writeCatalog("async_old.qm", count, false));
+    QM_CHECK(writeCatalog("async_new.qm", count, true));
+
+    QmTranslatorX translator;
+    QM_CHECK(translator.loadFile("async_old.qm"));
+    QM_CHECK(!translator.applyLoaded());
+
+    std::atomic<int> callbacks(0);
+    std::future<bool> loaded = translator.loadFileAsync("async_new.qm", nullptr, [&callbacks](bool ok)
+    {
+        if(ok)
+            ++callbacks;
+    });
+
+    size_t oldFrames = 0;
+    bool applied = false;
+    while(!applied)
+    {
+        applied = translator.applyLoaded();
+        QM_CHECK(translateFrame(translator, count, applied));
+        if(!applied)
+            ++oldFrames;
+    }
+    QM_CHECK(loaded.get());
+    QM_CHECK(callbacks == 1);
+    QM_CHECK(!translator.applyLoaded());
+    QM_CHECK(translateFrame(translator, count, true));
+    printf("Applied after %u frames\n", unsigned(oldFrames));
+    return true;
+}
+
+/*
+   The failed load keeps the current catalog, the message IDs get resolved
+   again for the applied catalog
+ */
+QM_TEST(async_swap)
+{
+    const size_t count = 1000;
+    QM_CHECK(writeCatalog("async_old.qm", count, false));
+    QM_CHECK(writeCatalog("async_new.qm", count, true));
+
+    std::vector<TestKey> strings;
+    std::vector<QmMessageKeyX> keys;
+    for(size_t i = 0; i < count; ++i)
+        strings.push_back(testKey(i));
+    for(const TestKey &key : strings)
+    {
+        QmMessageKeyX k = {key.context.c_str(), key.sourceText.c_str(), key.comment.c_str(), key.numerus};
+        keys.push_back(k);
+    }
+
+    QmTranslatorX translator;
+    QM_CHECK(translator.loadFile("async_old.qm"));
+    translator.bindMessageIds(keys.data(), keys.size());
+    QM_CHECK(translator.translateById8(1) == testTranslation(1));
+
+    std::future<bool> loaded = translator.loadFileAsync("async_absent.qm");
+    QM_CHECK(!loaded.get());
+    QM_CHECK(!translator.applyLoaded());
+    QM_CHECK(checkTestMessages(translator, count));
+
+    loaded = translator.loadFileAsync("async_new.qm");
+    QM_CHECK(loaded.get());
+    QM_CHECK(translator.do_translate8(strings[1].context.c_str(), strings[1].sourceText.c_str()) == testTranslation(1));
+    QM_CHECK(translator.applyLoaded());
+    QM_CHECK(translator.do_translate8(strings[1].context.c_str(), strings[1].sourceText.c_str()) ==
+             g_newPrefix + testTranslation(1));
+    for(size_t i = 0; i < count; ++i)
+    {
+        const int32_t n = strings[i].numerus ? 5 : -1;
+        QM_CHECK(translator.translateById8(uint32_t(i), n) ==
+                 g_newPrefix + testTranslation(i, strings[i].numerus ? testForm(n) : 0));
+    }
+    return true;
+}
+
+/*
+   The explicit load discards the result of the asynchronous one even when
+   the translator was empty, so applyLoaded() doesn't replace its catalog
+ */
+QM_TEST(async_explicit_load)
+{
+    const size_t count = 1000;
+    QM_CHECK(writeCatalog("async_old.qm", count, false));
+    QM_CHECK(writeCatalog("async_new.qm", count, true));
+
+    for(int variant = 0; variant < 2; ++variant)
+    {
+        QmTranslatorX translator;
+        std::future<bool> loaded = translator.loadFileAsync("async_new.qm");
+        QM_CHECK(loaded.get());
+        QM_CHECK(translator.isEmpty());
+        if(variant == 0)
+        {
+            QM_CHECK(translator.loadFile("async_old.qm"));
+        }
+        else
+        {
+            QmWriterX writer;
+            addTestMessages(writer, count);
+            std::vector<uint8_t> data;
+            QM_CHECK(compileCatalog(writer, data));
+            QM_CHECK(translator.loadData(data.data(), data.size()));
+        }
+        QM_CHECK(!translator.applyLoaded());
+        QM_CHECK(checkTestMessages(translator, count));
+    }
+    return true;
+}
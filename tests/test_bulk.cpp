@@ -0,0 +1,114 @@
+#include <string>
+#include <vector>
+#include <cstdlib>
+
+#include "qm_test.h"
+
+static bool readTestFile(const char *filePath, std::vector<std::string> &lines)
+{
+    FILE *file = fopen(filePath, "rb");
+    QM_CHECK(file);
+    std::string data;
+    char buffer[4096];
+    size_t got;
+    while((got = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        data.append(buffer, got);
+    fclose(file);
+
+    lines.clear();
+    size_t begin = 0, eol;
+    while((eol = data.find('\n', begin)) != std::string::npos)
+    {
+        lines.push_back(data.substr(begin, eol - begin));
+        begin = eol + 1;
+    }
+    QM_CHECK(begin == data.size());
+    return true;
+}
+
+static bool runBulk(const std::string &arguments)
+{
+    const std::string command = std::string("\"") + QM_BULK_TOOL + "\" -quiet " + arguments;
+    QM_CHECK(std::system(command.c_str()) == 0);
+    return true;
+}
+
+static bool writeBulkCatalog()
+{
+    QmWriterX writer;
+    addTestMessages(writer, 1000);
+    QmMessageX m;
+    m.context = "Bulk";
+    m.sourceText = "Tab\there \xF0\x9F\x98\x80";
+    m.translations.push_back(u"Line\nbreak \\ \U0001F600");
+    writer.addMessage(m);
+    std::vector<uint8_t> data;
+    QM_CHECK(compileCatalog(writer, data));
+    QM_CHECK(writeTestFile("bulk.qm", data));
+    return true;
+}
+
+/*
+   More lines than one batch translated by several threads come out in the
+   order of the input, the absent keys give the source texts
+ */
+QM_TEST(bulk_tsv)
+{
+    const size_t count = 70000;
+    QM_CHECK(writeBulkCatalog());
+    std::string input;
+    for(size_t i = 0; i < count; ++i)
+    {
+        const TestKey key = testKey(i % 2000);
+        input += key.context + '\t' + key.sourceText;
+        if(key.numerus || !key.comment.empty())
+            input += '\t' + std::string(key.numerus ? "5" : "") + '\t' + key.comment;
+        input += '\n';
+    }
+    input += "Bulk\tTab\\there \xF0\x9F\x98\x80\n";
+    QM_CHECK(writeTestFile("bulk_input.txt", std::vector<uint8_t>(input.begin(), input.end())));
+
+    QM_CHECK(runBulk("-threads 4 bulk.qm bulk_input.txt bulk_output.txt"));
+    std::vector<std::string> lines;
+    QM_CHECK(readTestFile("bulk_output.txt", lines));
+    QM_CHECK(lines.size() == count + 1);
+    for(size_t i = 0; i < count; ++i)
+    {
+        const size_t k = i % 2000;
+        const TestKey key = testKey(k);
+        if(k < 1000)
+            QM_CHECK(lines[i] == testTranslation(k, key.numerus ? testForm(5) : 0));
+        else
+            QM_CHECK(lines[i] == key.sourceText);
+    }
+    QM_CHECK(lines[count] == "Line\\nbreak \\\\ \xF0\x9F\x98\x80");
+
+    QM_CHECK(runBulk("-threads 1 -nosource bulk.qm bulk_input.txt bulk_output.txt"));
+    QM_CHECK(readTestFile("bulk_output.txt", lines));
+    QM_CHECK(lines.size() == count + 1);
+    QM_CHECK(lines[1] == testTranslation(1) && lines[1001].empty());
+    return true;
+}
+
+QM_TEST(bulk_json)
+{
+    QM_CHECK(writeBulkCatalog());
+    const std::string input =
+        "{\"context\": \"Context 0\", \"source\": \"Source text 1\"}\n"
+        "{\"context\": \"Context 0\", \"source\": \"Source text 11\", \"n\": 2}\n"
+        "{\"source\": \"Tab\\there \\ud83d\\ude00\", \"context\": \"Bulk\"}\n"
+        "{\"context\": \"Context 0\", \"source\": \"Absent \\\"key\\\"\"}\n"
+        "not a JSON line\n";
+    QM_CHECK(writeTestFile("bulk_input.jsonl", std::vector<uint8_t>(input.begin(), input.end())));
+
+    QM_CHECK(runBulk("-threads 2 bulk.qm bulk_input.jsonl bulk_output.jsonl"));
+    std::vector<std::string> lines;
+    QM_CHECK(readTestFile("bulk_output.jsonl", lines));
+    QM_CHECK(lines.size() == 5);
+    QM_CHECK(lines[0] == "{\"translation\": \"" + testTranslation(1) + "\"}");
+    QM_CHECK(lines[1] == "{\"translation\": \"" + testTranslation(11, testForm(2)) + "\"}");
+    QM_CHECK(lines[2] == "{\"translation\": \"Line\\nbreak \\\\ \xF0\x9F\x98\x80\"}");
+    QM_CHECK(lines[3] == "{\"translation\": \"Absent \\\"key\\\"\", \"untranslated\": true}");
+    QM_CHECK(lines[4] == "{\"translation\": \"\", \"untranslated\": true}");
+    return true;
+}
@@ -0,0 +1,83 @@
+#include <string>
+#include <vector>
+
+#include "qm_test.h"
+
+/*
+   Compiles the sample ts-file and checks every released translation
+ */
+static bool checkSampleFile(const char *name, bool stripKeys)
+{
+    QmWriterX writer;
+    writer.options().stripKeys = stripKeys;
+    QM_CHECK(writer.loadTsFile(testDataPath(name).c_str()));
+    QM_CHECK(!writer.messages().empty());
+
+    std::vector<uint8_t> data;
+    QM_CHECK(compileCatalog(writer, data));
+    QmTranslatorX translator;
+    QM_CHECK(translator.loadData(data.data(), data.size()));
+    QM_CHECK(translator.messagesCount() == writer.messages().size());
+
+    for(const QmMessageX &m : writer.messages())
+    {
+        std::u16string t;
+        QM_CHECK(translator.translate<char16_t>(qmAppendSinkX(t), m.context.c_str(),
+                                                m.sourceText.c_str(), m.comment.c_str()));
+        QM_CHECK(t == m.translations[0]);
+    }
+    return true;
+}
+
+QM_TEST(catalog_sample_files)
+{
+    QM_CHECK(checkSampleFile("testing_ru.ts", false));
+    QM_CHECK(checkSampleFile("testing_en.ts", false));
+    QM_CHECK(checkSampleFile("testing_ru.ts", true));
+    return true;
+}
+
+QM_TEST(catalog_generated)
+{
+    for(int stripKeys = 0; stripKeys < 2; ++stripKeys)
+    {
+        QmWriterX writer;
+        writer.options().stripKeys = stripKeys != 0;
+        addTestMessages(writer, 3000);
+        std::vector<uint8_t> data;
+        QM_CHECK(compileCatalog(writer, data));
+
+        QmTranslatorX translator;
+        QM_CHECK(translator.loadData(data.data(), data.size()));
+        QM_CHECK(checkTestMessages(translator, 3000));
+    }
+    return true;
+}
+
+/*
+   The messages of the dependency are found through the catalog naming it
+ */
+QM_TEST(catalog_dependencies)
+{
+    QmWriterX dependency;
+    addTestMessages(dependency, 1000);
+    std::vector<uint8_t> data;
+    QM_CHECK(compileCatalog(dependency, data));
+    QM_CHECK(writeTestFile("catalog_dependency.qm", data));
+
+    QmWriterX writer;
+    writer.setLanguage("ru");
+    writer.addDependency("catalog_dependency.qm");
+    QmMessageX m;
+    m.context = "Own";
+    m.sourceText = "Own message";
+    m.translations.push_back(u"Own translation");
+    writer.addMessage(m);
+    QM_CHECK(compileCatalog(writer, data));
+
+    QmTranslatorX translator;
+    QM_CHECK(translator.loadData(data.data(), data.size()));
+    QM_CHECK(translator.do_translate8("Own", "Own message") == "Own translation");
+    QM_CHECK(checkTestMessages(translator, 1000));
+    return true;
+}
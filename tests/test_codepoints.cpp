@@ -0,0 +1,143 @@
+#include <string>
+#include <vector>
+#include <set>
+
+#include "qm_test.h"
+
+/*
+   Adds the messages spread over the catalog having the non-Latin characters,
+   the pairs of surrogates and the unpaired ones, returns their codepoints
+ */
+static std::set<char32_t> addSpecialMessages(QmWriterX &writer, size_t count)
+{
+    std::set<char32_t> codepoints;
+    for(size_t i = 0; i < count; ++i)
+    {
+        QmMessageX m;
+        m.context = "Special " + std::to_string(i % 10);
+        m.sourceText = "Special " + std::to_string(i);
+        std::u16string t;
+        const char16_t bmp[] = {char16_t(0xE9 + i % 16), char16_t(0x416 + i % 32), char16_t(0x3000 + i)};
+        for(char16_t ch : bmp)
+        {
+            t.push_back(ch);
+            codepoints.insert(ch);
+        }
+        const char32_t astral = 0x1F600 + char32_t(i);
+        t.push_back(char16_t(0xD800 + ((astral - 0x10000) >> 10)));
+        t.push_back(char16_t(0xDC00 + ((astral - 0x10000) & 0x3FF)));
+        codepoints.insert(astral);
+        // Unpaired surrogates are ignored
+        t.push_back(char16_t(0xDC00 + i));
+        t.push_back(u'!');
+        t.push_back(char16_t(0xD800 + i));
+        m.translations.push_back(t);
+        writer.addMessage(m);
+    }
+    return codepoints;
+}
+
+/*
+   Codepoints of the catalog scanned by one thread and by several ones are the
+   same for the regular and the packed catalogs
+ */
+QM_TEST(codepoints_threads)
+{
+    const size_t count = 20000;
+    for(int packMessages = 0; packMessages < 2; ++packMessages)
+    {
+        QmWriterX writer;
+        writer.options().packMessages = packMessages != 0;
+        addTestMessages(writer, count);
+        std::set<char32_t> expected = addSpecialMessages(writer, 300);
+        for(const char *ch = "Translation 0123456789form!"; *ch; ++ch)
+            expected.insert(char32_t(*ch));
+        std::vector<uint8_t> data;
+        QM_CHECK(compileCatalog(writer, data));
+
+        for(unsigned threadsCount = 1; threadsCount <= 4; threadsCount += 3)
+        {
+            QmTranslatorX::setLoadThreads(threadsCount);
+            QmTranslatorX translator;
+            QM_CHECK(translator.loadData(data.data(), data.size()));
+            const std::vector<char32_t> codepoints = translator.codepoints().codepoints();
+            QM_CHECK(std::set<char32_t>(codepoints.begin(), codepoints.end()) == expected);
+            QM_CHECK(translator.codepoints().count() == expected.size());
+        }
+    }
+    QmTranslatorX::setLoadThreads(0);
+    return true;
+}
+
+/*
+   The codepoints of the dependencies are added to the catalog's own ones
+ */
+QM_TEST(codepoints_dependencies)
+{
+    QmWriterX dependency;
+    const std::set<char32_t> special = addSpecialMessages(dependency, 10);
+    std::vector<uint8_t> data;
+    QM_CHECK(compileCatalog(dependency, data));
+    QM_CHECK(writeTestFile("codepoints_dependency.qm", data));
+
+    QmWriterX writer;
+    writer.addDependency("codepoints_dependency.qm");
+    addTestMessages(writer, 100);
+    QM_CHECK(compileCatalog(writer, data));
+
+    QmTranslatorX translator;
+    QM_CHECK(translator.loadData(data.data(), data.size()));
+    const QmCodepointSetX &codepoints = translator.codepoints();
+    for(char32_t ch : special)
+        QM_CHECK(codepoints.contains(ch));
+    QM_CHECK(codepoints.contains(U'T'));
+    QM_CHECK(!codepoints.contains(U'Z'));
+    return true;
+}
+
+QM_TEST(codepoints_set)
+{
+    QmCodepointSetX set;
+    QM_CHECK(set.empty() && set.count() == 0 && !set.contains(U'A'));
+    const char32_t inserted[] = {0x10FFFF, U'A', 0x1F600, 0xFF, 0x100, U'A', 0x10FFFF + 1};
+    for(char32_t ch : inserted)
+        set.insert(ch);
+    // The codepoints beyond the Unicode range are ignored
+    QM_CHECK(set.count() == 5);
+    QM_CHECK(set.contains(0xFF) && set.contains(0x100) && !set.contains(0x101) && !set.contains(0x10FFFF + 1));
+    QM_CHECK(set.codepoints() == std::vector<char32_t>({U'A', 0xFF, 0x100, 0x1F600, 0x10FFFF}));
+
+    QmCodepointSetX other;
+    other.insert(U'B');
+    other.insert(0x1F600);
+    set.unite(other);
+    QM_CHECK(set.count() == 6 && set.contains(U'B'));
+    set.clear();
+    QM_CHECK(set.empty() && !set.contains(U'A'));
+    return true;
+}
+
+/*
+   The set is cached until the catalog is closed or replaced
+ */
+QM_TEST(codepoints_reload)
+{
+    QmWriterX writer;
+    addTestMessages(writer, 100);
+    std::vector<uint8_t> data;
+    QM_CHECK(compileCatalog(writer, data));
+    QmTranslatorX translator;
+    QM_CHECK(translator.loadData(data.data(), data.size()));
+    QM_CHECK(!translator.codepoints().contains(0x3000));
+
+    QmWriterX special;
+    std::set<char32_t> expected = addSpecialMessages(special, 5);
+    expected.insert(U'!');
+    QM_CHECK(compileCatalog(special, data));
+    QM_CHECK(translator.loadData(data.data(), data.size()));
+    const std::vector<char32_t> codepoints = translator.codepoints().codepoints();
+    QM_CHECK(std::set<char32_t>(codepoints.begin(), codepoints.end()) == expected);
+    translator.close();
+    QM_CHECK(translator.codepoints().empty());
+    return true;
+}
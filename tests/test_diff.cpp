@@ -0,0 +1,90 @@
+#include <string>
+#include <vector>
+#include <set>
+
+#include "QTranslatorX/qm_diff.h"
+#include "qm_test.h"
+
+/*
+   The new catalog drops every 10th message of the old one, changes the
+   translation of every 7th, the plural forms of the 33rd and adds more
+ */
+static bool compileCatalogs(std::vector<uint8_t> &oldData, std::vector<uint8_t> &newData,
+                            size_t count, bool stripKeys)
+{
+    QmWriterX oldWriter, newWriter;
+    oldWriter.options().stripKeys = newWriter.options().stripKeys = stripKeys;
+    addTestMessages(oldWriter, count);
+    addTestMessages(newWriter, count + count / 4);
+
+    std::vector<QmMessageX> messages;
+    for(size_t i = 0; i < newWriter.messages().size(); ++i)
+    {
+        QmMessageX m = newWriter.messages()[i];
+        if(i < count && i % 10 == 0)
+            continue;
+        if(i < count && i % 7 == 0)
+            m.translations[0] += u" (changed)";
+        if(i < count && i % 33 == 0)
+            m.translations.pop_back();
+        messages.push_back(m);
+    }
+    newWriter.messages() = messages;
+
+    QM_CHECK(compileCatalog(oldWriter, oldData));
+    QM_CHECK(compileCatalog(newWriter, newData));
+    return true;
+}
+
+QM_TEST(diff_counts)
+{
+    const size_t count = 20000;
+    size_t removed = 0, changed = 0;
+    for(size_t i = 0; i < count; ++i)
+    {
+        if(i % 10 == 0)
+            ++removed;
+        else if(i % 7 == 0 || i % 33 == 0)
+            ++changed;
+    }
+
+    for(int stripKeys = 0; stripKeys < 2; ++stripKeys)
+    {
+        std::vector<uint8_t> oldData, newData;
+        QM_CHECK(compileCatalogs(oldData, newData, count, stripKeys != 0));
+        QmTranslatorX oldCatalog, newCatalog;
+        QM_CHECK(oldCatalog.loadData(oldData.data(), oldData.size()));
+        QM_CHECK(newCatalog.loadData(newData.data(), newData.size()));
+
+        for(unsigned threadsCount = 1; threadsCount <= 4; threadsCount += 3)
+        {
+            QmCatalogDiffX diff;
+            diff.compare(oldCatalog, newCatalog, threadsCount);
+            QM_CHECK(!diff.identical());
+            QM_CHECK(diff.addedCount() == count / 4);
+            QM_CHECK(diff.removedCount() == removed);
+            QM_CHECK(diff.changedCount() == changed);
+            QM_CHECK(diff.unchangedCount() == count - removed - changed);
+            QM_CHECK(diff.changes().size() == diff.addedCount() + diff.removedCount() + diff.changedCount());
+
+            // Changes go by the key hashes and point to the messages of their sides
+            uint32_t previousHash = 0;
+            for(const QmCatalogDiffX::Change &change : diff.changes())
+            {
+                const QmMessageViewX &m = change.type == QmCatalogDiffX::Added ? change.newMessage : change.oldMessage;
+                QM_CHECK(m.hash >= previousHash);
+                previousHash = m.hash;
+                QM_CHECK((change.oldIndex == QmCatalogDiffX::npos) == (change.type == QmCatalogDiffX::Added));
+                QM_CHECK((change.newIndex == QmCatalogDiffX::npos) == (change.type == QmCatalogDiffX::Removed));
+                if(change.type == QmCatalogDiffX::Changed)
+                    QM_CHECK(oldCatalog.message(change.oldIndex).hash == newCatalog.message(change.newIndex).hash);
+            }
+        }
+
+        QmCatalogDiffX same;
+        same.compare(oldCatalog, oldCatalog);
+        QM_CHECK(same.identical());
+        QM_CHECK(same.unchangedCount() == oldCatalog.messagesCount());
+    }
+    return true;
+}
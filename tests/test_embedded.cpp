@@ -0,0 +1,78 @@
+#include <string>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+
+#include "qm_test.h"
+#include "test_catalogs.h"
+
+/*
+   The catalogs embedded by the qtranslatorx_embed_translations() are found
+   by the base names of their files
+ */
+QM_TEST(embedded_catalogs)
+{
+    QM_CHECK(test_catalogs_count == 2);
+    QM_CHECK(test_catalogs[test_catalogs_count].name == nullptr);
+
+    const char *names[] = {"testing_en", "testing_ru"};
+    for(const char *name : names)
+    {
+        QmWriterX writer;
+        QM_CHECK(writer.loadTsFile(testDataPath((std::string(name) + ".ts").c_str()).c_str()));
+
+        const QmEmbeddedCatalogX *catalog = test_catalogs;
+        while(catalog->name && std::strcmp(catalog->name, name) != 0)
+            ++catalog;
+        QM_CHECK(catalog->name);
+        QM_CHECK(reinterpret_cast<uintptr_t>(catalog->data) % 16 == 0);
+
+        QmTranslatorX translator;
+        QM_CHECK(translator.loadEmbedded(test_catalogs, name));
+        for(const QmMessageX &m : writer.messages())
+        {
+            QM_CHECK(translator.do_translate(m.context.c_str(), m.sourceText.c_str(), m.comment.c_str()) ==
+                     m.translations[0]);
+        }
+    }
+
+    QmTranslatorX translator;
+    QM_CHECK(!translator.loadEmbedded(test_catalogs, "testing_de"));
+    QM_CHECK(translator.isEmpty());
+    return true;
+}
+
+/*
+   The static data is not copied and stays untouched by the lookups
+ */
+QM_TEST(embedded_static_data)
+{
+    QmWriterX writer;
+    addTestMessages(writer, 2000);
+    std::vector<uint8_t> data;
+    QM_CHECK(compileCatalog(writer, data));
+    const std::vector<uint8_t> original = data;
+
+    QmTranslatorX translator;
+    QM_CHECK(!translator.loadStaticData(data.data(), 0));
+    QM_CHECK(translator.loadStaticData(data.data(), data.size()));
+    QM_CHECK(checkTestMessages(translator, 2000));
+
+    // The translation changed in the data comes out changed, the record has
+    // the length of the UTF-16BE data followed by the data
+    const std::string t = testTranslation(10);
+    std::vector<uint8_t> utf16be = {0, 0, 0, uint8_t(t.size() * 2)};
+    for(char ch : t)
+    {
+        utf16be.push_back(0);
+        utf16be.push_back(uint8_t(ch));
+    }
+    std::vector<uint8_t>::iterator it = std::search(data.begin(), data.end(), utf16be.begin(), utf16be.end());
+    QM_CHECK(it != data.end());
+    it[5] = 'X';
+    QM_CHECK(translator.do_translate8(testKey(10).context.c_str(), testKey(10).sourceText.c_str()) == "X" + t.substr(1));
+    it[5] = uint8_t(t[0]);
+    translator.close();
+    QM_CHECK(data == original);
+    return true;
+}
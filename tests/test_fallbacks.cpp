@@ -0,0 +1,124 @@
+#include <string>
+#include <vector>
+#include <thread>
+
+#include "qm_test.h"
+
+/*
+   Catalog of the messages from first to last, the translations prefixed
+   by the locale name
+ */
+static bool compileLocale(std::vector<uint8_t> &data, const std::string &locale,
+                          size_t first, size_t last, bool perfectHash)
+{
+    QmWriterX writer;
+    writer.options().perfectHash = perfectHash;
+    writer.setLanguage("ru");
+    for(size_t i = first; i < last; ++i)
+    {
+        const TestKey key = testKey(i);
+        QmMessageX m;
+        m.context = key.context;
+        m.sourceText = key.sourceText;
+        m.comment = key.comment;
+        const std::string t = locale + " " + testTranslation(i);
+        m.translations.push_back(std::u16string(t.begin(), t.end()));
+        writer.addMessage(m);
+    }
+    QM_CHECK(compileCatalog(writer, data));
+    return true;
+}
+
+/*
+   Every key is resolved by the first catalog having it, the keys absent from
+   all of them keep missing while they are remembered, until the fallback
+   having them gets loaded
+ */
+QM_TEST(fallbacks_order)
+{
+    for(int perfectHash = 0; perfectHash < 2; ++perfectHash)
+    {
+        std::vector<uint8_t> regional, parent, parentFull, base;
+        QM_CHECK(compileLocale(regional, "pt_BR", 0, 100, perfectHash != 0));
+        QM_CHECK(compileLocale(parent, "pt", 0, 1000, perfectHash != 0));
+        QM_CHECK(compileLocale(parentFull, "pt", 0, 3000, perfectHash != 0));
+        QM_CHECK(compileLocale(base, "en", 0, 2000, perfectHash != 0));
+
+        QmTranslatorX pt_BR, pt, en;
+        QM_CHECK(pt_BR.loadData(regional.data(), regional.size()));
+        QM_CHECK(pt.loadData(parent.data(), parent.size()));
+        QM_CHECK(en.loadData(base.data(), base.size()));
+        pt_BR.setFallbacks({&pt, &en});
+
+        std::string t;
+        for(int round = 0; round < 2; ++round)
+        {
+            for(size_t i = 0; i < 3000; i += 7)
+            {
+                const TestKey key = testKey(i);
+                const bool found = lookup(pt_BR, key, -1, t);
+                QM_CHECK(found == (i < 2000));
+                if(found)
+                {
+                    const char *locale = i < 100 ? "pt_BR " : i < 1000 ? "pt " : "en ";
+                    QM_CHECK(t == locale + testTranslation(i));
+                }
+            }
+        }
+
+        // The remembered absent keys are looked up again in the loaded catalog
+        QM_CHECK(pt.loadData(parentFull.data(), parentFull.size()));
+        for(size_t i = 0; i < 3000; i += 7)
+        {
+            QM_CHECK(lookup(pt_BR, testKey(i), -1, t));
+            QM_CHECK(t == (i < 100 ? "pt_BR " : "pt ") + testTranslation(i));
+        }
+
+        pt_BR.setFallbacks({&en});
+        QM_CHECK(lookup(pt_BR, testKey(1001), -1, t) && t == "en " + testTranslation(1001));
+        QM_CHECK(!lookup(pt_BR, testKey(2001), -1, t));
+    }
+    return true;
+}
+
+/*
+   The threads sharing the memo of more keys than it has slots get the
+   translations of the same catalogs
+ */
+QM_TEST(fallbacks_threads)
+{
+    std::vector<uint8_t> regional, parent, base;
+    QM_CHECK(compileLocale(regional, "pt_BR", 0, 1000, false));
+    QM_CHECK(compileLocale(parent, "pt", 0, 10000, false));
+    QM_CHECK(compileLocale(base, "en", 0, 15000, false));
+    QmTranslatorX pt_BR, pt, en;
+    QM_CHECK(pt_BR.loadData(regional.data(), regional.size()));
+    QM_CHECK(pt.loadData(parent.data(), parent.size()));
+    QM_CHECK(en.loadData(base.data(), base.size()));
+    pt_BR.setFallbacks({&pt, &en});
+
+    std::vector<size_t> failures(4, 0);
+    std::vector<std::thread> threads;
+    for(size_t t = 0; t < failures.size(); ++t)
+    {
+        threads.emplace_back([&pt_BR, &failures, t]()
+        {
+            std::string tn;
+            for(int round = 0; round < 2; ++round)
+            {
+                for(size_t i = t; i < 20000; i += 3)
+                {
+                    const bool found = lookup(pt_BR, testKey(i), -1, tn);
+                    const char *locale = i < 1000 ? "pt_BR " : i < 10000 ? "pt " : "en ";
+                    if(found != (i < 15000) || (found && tn != locale + testTranslation(i)))
+                        ++failures[t];
+                }
+            }
+        });
+    }
+    for(std::thread &t : threads)
+        t.join();
+    for(size_t f : failures)
+        QM_CHECK(f == 0);
+    return true;
+}
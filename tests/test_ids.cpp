@@ -0,0 +1,197 @@
+#include <string>
+#include <vector>
+#include <functional>
+
+#include "qm_test.h"
+
+static bool compileIdCatalog(std::vector<uint8_t> &data, size_t count, bool stripKeys, bool pack)
+{
+    QmWriterX writer;
+    writer.options().idBased = true;
+    writer.options().stripKeys = stripKeys;
+    writer.options().packMessages = pack;
+    addTestMessages(writer, count);
+    QM_CHECK(compileCatalog(writer, data));
+    return true;
+}
+
+static bool checkIds(QmTranslatorX &translator, size_t count)
+{
+    QmStringViewX view;
+    for(size_t i = 0; i < count; ++i)
+    {
+        const TestKey key = testKey(i);
+        if(key.numerus)
+        {
+            for(int32_t n : {1, 2, 11, 25})
+                QM_CHECK(translator.translateId8(key.id.c_str(), n) == testTranslation(i, testForm(n)));
+        }
+        else
+            QM_CHECK(translator.translateId8(key.id.c_str()) == testTranslation(i));
+        QM_CHECK(!translator.findTranslationId(("absent." + key.id).c_str(), -1, view));
+    }
+    return true;
+}
+
+/*
+   The ID-based catalogs get the index of IDs with -compress too, the packed
+   ones get it after the relayout unpacks them, all are found by the IDs
+ */
+QM_TEST(ids_index)
+{
+    const size_t count = 5000;
+    for(int variant = 0; variant < 4; ++variant)
+    {
+        std::vector<uint8_t> data;
+        QM_CHECK(compileIdCatalog(data, count, variant & 1, variant & 2));
+
+        QmTranslatorX translator;
+        QM_CHECK(translator.loadData(data.data(), data.size()));
+        QM_CHECK(translator.isPacked() == ((variant & 2) != 0));
+        QM_CHECK(translator.isIdBased() == !translator.isPacked());
+        QM_CHECK(checkIds(translator, count));
+        QM_CHECK(translator.relayout());
+        QM_CHECK(translator.isIdBased());
+        QM_CHECK(checkIds(translator, count));
+    }
+
+    // The catalogs keyed by the source texts have no index of IDs
+    QmWriterX writer;
+    addTestMessages(writer, 100);
+    std::vector<uint8_t> data;
+    QM_CHECK(compileCatalog(writer, data));
+    QmTranslatorX translator;
+    QM_CHECK(translator.loadData(data.data(), data.size()));
+    QM_CHECK(!translator.isIdBased());
+    QM_CHECK(translator.translateId8(testKey(1).id.c_str()).empty());
+    return true;
+}
+
+/*
+   The ID-based sample messages are found by the ID, others by the key
+ */
+QM_TEST(ids_sample_file)
+{
+    QmWriterX writer;
+    writer.options().idBased = true;
+    QM_CHECK(writer.loadTsFile(testDataPath("testing_ru.ts").c_str()));
+    std::vector<uint8_t> data;
+    QM_CHECK(compileCatalog(writer, data));
+
+    QmTranslatorX translator;
+    QM_CHECK(translator.loadData(data.data(), data.size()));
+    for(const QmMessageX &m : writer.messages())
+    {
+        if(m.id.empty())
+            continue;
+        std::u16string expected = m.translations[0];
+        QM_CHECK(translator.translateId(m.id.c_str()) == expected);
+    }
+    return true;
+}
+
+/*
+   Writes the synthetic catalog of the language, the translations get the
+   prefix and only the messages accepted by the filter are kept
+ */
+static bool writeLanguageCatalog(const char *filePath, const char *language, const std::string &prefix,
+                                 const std::vector<std::string> &dependencies,
+                                 const std::function<bool(size_t i)> &filter, size_t count)
+{
+    QmWriterX source;
+    addTestMessages(source, count);
+    QmWriterX writer;
+    QM_CHECK(writer.setLanguage(language));
+    for(const std::string &dependency : dependencies)
+        writer.addDependency(dependency);
+    for(size_t i = 0; i < count; ++i)
+    {
+        if(!filter(i))
+            continue;
+        QmMessageX m = source.messages()[i];
+        for(std::u16string &t : m.translations)
+            t.insert(t.begin(), prefix.begin(), prefix.end());
+        writer.addMessage(m);
+    }
+    std::vector<uint8_t> data;
+    QM_CHECK(compileCatalog(writer, data));
+    QM_CHECK(writeTestFile(filePath, data));
+    return true;
+}
+
+/*
+   Every bound ID gives the same translation as its key: of the catalog, its
+   dependency or the fallback having the message, by the plural rules of the
+   catalog having it
+ */
+static bool checkBoundIds(QmTranslatorX &translator, const std::vector<TestKey> &keys)
+{
+    for(size_t i = 0; i < keys.size(); ++i)
+    {
+        const TestKey &key = keys[i];
+        for(int32_t n : {-1, 0, 1, 2, 5, 21})
+        {
+            if(!key.numerus && n >= 0)
+                continue;
+            const std::string byKey = translator.do_translate8(key.context.c_str(), key.sourceText.c_str(),
+                                                               key.comment.c_str(), n);
+            QM_CHECK(translator.translateById8(uint32_t(i), n) == byKey);
+        }
+    }
+    return true;
+}
+
+QM_TEST(ids_dense)
+{
+    const size_t count = 3000;
+    const std::vector<std::string> noDependencies;
+    QM_CHECK(writeLanguageCatalog("ids_dependency.qm", "ru", "ru dependency ", noDependencies,
+                                  [](size_t i) { return i >= 2000; }, count));
+    QM_CHECK(writeLanguageCatalog("ids_ru.qm", "ru", "ru ", std::vector<std::string>(1, "ids_dependency.qm"),
+                                  [](size_t i) { return i < 2000 && i % 3 != 0; }, count));
+    QM_CHECK(writeLanguageCatalog("ids_fr.qm", "fr", "fr ", noDependencies,
+                                  [](size_t i) { return i % 2 == 0; }, count));
+    QM_CHECK(writeLanguageCatalog("ids_fr_new.qm", "fr", "fr new ", noDependencies,
+                                  [](size_t) { return true; }, count));
+
+    std::vector<TestKey> strings;
+    std::vector<QmMessageKeyX> keys;
+    for(size_t i = 0; i < count + 100; ++i)
+        strings.push_back(testKey(i));
+    for(const TestKey &key : strings)
+    {
+        QmMessageKeyX k = {key.context.c_str(), key.sourceText.c_str(), key.comment.c_str(), key.numerus};
+        keys.push_back(k);
+    }
+
+    QmTranslatorX fallback;
+    QM_CHECK(fallback.loadFile("ids_fr.qm"));
+    QmTranslatorX translator;
+    QM_CHECK(translator.loadFile("ids_ru.qm"));
+    translator.setFallbacks(std::vector<QmTranslatorX *>(1, &fallback));
+    translator.bindMessageIds(keys.data(), keys.size());
+    QM_CHECK(checkBoundIds(translator, strings));
+
+    // The fallback has the message 66 only, its rules give the form 1 to the number 5
+    QM_CHECK(translator.translateById8(66, 5) == "fr " + testTranslation(66, 1));
+    QM_CHECK(translator.translateById8(66, 1) == "fr " + testTranslation(66, 0));
+    QM_CHECK(translator.translateById8(11, 5) == "ru " + testTranslation(11, testForm(5)));
+    QM_CHECK(translator.translateById8(2200, 5) == "ru dependency " + testTranslation(2200, testForm(5)));
+    QM_CHECK(translator.translateById8(uint32_t(count + 1)).empty());
+
+    // The reloaded fallback is searched by the key until the IDs get resolved again
+    QM_CHECK(fallback.loadFile("ids_fr_new.qm"));
+    QM_CHECK(checkBoundIds(translator, strings));
+    QM_CHECK(translator.translateById8(3) == "fr new " + testTranslation(3));
+    translator.setFallbacks(std::vector<QmTranslatorX *>(1, &fallback));
+    QM_CHECK(checkBoundIds(translator, strings));
+
+    // The relayout and the reload of the catalog resolve the IDs again
+    QM_CHECK(translator.relayout());
+    QM_CHECK(checkBoundIds(translator, strings));
+    QM_CHECK(translator.loadFile("ids_fr.qm"));
+    QM_CHECK(checkBoundIds(translator, strings));
+    translator.bindMessageIds(nullptr, 0);
+    QM_CHECK(translator.translateById8(1).empty());
+    return true;
+}
@@ -0,0 +1,105 @@
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdio>
+
+#include "qm_test.h"
+
+static bool readTestFile(const char *filePath, std::vector<uint8_t> &data)
+{
+    FILE *file = fopen(filePath, "rb");
+    QM_CHECK(file);
+    data.clear();
+    uint8_t buffer[4096];
+    size_t got;
+    while((got = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        data.insert(data.end(), buffer, buffer + got);
+    fclose(file);
+    return true;
+}
+
+/*
+   The catalog without the perfect hash, the translations get the prefix of
+   the same length, so the catalogs differ by the content only
+ */
+static bool writeTestCatalog(const char *prefix)
+{
+    QmWriterX writer;
+    addTestMessages(writer, 3000);
+    for(QmMessageX &m : writer.messages())
+    {
+        for(std::u16string &t : m.translations)
+            t.insert(0, std::u16string(prefix, prefix + std::strlen(prefix)));
+    }
+    std::vector<uint8_t> data;
+    QM_CHECK(compileCatalog(writer, data));
+    QM_CHECK(writeTestFile("cached.qm", data));
+    return true;
+}
+
+static bool checkCachedCatalog(const char *prefix)
+{
+    QmTranslatorX translator;
+    QM_CHECK(translator.loadFileCached("cached.qm", "cached.qm.index"));
+    for(size_t i = 0; i < 3000; i += 7)
+    {
+        const TestKey key = testKey(i);
+        std::string tn;
+        QM_CHECK(lookup(translator, key, key.numerus ? 2 : -1, tn));
+        QM_CHECK(tn == prefix + testTranslation(i, key.numerus ? testForm(2) : 0));
+    }
+    QM_CHECK(translator.codepoints().contains(U'T') && translator.codepoints().contains(prefix[0]));
+    return true;
+}
+
+/*
+   The cache written by the first load serves the next ones, the damaged,
+   truncated or stale cache gets rebuilt
+ */
+QM_TEST(index_cache_rebuild)
+{
+    std::remove("cached.qm.index");
+    QM_CHECK(writeTestCatalog("A "));
+    QM_CHECK(checkCachedCatalog("A "));
+    std::vector<uint8_t> cache, current;
+    QM_CHECK(readTestFile("cached.qm.index", cache));
+    QM_CHECK(!cache.empty());
+    QM_CHECK(checkCachedCatalog("A "));
+    QM_CHECK(readTestFile("cached.qm.index", current));
+    QM_CHECK(current == cache);
+
+    std::vector<uint8_t> damaged = cache;
+    damaged[damaged.size() / 2] ^= 0x5A;
+    QM_CHECK(writeTestFile("cached.qm.index", damaged));
+    QM_CHECK(checkCachedCatalog("A "));
+    QM_CHECK(readTestFile("cached.qm.index", current));
+    QM_CHECK(current == cache);
+
+    damaged.assign(cache.begin(), cache.begin() + cache.size() / 3);
+    QM_CHECK(writeTestFile("cached.qm.index", damaged));
+    QM_CHECK(checkCachedCatalog("A "));
+    QM_CHECK(readTestFile("cached.qm.index", current));
+    QM_CHECK(current == cache);
+
+    // The catalog of the same size replaced after the cache was written
+    QM_CHECK(writeTestCatalog("B "));
+    QM_CHECK(checkCachedCatalog("B "));
+    QM_CHECK(readTestFile("cached.qm.index", current));
+    QM_CHECK(current.size() == cache.size() && current != cache);
+    QM_CHECK(checkCachedCatalog("B "));
+    return true;
+}
+
+/*
+   The cache which can't be written only costs the index built on every load
+ */
+QM_TEST(index_cache_unwritable)
+{
+    QM_CHECK(writeTestCatalog("A "));
+    QmTranslatorX translator;
+    QM_CHECK(translator.loadFileCached("cached.qm", "absent_directory/cached.qm.index"));
+    std::string tn;
+    QM_CHECK(lookup(translator, testKey(1), -1, tn) && tn == "A " + testTranslation(1));
+    QM_CHECK(!translator.loadFileCached("absent.qm", "cached.qm.index"));
+    return true;
+}
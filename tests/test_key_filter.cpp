@@ -0,0 +1,83 @@
+#include <string>
+#include <vector>
+
+#include "qm_test.h"
+
+/*
+   The key filter must never reject a key of the catalog: every message is
+   found with its comment, and the messages without the comment are found
+   by the keys having any other comment too
+ */
+static bool checkNoFalseNegatives(QmTranslatorX &translator, size_t first, size_t last)
+{
+    std::string t;
+    for(size_t i = first; i < last; ++i)
+    {
+        TestKey key = testKey(i);
+        const int32_t n = key.numerus ? 5 : -1;
+        QM_CHECK(lookup(translator, key, n, t));
+        QM_CHECK(t == testTranslation(i, key.numerus ? testForm(n) : 0));
+        if(key.comment.empty())
+        {
+            key.comment = "Unknown comment";
+            QM_CHECK(lookup(translator, key, n, t));
+            QM_CHECK(t == testTranslation(i, key.numerus ? testForm(n) : 0));
+        }
+    }
+    return true;
+}
+
+QM_TEST(filter_no_false_negatives)
+{
+    const size_t count = 50000;
+    for(int stripKeys = 0; stripKeys < 2; ++stripKeys)
+    {
+        QmWriterX writer;
+        writer.options().stripKeys = stripKeys != 0;
+        addTestMessages(writer, count);
+        std::vector<uint8_t> data;
+        QM_CHECK(compileCatalog(writer, data));
+
+        QmTranslatorX translator;
+        QM_CHECK(translator.loadData(data.data(), data.size()));
+        QM_CHECK(checkNoFalseNegatives(translator, 0, count));
+        QM_CHECK(checkTestMessages(translator, 2000));
+    }
+    return true;
+}
+
+/*
+   The dependencies have their own filters, the keys rejected by the filter
+   of the catalog are still searched in its dependencies. The contexts must
+   be in the contexts table of the catalog, otherwise (like in the Qt) the
+   dependencies aren't searched.
+ */
+QM_TEST(filter_dependencies)
+{
+    QmWriterX dependency;
+    dependency.options().stripKeys = true;
+    addTestMessages(dependency, 10000);
+    std::vector<uint8_t> data;
+    QM_CHECK(compileCatalog(dependency, data));
+    QM_CHECK(writeTestFile("filter_dependency.qm", data));
+
+    QmWriterX writer;
+    writer.options().stripKeys = true;
+    writer.setLanguage("ru");
+    writer.addDependency("filter_dependency.qm");
+    for(size_t i = 0; i < 100; ++i)
+    {
+        QmMessageX m;
+        m.context = testKey(i * 100).context;
+        m.sourceText = "Own message " + std::to_string(i);
+        m.translations.push_back(u"Own translation");
+        writer.addMessage(m);
+    }
+    QM_CHECK(compileCatalog(writer, data));
+
+    QmTranslatorX translator;
+    QM_CHECK(translator.loadData(data.data(), data.size()));
+    QM_CHECK(translator.do_translate8("Context 7", "Own message 7") == "Own translation");
+    QM_CHECK(checkNoFalseNegatives(translator, 0, 10000));
+    return true;
+}
@@ -0,0 +1,109 @@
+#include <string>
+#include <vector>
+#include <atomic>
+#include <cstdlib>
+
+#include "qm_test.h"
+
+//Index of the synthetic message by its translation "Translation <i>[ form <f>]"
+static size_t messageIndex(const QmMessageViewX &message)
+{
+    return size_t(std::strtoul(message.translation8().c_str() + 12, nullptr, 10));
+}
+
+/*
+   Every message comes once with its key and all translations
+ */
+QM_TEST(messages_iteration)
+{
+    const size_t count = 3000;
+    for(int stripKeys = 0; stripKeys < 2; ++stripKeys)
+    {
+        QmWriterX writer;
+        writer.options().stripKeys = stripKeys != 0;
+        addTestMessages(writer, count);
+        std::vector<uint8_t> data;
+        QM_CHECK(compileCatalog(writer, data));
+        QmTranslatorX translator;
+        QM_CHECK(translator.loadData(data.data(), data.size()));
+        QM_CHECK(translator.messagesCount() == count);
+
+        std::vector<int> seen(count, 0);
+        for(const QmMessageViewX &m : translator.messages())
+        {
+            const size_t i = messageIndex(m);
+            QM_CHECK(i < count);
+            ++seen[i];
+            const TestKey key = testKey(i);
+            // The stripped records keep only the fields resolving the collisions of the hashes
+            QM_CHECK(m.context.toString() == key.context || (stripKeys && m.context.empty()));
+            QM_CHECK(m.sourceText.toString() == key.sourceText || (stripKeys && m.sourceText.empty()));
+            QM_CHECK(m.comment.toString() == key.comment || (stripKeys && m.comment.empty()));
+            QM_CHECK(m.translationsCount == (key.numerus ? 3u : 1u));
+            for(uint32_t form = 0; form < m.translationsCount; ++form)
+            {
+                const std::u16string t = m.translation(form);
+                QM_CHECK(std::string(t.begin(), t.end()) == testTranslation(i, form));
+                QM_CHECK(m.translation8(form) == testTranslation(i, form));
+                QM_CHECK(m.translationData(form).size == t.size() * 2);
+            }
+        }
+        for(size_t i = 0; i < count; ++i)
+            QM_CHECK(seen[i] == 1);
+    }
+
+    QmTranslatorX empty;
+    QM_CHECK(empty.messagesCount() == 0);
+    QM_CHECK(empty.messages().begin() == empty.messages().end());
+    return true;
+}
+
+/*
+   The parts cover the messages in the order of the whole range, the threads
+   get every message once
+ */
+QM_TEST(messages_parts)
+{
+    const size_t count = 5000;
+    QmWriterX writer;
+    addTestMessages(writer, count);
+    std::vector<uint8_t> data;
+    QM_CHECK(compileCatalog(writer, data));
+    QmTranslatorX translator;
+    QM_CHECK(translator.loadData(data.data(), data.size()));
+
+    std::vector<uint32_t> offsets;
+    for(const QmMessageViewX &m : translator.messages())
+        offsets.push_back(m.offset);
+    QM_CHECK(offsets.size() == count);
+
+    const size_t partsCounts[] = {1, 3, 7, count + 5};
+    for(size_t partsCount : partsCounts)
+    {
+        std::vector<uint32_t> joined;
+        for(size_t part = 0; part < partsCount; ++part)
+        {
+            for(const QmMessageViewX &m : translator.messages(part, partsCount))
+                joined.push_back(m.offset);
+        }
+        QM_CHECK(joined == offsets);
+    }
+
+    for(unsigned threadsCount = 1; threadsCount <= 4; threadsCount += 3)
+    {
+        std::vector<std::atomic<int> > seen(count);
+        for(std::atomic<int> &s : seen)
+            s = 0;
+        std::atomic<size_t> maxPart(0);
+        translator.forEachMessage([&seen, &maxPart](const QmMessageViewX &m, size_t part)
+        {
+            seen[messageIndex(m)]++;
+            size_t max = maxPart.load();
+            while(part > max && !maxPart.compare_exchange_weak(max, part)) {}
+        }, threadsCount);
+        for(size_t i = 0; i < count; ++i)
+            QM_CHECK(seen[i] == 1);
+        QM_CHECK(maxPart < threadsCount);
+    }
+    return true;
+}
@@ -0,0 +1,132 @@
+#include <string>
+#include <vector>
+#include <set>
+#include <thread>
+#include <atomic>
+
+#include "qm_test.h"
+
+static bool loadTestCatalog(QmTranslatorX &translator, size_t count)
+{
+    QmWriterX writer;
+    addTestMessages(writer, count);
+    std::vector<uint8_t> data;
+    QM_CHECK(compileCatalog(writer, data));
+    QM_CHECK(translator.loadData(data.data(), data.size()));
+    return true;
+}
+
+static TestKey absentKey(size_t i)
+{
+    TestKey key = testKey(i);
+    key.sourceText = "Absent " + key.sourceText;
+    return key;
+}
+
+/*
+   The threads put the absent keys into their rings while the main thread
+   drains them, every absent key comes out once and the found ones never
+ */
+QM_TEST(misses_threads)
+{
+    const size_t count = 1000;
+    const size_t threadsCount = 4;
+    QmTranslatorX translator;
+    QM_CHECK(loadTestCatalog(translator, count));
+    translator.setMissCollector(64 * 1024);
+    QM_CHECK(translator.isCollectingMisses());
+
+    std::set<std::string> drained;
+    size_t drainedCount = 0;
+    bool duplicates = false;
+    auto drain = [&]()
+    {
+        drainedCount += translator.drainMisses([&](const char *context, const char *sourceText, const char *comment)
+        {
+            duplicates |= !drained.insert(std::string(context) + '|' + sourceText + '|' + comment).second;
+        });
+    };
+
+    std::atomic<size_t> running(threadsCount);
+    std::vector<std::thread> threads;
+    for(size_t t = 0; t < threadsCount; ++t)
+    {
+        threads.emplace_back([&translator, &running, t, count]()
+        {
+            std::string tn;
+            for(int round = 0; round < 3; ++round)
+            {
+                // Every thread misses its own half of the keys and half of the neighbour's
+                for(size_t i = t * count / 8; i < (t + 2) * count / 8; ++i)
+                {
+                    lookup(translator, absentKey(i), -1, tn);
+                    lookup(translator, testKey(i), -1, tn);
+                }
+            }
+            --running;
+        });
+    }
+    while(running)
+        drain();
+    for(std::thread &t : threads)
+        t.join();
+    drain();
+
+    QM_CHECK(!duplicates);
+    QM_CHECK(translator.droppedMisses() == 0);
+    QM_CHECK(drainedCount == drained.size());
+    QM_CHECK(drained.size() == (threadsCount + 1) * count / 8);
+    for(size_t i = 0; i < (threadsCount + 1) * count / 8; ++i)
+    {
+        const TestKey key = absentKey(i);
+        QM_CHECK(drained.count(key.context + '|' + key.sourceText + '|' + key.comment));
+    }
+    return true;
+}
+
+/*
+   The small ring wraps around many times between the drains, the keys put
+   into the full ring are dropped and get put again after the drain
+ */
+QM_TEST(misses_ring_wrap)
+{
+    const size_t count = 2000;
+    const size_t overflowCount = 200;
+    QmTranslatorX translator;
+    QM_CHECK(loadTestCatalog(translator, 100));
+    translator.setMissCollector(4096);
+
+    std::set<std::string> drained;
+    auto collect = [&drained](const char *, const char *sourceText, const char *)
+    {
+        drained.insert(sourceText);
+    };
+
+    std::string tn;
+    for(size_t i = 0; i < count; ++i)
+    {
+        lookup(translator, absentKey(i), -1, tn);
+        if(i % 10 == 9)
+            translator.drainMisses(collect);
+    }
+    QM_CHECK(translator.droppedMisses() == 0);
+    QM_CHECK(drained.size() == count);
+
+    // Overflow the ring, then put the dropped keys again
+    const size_t last = count + overflowCount;
+    for(size_t i = count; i < last; ++i)
+        lookup(translator, absentKey(i), -1, tn);
+    QM_CHECK(translator.droppedMisses() > 0);
+    while(drained.size() < last)
+    {
+        const size_t before = drained.size();
+        translator.drainMisses(collect);
+        for(size_t i = count; i < last; ++i)
+            lookup(translator, absentKey(i), -1, tn);
+        translator.drainMisses(collect);
+        QM_CHECK(drained.size() > before);
+    }
+    for(size_t i = 0; i < last; ++i)
+        QM_CHECK(drained.count(absentKey(i).sourceText));
+    return true;
+}
@@ -0,0 +1,103 @@
+#include <string>
+#include <vector>
+#include <future>
+#include <type_traits>
+#include <cstring>
+
+#include "qm_test.h"
+
+static_assert(std::is_nothrow_move_constructible<QmTranslatorX>::value, "QmTranslatorX must move without throwing");
+static_assert(std::is_nothrow_move_assignable<QmTranslatorX>::value, "QmTranslatorX must move without throwing");
+
+static bool compileTestCatalog(std::vector<uint8_t> &data, size_t count, const char *prefix)
+{
+    QmWriterX writer;
+    addTestMessages(writer, count);
+    for(QmMessageX &m : writer.messages())
+    {
+        for(std::u16string &t : m.translations)
+            t.insert(0, std::u16string(prefix, prefix + std::strlen(prefix)));
+    }
+    QM_CHECK(compileCatalog(writer, data));
+    return true;
+}
+
+/*
+   The catalog, the interned strings and the settings move to the other
+   translator, the moved-from one stays empty and usable
+ */
+QM_TEST(move_catalog)
+{
+    std::vector<uint8_t> data;
+    QM_CHECK(compileTestCatalog(data, 1000, ""));
+
+    QmTranslatorX first;
+    QM_CHECK(first.loadData(data.data(), data.size()));
+    const std::u16string &interned = first.translateInterned(testKey(5).context.c_str(), testKey(5).sourceText.c_str());
+
+    QmTranslatorX second(std::move(first));
+    QM_CHECK(first.isEmpty());
+    QM_CHECK(checkTestMessages(second, 1000));
+    QM_CHECK(std::string(interned.begin(), interned.end()) == testTranslation(5));
+    QM_CHECK(&second.translateInterned(testKey(5).context.c_str(), testKey(5).sourceText.c_str()) == &interned);
+
+    // The translators keep their catalogs while the vector grows
+    std::vector<QmTranslatorX> translators;
+    for(int i = 0; i < 10; ++i)
+    {
+        translators.emplace_back();
+        QM_CHECK(translators.back().loadData(data.data(), data.size()));
+    }
+    translators[3] = std::move(second);
+    for(QmTranslatorX &t : translators)
+        QM_CHECK(checkTestMessages(t, 1000));
+
+    QM_CHECK(first.loadData(data.data(), data.size()));
+    QM_CHECK(checkTestMessages(first, 1000));
+    return true;
+}
+
+/*
+   The pending asynchronous load moves with the catalog, the running prewarm
+   of the moved-from translator gets stopped before its catalog moves
+ */
+QM_TEST(move_async_and_prewarm)
+{
+    const size_t count = 50000;
+    std::vector<uint8_t> oldData, newData;
+    QM_CHECK(compileTestCatalog(oldData, count, ""));
+    QM_CHECK(compileTestCatalog(newData, count, "New "));
+    QM_CHECK(writeTestFile("move_new.qm", newData));
+
+    std::vector<std::string> contexts;
+    for(size_t i = 0; i < count; i += 100)
+        contexts.push_back(testKey(i).context);
+
+    for(int round = 0; round < 3; ++round)
+    {
+        QmTranslatorX first;
+        QM_CHECK(first.loadData(oldData.data(), oldData.size()));
+        std::future<size_t> warm = first.prewarm(contexts);
+        std::future<bool> loaded = first.loadFileAsync("move_new.qm");
+
+        QmTranslatorX second = std::move(first);
+        QM_CHECK(warm.get() <= count);
+        QM_CHECK(loaded.get());
+        QM_CHECK(!first.applyLoaded());
+        QM_CHECK(checkTestMessages(second, 100));
+        QM_CHECK(second.applyLoaded());
+        QM_CHECK(second.do_translate8(testKey(1).context.c_str(), testKey(1).sourceText.c_str()) ==
+                 "New " + testTranslation(1));
+
+        // Moving into the translator which has the running prewarm stops it too
+        warm = second.prewarm(contexts);
+        QmTranslatorX third;
+        QM_CHECK(third.loadData(oldData.data(), oldData.size()));
+        std::future<size_t> thirdWarm = third.prewarm(contexts);
+        third = std::move(second);
+        QM_CHECK(warm.get() <= count);
+        QM_CHECK(thirdWarm.get() <= count);
+        QM_CHECK(third.prewarm(contexts).get() == count);
+    }
+    return true;
+}
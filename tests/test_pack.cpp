@@ -0,0 +1,168 @@
+#include <string>
+#include <vector>
+#include <set>
+#include <random>
+
+#include "qm_test.h"
+#include "QTranslatorX/qm_format_p.h"
+
+/*
+   Finds the block of the compiled catalog by the tag
+ */
+static bool findBlock(const std::vector<uint8_t> &data, uint8_t tag, const uint8_t **block, uint32_t *blockLen)
+{
+    const uint8_t *d = data.data() + g_qm_magicLength;
+    const uint8_t *end = data.data() + data.size();
+    while(end - d > 5)
+    {
+        const uint8_t t = read8(d);
+        const uint32_t len = read32be(d + 1);
+        d += 5;
+        if(uint32_t(end - d) < len)
+            return false;
+        if(t == tag)
+        {
+            *block = d;
+            *blockLen = len;
+            return true;
+        }
+        d += len;
+    }
+    return false;
+}
+
+static bool checkRoundTrip(const std::vector<uint8_t> &src)
+{
+    std::vector<uint8_t> packed;
+    lzCompress(src.data(), src.size(), packed);
+
+    std::vector<uint8_t> unpacked(src.size() + 1);
+    QM_CHECK(lzDecompress(packed.data(), packed.size(), unpacked.data(), src.size()));
+    unpacked.resize(src.size());
+    QM_CHECK(unpacked == src);
+
+    // The wrong length and the truncated data are rejected
+    unpacked.resize(src.size() + 1);
+    QM_CHECK(!lzDecompress(packed.data(), packed.size(), unpacked.data(), src.size() + 1));
+    if(!src.empty())
+        QM_CHECK(!lzDecompress(packed.data(), packed.size() - 1, unpacked.data(), src.size()));
+    return true;
+}
+
+QM_TEST(pack_lz_round_trip)
+{
+    std::mt19937 random(12345);
+    std::vector<uint8_t> src;
+    QM_CHECK(checkRoundTrip(src));
+
+    src.assign(1, 'x');
+    QM_CHECK(checkRoundTrip(src));
+
+    // Incompressible data gives the long literal runs
+    src.resize(100000);
+    for(uint8_t &b : src)
+        b = uint8_t(random());
+    QM_CHECK(checkRoundTrip(src));
+
+    // Long overlapping matches
+    src.assign(70000, 'a');
+    QM_CHECK(checkRoundTrip(src));
+
+    // Text with the matches of all lengths and distances beyond 64 KiB
+    src.clear();
+    for(size_t i = 0; src.size() < 300000; ++i)
+    {
+        const std::string line = testKey(random() % 5000).sourceText + testTranslation(i);
+        src.insert(src.end(), line.begin(), line.end());
+    }
+    QM_CHECK(checkRoundTrip(src));
+    std::vector<uint8_t> packed;
+    lzCompress(src.data(), src.size(), packed);
+    QM_CHECK(packed.size() < src.size() / 2);
+    return true;
+}
+
+/*
+   The chunks have whole records and unpack into the original "Messages" block
+ */
+QM_TEST(pack_messages_block)
+{
+    QmWriterX writer;
+    addTestMessages(writer, 5000);
+    std::vector<uint8_t> data;
+    QM_CHECK(compileCatalog(writer, data));
+
+    const uint8_t *messages;
+    uint32_t length;
+    QM_CHECK(findBlock(data, QTranslatorEntryTypes::Messages, &messages, &length));
+
+    std::set<uint32_t> recordEnds;
+    QmRecordX record;
+    for(const uint8_t *m = messages; m < messages + length && readRecord(m, messages + length, record); m = record.end)
+        recordEnds.insert(uint32_t(record.end - messages));
+
+    std::vector<uint8_t> packed;
+    packMessages(messages, length, packed);
+    QM_CHECK(read32be(packed.data()) == length);
+    const uint32_t chunksCount = read32be(packed.data() + 4);
+    QM_CHECK(chunksCount > 1);
+
+    const uint8_t *table = packed.data() + g_pack_headerSize;
+    const uint8_t *packedData = table + (size_t(chunksCount) + 1) * 8;
+    std::vector<uint8_t> unpacked;
+    for(uint32_t c = 0; c < chunksCount; ++c)
+    {
+        const uint32_t from = read32be(table + c * 8);
+        const uint32_t to = read32be(table + c * 8 + 8);
+        const uint32_t packedFrom = read32be(table + c * 8 + 4);
+        const uint32_t packedTo = read32be(table + c * 8 + 12);
+        QM_CHECK(from == unpacked.size() && to > from);
+        QM_CHECK(recordEnds.count(to));
+
+        unpacked.resize(to);
+        QM_CHECK(lzDecompress(packedData + packedFrom, packedTo - packedFrom, unpacked.data() + from, to - from));
+    }
+    QM_CHECK(unpacked == std::vector<uint8_t>(messages, messages + length));
+    QM_CHECK(size_t(packedData - packed.data()) + read32be(table + chunksCount * 8 + 4) == packed.size());
+    return true;
+}
+
+/*
+   The packed catalog unpacks the chunks on demand, also when the cache
+   keeps less than one chunk, and the whole block for the enumeration
+ */
+QM_TEST(pack_catalog)
+{
+    const size_t count = 5000;
+    for(int stripKeys = 0; stripKeys < 2; ++stripKeys)
+    {
+        QmWriterX writer;
+        writer.options().stripKeys = stripKeys != 0;
+        addTestMessages(writer, count);
+        std::vector<uint8_t> plain, packed, packedLater;
+        QM_CHECK(compileCatalog(writer, plain));
+        writer.options().packMessages = true;
+        QM_CHECK(compileCatalog(writer, packed));
+        QM_CHECK(writer.pack(plain.data(), plain.size(), packedLater));
+        QM_CHECK(packed.size() < plain.size());
+        QM_CHECK(packedLater == packed);
+
+        QmTranslatorX translator;
+        QM_CHECK(translator.loadData(packed.data(), packed.size()));
+        QM_CHECK(translator.isPacked());
+        QM_CHECK(checkTestMessages(translator, count));
+
+        QmTranslatorX::setPackedCacheLimit(1);
+        QM_CHECK(checkTestMessages(translator, count));
+        QmTranslatorX::setPackedCacheLimit(1024 * 1024);
+
+        size_t enumerated = 0;
+        translator.forEachMessage([&enumerated](const QmMessageViewX &, size_t)
+        {
+            ++enumerated;
+        }, 1);
+        QM_CHECK(enumerated == translator.messagesCount());
+        QM_CHECK(checkTestMessages(translator, count));
+    }
+    return true;
+}
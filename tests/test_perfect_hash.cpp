@@ -0,0 +1,95 @@
+#include <string>
+#include <vector>
+#include <set>
+
+#include "qm_test.h"
+#include "QTranslatorX/qm_format_p.h"
+
+/*
+   Every key gets its own slot, which has the fingerprint and the offset of
+   the key, and the fingerprints reject nearly all absent keys
+ */
+QM_TEST(phash_build_lookup)
+{
+    const size_t count = 20000;
+    std::vector<TestKey> strings(count);
+    std::vector<PerfectHashKey> keys(count);
+    for(size_t i = 0; i < count; ++i)
+    {
+        strings[i] = testKey(i);
+        PerfectHashKey &k = keys[i];
+        k.context = reinterpret_cast<const uint8_t *>(strings[i].context.data());
+        k.sourceText = reinterpret_cast<const uint8_t *>(strings[i].sourceText.data());
+        k.comment = reinterpret_cast<const uint8_t *>(strings[i].comment.data());
+        k.contextLength = uint32_t(strings[i].context.size());
+        k.sourceTextLength = uint32_t(strings[i].sourceText.size());
+        k.commentLength = uint32_t(strings[i].comment.size());
+        k.offset = uint32_t(i * 16);
+    }
+
+    std::vector<uint8_t> table, parallelTable;
+    QM_CHECK(buildPerfectHash(keys, table, 1));
+    QM_CHECK(buildPerfectHash(keys, parallelTable, 4));
+    QM_CHECK(table == parallelTable);
+
+    const uint32_t seed = read32be(table.data());
+    const uint32_t slotsCount = read32be(table.data() + 4);
+    const uint32_t bucketsCount = read32be(table.data() + 8);
+    const uint8_t *displacements = table.data() + g_phash_headerSize;
+    const uint8_t *slots = displacements + size_t(bucketsCount) * 4;
+    QM_CHECK(slotsCount >= count);
+    QM_CHECK(table.size() == g_phash_headerSize + size_t(bucketsCount) * 4 + size_t(slotsCount) * 8);
+
+    std::set<uint32_t> used;
+    for(size_t i = 0; i < count; ++i)
+    {
+        const TestKey &key = strings[i];
+        const uint64_t h = phashKey(key.context.c_str(), key.sourceText.c_str(), key.comment.c_str(), seed);
+        const uint32_t d = read32be(displacements + size_t(phashBucket(h, bucketsCount)) * 4);
+        const uint32_t slot = phashSlot(h, d, slotsCount);
+        QM_CHECK(used.insert(slot).second);
+        QM_CHECK(read32be(slots + size_t(slot) * 8) == phashFingerprint(h));
+        QM_CHECK(read32be(slots + size_t(slot) * 8 + 4) == keys[i].offset);
+    }
+
+    size_t falsePositives = 0;
+    for(size_t i = count; i < count * 2; ++i)
+    {
+        const TestKey key = testKey(i);
+        const uint64_t h = phashKey(key.context.c_str(), key.sourceText.c_str(), key.comment.c_str(), seed);
+        const uint32_t d = read32be(displacements + size_t(phashBucket(h, bucketsCount)) * 4);
+        const uint32_t slot = phashSlot(h, d, slotsCount);
+        if(read32be(slots + size_t(slot) * 8) == phashFingerprint(h))
+            ++falsePositives;
+    }
+    QM_CHECK(falsePositives < 10);
+    return true;
+}
+
+/*
+   The perfect hash written by the compiler, added to the compiled catalog
+   and built at load time, all give the same translations
+ */
+QM_TEST(phash_catalog)
+{
+    const size_t count = 5000;
+    QmWriterX writer;
+    addTestMessages(writer, count);
+    std::vector<uint8_t> plain, hashed, added;
+    QM_CHECK(compileCatalog(writer, plain));
+    writer.options().perfectHash = true;
+    QM_CHECK(compileCatalog(writer, hashed));
+    QM_CHECK(writer.addPerfectHash(plain.data(), plain.size(), added));
+    QM_CHECK(hashed.size() > plain.size());
+    QM_CHECK(added.size() > plain.size());
+
+    QmTranslatorX translator;
+    QM_CHECK(translator.loadData(hashed.data(), hashed.size()));
+    QM_CHECK(checkTestMessages(translator, count));
+    QM_CHECK(translator.loadData(added.data(), added.size()));
+    QM_CHECK(checkTestMessages(translator, count));
+    QM_CHECK(translator.loadData(plain.data(), plain.size()));
+    QM_CHECK(translator.buildIndex());
+    QM_CHECK(checkTestMessages(translator, count));
+    return true;
+}
@@ -0,0 +1,116 @@
+#include <string>
+#include <vector>
+#include <thread>
+
+#include "qm_test.h"
+
+/*
+   The string stays in the pool while any reference added by intern() is not
+   released, the found strings are counted as the hits
+ */
+QM_TEST(pool_refcounts)
+{
+    QmStringPoolX pool;
+    const std::u16string &first = pool.intern(u"Pooled string");
+    const std::u16string &second = pool.internUtf16be(reinterpret_cast<const uint8_t *>("\0P\0o\0o\0l\0e\0d\0 \0s\0t\0r\0i\0n\0g"), 26);
+    QM_CHECK(&first == &second);
+    QmStringPoolX::Stats stats = pool.stats();
+    QM_CHECK(stats.strings == 1 && stats.requests == 2 && stats.hits == 1);
+    QM_CHECK(stats.savedBytes == 26);
+
+    pool.release(first);
+    QM_CHECK(pool.stats().strings == 1);
+    QM_CHECK(*pool.intern(u"Pooled string").c_str() == u'P');
+    pool.release(second);
+    pool.release(first);
+    QM_CHECK(pool.stats().strings == 0 && pool.stats().bytes == 0);
+    return true;
+}
+
+/*
+   The catalogs share the translations of the global pool, each of them holds
+   its reference until it's closed or reloaded
+ */
+QM_TEST(pool_catalogs)
+{
+    QmWriterX writer;
+    addTestMessages(writer, 1000);
+    std::vector<uint8_t> data;
+    QM_CHECK(compileCatalog(writer, data));
+
+    QmStringPoolX &pool = QmStringPoolX::global();
+    const size_t pooled = pool.stats().strings;
+    QmTranslatorX first, second;
+    QM_CHECK(first.loadData(data.data(), data.size()));
+    QM_CHECK(second.loadData(data.data(), data.size()));
+    const TestKey key = testKey(5);
+    const std::u16string &interned = first.translateInterned(key.context.c_str(), key.sourceText.c_str());
+    QM_CHECK(&second.translateInterned(key.context.c_str(), key.sourceText.c_str()) == &interned);
+    QM_CHECK(pool.stats().strings == pooled + 1);
+
+    first.close();
+    QM_CHECK(pool.stats().strings == pooled + 1);
+    QM_CHECK(std::string(interned.begin(), interned.end()) == testTranslation(5));
+
+    // The repeated lookups of the reloaded catalog get the string interned again
+    QM_CHECK(second.loadData(data.data(), data.size()));
+    QM_CHECK(pool.stats().strings == pooled);
+    for(int i = 0; i < 2; ++i)
+    {
+        const std::u16string &again = second.translateInterned(key.context.c_str(), key.sourceText.c_str());
+        QM_CHECK(std::string(again.begin(), again.end()) == testTranslation(5));
+        QM_CHECK(pool.stats().strings == pooled + 1);
+    }
+    second.close();
+    QM_CHECK(pool.stats().strings == pooled);
+    QM_CHECK(second.translateInterned(key.context.c_str(), key.sourceText.c_str()).empty());
+    return true;
+}
+
+/*
+   The threads get the same strings, each one interned once per catalog
+ */
+QM_TEST(pool_threads)
+{
+    QmWriterX writer;
+    addTestMessages(writer, 2000);
+    std::vector<uint8_t> data;
+    QM_CHECK(compileCatalog(writer, data));
+    QmTranslatorX translator;
+    QM_CHECK(translator.loadData(data.data(), data.size()));
+
+    const size_t pooled = QmStringPoolX::global().stats().strings;
+    std::vector<std::vector<const std::u16string *> > results(4);
+    std::vector<std::thread> threads;
+    for(size_t t = 0; t < results.size(); ++t)
+    {
+        threads.emplace_back([&translator, &results, t]()
+        {
+            for(int round = 0; round < 3; ++round)
+            {
+                results[t].clear();
+                for(size_t i = 0; i < 500; ++i)
+                {
+                    const TestKey key = testKey(i);
+                    results[t].push_back(&translator.translateInterned(key.context.c_str(), key.sourceText.c_str(),
+                                                                       key.comment.c_str(), key.numerus ? 1 : -1));
+                }
+            }
+        });
+    }
+    for(std::thread &t : threads)
+        t.join();
+
+    for(size_t i = 0; i < 500; ++i)
+    {
+        const TestKey key = testKey(i);
+        const std::string expected = testTranslation(i, key.numerus ? testForm(1) : 0);
+        QM_CHECK(std::string(results[0][i]->begin(), results[0][i]->end()) == expected);
+        for(size_t t = 1; t < results.size(); ++t)
+            QM_CHECK(results[t][i] == results[0][i]);
+    }
+    QM_CHECK(QmStringPoolX::global().stats().strings == pooled + 500);
+    translator.close();
+    QM_CHECK(QmStringPoolX::global().stats().strings == pooled);
+    return true;
+}
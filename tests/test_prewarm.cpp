@@ -0,0 +1,98 @@
+#include <string>
+#include <vector>
+#include <future>
+
+#include "qm_test.h"
+
+static bool loadTestCatalog(QmTranslatorX &translator, size_t count, bool packMessages)
+{
+    QmWriterX writer;
+    writer.options().packMessages = packMessages;
+    addTestMessages(writer, count);
+    std::vector<uint8_t> data;
+    QM_CHECK(compileCatalog(writer, data));
+    QM_CHECK(translator.loadData(data.data(), data.size()));
+    return true;
+}
+
+/*
+   The messages of the requested contexts get resolved and their translations
+   decoded, so translateInterned() adds no strings to the pool
+ */
+QM_TEST(prewarm_contexts)
+{
+    QmTranslatorX::setPackedCacheLimit(16 * 1024);
+    for(int packMessages = 0; packMessages < 2; ++packMessages)
+    {
+        QmTranslatorX translator;
+        QM_CHECK(loadTestCatalog(translator, 5000, packMessages != 0));
+        QM_CHECK(translator.isPacked() == (packMessages != 0));
+        std::future<size_t> warm = translator.prewarm({"Context 3", "Context 7", "Absent context"});
+        QM_CHECK(warm.get() == 200);
+        QM_CHECK(translator.isPacked() == (packMessages != 0));
+
+        const size_t pooled = QmStringPoolX::global().stats().strings;
+        for(size_t i = 300; i < 400; ++i)
+        {
+            const TestKey key = testKey(i);
+            const std::u16string &t = translator.translateInterned(key.context.c_str(), key.sourceText.c_str(),
+                                                                   key.comment.c_str(), key.numerus ? 1 : -1);
+            const std::string expected = testTranslation(i, key.numerus ? testForm(1) : 0);
+            QM_CHECK(std::string(t.begin(), t.end()) == expected);
+        }
+        QM_CHECK(QmStringPoolX::global().stats().strings == pooled);
+        QM_CHECK(checkTestMessages(translator, 5000));
+    }
+    QmTranslatorX::setPackedCacheLimit(1024 * 1024);
+    return true;
+}
+
+/*
+   The messages of the dependencies are resolved too
+ */
+QM_TEST(prewarm_dependencies)
+{
+    QmWriterX dependency;
+    addTestMessages(dependency, 1000);
+    std::vector<uint8_t> data;
+    QM_CHECK(compileCatalog(dependency, data));
+    QM_CHECK(writeTestFile("prewarm_dependency.qm", data));
+
+    QmWriterX writer;
+    writer.addDependency("prewarm_dependency.qm");
+    addTestMessages(writer, 500);
+    QM_CHECK(compileCatalog(writer, data));
+
+    QmTranslatorX translator;
+    QM_CHECK(translator.loadData(data.data(), data.size()));
+    // The catalog has the "Context 2" only, the dependency has both
+    QM_CHECK(translator.prewarm({"Context 2", "Context 8"}).get() == 300);
+    return true;
+}
+
+/*
+   The next prewarm cancels the running one, which completes its future
+   anyway, the closing of the catalog cancels the last one
+ */
+QM_TEST(prewarm_cancel)
+{
+    const size_t count = 100000;
+    QmTranslatorX translator;
+    QM_CHECK(loadTestCatalog(translator, count, true));
+    std::vector<std::string> contexts;
+    for(size_t i = 0; i < count; i += 100)
+        contexts.push_back(testKey(i).context);
+
+    std::vector<std::future<size_t> > warms;
+    for(int i = 0; i < 4; ++i)
+        warms.push_back(translator.prewarm(contexts));
+    for(size_t i = 0; i + 1 < warms.size(); ++i)
+        QM_CHECK(warms[i].get() <= count);
+    QM_CHECK(warms.back().get() == count);
+
+    std::future<size_t> closed = translator.prewarm(contexts);
+    translator.close();
+    QM_CHECK(closed.get() <= count);
+    QM_CHECK(translator.isEmpty());
+    return true;
+}
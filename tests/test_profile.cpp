@@ -0,0 +1,123 @@
+#include <string>
+#include <vector>
+#include <thread>
+
+#include "qm_test.h"
+
+static bool loadTestCatalog(QmTranslatorX &translator, size_t count)
+{
+    QmWriterX writer;
+    addTestMessages(writer, count);
+    std::vector<uint8_t> data;
+    QM_CHECK(compileCatalog(writer, data));
+    QM_CHECK(translator.loadData(data.data(), data.size()));
+    return true;
+}
+
+/*
+   The thread t looks up the key i (t + 1) * (i % 10 + 1) * 10 times, the
+   absent keys are recorded too
+ */
+static void lookupKeys(QmTranslatorX &translator, size_t keysCount, unsigned threadsCount)
+{
+    std::vector<std::thread> threads;
+    for(unsigned t = 0; t < threadsCount; ++t)
+    {
+        threads.emplace_back([&translator, keysCount, t]()
+        {
+            std::string tn;
+            for(size_t i = 0; i < keysCount; ++i)
+            {
+                const size_t times = (t + 1) * (i % 10 + 1) * 10;
+                const TestKey key = testKey(i);
+                for(size_t n = 0; n < times; ++n)
+                    lookup(translator, key, -1, tn);
+            }
+        });
+    }
+    for(std::thread &t : threads)
+        t.join();
+}
+
+static uint64_t expectedCount(size_t i, unsigned threadsCount)
+{
+    uint64_t count = 0;
+    for(unsigned t = 0; t < threadsCount; ++t)
+        count += (t + 1) * (i % 10 + 1) * 10;
+    return count;
+}
+
+/*
+   The logs of the threads get merged by the keys, the sampled lookups are
+   counted as many lookups as the rate
+ */
+QM_TEST(profile_threads)
+{
+    const size_t keysCount = 300;
+    const unsigned threadsCount = 4;
+    for(uint32_t rate = 1; rate <= 10; rate += 9)
+    {
+        QmTranslatorX translator;
+        QM_CHECK(loadTestCatalog(translator, 200));
+        translator.setProfiling(rate);
+        QM_CHECK(translator.profilingRate() == rate);
+        lookupKeys(translator, keysCount, threadsCount);
+
+        const QmAccessProfileX profile = translator.accessProfile();
+        QM_CHECK(profile.size() == keysCount);
+        for(size_t i = 0; i < keysCount; ++i)
+        {
+            const TestKey key = testKey(i);
+            const uint64_t count = profile.count(key.context, key.sourceText, key.comment);
+            if(rate == 1)
+                QM_CHECK(count == expectedCount(i, threadsCount));
+            else
+                QM_CHECK(count + threadsCount * rate >= expectedCount(i, threadsCount) &&
+                         count <= expectedCount(i, threadsCount) + threadsCount * rate);
+        }
+        const std::vector<QmAccessProfileX::Entry> entries = profile.entries();
+        QM_CHECK(entries.front().count >= entries.back().count);
+        uint64_t contextCount = 0;
+        for(size_t i = 100; i < 200; ++i)
+        {
+            const TestKey key = testKey(i);
+            contextCount += profile.count(key.context, key.sourceText, key.comment);
+        }
+        QM_CHECK(profile.contextCount("Context 1") == contextCount);
+    }
+    return true;
+}
+
+/*
+   The recorded keys survive the loads, the cleared profile starts over, the
+   paused recording counts nothing
+ */
+QM_TEST(profile_reload)
+{
+    QmTranslatorX translator;
+    QM_CHECK(loadTestCatalog(translator, 100));
+    translator.setProfiling();
+    lookupKeys(translator, 20, 1);
+    QM_CHECK(loadTestCatalog(translator, 100));
+    lookupKeys(translator, 20, 1);
+
+    QmAccessProfileX profile = translator.accessProfile();
+    const TestKey key = testKey(3);
+    QM_CHECK(profile.count(key.context, key.sourceText, key.comment) == 2 * expectedCount(3, 1));
+
+    QM_CHECK(translator.saveAccessProfile("profile.txt"));
+    QmAccessProfileX loaded;
+    QM_CHECK(loaded.loadFile("profile.txt"));
+    QM_CHECK(loaded.size() == profile.size());
+    QM_CHECK(loaded.count(key.context, key.sourceText, key.comment) == 2 * expectedCount(3, 1));
+
+    translator.clearAccessProfile();
+    QM_CHECK(translator.accessProfile().empty());
+    translator.setProfiling(0);
+    lookupKeys(translator, 20, 1);
+    QM_CHECK(translator.accessProfile().empty());
+    translator.setProfiling(1);
+    lookupKeys(translator, 20, 2);
+    QM_CHECK(translator.accessProfile().count(key.context, key.sourceText, key.comment) == expectedCount(3, 2));
+    return true;
+}
@@ -0,0 +1,81 @@
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+
+#include "qm_test.h"
+
+QM_TEST(pseudo_translations)
+{
+    QmTranslatorX translator;
+    QmPseudoLocaleX pseudo;
+    pseudo.expansion = 50;
+    translator.setPseudoLocale(&pseudo);
+
+    // Placeholders stay, the letters get accented, the numerus messages get the form
+    const std::string t = translator.do_translate8("Context", "Load %1 of <b>%n</b>");
+    QM_CHECK(t.size() > 2 && t.front() == '[' && t.back() == ']');
+    QM_CHECK(t.find("%1") != std::string::npos);
+    QM_CHECK(t.find("<b>%n</b>") != std::string::npos);
+    QM_CHECK(t.find("Load") == std::string::npos);
+    QM_CHECK(translator.do_translate8("Context", "Files", nullptr, 1).find("{0}]") != std::string::npos);
+    QM_CHECK(translator.do_translate8("Context", "Files", nullptr, 5).find("{1}]") != std::string::npos);
+
+    // New settings replace the cached translations
+    pseudo.brackets = false;
+    translator.setPseudoLocale(&pseudo);
+    const std::string unbracketed = translator.do_translate8("Context", "Load %1 of <b>%n</b>");
+    QM_CHECK(unbracketed == t.substr(1, t.size() - 2));
+
+    // The numerus rules of the loaded catalog choose the forms
+    QmWriterX writer;
+    addTestMessages(writer, 100);
+    std::vector<uint8_t> data;
+    QM_CHECK(compileCatalog(writer, data));
+    QM_CHECK(translator.loadData(data.data(), data.size()));
+    QM_CHECK(translator.do_translate8("Context", "Files", nullptr, 5).find("{2}") != std::string::npos);
+
+    translator.setPseudoLocale(nullptr);
+    QM_CHECK(translator.do_translate8(testKey(1).context.c_str(), testKey(1).sourceText.c_str()) == testTranslation(1));
+    return true;
+}
+
+/*
+   The threads synthesize more translations than their caches keep, every
+   one is the same as synthesized by the main thread
+ */
+QM_TEST(pseudo_threads)
+{
+    const size_t count = 3000;
+    const unsigned threadsCount = 4;
+    QmTranslatorX translator;
+    QmPseudoLocaleX pseudo;
+    pseudo.surrogates = true;
+    translator.setPseudoLocale(&pseudo);
+
+    std::vector<std::u16string> expected;
+    for(size_t i = 0; i < count; ++i)
+        expected.push_back(translator.do_translate("Context", testKey(i).sourceText.c_str(), nullptr, int32_t(i % 3) - 1));
+
+    std::atomic<bool> ok(true);
+    std::vector<std::thread> threads;
+    for(unsigned t = 0; t < threadsCount; ++t)
+    {
+        threads.emplace_back([&translator, &expected, &ok, t, count]()
+        {
+            for(int round = 0; round < 3; ++round)
+            {
+                for(size_t i = t; i < count; i += t + 1)
+                {
+                    const std::string sourceText = testKey(i).sourceText;
+                    if(translator.do_translate("Context", sourceText.c_str(), nullptr, int32_t(i % 3) - 1) != expected[i])
+                        ok = false;
+                }
+            }
+        });
+    }
+    for(std::thread &t : threads)
+        t.join();
+    QM_CHECK(ok);
+    return true;
+}
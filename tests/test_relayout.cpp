@@ -0,0 +1,101 @@
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+
+#include "qm_test.h"
+
+/*
+   Contexts of the records in the order of the offsets
+ */
+static std::vector<std::string> contextsByOffset(QmTranslatorX &translator)
+{
+    std::map<uint32_t, std::string> byOffset;
+    for(const QmMessageViewX &m : translator.messages())
+        byOffset[m.offset] = m.context.toString();
+
+    std::vector<std::string> contexts;
+    for(const std::pair<const uint32_t, std::string> &r : byOffset)
+        contexts.push_back(r.second);
+    return contexts;
+}
+
+/*
+   The hashes table, the perfect hash and the unpacked messages of every
+   kind of the catalog point to the moved records after the relayout
+ */
+QM_TEST(relayout_offsets)
+{
+    const size_t count = 5000;
+    for(int variant = 0; variant < 5; ++variant)
+    {
+        QmWriterX writer;
+        writer.options().perfectHash = variant == 1;
+        writer.options().stripKeys = variant >= 2;
+        writer.options().packMessages = variant >= 3;
+        writer.options().order = variant == 4 ? QmWriterX::OrderByKey : QmWriterX::OrderByHash;
+        addTestMessages(writer, count);
+        std::vector<uint8_t> data;
+        QM_CHECK(compileCatalog(writer, data));
+
+        QmTranslatorX translator;
+        QM_CHECK(translator.loadData(data.data(), data.size()));
+        const size_t messagesCount = translator.messagesCount();
+        QM_CHECK(translator.relayout());
+        QM_CHECK(!translator.isPacked());
+        QM_CHECK(translator.messagesCount() == messagesCount);
+        QM_CHECK(checkTestMessages(translator, count));
+
+        // The records having the context are grouped by it
+        if(!writer.options().stripKeys)
+        {
+            std::set<std::string> seen;
+            std::string previous;
+            for(const std::string &context : contextsByOffset(translator))
+            {
+                if(context != previous)
+                    QM_CHECK(seen.insert(context).second);
+                previous = context;
+            }
+            QM_CHECK(seen.size() == (count + 99) / 100);
+        }
+    }
+    return true;
+}
+
+/*
+   The contexts and the messages looked up more often go first
+ */
+QM_TEST(relayout_profile)
+{
+    const size_t count = 5000;
+    QmWriterX writer;
+    addTestMessages(writer, count);
+    std::vector<uint8_t> data;
+    QM_CHECK(compileCatalog(writer, data));
+
+    QmAccessProfileX profile;
+    const TestKey hot = testKey(3055), warm = testKey(3001), other = testKey(1234);
+    profile.add(hot.context, hot.sourceText, hot.comment, 100);
+    profile.add(warm.context, warm.sourceText, warm.comment, 10);
+    profile.add(other.context, other.sourceText, other.comment, 5);
+
+    QmTranslatorX translator;
+    QM_CHECK(translator.loadData(data.data(), data.size()));
+    QM_CHECK(translator.relayout(&profile));
+    QM_CHECK(checkTestMessages(translator, count));
+
+    std::map<uint32_t, std::string> sourceByOffset;
+    for(const QmMessageViewX &m : translator.messages())
+        sourceByOffset[m.offset] = m.sourceText.toString();
+    std::map<uint32_t, std::string>::const_iterator it = sourceByOffset.begin();
+    QM_CHECK(it->first == 0);
+    QM_CHECK((it++)->second == hot.sourceText);
+    QM_CHECK(it->second == warm.sourceText);
+
+    const std::vector<std::string> contexts = contextsByOffset(translator);
+    QM_CHECK(contexts[0] == hot.context);
+    QM_CHECK(contexts[99] == hot.context);
+    QM_CHECK(contexts[100] == other.context);
+    return true;
+}
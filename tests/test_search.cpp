@@ -0,0 +1,135 @@
+#include <string>
+#include <vector>
+#include <set>
+
+#include "QTranslatorX/qm_search.h"
+#include "qm_test.h"
+
+static bool compileSearchCatalog(std::vector<uint8_t> &data, size_t count, bool extraMessages)
+{
+    QmWriterX writer;
+    addTestMessages(writer, count);
+    if(extraMessages)
+    {
+        const char16_t *translations[] = {u"ŸES, ПРИВЕТ", u"Straße ΩMEGA"};
+        for(size_t i = 0; i < 2; ++i)
+        {
+            QmMessageX m;
+            m.context = "Search";
+            m.sourceText = "Extra " + std::to_string(i);
+            m.translations.push_back(translations[i]);
+            writer.addMessage(m);
+        }
+    }
+    QM_CHECK(compileCatalog(writer, data));
+    return true;
+}
+
+/*
+   Messages of the hits, checked against every translation of the catalog
+ */
+static bool checkHits(const QmSearchIndexX &index, const QmTranslatorX &translator, const std::string &text)
+{
+    const std::string query = QmSearchIndexX::normalize(text);
+    std::set<uint32_t> expected;
+    for(uint32_t i = 0; i < translator.messagesCount(); ++i)
+    {
+        QmMessageViewX m = translator.message(i);
+        for(uint32_t form = 0; form < m.translationsCount; ++form)
+        {
+            QmStringViewX data = m.translationData(form);
+            if(QmSearchIndexX::normalize(reinterpret_cast<const uint8_t *>(data.data), data.size).find(query) != std::string::npos)
+                expected.insert(i);
+        }
+    }
+
+    std::set<uint32_t> found;
+    for(const QmSearchIndexX::Hit &hit : index.search(translator, text))
+        QM_CHECK(found.insert(hit.message).second);
+    QM_CHECK(found == expected);
+    return true;
+}
+
+QM_TEST(search_hits)
+{
+    const size_t count = 5000;
+    std::vector<uint8_t> data;
+    QM_CHECK(compileSearchCatalog(data, count, true));
+    QmTranslatorX translator;
+    QM_CHECK(translator.loadData(data.data(), data.size()));
+
+    for(unsigned threadsCount = 1; threadsCount <= 4; threadsCount += 3)
+    {
+        QmSearchIndexX index;
+        QM_CHECK(index.build(translator, threadsCount));
+        QM_CHECK(checkHits(index, translator, "TRANSLATION 123"));
+        QM_CHECK(checkHits(index, translator, "form 2"));
+        QM_CHECK(checkHits(index, translator, "on 4"));
+        QM_CHECK(checkHits(index, translator, "absent text"));
+
+        // "Translation 1234 form ..." and "Translation 1234" are found once each
+        std::vector<QmSearchIndexX::Hit> hits = index.search(translator, "translation 1234");
+        QM_CHECK(hits.size() == 1);
+        QM_CHECK(hits[0].sourceText.toString() == testKey(1234).sourceText);
+        QM_CHECK(index.search(translator, "Translation", 10).size() == 10);
+    }
+    return true;
+}
+
+QM_TEST(search_case_folding)
+{
+    QM_CHECK(QmSearchIndexX::normalize("\xC5\xB8") == "\xC3\xBF");
+    QM_CHECK(QmSearchIndexX::normalize("\xD0\x9F\xD0\x81\xCE\xA9") == "\xD0\xBF\xD1\x91\xCF\x89");
+
+    std::vector<uint8_t> data;
+    QM_CHECK(compileSearchCatalog(data, 100, true));
+    QmTranslatorX translator;
+    QM_CHECK(translator.loadData(data.data(), data.size()));
+    QmSearchIndexX index;
+    QM_CHECK(index.build(translator));
+
+    const char *queries[] = {"\xC3\xBF" "es", "\xC5\xB8" "ES", "\xD0\xBF\xD1\x80\xD0\xB8\xD0\xB2\xD0\xB5\xD1\x82",
+                             "stra\xC3\x9F" "e", "\xCF\x89mega"};
+    for(const char *query : queries)
+    {
+        std::vector<QmSearchIndexX::Hit> hits = index.search(translator, query);
+        QM_CHECK(hits.size() == 1);
+        QM_CHECK(hits[0].context.toString() == "Search");
+    }
+    return true;
+}
+
+/*
+   The index answers for the catalog it was built for, the same catalog loaded
+   again is recognized by the signature, another one of the same size is not
+ */
+QM_TEST(search_signature)
+{
+    const size_t count = 3000;
+    std::vector<uint8_t> data, other;
+    QM_CHECK(compileSearchCatalog(data, count, true));
+    QmWriterX writer;
+    addTestMessages(writer, count + 2);
+    QM_CHECK(compileCatalog(writer, other));
+
+    QmTranslatorX translator;
+    QM_CHECK(translator.loadData(data.data(), data.size()));
+    QmSearchIndexX index;
+    QM_CHECK(index.build(translator));
+    QM_CHECK(index.saveFile("search.index"));
+    const size_t hitsCount = index.search(translator, "translation 12").size();
+    QM_CHECK(hitsCount > 0);
+
+    QmTranslatorX otherTranslator;
+    QM_CHECK(otherTranslator.loadData(other.data(), other.size()));
+    QM_CHECK(otherTranslator.messagesCount() == translator.messagesCount());
+    QM_CHECK(index.search(otherTranslator, "translation 12").empty());
+    QM_CHECK(!QmSearchIndexX().loadFile("search.index", otherTranslator));
+
+    QM_CHECK(translator.loadData(data.data(), data.size()));
+    QM_CHECK(index.search(translator, "translation 12").size() == hitsCount);
+    QmSearchIndexX loaded;
+    QM_CHECK(loaded.loadFile("search.index", translator));
+    QM_CHECK(checkHits(loaded, translator, "translation 12"));
+    return true;
+}
@@ -0,0 +1,90 @@
+#include <string>
+#include <vector>
+#include <type_traits>
+
+#include "qm_test.h"
+
+static_assert(!std::is_copy_constructible<QmSmallString8X>::value, "QmSmallStringX must be move-only");
+
+//Message of the "Small" context translated with the text
+static void addSmallMessage(QmWriterX &writer, const char *sourceText, const std::u16string &translation)
+{
+    QmMessageX m;
+    m.context = "Small";
+    m.sourceText = sourceText;
+    m.translations.push_back(translation);
+    writer.addMessage(m);
+}
+
+/*
+   The strings up to 24 characters of the encoding are kept inline, the
+   longer ones get the heap buffer of the exact size
+ */
+QM_TEST(small_inline_boundary)
+{
+    QmWriterX writer;
+    addSmallMessage(writer, "Latin 24", std::u16string(24, u'x'));
+    addSmallMessage(writer, "Latin 25", std::u16string(25, u'x'));
+    // 24 and 26 bytes of UTF-8, 12 and 13 characters of UTF-16
+    addSmallMessage(writer, "Cyrillic 12", std::u16string(12, u'\x416'));
+    addSmallMessage(writer, "Cyrillic 13", std::u16string(13, u'\x416'));
+    std::u16string emoji;
+    for(int i = 0; i < 13; ++i)
+        emoji += u"\U0001F600";
+    addSmallMessage(writer, "Emoji 13", emoji);
+    std::vector<uint8_t> data;
+    QM_CHECK(compileCatalog(writer, data));
+    QmTranslatorX translator;
+    QM_CHECK(translator.loadData(data.data(), data.size()));
+
+    QmSmallString8X latin = translator.translateSmall8("Small", "Latin 24");
+    QM_CHECK(latin.isInline() && latin.str() == std::string(24, 'x') && latin.c_str()[24] == 0);
+    latin = translator.translateSmall8("Small", "Latin 25");
+    QM_CHECK(!latin.isInline() && latin.size() == 25 && latin.c_str()[25] == 0);
+    QM_CHECK(translator.translateSmall("Small", "Latin 25").size() == 25);
+
+    QmSmallString8X cyrillic = translator.translateSmall8("Small", "Cyrillic 12");
+    QM_CHECK(cyrillic.isInline() && cyrillic.size() == 24);
+    QM_CHECK(cyrillic.str() == translator.do_translate8("Small", "Cyrillic 12"));
+    cyrillic = translator.translateSmall8("Small", "Cyrillic 13");
+    QM_CHECK(!cyrillic.isInline() && cyrillic.size() == 26);
+    QM_CHECK(translator.translateSmall("Small", "Cyrillic 13").isInline());
+
+    QmSmallString16X utf16 = translator.translateSmall("Small", "Emoji 13");
+    QM_CHECK(!utf16.isInline() && utf16.str() == emoji);
+    QmSmallString32X utf32 = translator.translateSmall32("Small", "Emoji 13");
+    QM_CHECK(utf32.isInline() && utf32.str() == std::u32string(13, U'\U0001F600'));
+
+    QmSmallString8X absent = translator.translateSmall8("Small", "Absent");
+    QM_CHECK(absent.empty() && absent.isInline() && absent.c_str()[0] == 0);
+    return true;
+}
+
+/*
+   The moved inline string is copied, the heap one hands its buffer over, the
+   moved-from strings are empty
+ */
+QM_TEST(small_move)
+{
+    QmWriterX writer;
+    addSmallMessage(writer, "Short", u"Short");
+    addSmallMessage(writer, "Long", std::u16string(40, u'y'));
+    std::vector<uint8_t> data;
+    QM_CHECK(compileCatalog(writer, data));
+    QmTranslatorX translator;
+    QM_CHECK(translator.loadData(data.data(), data.size()));
+
+    QmSmallString8X shortString = translator.translateSmall8("Small", "Short");
+    QmSmallString8X moved(std::move(shortString));
+    QM_CHECK(moved.isInline() && moved.str() == "Short");
+    QM_CHECK(shortString.empty() && shortString.isInline() && shortString.c_str()[0] == 0);
+
+    QmSmallString8X longString = translator.translateSmall8("Small", "Long");
+    const char *buffer = longString.data();
+    moved = std::move(longString);
+    QM_CHECK(moved.data() == buffer && moved.str() == std::string(40, 'y'));
+    QM_CHECK(longString.empty() && longString.isInline());
+    const std::string converted = moved;
+    QM_CHECK(converted == std::string(40, 'y'));
+    return true;
+}
@@ -0,0 +1,104 @@
+#include <string>
+#include <vector>
+#include <iterator>
+
+#include "qm_test.h"
+
+static const char16_t g_mixed[] = u"A\x416\x3000\U0001F600z";
+static const char     g_mixed8[] = "A\xD0\x96\xE3\x80\x80\xF0\x9F\x98\x80z";
+
+static bool loadMixedCatalog(QmTranslatorX &translator)
+{
+    QmWriterX writer;
+    QmMessageX m;
+    m.context = "Transcode";
+    m.sourceText = "Mixed";
+    m.translations.push_back(g_mixed);
+    writer.addMessage(m);
+    std::vector<uint8_t> data;
+    QM_CHECK(compileCatalog(writer, data));
+    QM_CHECK(translator.loadData(data.data(), data.size()));
+    return true;
+}
+
+/*
+   The characters of one, two, three and four bytes of UTF-8 come out in
+   every encoding, the wchar_t one is chosen by its size
+ */
+QM_TEST(transcode_encodings)
+{
+    QmTranslatorX translator;
+    QM_CHECK(loadMixedCatalog(translator));
+
+    std::string utf8;
+    QM_CHECK(translator.translate<char>(qmAppendSinkX(utf8), "Transcode", "Mixed"));
+    QM_CHECK(utf8 == g_mixed8);
+    QM_CHECK(translator.do_translate8("Transcode", "Mixed") == utf8);
+    std::u16string utf16;
+    QM_CHECK(translator.translate<char16_t>(qmAppendSinkX(utf16), "Transcode", "Mixed"));
+    QM_CHECK(utf16 == g_mixed);
+    const std::u32string utf32 = translator.translateAs<std::u32string>("Transcode", "Mixed");
+    QM_CHECK(utf32 == U"A\x416\x3000\U0001F600z");
+
+    const std::wstring wide = translator.translateAs<std::wstring>("Transcode", "Mixed");
+    if(sizeof(wchar_t) == 2)
+        QM_CHECK(wide.size() == 6 && std::u16string(wide.begin(), wide.end()) == g_mixed);
+    else
+        QM_CHECK(wide.size() == 5 && std::u32string(wide.begin(), wide.end()) == utf32);
+
+    const std::vector<char> bytes = translator.translateAs<std::vector<char> >("Transcode", "Mixed");
+    QM_CHECK(std::string(bytes.begin(), bytes.end()) == g_mixed8);
+
+    // The absent translation leaves the sink untouched
+    QM_CHECK(!translator.translate<char>(qmAppendSinkX(utf8), "Transcode", "Absent"));
+    QM_CHECK(utf8 == g_mixed8);
+    QM_CHECK(translator.translateAs<std::u32string>("Transcode", "Absent").empty());
+    return true;
+}
+
+/*
+   The fixed buffer keeps the whole characters which fit and stays
+   null-terminated, the output iterator gets every unit
+ */
+QM_TEST(transcode_sinks)
+{
+    QmTranslatorX translator;
+    QM_CHECK(loadMixedCatalog(translator));
+
+    char buffer[8];
+    QmSpanSinkX<char> span = qmSpanSinkX(buffer);
+    QM_CHECK(translator.translate<char>(span, "Transcode", "Mixed"));
+    QM_CHECK(span.truncated() && span.size() == 6);
+    QM_CHECK(std::string(buffer) == std::string(g_mixed8, 6));
+
+    char16_t buffer16[16];
+    QmSpanSinkX<char16_t> span16 = qmSpanSinkX(buffer16);
+    QM_CHECK(translator.translate<char16_t>(span16, "Transcode", "Mixed"));
+    QM_CHECK(!span16.truncated() && std::u16string(buffer16) == g_mixed);
+
+    std::vector<char32_t> units;
+    QM_CHECK(translator.translate<char32_t>(qmIteratorSinkX(std::back_inserter(units)), "Transcode", "Mixed"));
+    QM_CHECK(std::u32string(units.begin(), units.end()) == U"A\x416\x3000\U0001F600z");
+
+    QmCountSinkX count;
+    QM_CHECK(translator.translate<char>(count, "Transcode", "Mixed"));
+    QM_CHECK(count.size() == sizeof(g_mixed8) - 1);
+    return true;
+}
+
+/*
+   The high surrogate at the end of the data is dropped
+ */
+QM_TEST(transcode_surrogates)
+{
+    const uint8_t data[] = {0x00, 0x41, 0xD8, 0x3D, 0xDE, 0x00, 0xD8, 0x3D};
+    std::u32string utf32;
+    QmAppendSinkX<std::u32string> sink(utf32);
+    qmTranscodeX<char32_t>(data, sizeof(data), sink);
+    QM_CHECK(utf32 == U"A\U0001F600");
+    std::string utf8;
+    QmAppendSinkX<std::string> sink8(utf8);
+    qmTranscodeX<char>(data, sizeof(data) - 1, sink8);
+    QM_CHECK(utf8 == "A\xF0\x9F\x98\x80");
+    return true;
+}